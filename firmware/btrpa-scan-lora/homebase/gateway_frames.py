@@ -0,0 +1,345 @@
+#!/usr/bin/env python3
+"""
+btrpa-scan-lora Gateway Frame Decoder
+Reference decoder for the homebase node's binary serial output
+(GATEWAY_SERIAL_FRAMES, include/serial_frame.h): splits the port's byte
+stream into framed LoRa frames and human log text, and decodes each frame
+(include/wire_format.h) into a dict
+"""
+
+import math
+import re
+import struct
+import sys
+from pathlib import Path
+
+from target_filter import crc16
+
+SERIAL_FRAME_VERSION = 1
+SERIAL_SOURCES = {0: 'mesh', 1: 'local', 2: 'fusion'}
+SERIAL_HEADER = struct.Struct('<BBIhbBBB')   # version .. LoRa frame length
+SERIAL_FRAME_MAX_BYTES = 256
+
+WIRE_VERSION = 2
+WIRE_HEADER_BYTES = 8
+WIRE_RECORD_BYTES = 11
+WIRE_NO_DEVICE = 0xFF
+WIRE_DEVICE_REGISTRY = 0xFE
+WIRE_AGE_UNKNOWN = 0xFFFFFF
+WIRE_VELOCITY_UNIT_CMS = 20
+WIRE_POWER_STEP_DB = 2
+
+MESSAGE_TYPES = {1: 'TRUE_HIT', 2: 'POSSIBLE_HIT', 3: 'POSITION', 4: 'STATUS',
+                 5: 'COMMAND', 6: 'ACK', 7: 'TARGETS', 8: 'FUSED'}
+BODY_BYTES = {4: 10, 5: 6, 6: 4, 7: 6, 8: 10}
+SCAN_PROFILES = ['active', 'conservation', 'burst', 'auto']
+SCAN_REASONS = ['default', 'recent hit', 'battery low', 'no hits', 'command']
+RANGE_TRENDS = ['trend unknown', 'steady', 'approaching', 'receding']
+
+DEFAULT_CONFIG = Path(__file__).resolve().parent.parent / 'include' / 'config.h'
+
+
+def cobs_decode(data):
+    """Bytes between two zero delimiters -> payload, or None if malformed"""
+    out = bytearray()
+    i = 0
+    while i < len(data):
+        code = data[i]
+        if code == 0 or i + code > len(data):
+            return None
+        out += data[i + 1:i + code]
+        i += code
+        if code != 0xFF and i < len(data):
+            out.append(0)
+    return bytes(out)
+
+
+def cobs_encode(data):
+    """Payload -> bytes without zeros, as cobsEncode()"""
+    out = bytearray([0])
+    code = 0
+    for byte in data:
+        if byte != 0:
+            out.append(byte)
+        if byte == 0 or len(out) - code == 0xFF:
+            out[code] = len(out) - code
+            code = len(out)
+            out.append(0)
+    out[code] = len(out) - code
+    return bytes(out)
+
+
+def range_meters(code):
+    """A record's range byte -> (metres or None, trend), as rssi_tracker.h"""
+    distance = code & 0x3F
+    meters = 10 ** ((distance - 1) / 16) / 10 if distance else None
+    return meters, RANGE_TRENDS[code >> 6]
+
+
+def load_device_types(path=DEFAULT_CONFIG):
+    """Device type names by wire device index: MEDICAL_DEVICE_PREFIXES
+    then ADVERTISEMENT_RULES, as the nodes number them (config.h)"""
+    try:
+        text = Path(path).read_text()
+    except OSError:
+        return {}
+    text = re.sub(r'//[^\n]*', '', text)
+    entry = re.compile(r'\{\s*"([^"]*)"\s*,\s*"([^"]*)"\s*,\s*"([^"]*)"\s*\}')
+    types = []
+    prefixes = re.search(r'MEDICAL_DEVICE_PREFIXES\[\]\s*=\s*\{(.*?)\};', text, re.S)
+    if prefixes:
+        types += [(m.group(2), m.group(3)) for m in entry.finditer(prefixes.group(1))]
+    rules = re.search(r'#define ADVERTISEMENT_RULES((?:[^\n]*\\\n)*[^\n]*)', text)
+    if rules:
+        types += [(m.group(2), m.group(3)) for m in entry.finditer(rules.group(1))]
+    return dict(enumerate(types))
+
+
+def decode_wire_frame(data):
+    """A LoRa frame (wire_format.h) -> dict, or None if it does not decode"""
+    if len(data) < WIRE_HEADER_BYTES + 2 or crc16(data[:-2]) != struct.unpack_from('<H', data, len(data) - 2)[0]:
+        return None
+    if data[0] >> 4 != WIRE_VERSION:
+        return None
+    type_ = data[0] & 0x0F
+    flags = data[3]
+    header_time = data[4] | data[5] << 8 | data[6] << 16
+    count = data[7] & 0x0F
+    has_position = bool(flags & 0x01)
+    has_velocity = bool(data[7] & 0x10)
+    replayed = bool(data[7] & 0x80)
+    blocks = count if type_ == 7 else 0
+    records = 0 if type_ == 7 else count
+    body = BODY_BYTES.get(type_, 0) + 8 * blocks
+    expected = (WIRE_HEADER_BYTES + (8 if has_position else 0) + (2 if has_velocity else 0) +
+                WIRE_RECORD_BYTES * records + body + 2)
+    if len(data) != expected or (has_velocity and not has_position) or (records and type_ in BODY_BYTES):
+        return None
+    if type_ == 8 and not has_position:
+        return None
+
+    frame = {
+        'type': MESSAGE_TYPES.get(type_, type_),
+        'node': f"NODE-{data[1]:03d}",
+        'sequence': data[2],
+        'hops_left': (flags >> 1) & 0x07,
+        'power_backoff_db': (flags >> 4) * WIRE_POWER_STEP_DB,
+        'replayed': replayed,
+    }
+    if replayed:
+        frame['replay_age_s'] = None if header_time == WIRE_AGE_UNKNOWN else header_time
+    base_ms = 0 if replayed else header_time * 1000
+    frame['uptime_ms'] = base_ms
+
+    p = WIRE_HEADER_BYTES
+    if has_position:
+        lat, lon = struct.unpack_from('<ii', data, p)
+        frame['latitude'] = lat / 1e7
+        frame['longitude'] = lon / 1e7
+        p += 8
+    if has_velocity:
+        east, north = struct.unpack_from('<bb', data, p)
+        east *= WIRE_VELOCITY_UNIT_CMS / 100
+        north *= WIRE_VELOCITY_UNIT_CMS / 100
+        frame['speed'] = math.hypot(east, north)
+        frame['heading'] = math.degrees(math.atan2(east, north)) % 360
+        p += 2
+
+    frame['records'] = []
+    for _ in range(records):
+        delta, = struct.unpack_from('<H', data, p)
+        mac = ':'.join(f"{b:02x}" for b in data[p + 2:p + 8])
+        rssi, device, range_code = struct.unpack_from('<bBB', data, p + 8)
+        meters, trend = range_meters(range_code)
+        frame['records'].append({'uptime_ms': base_ms + delta, 'mac': mac, 'rssi': rssi,
+                                 'device_index': None if device == WIRE_NO_DEVICE else device,
+                                 'range_m': meters, 'trend': trend})
+        p += WIRE_RECORD_BYTES
+
+    if type_ == 4:
+        battery, profile, duty, *current = struct.unpack_from('<HBBHHH', data, p)
+        frame['status'] = {
+            'battery_v': battery / 1000,
+            'profile': SCAN_PROFILES[profile & 0x0F] if (profile & 0x0F) < len(SCAN_PROFILES) else '?',
+            'reason': SCAN_REASONS[profile >> 4] if (profile >> 4) < len(SCAN_REASONS) else '?',
+            'scan_percent': duty,
+            'est_ma': dict(zip(SCAN_PROFILES, (c / 10 for c in current))),
+        }
+    elif type_ == 5:
+        target, command, argument, _, minutes = struct.unpack_from('<BBBBH', data, p)
+        frame['command'] = {'target': target, 'command': command, 'argument': argument,
+                            'duration_min': minutes}
+    elif type_ == 6:
+        target, sequence, following = struct.unpack_from('<BBH', data, p)
+        frame['ack'] = {'target': target, 'sequence': sequence, 'following': following}
+    elif type_ == 7:
+        target, op, filter_crc, chunk = struct.unpack_from('<BBHH', data, p)
+        frame['targets'] = {'target': target, 'op': op, 'filter_crc': filter_crc, 'chunk': chunk,
+                            'data': bytes(data[p + 6:p + 6 + 8 * blocks])}
+    elif type_ == 8:
+        # The position above is the target's, fitted by the homebase
+        device, observers, radius = struct.unpack_from('<BBH', data, p + 6)
+        frame['fused'] = {'mac': ':'.join(f"{b:02x}" for b in data[p:p + 6]),
+                          'device_index': None if device == WIRE_NO_DEVICE else device,
+                          'observers': observers, 'radius_m': radius / 10}
+    return frame
+
+
+def decode_serial_frame(payload):
+    """A COBS-decoded serial frame -> dict with the receive metadata and the
+    LoRa frame, or None if its CRC, version or length is wrong"""
+    if len(payload) < SERIAL_HEADER.size + 2:
+        return None
+    if crc16(payload[:-2]) != struct.unpack_from('<H', payload, len(payload) - 2)[0]:
+        return None
+    version, source, uptime, rssi, snr_q2, sf, hops, length = SERIAL_HEADER.unpack_from(payload)
+    if version != SERIAL_FRAME_VERSION or SERIAL_HEADER.size + length + 2 != len(payload):
+        return None
+    frame = decode_wire_frame(payload[SERIAL_HEADER.size:SERIAL_HEADER.size + length])
+    if frame is None:
+        return None
+    frame['rx'] = {
+        'source': SERIAL_SOURCES.get(source, source),
+        'gateway_uptime_ms': uptime,
+        'rssi': rssi if source == 0 else None,
+        'snr': snr_q2 / 4 if source == 0 else None,
+        'sf': sf if source == 0 else None,
+        'hops': hops,
+    }
+    return frame
+
+
+class FrameStream:
+    """Splits the serial byte stream at zero bytes. Chunks that decode as
+    serial frames come out as ('frame', dict); everything else is the
+    human log and comes out line by line as ('text', str)."""
+
+    def __init__(self):
+        self.chunk = bytearray()
+        self.text = bytearray()
+        self.frames = 0
+        self.rejected = 0
+
+    def feed(self, data):
+        events = []
+        for byte in data:
+            if byte != 0:
+                self.chunk.append(byte)
+                continue
+            if self.chunk:
+                payload = cobs_decode(bytes(self.chunk))
+                frame = decode_serial_frame(payload) if payload is not None else None
+                if frame is not None:
+                    self.frames += 1
+                    events.append(('frame', frame))
+                elif len(self.chunk) >= 2 and self._frame_start(self.chunk):
+                    # Cut short by a reset, or corrupted
+                    self.rejected += 1
+                else:
+                    self.text += self.chunk
+                self.chunk.clear()
+        # Log text arrives between frames; pass on complete lines only
+        if b'\n' in self.chunk and (len(self.chunk) > SERIAL_FRAME_MAX_BYTES or
+                                     not self._frame_start(self.chunk)):
+            cut = self.chunk.rindex(b'\n') + 1
+            self.text += self.chunk[:cut]
+            del self.chunk[:cut]
+        while b'\n' in self.text:
+            line, _, rest = bytes(self.text).partition(b'\n')
+            self.text = bytearray(rest)
+            events.append(('text', line.decode('utf-8', errors='replace').rstrip('\r')))
+        return events
+
+    @staticmethod
+    def _frame_start(chunk):
+        """A frame's first COBS block carries the version byte, which log
+        text never contains; too short to tell counts as a frame"""
+        return len(chunk) < 2 or chunk[1] == SERIAL_FRAME_VERSION
+
+
+def describe(frame, device_types=None):
+    """One line per frame, for the console"""
+    device_types = device_types or {}
+    rx = frame['rx']
+    if rx['source'] == 'mesh':
+        link = f"RSSI {rx['rssi']} dBm, SNR {rx['snr']:.2f} dB, SF{rx['sf']}, {rx['hops']} hop(s)"
+    else:
+        link = rx['source']
+    line = f"{frame['node']} #{frame['sequence']} {frame['type']} ({link})"
+    if 'fused' in frame:
+        fused = frame['fused']
+        line += (f"\n  {fused['mac']} at {frame['latitude']:.6f}, {frame['longitude']:.6f} "
+                 f"±{fused['radius_m']:.1f} m from {fused['observers']} nodes")
+    elif 'latitude' in frame:
+        line += f" at {frame['latitude']:.6f}, {frame['longitude']:.6f}"
+    if 'speed' in frame:
+        line += f", moving {frame['speed']:.1f} m/s heading {frame['heading']:.0f}"
+    for record in frame['records']:
+        line += f"\n  {record['mac']} RSSI {record['rssi']} dBm"
+        index = record['device_index']
+        if index == WIRE_DEVICE_REGISTRY:
+            line += ", registry match"
+        elif index is not None:
+            line += f", {device_types.get(index, (f'device #{index}',))[0]}"
+        if record['range_m'] is not None:
+            line += f", ~{record['range_m']:.1f} m, {record['trend']}"
+    if 'status' in frame:
+        status = frame['status']
+        line += (f": battery {status['battery_v']:.2f} V, {status['profile']} ({status['reason']}), "
+                 f"scan {status['scan_percent']}%")
+    return line
+
+
+def main():
+    import argparse
+    import json
+
+    parser = argparse.ArgumentParser(
+        description='Decode the homebase node\'s framed serial output (GATEWAY_SERIAL_FRAMES)',
+        formatter_class=argparse.RawDescriptionHelpFormatter,
+        epilog="""
+Examples:
+  python3 gateway_frames.py -p /dev/ttyUSB0 -b 921600     # live
+  python3 gateway_frames.py capture.bin --json           # a saved capture
+  program --serial ... | python3 gateway_frames.py -     # the host simulation
+        """
+    )
+    parser.add_argument('capture', nargs='?', help="Captured serial bytes ('-' for stdin)")
+    parser.add_argument('-p', '--port', help='Serial port of the homebase node')
+    parser.add_argument('-b', '--baudrate', type=int, default=921600,
+                        help='Baudrate (default: 921600, GATEWAY_SERIAL_BAUD)')
+    parser.add_argument('--json', action='store_true', help='One JSON object per frame')
+    parser.add_argument('--log', action='store_true', help='Also print the human log lines')
+    parser.add_argument('--config', default=DEFAULT_CONFIG, help='config.h for device type names')
+    args = parser.parse_args()
+
+    if args.port:
+        import serial
+        source = serial.Serial(args.port, args.baudrate, timeout=0.1)
+        read = lambda: source.read(4096)
+    elif args.capture:
+        source = sys.stdin.buffer if args.capture == '-' else open(args.capture, 'rb')
+        read = lambda: source.read1(4096) if hasattr(source, 'read1') else source.read(4096)
+    else:
+        parser.error('give a capture file or --port')
+
+    device_types = load_device_types(args.config)
+    stream = FrameStream()
+    try:
+        while True:
+            data = read()
+            if not data and not args.port:
+                break
+            for kind, value in stream.feed(data):
+                if kind == 'frame':
+                    print(json.dumps(value, default=lambda b: b.hex()) if args.json
+                          else describe(value, device_types))
+                elif args.log:
+                    print(f"| {value}")
+    except KeyboardInterrupt:
+        pass
+    print(f"{stream.frames} frames, {stream.rejected} rejected", file=sys.stderr)
+
+
+if __name__ == '__main__':
+    main()
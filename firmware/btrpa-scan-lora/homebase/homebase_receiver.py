@@ -11,15 +11,40 @@ import time
 import csv
 from datetime import datetime
 from pathlib import Path
+import math
 import re
 
+from gateway_frames import FrameStream, WIRE_DEVICE_REGISTRY, load_device_types
+from target_filter import load_registry, parse_mac
+
+# The nodes' GPS_BEACON_MAX_INTERVAL_MS: a node that has not reported for
+# longer has lost its fix or the mesh, so its track is not extrapolated further
+BEACON_MAX_INTERVAL_S = 300
+METERS_PER_DEGREE = 111319.5
+
+
+def predict_position(position, now):
+    """Where a node reporting position (lat, lon, speed m/s, heading
+    degrees, time heard) should be by now, as the nodes predict it
+    (include/position_beacon.h)"""
+    elapsed = min((now - position['at']).total_seconds(), BEACON_MAX_INTERVAL_S)
+    meters = position['speed'] * elapsed
+    heading = math.radians(position['heading'])
+    lat = position['latitude'] + meters * math.cos(heading) / METERS_PER_DEGREE
+    lon = position['longitude'] + meters * math.sin(heading) / (
+        METERS_PER_DEGREE * math.cos(math.radians(position['latitude'])))
+    return lat, lon
+
 class HomebaseReceiver:
-    def __init__(self, port=None, baudrate=115200):
+    def __init__(self, port=None, baudrate=115200, registry=None):
         self.port = port
         self.baudrate = baudrate
+        self.registry = load_registry(registry) if registry else {}
         self.serial_conn = None
         self.detections_log = []
         self.node_status = {}
+        self.device_types = load_device_types()
+        self.framed = False     # the node sends binary frames (GATEWAY_SERIAL_FRAMES)
 
         # Create logs directory
         self.log_dir = Path("logs")
@@ -36,7 +61,8 @@ class HomebaseReceiver:
             writer = csv.writer(f)
             writer.writerow([
                 'Timestamp', 'Type', 'Source Node', 'Target MAC',
-                'RSSI', 'Latitude', 'Longitude', 'Device Type', 'Notes'
+                'RSSI', 'Latitude', 'Longitude', 'Device Type', 'Notes',
+                'Range (m)', 'Trend'
             ])
 
     def find_heltec_port(self):
@@ -104,7 +130,14 @@ class HomebaseReceiver:
             'mac': r'MAC:\s*([0-9a-f:]+)',
             'rssi': r'RSSI:\s*(-?\d+)',
             'gps': r'GPS:\s*(-?\d+\.\d+),\s*(-?\d+\.\d+)',
+            'beacon': r'Position beacon:\s*(-?\d+\.\d+),\s*(-?\d+\.\d+)'
+                      r'(?:, moving ([\d.]+) m/s heading (\d+))?',
+            'predicted': r'\(predicted, last position (\d+) s ago\)',
             'device': r'Device:\s*(.+)',
+            'range': r'Range:\s*~([\d.]+) m, (.+)',
+            'replayed': r'Replayed from journal, (recorded (\d+) s ago|age unknown)',
+            'power': r'Status: battery ([\d.]+) V, profile (\w+) \(([^)]*)\), scan (\d+)%, '
+                     r'est\. active ([\d.]+) mA, conservation ([\d.]+) mA, burst ([\d.]+) mA',
         }
 
         data = {}
@@ -118,20 +151,69 @@ class HomebaseReceiver:
                     data[key] = int(match.group(1))
                 elif key == 'from':
                     data['node'] = match.group(1)
+                elif key == 'beacon':
+                    data['position'] = {
+                        'latitude': float(match.group(1)),
+                        'longitude': float(match.group(2)),
+                        'speed': float(match.group(3) or 0),
+                        'heading': float(match.group(4) or 0),
+                        'at': datetime.now(),
+                    }
+                elif key == 'range':
+                    data['range_m'] = float(match.group(1))
+                    data['trend'] = match.group(2).strip()
+                elif key == 'predicted':
+                    data['notes'] = f"position predicted from {match.group(1)} s ago"
+                elif key == 'replayed':
+                    data['notes'] = f"replayed from journal, {match.group(1)}"
+                elif key == 'power':
+                    data['power'] = {
+                        'battery_v': float(match.group(1)),
+                        'profile': match.group(2),
+                        'reason': match.group(3),
+                        'scan_percent': int(match.group(4)),
+                        'est_ma': {
+                            'active': float(match.group(5)),
+                            'conservation': float(match.group(6)),
+                            'burst': float(match.group(7)),
+                        },
+                    }
                 else:
                     data[key] = match.group(1).strip()
 
         return data if data else None
 
+    def check_registry(self, detection):
+        """Confirm registry filter matches against the registry itself: the
+        filter lets about 1 in 256 other addresses through"""
+        if not self.registry or not detection.get('mac'):
+            return
+        key = parse_mac(detection['mac'])
+        if detection.get('device', '').startswith('Registry match'):
+            if key in self.registry:
+                note = f"registry CONFIRMED: {self.registry[key] or detection['mac']}"
+            else:
+                note = "not in registry: filter false match"
+        elif key in self.registry:
+            note = f"registered: {self.registry[key] or detection['mac']}"
+        else:
+            return
+        detection['notes'] = f"{detection['notes']}; {note}" if detection.get('notes') else note
+
     def log_detection(self, detection):
         """Log detection to CSV file and console"""
         timestamp = datetime.now().strftime("%Y-%m-%d %H:%M:%S")
+        self.check_registry(detection)
 
         # Console output with color and formatting
         if detection.get('type') in ['TRUE_HIT', 1]:
             print("\n" + "="*70)
             print("🚨 TRUE HIT DETECTED! 🚨")
             print("="*70)
+        elif detection.get('type') == 'FUSED':
+            print("\n" + "-"*70)
+            print("🎯 TARGET LOCATED")
+            print("-"*70)
         else:
             print("\n" + "-"*70)
             print("⚠️  POSSIBLE HIT")
@@ -143,6 +225,10 @@ class HomebaseReceiver:
             print(f"📱 MAC: {detection['mac']}")
         if detection.get('rssi'):
             print(f"📡 RSSI: {detection['rssi']} dBm")
+        if detection.get('type') == 'FUSED':
+            print(f"📏 Within {detection['range_m']:.1f} m (95%)")
+        elif detection.get('range_m') is not None:
+            print(f"📏 Range: ~{detection['range_m']:.1f} m, {detection['trend']}")
         if detection.get('latitude') and detection.get('longitude'):
             lat, lon = detection['latitude'], detection['longitude']
             print(f"🗺️  GPS: {lat:.6f}, {lon:.6f}")
@@ -150,6 +236,8 @@ class HomebaseReceiver:
             print(f"   https://maps.google.com/?q={lat},{lon}")
         if detection.get('device'):
             print(f"🏥 Device: {detection['device']}")
+        if detection.get('notes'):
+            print(f"📝 {detection['notes']}")
         print("-"*70 + "\n")
 
         # Write to CSV
@@ -164,18 +252,24 @@ class HomebaseReceiver:
                 detection.get('latitude', ''),
                 detection.get('longitude', ''),
                 detection.get('device', ''),
-                detection.get('notes', '')
+                detection.get('notes', ''),
+                detection.get('range_m', ''),
+                detection.get('trend', '')
             ])
 
         # Store in memory
         detection['timestamp'] = timestamp
         self.detections_log.append(detection)
 
-    def update_node_status(self, node_id):
-        """Update last seen timestamp for a node"""
+    def update_node_status(self, node_id, power=None, position=None):
+        """Update last seen timestamp (and latest power report and position
+        beacon) for a node"""
+        previous = self.node_status.get(node_id, {})
         self.node_status[node_id] = {
             'last_seen': datetime.now(),
-            'status': 'online'
+            'status': 'online',
+            'power': power or previous.get('power'),
+            'position': position or previous.get('position')
         }
 
     def print_status(self):
@@ -190,10 +284,125 @@ class HomebaseReceiver:
             print("\nNode List:")
             for node_id, status in self.node_status.items():
                 last_seen = status['last_seen'].strftime("%H:%M:%S")
-                print(f"  • {node_id}: {status['status']} (last seen {last_seen})")
+                line = f"  • {node_id}: {status['status']} (last seen {last_seen})"
+                power = status.get('power')
+                if power:
+                    battery = f"{power['battery_v']:.2f} V" if power['battery_v'] > 0 else "no battery"
+                    line += (f", {battery}, {power['profile']} ({power['reason']}), "
+                             f"~{power['est_ma'][power['profile']]:.0f} mA")
+                position = status.get('position')
+                if position:
+                    lat, lon = predict_position(position, datetime.now())
+                    line += f", at {lat:.6f}, {lon:.6f}"
+                    if position['speed'] > 0:
+                        line += f" (predicted, {position['speed']:.1f} m/s heading {position['heading']:.0f}°)"
+                print(line)
 
         print("="*70 + "\n")
 
+    def handle_line(self, line, current_detection):
+        """One line of the node's human log; returns the detection still
+        being assembled. Ignored for detections once the node sends frames."""
+        if not line or self.framed:
+            return current_detection
+
+        # Check for TRUE HIT (direct or via LoRa)
+        if '🚨' in line or 'TRUE HIT' in line:
+            current_detection = self.parse_true_hit(line) or {}
+            if current_detection and current_detection.get('node'):
+                self.update_node_status(current_detection['node'])
+
+        # Check for LoRa message
+        elif '📩 LoRa message received:' in line:
+            current_detection = {'is_lora_message': True}
+
+        # Parse LoRa message details
+        elif current_detection.get('is_lora_message'):
+            parsed = self.parse_lora_message(line)
+            if parsed:
+                power = parsed.pop('power', None)
+                position = parsed.pop('position', None)
+                current_detection.update(parsed)
+                if 'node' in current_detection:
+                    self.update_node_status(current_detection['node'], power, position)
+
+        # Check if detection is complete (a POSSIBLE HIT
+        # once its device line, which follows the MAC, is in)
+        if current_detection and \
+           'node' in current_detection and \
+           ('device' in current_detection if current_detection.get('type') == 2 else
+            'mac' in current_detection or 'device' in current_detection):
+            self.log_detection(current_detection)
+            current_detection = {}
+        return current_detection
+
+    def handle_frame(self, frame):
+        """One binary frame from a node running GATEWAY_SERIAL_FRAMES
+        (gateway_frames.py): node status, and a detection per record"""
+        self.framed = True
+        node = frame['node']
+        now = datetime.now()
+        position = None
+        # A fused location's position is its target's, not the node's
+        if 'latitude' in frame and not frame['replayed'] and frame['type'] != 'FUSED':
+            position = {'latitude': frame['latitude'], 'longitude': frame['longitude'],
+                        'speed': frame.get('speed', 0), 'heading': frame.get('heading', 0), 'at': now}
+        if frame['type'] in ('TRUE_HIT', 'POSSIBLE_HIT', 'POSITION', 'STATUS'):
+            self.update_node_status(node, frame.get('status'), position)
+        if frame['type'] == 'FUSED':
+            self.log_fused_location(frame)
+            return
+        if frame['type'] not in ('TRUE_HIT', 'POSSIBLE_HIT'):
+            return
+
+        rx = frame['rx']
+        notes = []
+        if frame['replayed']:
+            age = frame['replay_age_s']
+            notes.append("replayed from journal, " +
+                         (f"recorded {age} s ago" if age is not None else "age unknown"))
+        if rx['source'] == 'mesh':
+            notes.append(f"heard at {rx['rssi']} dBm, SNR {rx['snr']:.1f} dB, SF{rx['sf']}, "
+                         f"{rx['hops']} relay hop(s)")
+        latitude, longitude = frame.get('latitude'), frame.get('longitude')
+        track = self.node_status.get(node, {}).get('position')
+        if latitude is None and track and not frame['replayed']:
+            latitude, longitude = predict_position(track, now)
+            notes.append(f"position predicted from {(now - track['at']).total_seconds():.0f} s ago")
+
+        for record in frame['records']:
+            detection = {'type': frame['type'], 'node': node, 'mac': record['mac'],
+                         'rssi': record['rssi'], 'notes': '; '.join(notes)}
+            if latitude is not None:
+                detection['latitude'] = latitude
+                detection['longitude'] = longitude
+            index = record['device_index']
+            if index == WIRE_DEVICE_REGISTRY:
+                detection['device'] = 'Registry match'
+            elif index is not None:
+                device, manufacturer = self.device_types.get(index, (f"device #{index}", 'unknown'))
+                detection['device'] = f"{device} ({manufacturer})"
+            if record['range_m'] is not None:
+                detection['range_m'] = round(record['range_m'], 1)
+                detection['trend'] = record['trend']
+            self.log_detection(detection)
+
+    def log_fused_location(self, frame):
+        """A target located by the homebase from several nodes' reports
+        (include/target_fusion.h), logged as a detection at that location"""
+        fused = frame['fused']
+        detection = {'type': 'FUSED', 'node': frame['node'], 'mac': fused['mac'],
+                     'latitude': frame['latitude'], 'longitude': frame['longitude'],
+                     'range_m': fused['radius_m'], 'trend': 'uncertainty radius (95%)',
+                     'notes': f"fused from {fused['observers']} nodes"}
+        index = fused['device_index']
+        if index == WIRE_DEVICE_REGISTRY:
+            detection['device'] = 'Registry match'
+        elif index is not None:
+            device, manufacturer = self.device_types.get(index, (f"device #{index}", 'unknown'))
+            detection['device'] = f"{device} ({manufacturer})"
+        self.log_detection(detection)
+
     def run(self):
         """Main receiver loop"""
         if not self.connect():
@@ -208,52 +417,22 @@ class HomebaseReceiver:
         print("="*70 + "\n")
 
         try:
-            buffer = ""
+            stream = FrameStream()
             current_detection = {}
             last_status_time = time.time()
 
             while True:
-                if self.serial_conn.in_waiting:
-                    try:
-                        line = self.serial_conn.readline().decode('utf-8', errors='ignore').strip()
-
-                        if not line:
-                            continue
-
-                        # Check for TRUE HIT (direct or via LoRa)
-                        if '🚨' in line or 'TRUE HIT' in line:
-                            current_detection = self.parse_true_hit(line)
-                            if current_detection and current_detection.get('node'):
-                                self.update_node_status(current_detection['node'])
-
-                        # Check for LoRa message
-                        elif '📩 LoRa message received:' in line:
-                            current_detection = {'is_lora_message': True}
-
-                        # Parse LoRa message details
-                        elif current_detection.get('is_lora_message'):
-                            parsed = self.parse_lora_message(line)
-                            if parsed:
-                                current_detection.update(parsed)
-                                if 'node' in current_detection:
-                                    self.update_node_status(current_detection['node'])
-
-                        # Check if detection is complete
-                        if current_detection and \
-                           'node' in current_detection and \
-                           ('mac' in current_detection or 'device' in current_detection):
-                            self.log_detection(current_detection)
-                            current_detection = {}
-
-                        # Print status every 60 seconds
-                        if time.time() - last_status_time > 60:
-                            self.print_status()
-                            last_status_time = time.time()
-
-                    except UnicodeDecodeError:
-                        continue
-
-                time.sleep(0.01)  # Small delay to prevent CPU spinning
+                data = self.serial_conn.read(self.serial_conn.in_waiting or 1)
+                for kind, value in stream.feed(data):
+                    if kind == 'frame':
+                        self.handle_frame(value)
+                    else:
+                        current_detection = self.handle_line(value.strip(), current_detection)
+
+                # Print status every 60 seconds
+                if time.time() - last_status_time > 60:
+                    self.print_status()
+                    last_status_time = time.time()
 
         except KeyboardInterrupt:
             print("\n\n🛑 Stopping homebase receiver...")
@@ -276,15 +455,18 @@ Examples:
   python3 homebase_receiver.py                    # Auto-detect port
   python3 homebase_receiver.py -p /dev/ttyUSB0    # Specify port
   python3 homebase_receiver.py -p COM3             # Windows port
+  python3 homebase_receiver.py --registry registry.csv  # confirm registry matches
+  python3 homebase_receiver.py -b 921600          # node with GATEWAY_SERIAL_FRAMES
         """
     )
 
     parser.add_argument('-p', '--port', help='Serial port (auto-detect if not specified)')
     parser.add_argument('-b', '--baudrate', type=int, default=115200, help='Baudrate (default: 115200)')
+    parser.add_argument('--registry', help='Registry file the nodes\' filter was built from (target_filter.py)')
 
     args = parser.parse_args()
 
-    receiver = HomebaseReceiver(port=args.port, baudrate=args.baudrate)
+    receiver = HomebaseReceiver(port=args.port, baudrate=args.baudrate, registry=args.registry)
     receiver.run()
 
 
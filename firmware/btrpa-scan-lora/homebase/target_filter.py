@@ -0,0 +1,261 @@
+#!/usr/bin/env python3
+"""
+btrpa-scan-lora Registry Filter Builder
+Builds the xor filter field nodes match pre-registered identity addresses
+against (include/target_filter.h), and loads it into a node over USB
+"""
+
+import re
+import random
+import struct
+import sys
+import time
+
+CHUNK_BYTES = 112
+MASK64 = (1 << 64) - 1
+
+
+def parse_mac(text):
+    """'aa:bb:cc:dd:ee:ff' (':' or '-') -> 48-bit key, or None"""
+    match = re.fullmatch(r'\s*([0-9a-fA-F]{2}(?:[:-][0-9a-fA-F]{2}){5})\s*', text)
+    if not match:
+        return None
+    return int(re.sub(r'[:-]', '', match.group(1)), 16)
+
+
+def load_registry(path):
+    """MACs from a registry file: one per line, optionally followed by
+    ',label'; blank lines and '#' comments are skipped"""
+    registry = {}
+    with open(path) as f:
+        for number, line in enumerate(f, 1):
+            line = line.split('#', 1)[0].strip()
+            if not line:
+                continue
+            mac, _, label = line.partition(',')
+            key = parse_mac(mac)
+            if key is None:
+                raise ValueError(f"{path}:{number}: not a MAC address: {mac.strip()}")
+            registry[key] = label.strip()
+    return registry
+
+
+def filter_hash(key, seed):
+    """targetFilterHash(): murmur3 finalizer of key + seed * golden ratio"""
+    h = (key + seed * 0x9E3779B97F4A7C15) & MASK64
+    h = ((h ^ (h >> 33)) * 0xFF51AFD7ED558CCD) & MASK64
+    h = ((h ^ (h >> 33)) * 0xC4CEB9FE1A85EC53) & MASK64
+    return h ^ (h >> 33)
+
+
+def rotl(x, bits):
+    return ((x << bits) | (x >> (64 - bits))) & MASK64
+
+
+def slots(h, block_length):
+    """The three fingerprint positions of a hash, one per block"""
+    n = block_length
+    return ((h & 0xFFFFFFFF) * n >> 32,
+            ((rotl(h, 21) & 0xFFFFFFFF) * n >> 32) + n,
+            ((rotl(h, 42) & 0xFFFFFFFF) * n >> 32) + 2 * n)
+
+
+def fingerprint(h, bits):
+    return (h ^ (h >> 32)) & ((1 << bits) - 1)
+
+
+def crc16(data):
+    """CRC-16/CCITT-FALSE, as wireCrc16()"""
+    crc = 0xFFFF
+    for byte in data:
+        crc ^= byte << 8
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x1021) & 0xFFFF if crc & 0x8000 else (crc << 1) & 0xFFFF
+    return crc
+
+
+def build_filter(keys, bits, attempts=100):
+    """Xor filter (Graf & Lemire 2019) over keys: (seed, block length,
+    fingerprint list). Construction peels keys off slots only one key maps
+    to; a seed that leaves a cycle is replaced by the next one."""
+    keys = sorted(set(keys))
+    capacity = 32 + (123 * len(keys) + 99) // 100
+    block_length = (capacity + 2) // 3
+    rng = random.Random(len(keys))
+    for _ in range(attempts):
+        seed = rng.getrandbits(32)
+        count = [0] * (3 * block_length)
+        mask = [0] * (3 * block_length)
+        hashes = {}
+        for key in keys:
+            h = filter_hash(key, seed)
+            hashes[key] = h
+            for slot in slots(h, block_length):
+                count[slot] += 1
+                mask[slot] ^= key
+
+        alone = [slot for slot, c in enumerate(count) if c == 1]
+        order = []
+        while alone:
+            slot = alone.pop()
+            if count[slot] != 1:
+                continue
+            key = mask[slot]
+            order.append((key, slot))
+            for other in slots(hashes[key], block_length):
+                count[other] -= 1
+                mask[other] ^= key
+                if count[other] == 1:
+                    alone.append(other)
+        if len(order) != len(keys):
+            continue
+
+        fingerprints = [0] * (3 * block_length)
+        for key, slot in reversed(order):
+            h = hashes[key]
+            value = fingerprint(h, bits)
+            for other in slots(h, block_length):
+                if other != slot:
+                    value ^= fingerprints[other]
+            fingerprints[slot] = value
+        return seed, block_length, fingerprints
+    raise RuntimeError(f"no seed out of {attempts} built a filter")
+
+
+def encode_filter(bits, seed, block_length, entries, fingerprints):
+    """Header and fingerprint bytes as the node keeps them"""
+    if bits == 8:
+        body = bytes(fingerprints)
+    else:
+        body = b''.join(struct.pack('<H', f) for f in fingerprints)
+    header = struct.pack('<BBHIII', bits, 0, crc16(body), seed, block_length, entries)
+    return header, body
+
+
+def contains(header, body, key):
+    """XorFilter::contains(), to check a file or measure false matches"""
+    bits, _, _, seed, block_length, _ = struct.unpack('<BBHIII', header)
+    h = filter_hash(key, seed)
+    value = 0
+    for slot in slots(h, block_length):
+        value ^= body[slot] if bits == 8 else struct.unpack_from('<H', body, 2 * slot)[0]
+    return value == fingerprint(h, bits)
+
+
+def false_match_rate(header, body, keys, samples=100000):
+    """Share of random identity addresses outside the registry that match"""
+    rng = random.Random(1)
+    matches = tried = 0
+    while tried < samples:
+        key = rng.getrandbits(48)
+        if key in keys:
+            continue
+        tried += 1
+        matches += contains(header, body, key)
+    return matches / tried
+
+
+def console_lines(header, body):
+    """The console commands that load the filter into a node"""
+    bits, _, crc, seed, block_length, entries = struct.unpack('<BBHIII', header)
+    yield f"filter load {bits} {seed} {block_length} {entries} {crc:04x}"
+    for index in range(0, (len(body) + CHUNK_BYTES - 1) // CHUNK_BYTES):
+        yield f"filter chunk {crc:04x} {index} {body[index * CHUNK_BYTES:(index + 1) * CHUNK_BYTES].hex()}"
+
+
+def load_over_serial(port, baudrate, header, body, send):
+    """Feed the filter to a node's console chunk by chunk, waiting for its
+    answer to each so the console buffer never overflows"""
+    import serial
+
+    def wait_for(conn, pattern, timeout=10.0):
+        deadline = time.time() + timeout
+        while time.time() < deadline:
+            line = conn.readline().decode('utf-8', errors='ignore').strip()
+            if re.search(pattern, line):
+                return line
+        raise TimeoutError(f"no reply matching '{pattern}' from the node")
+
+    load, *chunks = console_lines(header, body)
+    with serial.Serial(port, baudrate, timeout=1) as conn:
+        conn.reset_input_buffer()
+        conn.write(f"{load}\n".encode())
+        reply = wait_for(conn, r'Filter: ')
+        print(reply)
+        if 'already installed' in reply:
+            chunks = []
+        elif 'loading' not in reply:
+            raise RuntimeError(reply)
+        for index, chunk in enumerate(chunks):
+            conn.write(f"{chunk}\n".encode())
+            reply = wait_for(conn, r'Filter: (chunk \d+|\w+ installed|.*CRC)')
+            if 'CRC' in reply:
+                raise RuntimeError(reply)
+            print(f"\r📤 {index + 1}/{len(chunks)} chunks", end='', flush=True)
+        if chunks:
+            print()
+            if 'installed' not in reply:
+                raise RuntimeError(f"filter incomplete: {reply}")
+            print(reply)
+        if send:
+            conn.write(f"filter send {send}\n".encode())
+            print(wait_for(conn, r'Filter: '))
+
+
+def main():
+    import argparse
+
+    parser = argparse.ArgumentParser(
+        description='btrpa-scan-lora Registry Filter Builder',
+        formatter_class=argparse.RawDescriptionHelpFormatter,
+        epilog="""
+Registry file: one identity MAC per line, optionally ',label'.
+
+Examples:
+  python3 target_filter.py registry.csv --out registry.xor
+  python3 target_filter.py registry.csv -p /dev/ttyUSB0            # load into one node
+  python3 target_filter.py registry.csv -p /dev/ttyUSB0 --send all # and broadcast it
+        """
+    )
+    parser.add_argument('registry', help='Registry file of identity MACs')
+    parser.add_argument('--bits', type=int, choices=(8, 16), default=8,
+                        help='Fingerprint bits: 1 in 256 or 1 in 65536 false matches (default: 8)')
+    parser.add_argument('--max-bytes', type=int, default=32768,
+                        help="The nodes' TARGET_FILTER_MAX_BYTES (default: 32768)")
+    parser.add_argument('-o', '--out', help='Write the filter (header + fingerprints) to this file')
+    parser.add_argument('--console', metavar='FILE',
+                        help='Write the console commands that load the filter to this file')
+    parser.add_argument('-p', '--port', help="Load the filter into the node on this serial port")
+    parser.add_argument('-b', '--baudrate', type=int, default=115200, help='Baudrate (default: 115200)')
+    parser.add_argument('--send', metavar='NODE', help="Then broadcast it from that node ('all' or a node index)")
+
+    args = parser.parse_args()
+
+    registry = load_registry(args.registry)
+    if not registry:
+        sys.exit(f"{args.registry}: no addresses")
+    seed, block_length, fingerprints = build_filter(registry.keys(), args.bits)
+    header, body = encode_filter(args.bits, seed, block_length, len(registry), fingerprints)
+    crc = struct.unpack_from('<H', header, 2)[0]
+    rate = false_match_rate(header, body, registry)
+    print(f"🧮 Filter {crc:04X}: {len(registry)} addresses, {args.bits}-bit, {len(body)} bytes "
+          f"({8 * len(body) / len(registry):.1f} bits each), "
+          f"false matches {rate * 100:.3f}% (expected {100 / (1 << args.bits):.3f}%)")
+    assert all(contains(header, body, key) for key in registry)
+    if len(body) > args.max_bytes:
+        sys.exit(f"❌ {len(body)} bytes exceed TARGET_FILTER_MAX_BYTES ({args.max_bytes})")
+
+    if args.out:
+        with open(args.out, 'wb') as f:
+            f.write(header + body)
+        print(f"📁 Written to {args.out}")
+    if args.console:
+        with open(args.console, 'w') as f:
+            f.writelines(f"{line}\n" for line in console_lines(header, body))
+        print(f"📁 Console commands written to {args.console}")
+    if args.port:
+        load_over_serial(args.port, args.baudrate, header, body, args.send)
+
+
+if __name__ == '__main__':
+    main()
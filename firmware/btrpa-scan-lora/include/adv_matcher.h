@@ -0,0 +1,310 @@
+/**
+ * btrpa-scan-lora Advertisement Payload Matcher
+ *
+ * Medical devices that randomize their address still advertise the same
+ * GATT services and manufacturer data (Glucose 0x1808, CGM 0x181F, a
+ * vendor's company ID). Rules from config.h name one of:
+ *
+ *   "uuid:181f"                      16-bit service UUID
+ *   "uuid:0000fe12"                  32-bit service UUID
+ *   "uuid:6e400001-b5a3-f393-e0a9-e50e24dcca9e"   128-bit service UUID
+ *   "company:00d0"                   manufacturer data from a company ID
+ *   "mfg:004c:02??15"                company ID plus leading data bytes,
+ *                                    "??" matching any byte (up to 8)
+ *
+ * UUIDs match in service UUID lists (complete or not), solicitation
+ * lists and service data. 128-bit UUIDs on the Bluetooth Base UUID are
+ * folded to 32 bits, so "uuid:1808" also matches its 128-bit form.
+ *
+ * Rules are parsed and sorted at compile time into one table, grouped by
+ * kind. An advert is matched in a single pass over the raw AD structures
+ * (getPayload()), with one binary search per UUID or manufacturer field,
+ * so the cost per advert is bounded by its length, not the rule count.
+ * No NimBLE std::string accessors, no copies, no heap. When several
+ * rules match, the first in config.h wins.
+ */
+
+#ifndef ADV_MATCHER_H
+#define ADV_MATCHER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "mac_table.h"
+
+struct AdvertisementRule {
+    const char* rule;           // see above
+    const char* deviceType;
+    const char* manufacturer;
+};
+
+enum AdRuleKind : uint8_t {
+    AD_RULE_INVALID = 0,
+    AD_RULE_UUID32,             // 16- and 32-bit UUIDs
+    AD_RULE_UUID128,
+    AD_RULE_COMPANY,            // company ID, optional data pattern
+    AD_RULE_KINDS,
+};
+
+constexpr size_t AD_PATTERN_MAX = 8;
+
+struct AdRuleEntry {
+    uint64_t hi;                // UUID128 high half
+    uint64_t lo;                // UUID128 low half, UUID32, or company ID
+    uint8_t pattern[AD_PATTERN_MAX];
+    uint8_t mask[AD_PATTERN_MAX];
+    uint8_t patternLength;
+    AdRuleKind kind;
+    uint16_t index;             // position in the source table
+};
+
+// Bluetooth Base UUID 00000000-0000-1000-8000-00805f9b34fb
+constexpr uint64_t AD_BASE_UUID_HI = 0x0000000000001000ULL;
+constexpr uint64_t AD_BASE_UUID_LO = 0x800000805f9b34fbULL;
+
+constexpr bool adUuidIsBase(uint64_t hi, uint64_t lo) {
+    return lo == AD_BASE_UUID_LO && (hi & 0xFFFFFFFFULL) == AD_BASE_UUID_HI;
+}
+
+// Reads up to maxNibbles hex digits (skipping '-'), stopping at ':' or
+// the end; returns the count, or -1 on a bad character or overflow
+constexpr int adParseHex(const char*& p, uint64_t& hi, uint64_t& lo, int maxNibbles) {
+    int nibbles = 0;
+    for (; *p != '\0' && *p != ':'; p++) {
+        if (*p == '-') continue;
+        int n = macHexNibble(*p);
+        if (n < 0 || nibbles == maxNibbles) return -1;
+        hi = (hi << 4) | (lo >> 60);
+        lo = (lo << 4) | (uint64_t)n;
+        nibbles++;
+    }
+    return nibbles;
+}
+
+constexpr bool adHasPrefix(const char* text, const char* prefix) {
+    for (; *prefix != '\0'; text++, prefix++) {
+        if (*text != *prefix) return false;
+    }
+    return true;
+}
+
+constexpr AdRuleEntry parseAdRule(const char* text, uint16_t index) {
+    AdRuleEntry entry = {};
+    entry.index = index;
+    uint64_t hi = 0, lo = 0;
+    const char* p = text;
+
+    if (adHasPrefix(text, "uuid:")) {
+        p += 5;
+        int nibbles = adParseHex(p, hi, lo, 32);
+        if (*p != '\0') return entry;
+        if (nibbles == 4 || nibbles == 8) {
+            entry.kind = AD_RULE_UUID32;
+            entry.lo = lo;
+        } else if (nibbles == 32) {
+            bool base = adUuidIsBase(hi, lo);
+            entry.kind = base ? AD_RULE_UUID32 : AD_RULE_UUID128;
+            entry.hi = base ? 0 : hi;
+            entry.lo = base ? hi >> 32 : lo;
+        }
+        return entry;
+    }
+
+    bool data = adHasPrefix(text, "mfg:");
+    if (!data && !adHasPrefix(text, "company:")) return entry;
+    p += data ? 4 : 8;
+    if (adParseHex(p, hi, lo, 4) != 4) return entry;
+    entry.lo = lo;
+    if (data) {
+        if (*p != ':') return entry;
+        for (p++; *p != '\0'; p += 2) {
+            if (entry.patternLength == AD_PATTERN_MAX || p[1] == '\0') return entry;
+            uint8_t i = entry.patternLength++;
+            if (p[0] == '?' && p[1] == '?') continue;
+            int h = macHexNibble(p[0]), l = macHexNibble(p[1]);
+            if (h < 0 || l < 0) return entry;
+            entry.pattern[i] = (uint8_t)(h << 4 | l);
+            entry.mask[i] = 0xFF;
+        }
+        if (entry.patternLength == 0) return entry;
+    } else if (*p != '\0') {
+        return entry;
+    }
+    entry.kind = AD_RULE_COMPANY;
+    return entry;
+}
+
+// By kind, key, then source order, so the first equal entry wins
+constexpr bool adRuleBefore(const AdRuleEntry& a, const AdRuleEntry& b) {
+    return a.kind != b.kind ? a.kind < b.kind :
+           a.hi != b.hi ? a.hi < b.hi :
+           a.lo != b.lo ? a.lo < b.lo : a.index < b.index;
+}
+
+struct AdScanResult {
+    uint8_t flags;              // AD type 0x01 value, 0 if absent
+    int16_t rule;               // source index of the matching rule, or -1
+};
+
+template <size_t N>
+struct AdRuleSet {
+    AdRuleEntry entries[N > 0 ? N : 1];
+    uint16_t start[AD_RULE_KINDS];
+    uint16_t count[AD_RULE_KINDS];
+
+    static constexpr size_t size() { return N; }
+
+    constexpr bool valid() const {
+        for (size_t i = 0; i < N; i++) {
+            if (entries[i].kind == AD_RULE_INVALID) return false;
+        }
+        return true;
+    }
+
+    // First entry of kind with key (hi, lo), or N
+    size_t find(AdRuleKind kind, uint64_t hi, uint64_t lo) const {
+        size_t first = start[kind], last = start[kind] + count[kind];
+        const size_t end = last;
+        while (first < last) {
+            size_t mid = first + (last - first) / 2;
+            const AdRuleEntry& e = entries[mid];
+            if (e.hi < hi || (e.hi == hi && e.lo < lo)) {
+                first = mid + 1;
+            } else {
+                last = mid;
+            }
+        }
+        return first < end && entries[first].hi == hi && entries[first].lo == lo ? first : N;
+    }
+
+    int matchUuid32(uint32_t uuid) const {
+        size_t i = find(AD_RULE_UUID32, 0, uuid);
+        return i < N ? entries[i].index : -1;
+    }
+
+    // 16 bytes, little-endian as on air
+    int matchUuid128(const uint8_t* p) const {
+        uint64_t lo = 0, hi = 0;
+        for (int i = 7; i >= 0; i--) lo = (lo << 8) | p[i];
+        for (int i = 15; i >= 8; i--) hi = (hi << 8) | p[i];
+        if (adUuidIsBase(hi, lo)) return matchUuid32((uint32_t)(hi >> 32));
+        size_t i = find(AD_RULE_UUID128, hi, lo);
+        return i < N ? entries[i].index : -1;
+    }
+
+    // Manufacturer-specific data: company ID (little-endian) then data.
+    // Rules for one company are in source order, so the first fit wins.
+    int matchManufacturer(const uint8_t* p, size_t length) const {
+        if (length < 2) return -1;
+        uint16_t company = (uint16_t)(p[0] | p[1] << 8);
+        size_t end = start[AD_RULE_COMPANY] + count[AD_RULE_COMPANY];
+        for (size_t i = find(AD_RULE_COMPANY, 0, company); i < end && entries[i].lo == company; i++) {
+            const AdRuleEntry& e = entries[i];
+            if (e.patternLength > length - 2) continue;
+            bool match = true;
+            for (uint8_t b = 0; b < e.patternLength && match; b++) {
+                match = ((p[2 + b] ^ e.pattern[b]) & e.mask[b]) == 0;
+            }
+            if (match) return e.index;
+        }
+        return -1;
+    }
+};
+
+template <size_t N>
+constexpr void adRuleSiftDown(AdRuleEntry (&entries)[N], size_t root, size_t end) {
+    while (2 * root + 1 < end) {
+        size_t child = 2 * root + 1;
+        if (child + 1 < end && adRuleBefore(entries[child], entries[child + 1])) child++;
+        if (!adRuleBefore(entries[root], entries[child])) return;
+        AdRuleEntry tmp = entries[root];
+        entries[root] = entries[child];
+        entries[child] = tmp;
+        root = child;
+    }
+}
+
+// Built from a list ending in a {nullptr, ...} sentinel, so it may be empty
+template <size_t N>
+constexpr AdRuleSet<N - 1> makeAdRuleSet(const AdvertisementRule (&rules)[N]) {
+    static_assert(N - 1 <= INT16_MAX, "advertisement rule table too large");
+    constexpr size_t M = N - 1;
+    AdRuleSet<M> set{};
+    for (size_t i = 0; i < M; i++) {
+        set.entries[i] = rules[i].rule != nullptr ? parseAdRule(rules[i].rule, (uint16_t)i) : AdRuleEntry{};
+    }
+    for (size_t i = M / 2; i-- > 0;) {
+        adRuleSiftDown(set.entries, i, M);
+    }
+    for (size_t end = M; end-- > 1;) {
+        AdRuleEntry tmp = set.entries[0];
+        set.entries[0] = set.entries[end];
+        set.entries[end] = tmp;
+        adRuleSiftDown(set.entries, 0, end);
+    }
+    for (size_t i = M; i-- > 0;) {
+        set.start[set.entries[i].kind] = (uint16_t)i;
+        set.count[set.entries[i].kind]++;
+    }
+    return set;
+}
+
+// One pass over the AD structures: Flags, and the first-listed rule any
+// UUID or manufacturer field matches. Stops at a malformed length.
+template <size_t N>
+AdScanResult scanAdvertisement(const AdRuleSet<N>& rules, const uint8_t* payload, size_t length) {
+    AdScanResult result = {0, -1};
+    auto consider = [&result](int rule) {
+        if (rule >= 0 && (result.rule < 0 || rule < result.rule)) result.rule = (int16_t)rule;
+    };
+
+    size_t i = 0;
+    while (i + 1 < length) {
+        uint8_t fieldLength = payload[i];
+        if (fieldLength == 0 || i + 1 + fieldLength > length) break;
+        uint8_t type = payload[i + 1];
+        const uint8_t* data = payload + i + 2;
+        size_t dataLength = fieldLength - 1;
+        i += fieldLength + 1;
+
+        switch (type) {
+            case 0x01:          // Flags
+                if (dataLength >= 1) result.flags = data[0];
+                break;
+            case 0x02: case 0x03: case 0x14:    // 16-bit UUIDs, solicitation
+                for (size_t u = 0; u + 2 <= dataLength; u += 2) {
+                    consider(rules.matchUuid32((uint32_t)(data[u] | data[u + 1] << 8)));
+                }
+                break;
+            case 0x04: case 0x05: case 0x1F:    // 32-bit UUIDs, solicitation
+                for (size_t u = 0; u + 4 <= dataLength; u += 4) {
+                    consider(rules.matchUuid32((uint32_t)data[u] | (uint32_t)data[u + 1] << 8 |
+                                               (uint32_t)data[u + 2] << 16 | (uint32_t)data[u + 3] << 24));
+                }
+                break;
+            case 0x06: case 0x07: case 0x15:    // 128-bit UUIDs, solicitation
+                for (size_t u = 0; u + 16 <= dataLength; u += 16) consider(rules.matchUuid128(data + u));
+                break;
+            case 0x16:          // Service Data, 16-bit UUID
+                if (dataLength >= 2) consider(rules.matchUuid32((uint32_t)(data[0] | data[1] << 8)));
+                break;
+            case 0x20:          // Service Data, 32-bit UUID
+                if (dataLength >= 4) {
+                    consider(rules.matchUuid32((uint32_t)data[0] | (uint32_t)data[1] << 8 |
+                                               (uint32_t)data[2] << 16 | (uint32_t)data[3] << 24));
+                }
+                break;
+            case 0x21:          // Service Data, 128-bit UUID
+                if (dataLength >= 16) consider(rules.matchUuid128(data));
+                break;
+            case 0xFF:          // Manufacturer Specific Data
+                consider(rules.matchManufacturer(data, dataLength));
+                break;
+            default:
+                break;
+        }
+    }
+    return result;
+}
+
+#endif // ADV_MATCHER_H
@@ -0,0 +1,134 @@
+/**
+ * btrpa-scan-lora Heap Allocation Counter
+ *
+ * A node runs for days, and small allocations made per advertisement
+ * fragment the heap until a larger one fails. The scan path is meant to
+ * allocate nothing; this counter is how that is checked.
+ *
+ * Debug builds define DEBUG_COUNT_ALLOCATIONS and link with
+ * -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc,--wrap=free (the
+ * *_alloc environments in platformio.ini). Every call to those functions
+ * in the image, including operator new and NimBLE, then passes through
+ * the wrappers here. Allocations are counted three ways:
+ *   - all tasks
+ *   - the BLE host task: NimBLE's own work per advert plus onResult
+ *   - inside an AllocScope: the onResult-to-enqueue path itself
+ * newlib's reentrant _malloc_r family is not wrapped.
+ *
+ * Without the flag the counters stay zero and AllocScope compiles away.
+ * Include from one translation unit only; it defines the wrappers.
+ */
+
+#ifndef ALLOC_COUNTER_H
+#define ALLOC_COUNTER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+struct AllocCounts {
+    std::atomic<uint32_t> allocs{0};
+    std::atomic<uint32_t> bytes{0};
+    std::atomic<uint32_t> frees{0};
+};
+
+struct AllocCounter {
+    AllocCounts all;
+    AllocCounts hostTask;
+    AllocCounts scoped;
+    // Set by AllocScope; both read from any task inside malloc
+    std::atomic<TaskHandle_t> hostTaskHandle{nullptr};
+    std::atomic<TaskHandle_t> scopeTask{nullptr};
+
+    static constexpr bool enabled() { return DEBUG_COUNT_ALLOCATIONS; }
+
+    void record(AllocCounts& counts, size_t size) {
+        counts.allocs.fetch_add(1, std::memory_order_relaxed);
+        counts.bytes.fetch_add((uint32_t)size, std::memory_order_relaxed);
+    }
+
+    void allocated(size_t size) {
+        record(all, size);
+        TaskHandle_t host = hostTaskHandle.load(std::memory_order_relaxed);
+        if (host == nullptr) return;
+        TaskHandle_t self = xTaskGetCurrentTaskHandle();
+        if (self != host) return;
+        record(hostTask, size);
+        if (scopeTask.load(std::memory_order_relaxed) == self) record(scoped, size);
+    }
+
+    void freed() {
+        all.frees.fetch_add(1, std::memory_order_relaxed);
+    }
+};
+
+inline AllocCounter allocCounter;
+
+// Marks the calling task as the BLE host task and counts its allocations
+// as scoped until the end of the block. Not reentrant.
+class AllocScope {
+public:
+    AllocScope() {
+        #if DEBUG_COUNT_ALLOCATIONS
+        TaskHandle_t self = xTaskGetCurrentTaskHandle();
+        allocCounter.hostTaskHandle.store(self, std::memory_order_relaxed);
+        allocCounter.scopeTask.store(self, std::memory_order_relaxed);
+        #endif
+    }
+    ~AllocScope() {
+        #if DEBUG_COUNT_ALLOCATIONS
+        allocCounter.scopeTask.store(nullptr, std::memory_order_relaxed);
+        #endif
+    }
+    AllocScope(const AllocScope&) = delete;
+    AllocScope& operator=(const AllocScope&) = delete;
+};
+
+// Counter deltas between two reports
+struct AllocSnapshot {
+    uint32_t allocs;
+    uint32_t bytes;
+    uint32_t frees;
+};
+
+inline AllocSnapshot allocSnapshot(const AllocCounts& counts) {
+    return {counts.allocs.load(std::memory_order_relaxed),
+            counts.bytes.load(std::memory_order_relaxed),
+            counts.frees.load(std::memory_order_relaxed)};
+}
+
+#if DEBUG_COUNT_ALLOCATIONS
+extern "C" {
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t count, size_t size);
+void* __real_realloc(void* ptr, size_t size);
+void __real_free(void* ptr);
+
+void* __wrap_malloc(size_t size) {
+    allocCounter.allocated(size);
+    return __real_malloc(size);
+}
+
+void* __wrap_calloc(size_t count, size_t size) {
+    allocCounter.allocated(count * size);
+    return __real_calloc(count, size);
+}
+
+// A realloc to a new size is an allocation; realloc(p, 0) is a free
+void* __wrap_realloc(void* ptr, size_t size) {
+    if (size > 0) allocCounter.allocated(size);
+    if (ptr != nullptr) allocCounter.freed();
+    return __real_realloc(ptr, size);
+}
+
+void __wrap_free(void* ptr) {
+    if (ptr != nullptr) allocCounter.freed();
+    __real_free(ptr);
+}
+}
+#endif
+
+#endif // ALLOC_COUNTER_H
@@ -0,0 +1,227 @@
+/**
+ * btrpa-scan-lora Channel Access
+ *
+ * Two checks a frame passes before it goes on air.
+ *
+ * Listen before talk: the radio runs channel activity detection (CAD) at
+ * the frame's spreading factor first. If another node is transmitting,
+ * the sender backs off for a random time that doubles with each busy
+ * check, so nodes that queued hits at the same moment spread out instead
+ * of colliding. After maxBackoffs busy checks a hit or an ack is sent
+ * anyway and a beacon or status frame is dropped. A higher-priority frame
+ * is not held up by a lower one's backoff.
+ *
+ * Duty cycle: regulators limit the share of time a node may transmit in
+ * a sub-band, measured over an hour (1% in most of EU868, so 36 s). The
+ * ledger keeps airtime in buckets over a sliding window and admits a
+ * frame only if it fits under its class's share of the budget, so
+ * routine traffic stops well before the limit and the remainder is left
+ * for hits. Bands without a limit are still tracked for the report.
+ *
+ * Not thread-safe: the radio task owns both. Fixed storage, no heap.
+ */
+
+#ifndef CHANNEL_ACCESS_H
+#define CHANNEL_ACCESS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "lora_tx_queue.h"
+
+// ============================================================================
+// REGIONAL DUTY-CYCLE LIMITS
+// ============================================================================
+
+struct DutyCycleBand {
+    const char* name;
+    uint32_t lowKHz;        // inclusive
+    uint32_t highKHz;       // exclusive
+    uint16_t permille;      // 10 = 1%
+};
+
+// ETSI EN 300 220 sub-bands as used by LoRaWAN EU868/EU433 (RP002)
+constexpr DutyCycleBand DUTY_CYCLE_BANDS[] = {
+    {"EU433",    433050, 434790, 100},
+    {"EU868 g",  863000, 868000, 10},
+    {"EU868 g1", 868000, 868600, 10},
+    {"EU868 g2", 868700, 869200, 1},
+    {"EU868 g3", 869400, 869650, 100},
+    {"EU868 g4", 869700, 870000, 10},
+};
+constexpr size_t NUM_DUTY_CYCLE_BANDS = sizeof(DUTY_CYCLE_BANDS) / sizeof(DUTY_CYCLE_BANDS[0]);
+
+// Band containing frequencyKHz, or -1 where no duty cycle applies
+constexpr int dutyCycleBandIndex(uint32_t frequencyKHz) {
+    for (size_t i = 0; i < NUM_DUTY_CYCLE_BANDS; i++) {
+        if (frequencyKHz >= DUTY_CYCLE_BANDS[i].lowKHz && frequencyKHz < DUTY_CYCLE_BANDS[i].highKHz) {
+            return (int)i;
+        }
+    }
+    return -1;
+}
+
+// ============================================================================
+// DUTY-CYCLE LEDGER
+// ============================================================================
+
+struct DutyCycleStats {
+    uint32_t frames;        // transmissions recorded
+    uint64_t airtimeUs;     // total, since boot
+    uint64_t peakUsedUs;    // most airtime inside one window
+};
+
+template <size_t Buckets>
+class DutyCycleLedger {
+    static_assert(Buckets >= 2, "DutyCycleLedger needs at least two buckets");
+
+public:
+    // permille 0 = no limit (airtime is still tracked)
+    DutyCycleLedger(uint32_t windowMs, uint16_t permille)
+        : bucketMs_(windowMs / Buckets), budgetUs_((uint64_t)windowMs * permille) {}
+
+    bool limited() const { return budgetUs_ > 0; }
+    uint64_t budgetUs() const { return budgetUs_; }
+    const DutyCycleStats& stats() const { return stats_; }
+
+    // Airtime inside the window ending now
+    uint64_t usedUs(uint32_t nowMs) {
+        advance(nowMs);
+        uint64_t used = 0;
+        for (size_t i = 0; i < SLOTS; i++) used += slots_[i];
+        return used;
+    }
+
+    // Would airtimeUs more stay within percent of the budget?
+    bool admits(uint32_t airtimeUs, uint8_t percent, uint32_t nowMs) {
+        return !limited() || usedUs(nowMs) + airtimeUs <= budgetUs_ * percent / 100;
+    }
+
+    void record(uint32_t airtimeUs, uint32_t nowMs) {
+        advance(nowMs);
+        slots_[current_] += airtimeUs;
+        stats_.frames++;
+        stats_.airtimeUs += airtimeUs;
+        uint64_t used = usedUs(nowMs);
+        if (used > stats_.peakUsedUs) stats_.peakUsedUs = used;
+    }
+
+    // Time until the oldest recorded airtime leaves the window; 0 if none
+    uint32_t msUntilRelease(uint32_t nowMs) {
+        advance(nowMs);
+        for (size_t age = SLOTS - 1; age > 0; age--) {
+            if (slots_[(current_ + SLOTS - age) % SLOTS] != 0) {
+                return (uint32_t)(SLOTS - age) * bucketMs_ - (nowMs - bucketStartMs_);
+            }
+        }
+        return slots_[current_] != 0 ? (uint32_t)SLOTS * bucketMs_ - (nowMs - bucketStartMs_) : 0;
+    }
+
+private:
+    // One slot more than the window, so airtime is only forgotten once the
+    // whole window has passed since the end of its bucket
+    static constexpr size_t SLOTS = Buckets + 1;
+
+    void advance(uint32_t nowMs) {
+        uint32_t elapsed = (nowMs - bucketStartMs_) / bucketMs_;
+        if (elapsed == 0) return;
+        for (uint32_t i = 0; i < elapsed && i < SLOTS; i++) {
+            current_ = (current_ + 1) % SLOTS;
+            slots_[current_] = 0;
+        }
+        bucketStartMs_ += elapsed * bucketMs_;
+    }
+
+    uint32_t bucketMs_;
+    uint64_t budgetUs_;
+    uint32_t slots_[SLOTS] = {};
+    size_t current_ = 0;
+    uint32_t bucketStartMs_ = 0;
+    DutyCycleStats stats_ = {};
+};
+
+// ============================================================================
+// LISTEN BEFORE TALK
+// ============================================================================
+
+enum LbtDecision : uint8_t {
+    LBT_BACK_OFF,           // wait and check again
+    LBT_TRANSMIT,           // out of patience: send a hit or ack anyway
+    LBT_DROP,               // out of patience: give up on a routine frame
+};
+
+struct LbtStats {
+    uint32_t checks;        // CADs run before a transmission
+    uint32_t busy;          // of those, channel occupied
+    uint32_t backoffs;
+    uint64_t backoffMs;     // total time spent backing off
+    uint32_t forced;        // hits and acks sent on a busy channel
+    uint32_t dropped;       // routine frames given up on
+};
+
+class ListenBeforeTalk {
+public:
+    // Backoff before attempt n is baseMs plus a random share of baseMs << n
+    ListenBeforeTalk(uint32_t baseMs, uint8_t maxBackoffs)
+        : baseMs_(baseMs), maxBackoffs_(maxBackoffs) {}
+
+    const LbtStats& stats() const { return stats_; }
+
+    // A frame of txClass must not be sent yet
+    bool backingOff(TxClass txClass, uint32_t nowMs) const {
+        return txClass >= class_ && (int32_t)(nowMs - untilMs_) < 0;
+    }
+
+    uint32_t msUntilClear(uint32_t nowMs) const {
+        int32_t left = (int32_t)(untilMs_ - nowMs);
+        return left > 0 ? (uint32_t)left : 0;
+    }
+
+    // CAD result for the next frame; returns what to do with it when busy.
+    // random is any uniformly distributed value.
+    LbtDecision check(TxClass txClass, bool busy, uint32_t nowMs, uint32_t random) {
+        stats_.checks++;
+        if (txClass < class_) {
+            // A more urgent frame than the one backing off starts afresh
+            class_ = txClass;
+            attempts_ = 0;
+        }
+        if (!busy) return LBT_TRANSMIT;
+
+        stats_.busy++;
+        if (attempts_ >= maxBackoffs_) {
+            reset();
+            if (txClass <= TX_CLASS_POSSIBLE_HIT) {
+                stats_.forced++;
+                return LBT_TRANSMIT;
+            }
+            stats_.dropped++;
+            return LBT_DROP;
+        }
+
+        uint32_t windowMs = baseMs_ << attempts_;
+        uint32_t waitMs = baseMs_ + random % windowMs;
+        attempts_++;
+        class_ = txClass;
+        untilMs_ = nowMs + waitMs;
+        stats_.backoffs++;
+        stats_.backoffMs += waitMs;
+        return LBT_BACK_OFF;
+    }
+
+    // The frame went out (or was dropped): the next one starts afresh
+    void reset() {
+        attempts_ = 0;
+        class_ = TX_CLASS_COUNT;
+    }
+
+private:
+    uint32_t baseMs_;
+    uint8_t maxBackoffs_;
+    uint8_t attempts_ = 0;
+    TxClass class_ = TX_CLASS_COUNT;    // class that is backing off
+    uint32_t untilMs_ = 0;
+    LbtStats stats_ = {};
+};
+
+#endif // CHANNEL_ACCESS_H
@@ -13,14 +13,21 @@
 
 // Unique node identifier (max 16 chars)
 // Change this for each node: NODE-001, NODE-002, etc.
+// LoRa frames carry only the trailing number (1-254) as a one-byte node index
 #define NODE_ID_CONFIG "NODE-001"
 
+// Uncomment to set the node index explicitly when NODE_ID_CONFIG does not
+// end in a number
+// #define NODE_INDEX 1
+
 // ============================================================================
 // TARGET MAC ADDRESSES (TRUE HIT)
 // ============================================================================
 
 // Add your target MAC addresses here (exact matches)
 // Format: "aa:bb:cc:dd:ee:ff" (lowercase, colon-separated)
+// Addresses are checked and packed into a sorted table at compile time, so
+// thousands of entries cost no RAM and a typo fails the build.
 //
 // Example scenarios:
 // - Known pacemaker MAC from phone app disconnect
@@ -29,7 +36,7 @@
 //
 // To add multiple targets, uncomment and fill in:
 
-const char* TARGET_MACS[] = {
+constexpr const char* TARGET_MACS[] = {
     // INSTRUCTIONS: Add target MAC addresses below (one per line)
     // Format: "aa:bb:cc:dd:ee:ff" (lowercase, colon-separated)
     // Example: "70:b3:d5:b3:4a:bc",  // Medtronic pacemaker from phone app
@@ -40,6 +47,23 @@ const char* TARGET_MACS[] = {
 
 const int NUM_TARGET_MACS = sizeof(TARGET_MACS) / sizeof(TARGET_MACS[0]);
 
+// ============================================================================
+// TARGET IDENTITY RESOLVING KEYS (TRUE HIT)
+// ============================================================================
+
+// Phones and watches rotate random (RPA) addresses every few minutes.
+// With the device's IRK (from a paired phone or computer, as used by
+// btrpa-scan.py --irk) every rotated address resolves to the target.
+// Format: {"<32 hex digits>", "<label>"}, one per line, each line ending
+// in a backslash. Keys are checked at compile time.
+#define TARGET_IRKS \
+    {"ec0234a357c8ad05341010a60a397d9b", "Test device"},  /* Core Spec sample key, replace */ \
+    /* {"0123456789abcdef0123456789abcdef", "Target phone"}, */
+
+// Resolved and rejected RPAs remembered so each address is computed once
+// (power of two, 8 bytes per entry; 16 KB covers ~1500 phones in range)
+#define RPA_CACHE_SIZE 2048
+
 // ============================================================================
 // MEDICAL DEVICE PREFIXES (POSSIBLE HIT)
 // ============================================================================
@@ -49,13 +73,18 @@ const int NUM_TARGET_MACS = sizeof(TARGET_MACS) / sizeof(TARGET_MACS[0]);
 
 // Medical device MAC prefixes database
 // These will trigger POSSIBLE HIT alerts
+//
+// Prefixes are hex nibbles with optional ':' or '-' separators, so IEEE
+// MA-L ("aa:bb:cc"), MA-M ("aa:bb:cc:d") and MA-S ("aa:bb:cc:dd:e") blocks
+// can be mixed. Append "/bits" for a non-nibble length. When several
+// prefixes match, the longest (most specific) one is reported.
 struct MedicalDevicePrefixConfig {
     const char* prefix;
     const char* deviceType;
     const char* manufacturer;
 };
 
-const MedicalDevicePrefixConfig MEDICAL_DEVICE_PREFIXES[] = {
+constexpr MedicalDevicePrefixConfig MEDICAL_DEVICE_PREFIXES[] = {
     // Medtronic Cardiac Devices
     {"70:b3:d5:b3:4", "Pacemaker/ICD/CRT", "Medtronic"},
 
@@ -71,6 +100,25 @@ const MedicalDevicePrefixConfig MEDICAL_DEVICE_PREFIXES[] = {
 
 const int NUM_MEDICAL_PREFIXES = sizeof(MEDICAL_DEVICE_PREFIXES) / sizeof(MEDICAL_DEVICE_PREFIXES[0]);
 
+// Advertisement payload rules (POSSIBLE HIT), for devices that randomize
+// their address but keep advertising the same services. Each entry is
+// {"<rule>", "<device type>", "<manufacturer>"}, each line ending in a
+// backslash. Rules:
+//   "uuid:181f"               16-bit, 32-bit or 128-bit service UUID
+//   "company:00d0"            manufacturer data from this company ID
+//   "mfg:004c:02??15"         company ID plus leading data bytes (?? = any)
+// Rules are checked at compile time; the first listed match is reported.
+// Enabled with ENABLE_MEDICAL_DEVICE_SCANNING.
+#define ADVERTISEMENT_RULES \
+    {"uuid:1808", "Glucose meter", "Standard service"}, \
+    {"uuid:181f", "Continuous glucose monitor", "Standard service"}, \
+    {"uuid:183a", "Insulin delivery", "Standard service"}, \
+    {"uuid:1810", "Blood pressure monitor", "Standard service"}, \
+    {"uuid:1822", "Pulse oximeter", "Standard service"}, \
+    {"uuid:febc", "CGM transmitter", "Dexcom"}, \
+    /* Also worn for fitness: expect false positives */ \
+    {"uuid:180d", "Heart rate monitor", "Standard service"}, \
+
 // ============================================================================
 // BLE SCANNING PARAMETERS
 // ============================================================================
@@ -92,13 +140,38 @@ const int NUM_MEDICAL_PREFIXES = sizeof(MEDICAL_DEVICE_PREFIXES) / sizeof(MEDICA
 // GPS CONFIGURATION
 // ============================================================================
 
-// Movement threshold for position beaconing (meters)
-// Node sends position update when it moves > this distance
+// Position beacons (position_beacon.h). Beacons and hits carry the
+// node's velocity, and the homebase extrapolates from the last one; the
+// node beacons again when it strays more than GPS_MOVEMENT_THRESHOLD
+// meters from that prediction, at most every GPS_BEACON_MIN_INTERVAL_MS
+// and at least every GPS_BEACON_MAX_INTERVAL_MS. Below
+// GPS_STATIONARY_SPEED_CMS (cm/s) the node counts as standing still.
 #define GPS_MOVEMENT_THRESHOLD 25.0
+#define GPS_BEACON_MIN_INTERVAL_MS 10000
+#define GPS_BEACON_MAX_INTERVAL_MS 300000
+#define GPS_STATIONARY_SPEED_CMS 50
+
+// Nodes whose last position the homebase keeps for extrapolation
+#define MESH_TRACKED_NODES 16
 
-// GPS timeout for initial fix (milliseconds)
+// How long to wait for the module's first sentence, at boot or after a
+// baud rate change, before reporting it missing (milliseconds)
 #define GPS_INIT_TIMEOUT 2000
 
+// Module setup at boot: GGA and RMC only (GSV, GSA, GLL and VTG off), one
+// fix every GPS_RATE_MS, sent as both UBX (u-blox) and PMTK (MediaTek,
+// Quectel) commands. The link starts at GPS_MODULE_BAUD, the module's
+// default, and moves to GPS_BAUD once the module acknowledges. Faster
+// fixes need a faster link: 9600 baud carries both sentences up to 5 Hz.
+// false leaves the module as it is.
+#define GPS_CONFIGURE_MODULE true
+#define GPS_MODULE_BAUD 9600
+#define GPS_BAUD 9600
+#define GPS_RATE_MS 1000
+
+// Positions older than this are not attached to detections (milliseconds)
+#define GPS_MAX_FIX_AGE_MS 10000
+
 // ============================================================================
 // ALERT CONFIGURATION
 // ============================================================================
@@ -132,23 +205,309 @@ const int NUM_MEDICAL_PREFIXES = sizeof(MEDICAL_DEVICE_PREFIXES) / sizeof(MEDICA
 // Meshtastic channel name
 #define MESH_CHANNEL_NAME "SAR-SEARCH"
 
+// Frames waiting for the radio. Sent TRUE HIT first, then POSSIBLE HIT,
+// position, status; when full, lower-priority frames are dropped first.
+#define LORA_TX_QUEUE_DEPTH 8
+
+// POSSIBLE HITs are held for up to LORA_BATCH_WINDOW_MS (max 60000) so
+// devices seen together share one frame, up to LORA_BATCH_MAX_RECORDS
+// (1-8) per frame. 0 sends each one immediately. TRUE HITs never wait.
+#define LORA_BATCH_WINDOW_MS 3000
+#define LORA_BATCH_MAX_RECORDS 8
+
+// Radio task priority (above the detection task) and stack (bytes). It
+// owns the SX1262: sends queued frames and reads out received ones.
+#define LORA_RADIO_TASK_PRIORITY 3
+#define LORA_RADIO_TASK_STACK 4096
+
+// Received frames waiting to be decoded (power of two), and the priority
+// and stack of the task that decodes them. Raise the depth on gateway or
+// relay nodes if the statistics report RX overflows.
+#define LORA_RX_QUEUE_DEPTH 8
+#define LORA_RX_TASK_PRIORITY 1
+#define LORA_RX_TASK_STACK 4096
+
+// ============================================================================
+// MESH RELAY
+// ============================================================================
+
+// Set to true on nodes that should rebroadcast frames from other nodes,
+// e.g. one placed between the search area and the homebase. Every node
+// ignores copies of frames it has already heard.
+#define MESH_RELAY_ENABLED false
+
+// Relays a frame from this node may cross (0-7). Each relay uses one.
+#define MESH_HOP_LIMIT 3
+
+// Relay position beacons as well as hits (costs far more airtime)
+#define MESH_RELAY_BEACONS false
+
+// Rebroadcast delay: MIN + up to SPREAD for a strong signal (a weakly
+// heard frame goes sooner, as its relay adds more range) + random JITTER
+#define MESH_RELAY_MIN_DELAY_MS 200
+#define MESH_RELAY_DELAY_SPREAD_MS 2000
+#define MESH_RELAY_JITTER_MS 600
+
+// Cancel a pending rebroadcast after hearing this many other relays send
+// the same frame (0 = always rebroadcast)
+#define MESH_RELAY_DUPLICATE_LIMIT 2
+
+// Recently heard frames remembered for duplicate suppression, and
+// rebroadcasts that can wait at once
+#define MESH_SEEN_CACHE_SIZE 64
+#define MESH_SEEN_WINDOW_MS 120000
+#define MESH_RELAY_PENDING 4
+
+// Set to true on the homebase node (the one wired to the laptop). It
+// acknowledges every hit and status frame it hears, MESH_ACK_DELAY_MS
+// after the first so that one ack covers a burst; field nodes replay
+// journaled detections that were never acknowledged.
+#define MESH_GATEWAY false
+#define MESH_ACK_DELAY_MS 1500
+
+// Homebase only: also send every frame it accepts, and its own hits, as
+// binary frames (include/serial_frame.h) for homebase_receiver.py, on a
+// USB port running at GATEWAY_SERIAL_BAUD. The human log stays on the
+// same port unless GATEWAY_HUMAN_LOG is false: then the port carries the
+// frames alone, plus replies for 30 s after each console line.
+#define GATEWAY_SERIAL_FRAMES false
+#define GATEWAY_SERIAL_BAUD 921600
+#define GATEWAY_HUMAN_LOG true
+
+// Homebase only: locate a target several field nodes hear from their
+// positions and path-loss ranges (include/target_fusion.h). Reports of one
+// MAC within FUSION_WINDOW_MS are fitted together, each node once, up to
+// FUSION_OBSERVERS nodes for FUSION_TARGETS targets at a time. With
+// FUSION_MIN_OBSERVERS nodes or more the location goes to the log, to the
+// host and, with FUSION_BROADCAST, over the mesh to the field teams, at
+// most every FUSION_INTERVAL_MS per target. FUSION_RANGE_SIGMA is a
+// range's error as a share of itself.
+#define FUSION_ENABLED true
+#define FUSION_TARGETS 16
+#define FUSION_OBSERVERS 20
+#define FUSION_WINDOW_MS 30000
+#define FUSION_MIN_OBSERVERS 3
+#define FUSION_INTERVAL_MS 15000
+#define FUSION_RANGE_SIGMA 0.4
+#define FUSION_BROADCAST true
+
+// ============================================================================
+// LORA DATA RATE
+// ============================================================================
+
+// Spreading factors in use, fastest first (SF7-SF12). Frames to nearby
+// neighbours go at the fastest rate their link allows; TRUE HITs and
+// unknown links use the last (most robust) one. Nodes scan for all of
+// them, so every node in a mesh, homebase included, needs the same list.
+// A single entry, e.g. { 10 }, turns adaptation off.
+#define LORA_SPREADING_FACTORS { 7, 8, 9, 10 }
+
+// SNR margin (dB) above the demodulation floor required of the weakest
+// neighbour link before a faster rate is used (acks and gateway commands
+// and targets use the POSSIBLE HIT margin)
+#define LORA_POSSIBLE_HIT_MARGIN_DB 10
+#define LORA_ROUTINE_MARGIN_DB 6
+
+// Largest TX power reduction (dB) for beacons to close neighbours
+#define LORA_MAX_POWER_BACKOFF_DB 10
+
+// After this many consecutive failed fast frames (TX timeouts, or frames
+// no relay repeated), send at the robust rate for LORA_RATE_FALLBACK_MS
+#define LORA_RATE_FALLBACK_FAILURES 3
+#define LORA_RATE_FALLBACK_MS 60000
+
+// Neighbours tracked for link quality, forgotten after this long unheard
+#define LORA_LINK_TABLE_SIZE 16
+#define LORA_LINK_MAX_AGE_MS 600000
+
+// ============================================================================
+// LORA CHANNEL ACCESS
+// ============================================================================
+
+// Regional duty-cycle limit in tenths of a percent (10 = 1%), measured
+// over an hour. -1 uses the limit of the band LORA_FREQUENCY is in (1% at
+// 868 MHz, none at 915 MHz); 0 turns the limit off.
+#define LORA_DUTY_CYCLE_PERMILLE -1
+
+// Share of the hourly budget beacons and status frames may use, and
+// POSSIBLE HITs and acks; the rest is kept for TRUE HITs. Frames over their share
+// wait in the queue until older airtime leaves the window.
+#define LORA_DUTY_ROUTINE_PERCENT 70
+#define LORA_DUTY_POSSIBLE_HIT_PERCENT 90
+
+// Listen before talk: a busy channel delays a frame by LORA_LBT_BACKOFF_MS
+// plus a random share of a window that doubles per busy check. After
+// LORA_LBT_MAX_BACKOFFS, hits and acks are sent anyway and other frames
+// dropped.
+#define LORA_LBT_BACKOFF_MS 100
+#define LORA_LBT_MAX_BACKOFFS 5
+
+// ============================================================================
+// DETECTION PIPELINE
+// ============================================================================
+
+// The BLE callback only queues a small record per advertisement; matching,
+// display and LoRa alerts run in a separate detection task.
+
+// Queued advertisements awaiting the detection task (power of two).
+// Raise if the statistics report queue overflows in dense crowds.
+#define DETECTION_QUEUE_DEPTH 64
+
+// Core and FreeRTOS priority of the detection task. NimBLE runs on core 0,
+// the Arduino loop on core 1 at priority 1.
+#define DETECTION_TASK_CORE 1
+#define DETECTION_TASK_PRIORITY 2
+
+// Detection task stack size (bytes)
+#define DETECTION_TASK_STACK 6144
+
+// Background tasks: GPS parsing (woken by the UART when the module pauses
+// after a burst of sentences), the OLED scanning screen, the statistics
+// report and the alert log, which prints the detection task's alerts so
+// that a slow serial port never holds detection up. By default on core 0
+// below NimBLE, leaving core 1 to detection and the radio. Stacks in
+// bytes; the report shows how much each used.
+#define BACKGROUND_TASK_CORE 0
+#define GPS_TASK_PRIORITY 1
+#define GPS_TASK_STACK 3072
+#define DISPLAY_TASK_PRIORITY 1
+#define DISPLAY_TASK_STACK 3072
+#define TELEMETRY_TASK_PRIORITY 1
+#define TELEMETRY_TASK_STACK 4096
+#define ALERT_LOG_TASK_PRIORITY 1
+#define ALERT_LOG_TASK_STACK 4096
+
+// Alerts waiting for the alert log task (power of two). One that finds
+// it full is not printed (it still goes out over LoRa); the report shows
+// the overflows.
+#define ALERT_LOG_DEPTH 16
+
+// Matched devices are tracked in a fixed table (power of two; 3/4 usable,
+// 32 bytes per slot). A device is re-reported over LoRa only when its
+// smoothed RSSI moves by DEVICE_REPORT_RSSI_DELTA dB or every
+// DEVICE_REPORT_REFRESH_MS; devices unseen for DEVICE_CACHE_MAX_AGE_MS are
+// forgotten and count as new when they return.
+#define DEVICE_CACHE_SIZE 64
+#define DEVICE_CACHE_MAX_AGE_MS 300000
+#define DEVICE_REPORT_REFRESH_MS 60000
+#define DEVICE_REPORT_RSSI_DELTA 10
+
+// Each device's RSSI is smoothed by a small Kalman filter: RSSI_NOISE_DB is
+// one reading's scatter, RSSI_WANDER_DB how far the true level drifts per
+// second. The smoothed level is compared with its RSSI_TREND_WINDOW_MS
+// trailing average; a lead of RSSI_TREND_DB marks the device approaching
+// or receding. Range uses the log-distance model: RSSI_AT_1M is the level
+// at one metre, RSSI_ENVIRONMENT the path-loss exponent (RSSI_ENV_FREE_SPACE
+// n=2.0, RSSI_ENV_OUTDOOR 2.2, RSSI_ENV_INDOOR 3.0; also the "environment"
+// console command).
+#define RSSI_ENVIRONMENT RSSI_ENV_OUTDOOR
+#define RSSI_AT_1M -59
+#define RSSI_NOISE_DB 4
+#define RSSI_WANDER_DB 1
+#define RSSI_TREND_WINDOW_MS 10000
+#define RSSI_TREND_DB 2
+
+// ============================================================================
+// DETECTION JOURNAL
+// ============================================================================
+
+// Every TRUE and POSSIBLE HIT is appended to the "journal" flash partition
+// (partitions.csv, about 40,000 records) and survives reboots and power
+// loss. TRUE HITs are written at once; POSSIBLE HITs a 256-byte page at a
+// time, or after JOURNAL_FLUSH_MS.
+#define JOURNAL_FLUSH_MS 10000
+
+// A sent record not acknowledged by the homebase within the timeout is
+// sent again, oldest first, one frame every REPLAY_INTERVAL, for as long
+// as the homebase has acknowledged anything in the last REACHABLE_MS.
+// "journal dump" / "journal pending" on the USB console print the journal.
+#define JOURNAL_ACK_TIMEOUT_MS 120000
+#define JOURNAL_REPLAY_INTERVAL_MS 15000
+#define JOURNAL_REACHABLE_MS 600000
+
+// Journal task, on BACKGROUND_TASK_CORE (stack in bytes)
+#define JOURNAL_TASK_PRIORITY 1
+#define JOURNAL_TASK_STACK 4096
+
+// ============================================================================
+// RUNTIME TARGETS
+// ============================================================================
+
+// Targets can be added after flashing, from the gateway console or over
+// the mesh ("target add all 28:34:ff:74:aa:99"), and are kept in the
+// "targets" NVS partition across reboots:
+//   - up to RUNTIME_TARGET_CAPACITY exact MACs, reported as TRUE HITs
+//   - one registry filter of pre-registered identity addresses
+//     (homebase/target_filter.py), reported as POSSIBLE HITs that the
+//     homebase confirms against the registry. 8-bit fingerprints hold
+//     about TARGET_FILTER_MAX_BYTES / 1.23 addresses at 1 false match in
+//     256, 16-bit ones half that at 1 in 65536. Two buffers of this size
+//     are kept in RAM, so a new filter loads while the old one matches.
+#define RUNTIME_TARGET_CAPACITY 32
+#define TARGET_FILTER_MAX_BYTES 32768
+
+// "filter send all" on the gateway broadcasts its filter: every chunk
+// TARGET_FILTER_ROUNDS times, one frame per FRAME_INTERVAL while the
+// transmit queue is nearly empty. Each chunk is a ~2 s frame at SF10
+// that counts against the routine duty-cycle share; large registries
+// are better loaded over USB on each node.
+#define TARGET_FILTER_ROUNDS 2
+#define TARGET_FILTER_FRAME_INTERVAL_MS 3000
+
+// ============================================================================
+// POWER MANAGEMENT
+// ============================================================================
+
+// The node scans with BLE_SCAN_INTERVAL/WINDOW (active) unless:
+//   - it had a hit in the last SCAN_BURST_MS: continuous scanning (burst)
+//   - the battery is below BATTERY_LOW_MV (until it recovers above
+//     BATTERY_RECOVER_MV), or nothing was hit for SCAN_IDLE_CONSERVE_MS:
+//     one SCAN_CONSERVATION_WINDOW_MS window every
+//     SCAN_CONSERVATION_INTERVAL_MS (conservation), light sleep in between
+//     with the OLED off; LoRa keeps listening and wakes the node
+// A gateway command ("scan all conservation 60" on its serial console)
+// overrides this on one node or all of them. 0 disables a trigger.
+#define SCAN_CONSERVATION_INTERVAL_MS 10000
+#define SCAN_CONSERVATION_WINDOW_MS 1000
+#define SCAN_BURST_MS 120000
+#define SCAN_IDLE_CONSERVE_MS 0
+#define BATTERY_LOW_MV 3500
+#define BATTERY_RECOVER_MV 3700
+
+// Battery voltage, scan profile and estimated current, sent to the mesh
+// this often and on every profile change (milliseconds, 0 = never)
+#define STATUS_INTERVAL_MS 600000
+
 // ============================================================================
 // HARDWARE PIN DEFINITIONS
 // ============================================================================
 
+// Battery: ADC pin (-1 = no measurement), the pin that switches the
+// divider on (-1 = always on) and the divider ratio. On the V3 the divider
+// switch is GPIO37, used for GPS RX here; boards that read 0 V need the
+// GPS moved and BATTERY_ADC_CTRL_PIN set to 37.
 #if defined(HELTEC_V3)
     #define GPS_RX_PIN 37
     #define GPS_TX_PIN 38
     #define LED_PIN 35
+    #define BATTERY_ADC_PIN 1
+    #define BATTERY_ADC_CTRL_PIN -1
+    #define BATTERY_DIVIDER 4.9
 #elif defined(HELTEC_V2)
     #define GPS_RX_PIN 17
     #define GPS_TX_PIN 16
     #define LED_PIN 25
+    #define BATTERY_ADC_PIN 37
+    #define BATTERY_ADC_CTRL_PIN -1
+    #define BATTERY_DIVIDER 3.2
 #else
     #warning "Unknown Heltec version - using V3 pin definitions"
     #define GPS_RX_PIN 37
     #define GPS_TX_PIN 38
     #define LED_PIN 35
+    #define BATTERY_ADC_PIN 1
+    #define BATTERY_ADC_CTRL_PIN -1
+    #define BATTERY_DIVIDER 4.9
 #endif
 
 // ============================================================================
@@ -162,6 +521,9 @@ const int NUM_MEDICAL_PREFIXES = sizeof(MEDICAL_DEVICE_PREFIXES) / sizeof(MEDICA
 // Set to true for testing to see all nearby BLE devices
 #define DEBUG_SHOW_ALL_DEVICES false
 
+// Heap allocation counts per advert: build the heltec_wifi_lora_32_V3_alloc
+// (or native_alloc) environment rather than setting a flag here
+
 // Statistics reporting interval (milliseconds)
 #define STATS_INTERVAL 30000
 
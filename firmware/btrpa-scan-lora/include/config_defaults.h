@@ -0,0 +1,477 @@
+/**
+ * btrpa-scan-lora Configuration Defaults
+ *
+ * Fallbacks for settings added after a node's config.h was written (for
+ * example one downloaded from an older web flasher). Edit config.h, not
+ * this file; anything defined there wins.
+ */
+
+#ifndef CONFIG_DEFAULTS_H
+#define CONFIG_DEFAULTS_H
+
+// ============================================================================
+// TARGET IDENTITY RESOLVING KEYS
+// ============================================================================
+
+// No keys: only exact MAC matches raise TRUE HITs
+#ifndef TARGET_IRKS
+#define TARGET_IRKS
+#endif
+
+#ifndef RPA_CACHE_SIZE
+#define RPA_CACHE_SIZE 2048
+#endif
+
+// ============================================================================
+// ADVERTISEMENT PAYLOAD RULES
+// ============================================================================
+
+// No rules: POSSIBLE HITs come from MAC prefixes only
+#ifndef ADVERTISEMENT_RULES
+#define ADVERTISEMENT_RULES
+#endif
+
+// ============================================================================
+// GPS
+// ============================================================================
+
+#ifndef GPS_MOVEMENT_THRESHOLD
+#define GPS_MOVEMENT_THRESHOLD 25.0
+#endif
+
+#ifndef GPS_BEACON_MIN_INTERVAL_MS
+#define GPS_BEACON_MIN_INTERVAL_MS 10000
+#endif
+
+#ifndef GPS_BEACON_MAX_INTERVAL_MS
+#define GPS_BEACON_MAX_INTERVAL_MS 300000
+#endif
+
+#ifndef GPS_STATIONARY_SPEED_CMS
+#define GPS_STATIONARY_SPEED_CMS 50
+#endif
+
+#ifndef MESH_TRACKED_NODES
+#define MESH_TRACKED_NODES 16
+#endif
+
+#ifndef GPS_INIT_TIMEOUT
+#define GPS_INIT_TIMEOUT 2000
+#endif
+
+#ifndef GPS_CONFIGURE_MODULE
+#define GPS_CONFIGURE_MODULE true
+#endif
+
+#ifndef GPS_MODULE_BAUD
+#define GPS_MODULE_BAUD 9600
+#endif
+
+#ifndef GPS_BAUD
+#define GPS_BAUD 9600
+#endif
+
+#ifndef GPS_RATE_MS
+#define GPS_RATE_MS 1000
+#endif
+
+#ifndef GPS_MAX_FIX_AGE_MS
+#define GPS_MAX_FIX_AGE_MS 10000
+#endif
+
+// ============================================================================
+// DETECTION PIPELINE
+// ============================================================================
+
+#ifndef DETECTION_QUEUE_DEPTH
+#define DETECTION_QUEUE_DEPTH 64
+#endif
+
+#ifndef DETECTION_TASK_CORE
+#define DETECTION_TASK_CORE 1
+#endif
+
+#ifndef DETECTION_TASK_PRIORITY
+#define DETECTION_TASK_PRIORITY 2
+#endif
+
+#ifndef DETECTION_TASK_STACK
+#define DETECTION_TASK_STACK 6144
+#endif
+
+#ifndef BACKGROUND_TASK_CORE
+#define BACKGROUND_TASK_CORE 0
+#endif
+
+#ifndef GPS_TASK_PRIORITY
+#define GPS_TASK_PRIORITY 1
+#endif
+
+#ifndef GPS_TASK_STACK
+#define GPS_TASK_STACK 3072
+#endif
+
+#ifndef DISPLAY_TASK_PRIORITY
+#define DISPLAY_TASK_PRIORITY 1
+#endif
+
+#ifndef DISPLAY_TASK_STACK
+#define DISPLAY_TASK_STACK 3072
+#endif
+
+#ifndef TELEMETRY_TASK_PRIORITY
+#define TELEMETRY_TASK_PRIORITY 1
+#endif
+
+#ifndef TELEMETRY_TASK_STACK
+#define TELEMETRY_TASK_STACK 4096
+#endif
+
+#ifndef ALERT_LOG_TASK_PRIORITY
+#define ALERT_LOG_TASK_PRIORITY 1
+#endif
+
+#ifndef ALERT_LOG_TASK_STACK
+#define ALERT_LOG_TASK_STACK 4096
+#endif
+
+#ifndef ALERT_LOG_DEPTH
+#define ALERT_LOG_DEPTH 16
+#endif
+
+#ifndef DEVICE_CACHE_SIZE
+#define DEVICE_CACHE_SIZE 64
+#endif
+
+#ifndef DEVICE_CACHE_MAX_AGE_MS
+#define DEVICE_CACHE_MAX_AGE_MS 300000
+#endif
+
+#ifndef DEVICE_REPORT_REFRESH_MS
+#define DEVICE_REPORT_REFRESH_MS 60000
+#endif
+
+#ifndef DEVICE_REPORT_RSSI_DELTA
+#define DEVICE_REPORT_RSSI_DELTA 10
+#endif
+
+#ifndef RSSI_ENVIRONMENT
+#define RSSI_ENVIRONMENT RSSI_ENV_OUTDOOR
+#endif
+
+#ifndef RSSI_AT_1M
+#define RSSI_AT_1M -59
+#endif
+
+#ifndef RSSI_NOISE_DB
+#define RSSI_NOISE_DB 4
+#endif
+
+#ifndef RSSI_WANDER_DB
+#define RSSI_WANDER_DB 1
+#endif
+
+#ifndef RSSI_TREND_WINDOW_MS
+#define RSSI_TREND_WINDOW_MS 10000
+#endif
+
+#ifndef RSSI_TREND_DB
+#define RSSI_TREND_DB 2
+#endif
+
+// ============================================================================
+// DETECTION JOURNAL
+// ============================================================================
+
+#ifndef JOURNAL_FLUSH_MS
+#define JOURNAL_FLUSH_MS 10000
+#endif
+
+#ifndef JOURNAL_ACK_TIMEOUT_MS
+#define JOURNAL_ACK_TIMEOUT_MS 120000
+#endif
+
+#ifndef JOURNAL_REPLAY_INTERVAL_MS
+#define JOURNAL_REPLAY_INTERVAL_MS 15000
+#endif
+
+#ifndef JOURNAL_REACHABLE_MS
+#define JOURNAL_REACHABLE_MS 600000
+#endif
+
+#ifndef JOURNAL_TASK_PRIORITY
+#define JOURNAL_TASK_PRIORITY 1
+#endif
+
+#ifndef JOURNAL_TASK_STACK
+#define JOURNAL_TASK_STACK 4096
+#endif
+
+// ============================================================================
+// RUNTIME TARGETS
+// ============================================================================
+
+#ifndef RUNTIME_TARGET_CAPACITY
+#define RUNTIME_TARGET_CAPACITY 32
+#endif
+
+#ifndef TARGET_FILTER_MAX_BYTES
+#define TARGET_FILTER_MAX_BYTES 32768
+#endif
+
+#ifndef TARGET_FILTER_ROUNDS
+#define TARGET_FILTER_ROUNDS 2
+#endif
+
+#ifndef TARGET_FILTER_FRAME_INTERVAL_MS
+#define TARGET_FILTER_FRAME_INTERVAL_MS 3000
+#endif
+
+// ============================================================================
+// LORA TRANSMIT QUEUE
+// ============================================================================
+
+#ifndef LORA_TX_QUEUE_DEPTH
+#define LORA_TX_QUEUE_DEPTH 8
+#endif
+
+#ifndef LORA_BATCH_WINDOW_MS
+#define LORA_BATCH_WINDOW_MS 3000
+#endif
+
+#ifndef LORA_BATCH_MAX_RECORDS
+#define LORA_BATCH_MAX_RECORDS 8
+#endif
+
+#ifndef LORA_RADIO_TASK_PRIORITY
+#define LORA_RADIO_TASK_PRIORITY 3
+#endif
+
+#ifndef LORA_RADIO_TASK_STACK
+#define LORA_RADIO_TASK_STACK 4096
+#endif
+
+#ifndef LORA_RX_QUEUE_DEPTH
+#define LORA_RX_QUEUE_DEPTH 8
+#endif
+
+#ifndef LORA_RX_TASK_PRIORITY
+#define LORA_RX_TASK_PRIORITY 1
+#endif
+
+#ifndef LORA_RX_TASK_STACK
+#define LORA_RX_TASK_STACK 4096
+#endif
+
+// ============================================================================
+// MESH RELAY
+// ============================================================================
+
+#ifndef MESH_RELAY_ENABLED
+#define MESH_RELAY_ENABLED false
+#endif
+
+#ifndef MESH_HOP_LIMIT
+#define MESH_HOP_LIMIT 3
+#endif
+
+#ifndef MESH_RELAY_BEACONS
+#define MESH_RELAY_BEACONS false
+#endif
+
+#ifndef MESH_RELAY_MIN_DELAY_MS
+#define MESH_RELAY_MIN_DELAY_MS 200
+#endif
+
+#ifndef MESH_RELAY_DELAY_SPREAD_MS
+#define MESH_RELAY_DELAY_SPREAD_MS 2000
+#endif
+
+#ifndef MESH_RELAY_JITTER_MS
+#define MESH_RELAY_JITTER_MS 600
+#endif
+
+#ifndef MESH_RELAY_DUPLICATE_LIMIT
+#define MESH_RELAY_DUPLICATE_LIMIT 2
+#endif
+
+#ifndef MESH_SEEN_CACHE_SIZE
+#define MESH_SEEN_CACHE_SIZE 64
+#endif
+
+#ifndef MESH_SEEN_WINDOW_MS
+#define MESH_SEEN_WINDOW_MS 120000
+#endif
+
+#ifndef MESH_RELAY_PENDING
+#define MESH_RELAY_PENDING 4
+#endif
+
+#ifndef MESH_GATEWAY
+#define MESH_GATEWAY false
+#endif
+
+#ifndef MESH_ACK_DELAY_MS
+#define MESH_ACK_DELAY_MS 1500
+#endif
+
+#ifndef GATEWAY_SERIAL_FRAMES
+#define GATEWAY_SERIAL_FRAMES false
+#endif
+
+#ifndef GATEWAY_SERIAL_BAUD
+#define GATEWAY_SERIAL_BAUD 921600
+#endif
+
+#ifndef GATEWAY_HUMAN_LOG
+#define GATEWAY_HUMAN_LOG true
+#endif
+
+#ifndef FUSION_ENABLED
+#define FUSION_ENABLED true
+#endif
+
+#ifndef FUSION_TARGETS
+#define FUSION_TARGETS 16
+#endif
+
+#ifndef FUSION_OBSERVERS
+#define FUSION_OBSERVERS 20
+#endif
+
+#ifndef FUSION_WINDOW_MS
+#define FUSION_WINDOW_MS 30000
+#endif
+
+#ifndef FUSION_MIN_OBSERVERS
+#define FUSION_MIN_OBSERVERS 3
+#endif
+
+#ifndef FUSION_INTERVAL_MS
+#define FUSION_INTERVAL_MS 15000
+#endif
+
+#ifndef FUSION_RANGE_SIGMA
+#define FUSION_RANGE_SIGMA 0.4
+#endif
+
+#ifndef FUSION_BROADCAST
+#define FUSION_BROADCAST true
+#endif
+
+// ============================================================================
+// LORA DATA RATE
+// ============================================================================
+
+#ifndef LORA_SPREADING_FACTORS
+#define LORA_SPREADING_FACTORS { 7, 8, 9, 10 }
+#endif
+
+#ifndef LORA_POSSIBLE_HIT_MARGIN_DB
+#define LORA_POSSIBLE_HIT_MARGIN_DB 10
+#endif
+
+#ifndef LORA_ROUTINE_MARGIN_DB
+#define LORA_ROUTINE_MARGIN_DB 6
+#endif
+
+#ifndef LORA_MAX_POWER_BACKOFF_DB
+#define LORA_MAX_POWER_BACKOFF_DB 10
+#endif
+
+#ifndef LORA_RATE_FALLBACK_FAILURES
+#define LORA_RATE_FALLBACK_FAILURES 3
+#endif
+
+#ifndef LORA_RATE_FALLBACK_MS
+#define LORA_RATE_FALLBACK_MS 60000
+#endif
+
+#ifndef LORA_LINK_TABLE_SIZE
+#define LORA_LINK_TABLE_SIZE 16
+#endif
+
+#ifndef LORA_LINK_MAX_AGE_MS
+#define LORA_LINK_MAX_AGE_MS 600000
+#endif
+
+// ============================================================================
+// LORA CHANNEL ACCESS
+// ============================================================================
+
+#ifndef LORA_DUTY_CYCLE_PERMILLE
+#define LORA_DUTY_CYCLE_PERMILLE -1
+#endif
+
+#ifndef LORA_DUTY_ROUTINE_PERCENT
+#define LORA_DUTY_ROUTINE_PERCENT 70
+#endif
+
+#ifndef LORA_DUTY_POSSIBLE_HIT_PERCENT
+#define LORA_DUTY_POSSIBLE_HIT_PERCENT 90
+#endif
+
+#ifndef LORA_LBT_BACKOFF_MS
+#define LORA_LBT_BACKOFF_MS 100
+#endif
+
+#ifndef LORA_LBT_MAX_BACKOFFS
+#define LORA_LBT_MAX_BACKOFFS 5
+#endif
+
+// ============================================================================
+// POWER MANAGEMENT
+// ============================================================================
+
+#ifndef SCAN_CONSERVATION_INTERVAL_MS
+#define SCAN_CONSERVATION_INTERVAL_MS 10000
+#endif
+
+#ifndef SCAN_CONSERVATION_WINDOW_MS
+#define SCAN_CONSERVATION_WINDOW_MS 1000
+#endif
+
+#ifndef SCAN_BURST_MS
+#define SCAN_BURST_MS 120000
+#endif
+
+#ifndef SCAN_IDLE_CONSERVE_MS
+#define SCAN_IDLE_CONSERVE_MS 0
+#endif
+
+#ifndef BATTERY_LOW_MV
+#define BATTERY_LOW_MV 3500
+#endif
+
+#ifndef BATTERY_RECOVER_MV
+#define BATTERY_RECOVER_MV 3700
+#endif
+
+#ifndef STATUS_INTERVAL_MS
+#define STATUS_INTERVAL_MS 600000
+#endif
+
+// Older config.h files have no battery pins: do not measure
+#ifndef BATTERY_ADC_PIN
+#define BATTERY_ADC_PIN -1
+#endif
+
+#ifndef BATTERY_ADC_CTRL_PIN
+#define BATTERY_ADC_CTRL_PIN -1
+#endif
+
+#ifndef BATTERY_DIVIDER
+#define BATTERY_DIVIDER 1.0
+#endif
+
+// ============================================================================
+// DEBUG CONFIGURATION
+// ============================================================================
+
+// Set by the *_alloc build environments, which also wrap malloc; setting
+// it alone fails to link
+#ifndef DEBUG_COUNT_ALLOCATIONS
+#define DEBUG_COUNT_ALLOCATIONS 0
+#endif
+
+#endif // CONFIG_DEFAULTS_H
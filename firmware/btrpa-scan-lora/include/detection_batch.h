@@ -0,0 +1,82 @@
+/**
+ * btrpa-scan-lora Detection Batch
+ *
+ * Collects detection records for one multi-record LoRa frame. Every frame
+ * pays for its own preamble, header and CRC (about 350 ms at SF10), so
+ * when several devices show up together it is cheaper to send them as one
+ * frame. The batch is due when it fills or when the batching window since
+ * its first record has passed. A repeat report for a MAC already in the
+ * batch replaces that record.
+ *
+ * Not thread-safe: one task owns a batch. Fixed storage, no heap.
+ */
+
+#ifndef DETECTION_BATCH_H
+#define DETECTION_BATCH_H
+
+#include <stdint.h>
+
+#include "wire_format.h"
+
+struct DetectionBatchStats {
+    uint32_t records;       // records added
+    uint32_t coalesced;     // replaced a record for the same MAC
+    uint32_t frames;        // batches taken for sending
+    uint32_t recordsSent;   // records in those frames
+};
+
+template <uint8_t MaxRecords>
+class DetectionBatch {
+    static_assert(MaxRecords >= 1 && MaxRecords <= WIRE_MAX_RECORDS,
+                  "batch must fit in one wire frame");
+
+public:
+    explicit DetectionBatch(uint32_t windowMs) : windowMs_(windowMs) {}
+
+    bool empty() const { return count_ == 0; }
+    uint8_t size() const { return count_; }
+    const DetectionBatchStats& stats() const { return stats_; }
+
+    // Returns true when the batch is due (full, or no window configured)
+    bool add(const WireRecord& record, uint32_t nowMs) {
+        stats_.records++;
+        for (uint8_t i = 0; i < count_; i++) {
+            if (records_[i].mac == record.mac) {
+                records_[i] = record;
+                stats_.coalesced++;
+                return due(nowMs);
+            }
+        }
+        if (count_ == 0) openedMs_ = nowMs;
+        records_[count_++] = record;
+        return due(nowMs);
+    }
+
+    bool due(uint32_t nowMs) const {
+        return count_ > 0 && (count_ >= MaxRecords || nowMs - openedMs_ >= windowMs_);
+    }
+
+    // Time left in the window; 0 if due or empty
+    uint32_t msUntilDue(uint32_t nowMs) const {
+        if (count_ == 0 || due(nowMs)) return 0;
+        return windowMs_ - (nowMs - openedMs_);
+    }
+
+    // Move the records into frame and start a new batch
+    void take(WireFrame& frame) {
+        for (uint8_t i = 0; i < count_; i++) frame.records[i] = records_[i];
+        frame.recordCount = count_;
+        stats_.frames++;
+        stats_.recordsSent += count_;
+        count_ = 0;
+    }
+
+private:
+    WireRecord records_[MaxRecords];
+    uint8_t count_ = 0;
+    uint32_t openedMs_ = 0;
+    uint32_t windowMs_;
+    DetectionBatchStats stats_ = {};
+};
+
+#endif // DETECTION_BATCH_H
@@ -0,0 +1,222 @@
+/**
+ * btrpa-scan-lora Device Cache
+ *
+ * Per-device state for matched advertisers, so a phone advertising at
+ * 10 Hz produces a handful of mesh reports instead of one per advert.
+ * A device is reported on first sighting (or again after aging out),
+ * when its smoothed RSSI moves by a set number of dB since the last
+ * report, or when the refresh interval has passed. Each entry carries
+ * the device's RSSI filter (rssi_tracker.h).
+ *
+ * Fixed-capacity open-addressing table keyed by the 48-bit MAC key, with
+ * linear probing and backward-shift deletion (no tombstones). Entries
+ * unseen for maxAgeMs are swept when the table fills; if none have aged
+ * out, the least recently seen device is evicted. The load is capped at
+ * 3/4 of the slots so probe sequences stay short. Not thread-safe: one
+ * task owns the cache. Fixed storage, no heap.
+ */
+
+#ifndef DEVICE_CACHE_H
+#define DEVICE_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "mac_table.h"
+#include "rssi_tracker.h"
+
+enum DeviceReport : uint8_t {
+    DEVICE_SUPPRESS = 0,        // seen recently, nothing new to say
+    DEVICE_REPORT_NEW,          // first sighting, or first since aging out
+    DEVICE_REPORT_RSSI,         // smoothed RSSI moved by rssiDelta dB
+    DEVICE_REPORT_REFRESH,      // refresh interval elapsed
+};
+
+inline const char* deviceReportName(DeviceReport report) {
+    switch (report) {
+        case DEVICE_SUPPRESS: return "suppressed";
+        case DEVICE_REPORT_NEW: return "first sighting";
+        case DEVICE_REPORT_RSSI: return "RSSI change";
+        case DEVICE_REPORT_REFRESH: return "refresh";
+    }
+    return "?";
+}
+
+struct DeviceEntry {
+    uint64_t key;           // MAC_KEY_INVALID when the slot is free
+    uint32_t firstSeenMs;
+    uint32_t lastSeenMs;
+    uint32_t lastReportMs;
+    uint16_t sightings;     // stops at UINT16_MAX
+    uint16_t reports;
+    RssiFilter rssi;
+    int8_t rssiMax;
+    int8_t reportedRssi;    // smoothed RSSI at the last report
+
+    int8_t rssiMean() const { return rssi.rssi(); }
+
+    // Unknown until the trailing average has had half its time constant
+    RssiTrend trend(const RssiFilterConfig& config) const {
+        return lastSeenMs - firstSeenMs < config.trendTauMs / 2 ? RSSI_TREND_UNKNOWN : rssi.trend(config);
+    }
+};
+
+static_assert(sizeof(DeviceEntry) <= 32, "DeviceEntry grew past its RAM budget");
+
+struct DeviceCacheStats {
+    uint32_t inserted;      // new devices (including re-sightings after aging)
+    uint32_t reported;      // sightings that produced a report
+    uint32_t suppressed;    // sightings absorbed by the cache
+    uint32_t expired;       // swept after maxAgeMs without a sighting
+    uint32_t evicted;       // pushed out by a full table
+    uint32_t peak;          // most devices held at once
+};
+
+template <size_t Capacity>
+class DeviceCache {
+    static_assert(Capacity >= 4 && (Capacity & (Capacity - 1)) == 0,
+                  "DeviceCache capacity must be a power of two");
+
+public:
+    // refreshMs or rssiDelta of 0 disables that report trigger
+    DeviceCache(uint32_t maxAgeMs, uint32_t refreshMs, uint8_t rssiDelta, const RssiFilterConfig& filter)
+        : maxAgeMs_(maxAgeMs), refreshMs_(refreshMs), rssiDelta_(rssiDelta), filter_(filter) {
+        for (size_t i = 0; i < Capacity; i++) slots_[i].key = MAC_KEY_INVALID;
+    }
+
+    static constexpr size_t capacity() { return Capacity; }
+    static constexpr size_t maxDevices() { return Capacity * 3 / 4; }
+    size_t size() const { return count_; }
+    const DeviceCacheStats& stats() const { return stats_; }
+    const RssiFilterConfig& filter() const { return filter_; }
+
+    // Record a sighting and decide whether it should be reported. entry
+    // points at the device's state until the next call.
+    DeviceReport observe(uint64_t key, int8_t rssi, uint32_t nowMs, const DeviceEntry*& entry) {
+        size_t slot = find(key);
+        DeviceEntry* device = &slots_[slot];
+
+        if (device->key == key && nowMs - device->lastSeenMs > maxAgeMs_) {
+            stats_.expired++;
+            reset(*device, key, rssi, nowMs, filter_);
+        } else if (device->key != key) {
+            if (count_ >= maxDevices()) {
+                makeRoom(nowMs);
+                slot = find(key);
+                device = &slots_[slot];
+            }
+            reset(*device, key, rssi, nowMs, filter_);
+            count_++;
+            if (count_ > stats_.peak) stats_.peak = count_;
+        } else {
+            device->rssi.update(rssi, nowMs - device->lastSeenMs, filter_);
+            device->lastSeenMs = nowMs;
+            if (device->sightings < UINT16_MAX) device->sightings++;
+            if (rssi > device->rssiMax) device->rssiMax = rssi;
+        }
+        entry = device;
+
+        DeviceReport report = DEVICE_SUPPRESS;
+        int drift = device->rssiMean() - device->reportedRssi;
+        if (device->sightings == 1) {
+            report = DEVICE_REPORT_NEW;
+        } else if (rssiDelta_ != 0 && (drift >= rssiDelta_ || -drift >= rssiDelta_)) {
+            report = DEVICE_REPORT_RSSI;
+        } else if (refreshMs_ != 0 && nowMs - device->lastReportMs >= refreshMs_) {
+            report = DEVICE_REPORT_REFRESH;
+        }
+
+        if (report == DEVICE_SUPPRESS) {
+            stats_.suppressed++;
+        } else {
+            stats_.reported++;
+            device->lastReportMs = nowMs;
+            device->reportedRssi = device->rssiMean();
+            device->reports++;
+        }
+        return report;
+    }
+
+    // Drop every device not seen for maxAgeMs; returns how many
+    size_t expire(uint32_t nowMs) {
+        size_t removed = 0;
+        for (size_t i = 0; i < Capacity; i++) {
+            // Backward shift can pull a later entry into slot i; re-check it
+            while (slots_[i].key != MAC_KEY_INVALID && nowMs - slots_[i].lastSeenMs > maxAgeMs_) {
+                removeAt(i);
+                removed++;
+            }
+        }
+        stats_.expired += removed;
+        return removed;
+    }
+
+private:
+    static constexpr size_t MASK = Capacity - 1;
+
+    static size_t home(uint64_t key) {
+        // Fibonacci hashing; the high bits of the product mix all 48 key bits
+        return (size_t)((key * 0x9E3779B97F4A7C15ULL) >> 32) & MASK;
+    }
+
+    // Slot holding key, or the free slot where it would go
+    size_t find(uint64_t key) const {
+        size_t i = home(key);
+        while (slots_[i].key != MAC_KEY_INVALID && slots_[i].key != key) i = (i + 1) & MASK;
+        return i;
+    }
+
+    static void reset(DeviceEntry& device, uint64_t key, int8_t rssi, uint32_t nowMs,
+                      const RssiFilterConfig& filter) {
+        device.key = key;
+        device.firstSeenMs = nowMs;
+        device.lastSeenMs = nowMs;
+        device.lastReportMs = nowMs;
+        device.sightings = 1;
+        device.reports = 0;
+        device.rssi.reset(rssi, filter);
+        device.rssiMax = rssi;
+        device.reportedRssi = rssi;
+    }
+
+    void makeRoom(uint32_t nowMs) {
+        if (expire(nowMs) > 0) return;
+        size_t oldest = 0;
+        for (size_t i = 1; i < Capacity; i++) {
+            if (slots_[i].key == MAC_KEY_INVALID) continue;
+            if (slots_[oldest].key == MAC_KEY_INVALID ||
+                (int32_t)(slots_[i].lastSeenMs - slots_[oldest].lastSeenMs) < 0) {
+                oldest = i;
+            }
+        }
+        removeAt(oldest);
+        stats_.evicted++;
+    }
+
+    // Backward-shift deletion: close the gap so later probes still find
+    // every entry whose home slot lies before it
+    void removeAt(size_t i) {
+        size_t j = i;
+        for (;;) {
+            j = (j + 1) & MASK;
+            if (slots_[j].key == MAC_KEY_INVALID) break;
+            size_t k = home(slots_[j].key);
+            bool stays = i <= j ? (i < k && k <= j) : (i < k || k <= j);
+            if (stays) continue;
+            slots_[i] = slots_[j];
+            i = j;
+        }
+        slots_[i].key = MAC_KEY_INVALID;
+        count_--;
+    }
+
+    DeviceEntry slots_[Capacity];
+    size_t count_ = 0;
+    uint32_t maxAgeMs_;
+    uint32_t refreshMs_;
+    uint8_t rssiDelta_;
+    RssiFilterConfig filter_;
+    DeviceCacheStats stats_ = {};
+};
+
+#endif // DEVICE_CACHE_H
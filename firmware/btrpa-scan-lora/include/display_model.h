@@ -0,0 +1,253 @@
+/**
+ * btrpa-scan-lora Display Model
+ *
+ * What the OLED shows, kept apart from the I2C transfer that shows it.
+ *
+ * Tasks that raise alerts post them to a DisplayMailbox: a struct copy
+ * under the caller's lock, no drawing, so a detection never waits for the
+ * bus. The mailbox holds one pending alert, the highest-ranked and newest
+ * (TRUE HIT over POSSIBLE HIT), and counts the others it folded in.
+ *
+ * The display task feeds the mailbox into an AlertView, which holds an
+ * alert on screen for its hold time and merges a burst into that screen
+ * ("+N"). A lower-ranked alert never replaces a higher one still on
+ * screen.
+ *
+ * Each screen is up to four text lines. TileRenderer compares the new
+ * lines with those on the panel and redraws only the 8-pixel tile rows
+ * they cover: clear those rows in the frame buffer, draw the lines that
+ * touch them, then send each run of rows with updateDisplayArea(). A
+ * scanning frame where only the counters moved costs a few rows instead
+ * of the whole 1 KB buffer. Templated on the display so any U8g2
+ * full-buffer constructor works; not thread-safe (the display task owns
+ * it). Fixed storage, no heap.
+ */
+
+#ifndef DISPLAY_MODEL_H
+#define DISPLAY_MODEL_H
+
+#include <stdint.h>
+#include <string.h>
+
+enum DisplayAlertKind : uint8_t {
+    DISPLAY_ALERT_NONE = 0,
+    DISPLAY_ALERT_POSSIBLE_HIT,
+    DISPLAY_ALERT_TRUE_HIT,
+};
+
+struct DisplayAlert {
+    uint8_t kind;               // DisplayAlertKind, also the rank
+    int16_t rssi;
+    uint32_t atMs;
+    char mac[18];
+    char detail[24];            // device type (POSSIBLE HIT)
+};
+
+// Filled by the alerting tasks, emptied by the display task. The caller
+// provides the lock.
+class DisplayMailbox {
+public:
+    void post(const DisplayAlert& alert) {
+        if (pending_.kind != DISPLAY_ALERT_NONE) {
+            merged_++;
+            if (alert.kind < pending_.kind) return;
+        }
+        pending_ = alert;
+    }
+
+    // The pending alert and how many more were folded into it
+    bool take(DisplayAlert& alert, uint32_t& merged) {
+        if (pending_.kind == DISPLAY_ALERT_NONE) return false;
+        alert = pending_;
+        merged = merged_;
+        pending_.kind = DISPLAY_ALERT_NONE;
+        merged_ = 0;
+        return true;
+    }
+
+private:
+    DisplayAlert pending_ = {};
+    uint32_t merged_ = 0;
+};
+
+struct AlertViewStats {
+    uint32_t alerts;            // offered, including merged ones
+    uint32_t screens;           // alerts that got a screen of their own
+};
+
+class AlertView {
+public:
+    AlertView(uint16_t trueHitHoldMs, uint16_t possibleHitHoldMs)
+        : trueHitHoldMs_(trueHitHoldMs), possibleHitHoldMs_(possibleHitHoldMs) {}
+
+    // merged: further alerts the mailbox folded into this one
+    void offer(const DisplayAlert& alert, uint32_t merged, uint32_t nowMs) {
+        bool onScreen = showing(nowMs);
+        stats_.alerts += 1 + merged;
+        if (onScreen && alert.kind < shown_.kind) {
+            more_ += 1 + merged;
+            return;
+        }
+        more_ = onScreen ? more_ + 1 + merged : merged;
+        shown_ = alert;
+        untilMs_ = nowMs + (alert.kind == DISPLAY_ALERT_TRUE_HIT ? trueHitHoldMs_ : possibleHitHoldMs_);
+        stats_.screens++;
+    }
+
+    bool showing(uint32_t nowMs) const {
+        return shown_.kind != DISPLAY_ALERT_NONE && (int32_t)(untilMs_ - nowMs) > 0;
+    }
+
+    uint32_t msLeft(uint32_t nowMs) const { return showing(nowMs) ? untilMs_ - nowMs : 0; }
+
+    const DisplayAlert& shown() const { return shown_; }
+    uint32_t more() const { return more_; }
+    const AlertViewStats& stats() const { return stats_; }
+
+private:
+    uint16_t trueHitHoldMs_;
+    uint16_t possibleHitHoldMs_;
+    DisplayAlert shown_ = {};
+    uint32_t untilMs_ = 0;
+    uint32_t more_ = 0;
+    AlertViewStats stats_ = {};
+};
+
+// One line of text at a baseline
+struct DisplayLine {
+    const uint8_t* font;
+    uint8_t x;
+    uint8_t y;
+    char text[22];
+};
+
+struct DisplayScreen {
+    static constexpr uint8_t MAX_LINES = 4;
+    DisplayLine lines[MAX_LINES];
+    uint8_t count;
+
+    DisplayLine& add(const uint8_t* font, uint8_t x, uint8_t y) {
+        DisplayLine& line = lines[count < MAX_LINES ? count++ : MAX_LINES - 1];
+        line.font = font;
+        line.x = x;
+        line.y = y;
+        line.text[0] = '\0';
+        return line;
+    }
+};
+
+struct TileRendererStats {
+    uint32_t frames;            // frames that sent anything
+    uint32_t fullFrames;        // whole buffer sent
+    uint32_t tileRows;          // 8-pixel rows sent, full frames included
+    uint32_t unchanged;         // frames skipped: nothing changed
+};
+
+template <typename Display>
+class TileRenderer {
+public:
+    static constexpr uint8_t TILE_ROWS = 8;     // 64 pixels
+    static constexpr uint8_t TILE_COLS = 16;    // 128 pixels
+
+    explicit TileRenderer(Display& display) : display_(display) {}
+
+    // Whatever is on the panel is unknown: the next frame is sent whole
+    void invalidate() { valid_ = false; }
+
+    // Draw next into the frame buffer where it differs from the panel.
+    // Returns the tile rows to send as a bit mask (bit n = row n).
+    uint8_t prepare(const DisplayScreen& next) {
+        uint8_t dirty = 0;
+        if (!valid_) {
+            dirty = 0xFF;
+        } else {
+            uint8_t lines = next.count > shown_.count ? next.count : shown_.count;
+            for (uint8_t i = 0; i < lines; i++) {
+                bool before = i < shown_.count, after = i < next.count;
+                if (before && after && sameLine(shown_.lines[i], next.lines[i])) continue;
+                if (before) dirty |= rowsOf(shown_.lines[i]);
+                if (after) dirty |= rowsOf(next.lines[i]);
+            }
+        }
+        if (dirty == 0) {
+            stats_.unchanged++;
+            return 0;
+        }
+
+        if (dirty == 0xFF) {
+            display_.clearBuffer();
+        } else {
+            display_.setDrawColor(0);
+            forEachRun(dirty, [this](uint8_t row, uint8_t rows) {
+                display_.drawBox(0, row * 8, TILE_COLS * 8, rows * 8);
+            });
+            display_.setDrawColor(1);
+        }
+        // Unchanged lines that share a cleared row are drawn again too
+        for (uint8_t i = 0; i < next.count; i++) {
+            if ((rowsOf(next.lines[i]) & dirty) == 0) continue;
+            display_.setFont(next.lines[i].font);
+            display_.drawStr(next.lines[i].x, next.lines[i].y, next.lines[i].text);
+        }
+        shown_ = next;
+        valid_ = true;
+        return dirty;
+    }
+
+    // Send the rows prepare() returned
+    void flush(uint8_t dirty) {
+        if (dirty == 0) return;
+        stats_.frames++;
+        if (dirty == 0xFF) {
+            stats_.fullFrames++;
+            stats_.tileRows += TILE_ROWS;
+            display_.sendBuffer();
+            return;
+        }
+        forEachRun(dirty, [this](uint8_t row, uint8_t rows) {
+            stats_.tileRows += rows;
+            display_.updateDisplayArea(0, row, TILE_COLS, rows);
+        });
+    }
+
+    const TileRendererStats& stats() const { return stats_; }
+
+private:
+    static bool sameLine(const DisplayLine& a, const DisplayLine& b) {
+        return a.font == b.font && a.x == b.x && a.y == b.y && strcmp(a.text, b.text) == 0;
+    }
+
+    // Tile rows a line's glyphs can reach, from the font's ascent above
+    // and descent below the baseline
+    uint8_t rowsOf(const DisplayLine& line) {
+        display_.setFont(line.font);
+        int top = line.y - display_.getAscent();
+        int bottom = line.y - display_.getDescent();     // descent is negative
+        if (top < 0) top = 0;
+        if (bottom > TILE_ROWS * 8 - 1) bottom = TILE_ROWS * 8 - 1;
+        uint8_t rows = 0;
+        for (int row = top / 8; row <= bottom / 8; row++) rows |= (uint8_t)(1u << row);
+        return rows;
+    }
+
+    template <typename F>
+    static void forEachRun(uint8_t mask, F send) {
+        for (uint8_t row = 0; row < TILE_ROWS;) {
+            if (!(mask & (1u << row))) {
+                row++;
+                continue;
+            }
+            uint8_t end = row;
+            while (end < TILE_ROWS && (mask & (1u << end))) end++;
+            send(row, (uint8_t)(end - row));
+            row = end;
+        }
+    }
+
+    Display& display_;
+    DisplayScreen shown_ = {};
+    bool valid_ = false;
+    TileRendererStats stats_ = {};
+};
+
+#endif // DISPLAY_MODEL_H
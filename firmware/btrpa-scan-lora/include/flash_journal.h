@@ -0,0 +1,441 @@
+/**
+ * btrpa-scan-lora Flash Journal
+ *
+ * Append-only log of the node's own detections in a raw flash partition,
+ * so a hit that never reached the homebase (out of range, frame lost,
+ * power cut) is kept and can be sent again or read out over USB.
+ *
+ * The partition is a ring of 4 KB erase sectors written strictly in
+ * order, so every sector is erased once per lap and wear is even. Each
+ * sector starts with a 32-byte header (magic, sector sequence number,
+ * CRC) followed by 127 fixed 32-byte records:
+ *
+ *   Offset  Size  Field
+ *   0       2     boot number
+ *   2       1     MessageType | 0x80 if a position follows
+ *   3       1     device type (WIRE_NO_DEVICE for a TRUE HIT)
+ *   4       4     detection time, uptime in ms in that boot
+ *   8       4     UTC from GPS, Unix seconds (0 = unknown)
+ *   12      6     MAC address, most significant byte first
+ *   18      1     RSSI (dBm, int8)
+ *   19      1     state: 0xFF pending, 0x00 acknowledged
+ *   20      8     latitude, longitude as int32 degrees x 1e7
+ *   28      1     range byte (WireRecord::range), 0 = none
+ *   29      1     reserved, 0
+ *   30      2     CRC-16 over bytes 0-29, state read as 0xFF
+ *
+ * All fields are little-endian. A record is identified by its place in
+ * the ring: sector sequence x 127 + slot, which only grows. The state
+ * byte is the only field written twice: flash bits can go from 1 to 0
+ * without an erase, so an acknowledgement costs a one-byte write and
+ * leaves the CRC valid.
+ *
+ * Records are buffered in RAM and written in batches (one 256-byte page
+ * holds 8), since every flash write or erase stalls both cores' caches
+ * for its duration. What is still buffered when power is cut is lost.
+ *
+ * After a reset, begin() finds the newest sector from the headers and
+ * reads every record back: records whose CRC fails (a write cut short)
+ * are skipped, writing resumes after the last one used, and the boot
+ * number moves on. Opening a sector erases the oldest one, and any of its
+ * records never acknowledged are counted as lost.
+ *
+ * Flash must provide read/write/erase(offset, ...) and size(); main.cpp
+ * wraps an ESP-IDF partition. Not thread-safe: one task owns the journal.
+ * Fixed storage, no heap.
+ */
+
+#ifndef FLASH_JOURNAL_H
+#define FLASH_JOURNAL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "wire_format.h"
+
+struct JournalRecord {
+    uint16_t boot;
+    uint8_t type;           // MSG_TRUE_HIT or MSG_POSSIBLE_HIT
+    uint8_t deviceIndex;
+    uint32_t uptimeMs;
+    uint32_t utc;           // 0 = unknown
+    uint64_t mac;
+    int8_t rssi;
+    uint8_t range;          // as WireRecord::range
+    bool hasPosition;
+    bool acked;
+    int32_t latE7;
+    int32_t lonE7;
+};
+
+struct JournalStats {
+    uint32_t appended;      // records added this boot
+    uint32_t writes;        // flash writes of record batches
+    uint32_t acked;         // records acknowledged this boot
+    uint32_t lost;          // unacknowledged records erased by the ring
+    uint32_t erases;        // sectors opened
+    uint32_t recovered;     // valid records found by begin()
+    uint32_t torn;          // records begin() skipped for a bad CRC
+    uint32_t failures;      // flash operations that returned an error
+};
+
+template <typename Flash, size_t BatchCapacity>
+class FlashJournal {
+public:
+    static constexpr uint32_t SECTOR_BYTES = 4096;
+    static constexpr uint32_t SLOT_BYTES = 32;
+    static constexpr uint32_t RECORDS_PER_SECTOR = SECTOR_BYTES / SLOT_BYTES - 1;
+    static constexpr uint32_t MAGIC = 0x4A525442;   // "BTRJ"
+
+    explicit FlashJournal(Flash& flash) : flash_(flash) {}
+
+    // Recover the ring; false if the partition is too small to use
+    bool begin() {
+        sectors_ = flash_.size() / SECTOR_BYTES;
+        if (sectors_ < 2) return false;
+
+        uint32_t head = 0, tail = 0;
+        for (uint32_t i = 0; i < sectors_; i++) {
+            uint32_t sequence = readHeader(i);
+            if (sequence == 0) continue;
+            if (head == 0 || sequence > head) head = sequence;
+            if (tail == 0 || sequence < tail) tail = sequence;
+        }
+        if (head == 0) {
+            // Blank or foreign partition: start at sector sequence 1
+            nextId_ = RECORDS_PER_SECTOR;
+            oldestId_ = oldestPending_ = nextId_;
+            boot_ = 1;
+            return true;
+        }
+        if (tail + sectors_ <= head) tail = head - sectors_ + 1;
+
+        uint16_t lastBoot = 0;
+        bool anyPending = false;
+        uint32_t headSlots = 0;      // slots used in the newest sector
+        uint8_t page[SLOT_BYTES * 8];
+        for (uint32_t sequence = tail; sequence <= head; sequence++) {
+            if (readHeader(sequence % sectors_) != sequence) continue;
+            uint32_t base = (sequence % sectors_) * SECTOR_BYTES;
+            for (uint32_t slot = 1; slot <= RECORDS_PER_SECTOR; slot += 8) {
+                uint32_t n = RECORDS_PER_SECTOR + 1 - slot < 8 ? RECORDS_PER_SECTOR + 1 - slot : 8;
+                if (!flash_.read(base + slot * SLOT_BYTES, page, n * SLOT_BYTES)) {
+                    stats_.failures++;
+                    continue;
+                }
+                for (uint32_t k = 0; k < n; k++) {
+                    const uint8_t* p = page + k * SLOT_BYTES;
+                    if (blank(p)) continue;
+                    if (sequence == head) headSlots = slot + k;
+                    JournalRecord record;
+                    if (!decode(p, record)) {
+                        stats_.torn++;
+                        continue;
+                    }
+                    stats_.recovered++;
+                    if (record.boot > lastBoot) lastBoot = record.boot;
+                    if (!record.acked) {
+                        if (!anyPending) oldestPending_ = idOf(sequence, slot + k);
+                        anyPending = true;
+                        pending_++;
+                    }
+                }
+            }
+        }
+        nextId_ = headSlots < RECORDS_PER_SECTOR ? idOf(head, headSlots + 1) : idOf(head + 1, 1);
+        oldestId_ = idOf(tail, 1);
+        if (!anyPending) oldestPending_ = nextId_;
+        boot_ = (uint16_t)(lastBoot + 1);
+        return true;
+    }
+
+    uint16_t boot() const { return boot_; }
+    uint32_t sectors() const { return sectors_; }
+    uint32_t capacity() const { return sectors_ * RECORDS_PER_SECTOR; }
+    uint32_t pending() const { return pending_; }
+    size_t buffered() const { return batchCount_; }
+    const JournalStats& stats() const { return stats_; }
+
+    // Ids of the records still in the ring, oldest first: [oldestId, endId)
+    uint32_t oldestId() const { return oldestId_; }
+    uint32_t endId() const { return nextId_; }
+    uint32_t oldestPendingId() const { return oldestPending_; }
+
+    // Buffer a record; returns its id. A full buffer is written first.
+    uint32_t add(const JournalRecord& record, uint32_t nowMs) {
+        if (batchCount_ == BatchCapacity) flush();
+        if (batchCount_ == 0) batchSinceMs_ = nowMs;
+        batch_[batchCount_] = record;
+        batch_[batchCount_].acked = false;
+        batchCount_++;
+        pending_++;
+        stats_.appended++;
+        return nextId_++;
+    }
+
+    // Time the oldest buffered record has waited
+    uint32_t bufferedMs(uint32_t nowMs) const { return batchCount_ ? nowMs - batchSinceMs_ : 0; }
+
+    // Write the buffered records, opening sectors as needed
+    void flush() {
+        uint32_t id = nextId_ - (uint32_t)batchCount_;
+        size_t i = 0;
+        while (i < batchCount_) {
+            uint32_t sequence = id / RECORDS_PER_SECTOR;
+            uint32_t slot = id % RECORDS_PER_SECTOR + 1;
+            if (slot == 1) openSector(sequence);
+            size_t n = batchCount_ - i;
+            if (n > RECORDS_PER_SECTOR + 1 - slot) n = RECORDS_PER_SECTOR + 1 - slot;
+            for (size_t k = 0; k < n; k++) encode(batch_[i + k], buffer_ + k * SLOT_BYTES);
+            if (!flash_.write((sequence % sectors_) * SECTOR_BYTES + slot * SLOT_BYTES, buffer_, n * SLOT_BYTES)) {
+                stats_.failures++;
+            }
+            stats_.writes++;
+            i += n;
+            id += (uint32_t)n;
+        }
+        batchCount_ = 0;
+    }
+
+    // Mark a record delivered; false if it already was or has left the ring
+    bool ack(uint32_t id) {
+        uint32_t firstBuffered = nextId_ - (uint32_t)batchCount_;
+        if (id >= firstBuffered && id < nextId_) {
+            JournalRecord& record = batch_[id - firstBuffered];
+            if (record.acked) return false;
+            record.acked = true;
+        } else {
+            if (id < oldestId_ || id >= firstBuffered) return false;
+            uint32_t offset = stateOffset(id);
+            uint8_t state;
+            if (!flash_.read(offset, &state, 1) || state != 0xFF) return false;
+            state = 0;
+            if (!flash_.write(offset, &state, 1)) stats_.failures++;
+        }
+        pending_--;
+        stats_.acked++;
+        return true;
+    }
+
+    // Read one record, buffered or on flash; false if invalid or gone
+    bool read(uint32_t id, JournalRecord& out) {
+        uint32_t firstBuffered = nextId_ - (uint32_t)batchCount_;
+        if (id >= firstBuffered && id < nextId_) {
+            out = batch_[id - firstBuffered];
+            return true;
+        }
+        if (id < oldestId_ || id >= firstBuffered) return false;
+        uint8_t slot[SLOT_BYTES];
+        if (!flash_.read(stateOffset(id) - 19, slot, SLOT_BYTES)) {
+            stats_.failures++;
+            return false;
+        }
+        return !blank(slot) && decode(slot, out);
+    }
+
+    // Move oldestPendingId past acknowledged records, reading at most
+    // limit of them
+    void skipAcked(uint32_t limit) {
+        if (oldestPending_ < oldestId_) oldestPending_ = oldestId_;
+        JournalRecord record;
+        while (limit-- > 0 && oldestPending_ < nextId_) {
+            if (read(oldestPending_, record) && !record.acked) return;
+            oldestPending_++;
+        }
+    }
+
+private:
+    static uint32_t idOf(uint32_t sequence, uint32_t slot) { return sequence * RECORDS_PER_SECTOR + slot - 1; }
+
+    uint32_t stateOffset(uint32_t id) const {
+        return (id / RECORDS_PER_SECTOR % sectors_) * SECTOR_BYTES + (id % RECORDS_PER_SECTOR + 1) * SLOT_BYTES + 19;
+    }
+
+    static bool blank(const uint8_t* p) {
+        for (uint32_t i = 0; i < SLOT_BYTES; i++) {
+            if (p[i] != 0xFF) return false;
+        }
+        return true;
+    }
+
+    static uint16_t recordCrc(const uint8_t* p) {
+        uint8_t copy[30];
+        memcpy(copy, p, sizeof(copy));
+        copy[19] = 0xFF;
+        return wireCrc16(copy, sizeof(copy));
+    }
+
+    static void encode(const JournalRecord& record, uint8_t* p) {
+        wirePut16(p, record.boot);
+        p[2] = (uint8_t)(record.type | (record.hasPosition ? 0x80 : 0));
+        p[3] = record.deviceIndex;
+        wirePut32(p + 4, record.uptimeMs);
+        wirePut32(p + 8, record.utc);
+        for (int b = 0; b < 6; b++) p[12 + b] = (uint8_t)(record.mac >> (40 - 8 * b));
+        p[18] = (uint8_t)record.rssi;
+        p[19] = record.acked ? 0x00 : 0xFF;
+        wirePut32(p + 20, (uint32_t)record.latE7);
+        wirePut32(p + 24, (uint32_t)record.lonE7);
+        p[28] = record.range;
+        p[29] = 0;
+        wirePut16(p + 30, recordCrc(p));
+    }
+
+    static bool decode(const uint8_t* p, JournalRecord& record) {
+        if (wireGet16(p + 30) != recordCrc(p)) return false;
+        record.boot = wireGet16(p);
+        record.type = p[2] & 0x7F;
+        record.hasPosition = (p[2] & 0x80) != 0;
+        record.deviceIndex = p[3];
+        record.uptimeMs = wireGet32(p + 4);
+        record.utc = wireGet32(p + 8);
+        record.mac = 0;
+        for (int b = 0; b < 6; b++) record.mac = (record.mac << 8) | p[12 + b];
+        record.rssi = (int8_t)p[18];
+        record.acked = p[19] != 0xFF;
+        record.latE7 = (int32_t)wireGet32(p + 20);
+        record.lonE7 = (int32_t)wireGet32(p + 24);
+        record.range = p[28];
+        return true;
+    }
+
+    // Sector sequence number from a valid header in sector index, else 0
+    uint32_t readHeader(uint32_t index) {
+        uint8_t header[SLOT_BYTES];
+        if (!flash_.read(index * SECTOR_BYTES, header, sizeof(header))) {
+            stats_.failures++;
+            return 0;
+        }
+        if (wireGet32(header) != MAGIC || wireGet16(header + 30) != wireCrc16(header, 30)) return 0;
+        uint32_t sequence = wireGet32(header + 4);
+        return sequence % sectors_ == index ? sequence : 0;
+    }
+
+    // Erase the sector that will hold sequence and write its header,
+    // counting what it held that was never acknowledged
+    void openSector(uint32_t sequence) {
+        uint32_t index = sequence % sectors_;
+        uint32_t base = index * SECTOR_BYTES;
+        if (sequence >= sectors_ && readHeader(index) == sequence - sectors_) {
+            uint8_t page[SLOT_BYTES * 8];
+            for (uint32_t slot = 1; slot <= RECORDS_PER_SECTOR; slot += 8) {
+                uint32_t n = RECORDS_PER_SECTOR + 1 - slot < 8 ? RECORDS_PER_SECTOR + 1 - slot : 8;
+                if (!flash_.read(base + slot * SLOT_BYTES, page, n * SLOT_BYTES)) continue;
+                for (uint32_t k = 0; k < n; k++) {
+                    JournalRecord record;
+                    const uint8_t* p = page + k * SLOT_BYTES;
+                    if (!blank(p) && decode(p, record) && !record.acked) {
+                        pending_--;
+                        stats_.lost++;
+                    }
+                }
+            }
+        }
+        uint32_t oldest = sequence >= sectors_ ? idOf(sequence - sectors_ + 1, 1) : 0;
+        if (oldest > oldestId_) oldestId_ = oldest;
+        if (oldestPending_ < oldestId_) oldestPending_ = oldestId_;
+
+        if (!flash_.erase(base, SECTOR_BYTES)) stats_.failures++;
+        stats_.erases++;
+        uint8_t header[SLOT_BYTES];
+        memset(header, 0, sizeof(header));
+        wirePut32(header, MAGIC);
+        wirePut32(header + 4, sequence);
+        wirePut16(header + 30, wireCrc16(header, 30));
+        if (!flash_.write(base, header, sizeof(header))) stats_.failures++;
+    }
+
+    Flash& flash_;
+    uint32_t sectors_ = 0;
+    uint32_t nextId_ = 0;           // id the next added record gets
+    uint32_t oldestId_ = 0;         // first id still on flash
+    uint32_t oldestPending_ = 0;    // no pending record before this id
+    uint32_t pending_ = 0;
+    uint16_t boot_ = 0;
+    JournalRecord batch_[BatchCapacity];
+    size_t batchCount_ = 0;
+    uint32_t batchSinceMs_ = 0;
+    uint8_t buffer_[BatchCapacity * SLOT_BYTES];
+    JournalStats stats_ = {};
+};
+
+// Journal records sent in frames not yet acknowledged, by sequence
+// number. An entry whose ack does not come within the timeout is dropped
+// and its records become due for replay.
+template <size_t Capacity>
+class JournalInFlight {
+public:
+    struct Frame {
+        uint8_t sequence;
+        uint8_t count;
+        bool replayed;
+        uint32_t sentMs;
+        uint32_t ids[WIRE_MAX_RECORDS];
+    };
+
+    void add(uint8_t sequence, const uint32_t* ids, uint8_t count, bool replayed, uint32_t nowMs) {
+        if (count_ == Capacity) remove(0);
+        Frame& frame = frames_[count_++];
+        frame.sequence = sequence;
+        frame.count = count;
+        frame.replayed = replayed;
+        frame.sentMs = nowMs;
+        memcpy(frame.ids, ids, count * sizeof(ids[0]));
+    }
+
+    // Take the frame with this sequence number; false if not waiting
+    bool acked(uint8_t sequence, Frame& out) {
+        for (size_t i = 0; i < count_; i++) {
+            if (frames_[i].sequence != sequence) continue;
+            out = frames_[i];
+            remove(i);
+            return true;
+        }
+        return false;
+    }
+
+    bool contains(uint32_t id) const {
+        for (size_t i = 0; i < count_; i++) {
+            for (uint8_t k = 0; k < frames_[i].count; k++) {
+                if (frames_[i].ids[k] == id) return true;
+            }
+        }
+        return false;
+    }
+
+    // Drop frames sent more than timeoutMs ago; returns how many
+    size_t expire(uint32_t nowMs, uint32_t timeoutMs) {
+        size_t expired = 0;
+        while (count_ > 0 && nowMs - frames_[0].sentMs >= timeoutMs) {
+            remove(0);
+            expired++;
+        }
+        return expired;
+    }
+
+    // Time until the oldest frame times out; UINT32_MAX if none
+    uint32_t msUntilExpiry(uint32_t nowMs, uint32_t timeoutMs) const {
+        if (count_ == 0) return UINT32_MAX;
+        uint32_t waited = nowMs - frames_[0].sentMs;
+        return waited >= timeoutMs ? 0 : timeoutMs - waited;
+    }
+
+    size_t replaysWaiting() const {
+        size_t n = 0;
+        for (size_t i = 0; i < count_; i++) n += frames_[i].replayed;
+        return n;
+    }
+
+private:
+    // Oldest first, so expiry only looks at the front
+    void remove(size_t i) {
+        for (size_t k = i + 1; k < count_; k++) frames_[k - 1] = frames_[k];
+        count_--;
+    }
+
+    Frame frames_[Capacity] = {};
+    size_t count_ = 0;
+};
+
+#endif // FLASH_JOURNAL_H
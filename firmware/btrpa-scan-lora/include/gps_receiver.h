@@ -0,0 +1,481 @@
+/**
+ * btrpa-scan-lora GPS Receiver
+ *
+ * Everything between the GPS module's UART and the tasks that want the
+ * node's position:
+ *
+ *   GpsCommands  UBX (u-blox) and PMTK (MediaTek, Quectel L76 and clones)
+ *                commands that cut the module's output to the two
+ *                sentences used here, set the fix rate and raise the baud
+ *                rate. A module ignores the other vendor's dialect, so
+ *                both can be sent when the module is unknown.
+ *   GpsParser    streaming parser fed from the UART buffer. Only GGA
+ *                (position, fix quality, satellites, HDOP) and RMC (date,
+ *                speed, course) are decoded, straight to fixed point;
+ *                other sentences are checksummed and skipped. UBX
+ *                ACK/NAK frames and PMTK001 replies are recognised too, so
+ *                the GPS task learns which dialect the module speaks.
+ *   GpsSnapshot  the latest fix, published by the GPS task and read by any
+ *                task without a lock (see below).
+ *
+ * Talker IDs are ignored ($GPGGA, $GNGGA, $GLGGA... all count as GGA).
+ * No floating point, no heap. The parser and commands are not thread-safe:
+ * the GPS task owns them.
+ */
+
+#ifndef GPS_RECEIVER_H
+#define GPS_RECEIVER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <atomic>
+
+// The node's position as the module last reported it
+struct GpsFix {
+    int32_t latE7;            // degrees x 1e7
+    int32_t lonE7;
+    uint32_t fixMs;           // millis() of the sentence that carried the position; 0 = never
+    uint32_t utc;             // Unix time of the last RMC; 0 without a plausible date
+    uint16_t hdopCenti;       // HDOP x 100; 0 = unknown
+    uint16_t speedCmS;        // speed over ground, cm/s
+    uint16_t courseCentiDeg;  // course over ground, degrees x 100 from north
+    uint8_t quality;          // GGA fix quality; 0 = no fix
+    uint8_t satellites;
+
+    bool valid() const { return fixMs != 0 && quality != 0; }
+    uint32_t ageMs(uint32_t nowMs) const { return nowMs - fixMs; }
+};
+
+// ============================================================================
+// Parser
+// ============================================================================
+
+enum GpsMessage : uint8_t {
+    GPS_NONE,          // mid-sentence, or a sentence not used here
+    GPS_GGA,
+    GPS_RMC,
+    GPS_UBX_ACK,       // u-blox accepted a command
+    GPS_UBX_NAK,
+    GPS_PMTK_ACK,      // PMTK001 with "action succeeded"
+    GPS_PMTK_NAK,
+};
+
+struct GpsParserStats {
+    uint32_t sentences;       // checksummed NMEA sentences
+    uint32_t checksumErrors;
+    uint32_t skipped;         // valid sentences other than GGA, RMC and PMTK001
+    uint32_t overlong;        // longer than NMEA's 82 characters
+    uint32_t ubxFrames;
+};
+
+// Days since 1970-01-01 of a Gregorian date
+constexpr int32_t gpsDaysFromCivil(int32_t year, uint32_t month, uint32_t day) {
+    year -= month <= 2;
+    int32_t era = (year >= 0 ? year : year - 399) / 400;
+    uint32_t yoe = (uint32_t)(year - era * 400);
+    uint32_t doy = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+    uint32_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + (int32_t)doe - 719468;
+}
+
+class GpsParser {
+public:
+    const GpsParserStats& stats() const { return stats_; }
+
+    // The command a UBX ACK/NAK or PMTK001 reply answered (UBX: class << 8 | id)
+    uint16_t ackedCommand() const { return acked_; }
+
+    // Feed one byte. GGA and RMC update fix (all but fixMs, which the
+    // caller stamps when fix.quality says the position is valid).
+    GpsMessage feed(uint8_t c, GpsFix& fix) {
+        if (ubxLength_ > 0) return feedUbx(c);
+        if (c == '$') {
+            length_ = 0;
+            inSentence_ = true;
+            return GPS_NONE;
+        }
+        if (!inSentence_) {
+            if (c == 0xB5) ubxLength_ = 1;
+            return GPS_NONE;
+        }
+        if (c == '\r' || c == '\n') {
+            inSentence_ = false;
+            return finish(fix);
+        }
+        if (length_ == sizeof(line_) - 1) {
+            inSentence_ = false;
+            stats_.overlong++;
+            return GPS_NONE;
+        }
+        line_[length_++] = (char)c;
+        return GPS_NONE;
+    }
+
+private:
+    // One comma-separated field at a time
+    struct Fields {
+        const char* p;
+        const char* end;
+
+        // The next field; empty at the end of the sentence
+        bool next(const char*& start, size_t& length) {
+            if (p > end) {
+                start = end;
+                length = 0;
+                return false;
+            }
+            start = p;
+            while (p < end && *p != ',') p++;
+            length = (size_t)(p - start);
+            p++;
+            return true;
+        }
+    };
+
+    static int hexDigit(char c) {
+        if (c >= '0' && c <= '9') return c - '0';
+        if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+        if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+        return -1;
+    }
+
+    // Digits before and after the point, the fraction scaled to 10^decimals
+    static bool parseFixed(const char* s, size_t length, uint8_t decimals, uint64_t& value) {
+        if (length == 0 || length > 15) return false;
+        uint64_t whole = 0, fraction = 0;
+        uint8_t fractionDigits = 0;
+        bool point = false;
+        for (size_t i = 0; i < length; i++) {
+            char c = s[i];
+            if (c == '.' && !point) {
+                point = true;
+            } else if (c < '0' || c > '9') {
+                return false;
+            } else if (!point) {
+                whole = whole * 10 + (uint64_t)(c - '0');
+            } else if (fractionDigits < decimals) {
+                fraction = fraction * 10 + (uint64_t)(c - '0');
+                fractionDigits++;
+            }
+        }
+        for (; fractionDigits < decimals; fractionDigits++) fraction *= 10;
+        uint64_t scale = 1;
+        for (uint8_t i = 0; i < decimals; i++) scale *= 10;
+        value = whole * scale + fraction;
+        return true;
+    }
+
+    // "ddmm.mmmmm" (lat) or "dddmm.mmmmm" (lon) and its hemisphere
+    static bool parseCoordinate(const char* s, size_t length, const char* hemisphere, size_t hemisphereLength,
+                                int32_t& e7) {
+        uint64_t value64;
+        if (hemisphereLength != 1 || !parseFixed(s, length, 6, value64)) return false;
+        uint32_t degrees = (uint32_t)(value64 / 100000000);
+        uint32_t minutesE6 = (uint32_t)(value64 - (uint64_t)degrees * 100000000);
+        if (degrees > 180 || minutesE6 >= 60000000) return false;
+        // minutes x 1e6 -> degrees x 1e7 is x 10 / 60
+        int32_t value = (int32_t)(degrees * 10000000 + (minutesE6 + 3) / 6);
+        char h = hemisphere[0];
+        if (h == 'S' || h == 'W') value = -value;
+        else if (h != 'N' && h != 'E') return false;
+        e7 = value;
+        return true;
+    }
+
+    GpsMessage finish(GpsFix& fix) {
+        // "<address>,<fields>*hh"
+        if (length_ < 9 || line_[length_ - 3] != '*') return GPS_NONE;
+        int hi = hexDigit(line_[length_ - 2]), lo = hexDigit(line_[length_ - 1]);
+        uint8_t checksum = 0;
+        for (size_t i = 0; i < length_ - 3; i++) checksum ^= (uint8_t)line_[i];
+        if (hi < 0 || lo < 0 || checksum != (uint8_t)(hi << 4 | lo)) {
+            stats_.checksumErrors++;
+            return GPS_NONE;
+        }
+        stats_.sentences++;
+
+        Fields fields = {line_, line_ + length_ - 3};
+        const char* address;
+        size_t addressLength;
+        fields.next(address, addressLength);
+        if (addressLength == 7 && memcmp(address, "PMTK001", 7) == 0) return pmtkAck(fields);
+        if (addressLength != 5) {
+            stats_.skipped++;
+            return GPS_NONE;
+        }
+        if (memcmp(address + 2, "GGA", 3) == 0) return gga(fields, fix);
+        if (memcmp(address + 2, "RMC", 3) == 0) return rmc(fields, fix);
+        stats_.skipped++;
+        return GPS_NONE;
+    }
+
+    // $xxGGA,hhmmss.ss,lat,N,lon,E,quality,satellites,hdop,altitude,M,...
+    GpsMessage gga(Fields& fields, GpsFix& fix) {
+        const char* f[9];
+        size_t n[9];
+        for (int i = 0; i < 9; i++) fields.next(f[i], n[i]);
+        uint64_t quality = 0, satellites = 0, hdop = 0;
+        parseFixed(f[5], n[5], 0, quality);
+        int32_t lat, lon;
+        if (quality == 0 || !parseCoordinate(f[1], n[1], f[2], n[2], lat) ||
+            !parseCoordinate(f[3], n[3], f[4], n[4], lon)) {
+            fix.quality = 0;
+            return GPS_GGA;
+        }
+        fix.latE7 = lat;
+        fix.lonE7 = lon;
+        fix.quality = (uint8_t)(quality > 255 ? 255 : quality);
+        if (parseFixed(f[6], n[6], 0, satellites)) fix.satellites = (uint8_t)(satellites > 255 ? 255 : satellites);
+        fix.hdopCenti = parseFixed(f[7], n[7], 2, hdop) && hdop < 0xFFFF ? (uint16_t)hdop : 0;
+        return GPS_GGA;
+    }
+
+    // $xxRMC,hhmmss.ss,A,lat,N,lon,E,knots,course,ddmmyy,...
+    GpsMessage rmc(Fields& fields, GpsFix& fix) {
+        const char* f[9];
+        size_t n[9];
+        for (int i = 0; i < 9; i++) fields.next(f[i], n[i]);
+
+        // Receivers report 1980 or 2000 dates until they have the almanac
+        uint64_t time, date;
+        fix.utc = 0;
+        if (n[0] >= 6 && n[8] == 6 && parseFixed(f[0], 6, 0, time) && parseFixed(f[8], 6, 0, date) &&
+            date % 100 >= 24) {
+            uint32_t day = (uint32_t)(date / 10000), month = (uint32_t)(date / 100 % 100);
+            if (day >= 1 && day <= 31 && month >= 1 && month <= 12) {
+                fix.utc = (uint32_t)gpsDaysFromCivil((int32_t)(2000 + date % 100), month, day) * 86400 +
+                          (uint32_t)(time / 10000 * 3600 + time / 100 % 100 * 60 + time % 100);
+            }
+        }
+
+        int32_t lat, lon;
+        if (n[1] != 1 || f[1][0] != 'A' || !parseCoordinate(f[2], n[2], f[3], n[3], lat) ||
+            !parseCoordinate(f[4], n[4], f[5], n[5], lon)) {
+            fix.quality = 0;
+            return GPS_RMC;
+        }
+        fix.latE7 = lat;
+        fix.lonE7 = lon;
+        if (fix.quality == 0) fix.quality = 1;   // until a GGA says more
+
+        uint64_t milliKnots = 0, course = 0;
+        parseFixed(f[6], n[6], 3, milliKnots);
+        uint64_t speed = (milliKnots * 5144 + 50000) / 100000;   // 1 kn = 51.44 cm/s
+        fix.speedCmS = (uint16_t)(speed > 0xFFFF ? 0xFFFF : speed);
+        if (parseFixed(f[7], n[7], 2, course) && course < 36000) fix.courseCentiDeg = (uint16_t)course;
+        return GPS_RMC;
+    }
+
+    // $PMTK001,command,flag: 3 = succeeded, 0-2 invalid/unsupported/failed
+    GpsMessage pmtkAck(Fields& fields) {
+        const char* f[2];
+        size_t n[2];
+        for (int i = 0; i < 2; i++) fields.next(f[i], n[i]);
+        uint64_t command = 0, flag = 0;
+        parseFixed(f[0], n[0], 0, command);
+        parseFixed(f[1], n[1], 0, flag);
+        acked_ = (uint16_t)command;
+        return flag == 3 ? GPS_PMTK_ACK : GPS_PMTK_NAK;
+    }
+
+    // B5 62 class id length(2) payload checksum(2); only ACK-ACK (05 01)
+    // and ACK-NAK (05 00) are decoded, the rest skipped
+    GpsMessage feedUbx(uint8_t c) {
+        uint16_t position = ubxLength_++;
+        if (position == 1 && c != 0x62) {
+            ubxLength_ = 0;
+            return GPS_NONE;
+        }
+        if (position < sizeof(ubx_)) ubx_[position] = c;
+        if (position < 6) return GPS_NONE;
+        uint16_t payload = (uint16_t)(ubx_[4] | ubx_[5] << 8);
+        if (payload > UBX_MAX_PAYLOAD) {
+            // Not a frame: 0xB5 in line noise
+            ubxLength_ = 0;
+            return GPS_NONE;
+        }
+        if (position < 6u + payload + 1) return GPS_NONE;
+        ubxLength_ = 0;
+        stats_.ubxFrames++;
+        if (ubx_[2] != 0x05 || payload != 2) return GPS_NONE;
+        uint8_t a = 0, b = 0;
+        for (int i = 2; i < 8; i++) {
+            a += ubx_[i];
+            b += a;
+        }
+        if (a != ubx_[8] || b != ubx_[9]) return GPS_NONE;
+        acked_ = (uint16_t)(ubx_[6] << 8 | ubx_[7]);
+        return ubx_[3] == 0x01 ? GPS_UBX_ACK : GPS_UBX_NAK;
+    }
+
+    static constexpr uint16_t UBX_MAX_PAYLOAD = 512;
+
+    char line_[83];           // NMEA's 82 characters less the '$', plus one
+    size_t length_ = 0;
+    bool inSentence_ = false;
+    uint8_t ubx_[10];
+    uint16_t ubxLength_ = 0;
+    uint16_t acked_ = 0;
+    GpsParserStats stats_ = {};
+};
+
+// ============================================================================
+// Module commands
+// ============================================================================
+
+constexpr uint16_t UBX_CFG_PRT = 0x0600;
+constexpr uint16_t UBX_CFG_MSG = 0x0601;
+constexpr uint16_t UBX_CFG_RATE = 0x0608;
+constexpr uint16_t PMTK_SET_BAUD = 251;
+constexpr uint16_t PMTK_SET_FIX_INTERVAL = 220;
+constexpr uint16_t PMTK_SET_NMEA_OUTPUT = 314;
+
+// Room for the longest sequence below
+constexpr size_t GPS_COMMAND_BYTES = 128;
+
+class GpsCommands {
+public:
+    // u-blox: GGA and RMC once per fix, GLL/GSA/GSV/VTG off, one fix
+    // every rateMs. Not saved to the module's flash: sent at every boot.
+    static size_t ubxConfigure(uint8_t* out, uint16_t rateMs) {
+        static const uint8_t NMEA_RATES[][2] = {
+            {0x00, 1},   // GGA
+            {0x01, 0},   // GLL
+            {0x02, 0},   // GSA
+            {0x03, 0},   // GSV
+            {0x04, 1},   // RMC
+            {0x05, 0},   // VTG
+        };
+        size_t length = 0;
+        for (const auto& rate : NMEA_RATES) {
+            const uint8_t payload[3] = {0xF0, rate[0], rate[1]};
+            length += ubxFrame(out + length, UBX_CFG_MSG, payload, sizeof(payload));
+        }
+        // measRate, navRate 1, timeRef GPS
+        const uint8_t payload[6] = {(uint8_t)rateMs, (uint8_t)(rateMs >> 8), 1, 0, 1, 0};
+        return length + ubxFrame(out + length, UBX_CFG_RATE, payload, sizeof(payload));
+    }
+
+    // u-blox: UART1 at baud, 8N1, UBX + NMEA in and out
+    static size_t ubxBaud(uint8_t* out, uint32_t baud) {
+        uint8_t payload[20] = {1, 0, 0, 0, 0xD0, 0x08, 0, 0};
+        for (int i = 0; i < 4; i++) payload[8 + i] = (uint8_t)(baud >> (8 * i));
+        payload[12] = 0x03;
+        payload[14] = 0x03;
+        return ubxFrame(out, UBX_CFG_PRT, payload, sizeof(payload));
+    }
+
+    // MediaTek: GGA and RMC every fix, one fix every rateMs (100 ms at most)
+    static size_t pmtkConfigure(char* out, uint16_t rateMs) {
+        size_t length = nmeaSentence(out, "PMTK314,0,1,0,1,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0");
+        char body[16] = "PMTK220,";
+        formatNumber(body + 8, rateMs);
+        return length + nmeaSentence(out + length, body);
+    }
+
+    static size_t pmtkBaud(char* out, uint32_t baud) {
+        char body[20] = "PMTK251,";
+        formatNumber(body + 8, baud);
+        return nmeaSentence(out, body);
+    }
+
+    // "$<body>*hh\r\n"
+    static size_t nmeaSentence(char* out, const char* body) {
+        static const char HEX_DIGITS[] = "0123456789ABCDEF";
+        size_t length = 0;
+        uint8_t checksum = 0;
+        out[length++] = '$';
+        for (const char* p = body; *p; p++) {
+            out[length++] = *p;
+            checksum ^= (uint8_t)*p;
+        }
+        out[length++] = '*';
+        out[length++] = HEX_DIGITS[checksum >> 4];
+        out[length++] = HEX_DIGITS[checksum & 0x0F];
+        out[length++] = '\r';
+        out[length++] = '\n';
+        out[length] = '\0';
+        return length;
+    }
+
+    // Sync chars, class, id, length, payload, 8-bit Fletcher checksum over
+    // class to payload
+    static size_t ubxFrame(uint8_t* out, uint16_t command, const uint8_t* payload, uint16_t payloadLength) {
+        out[0] = 0xB5;
+        out[1] = 0x62;
+        out[2] = (uint8_t)(command >> 8);
+        out[3] = (uint8_t)command;
+        out[4] = (uint8_t)payloadLength;
+        out[5] = (uint8_t)(payloadLength >> 8);
+        memcpy(out + 6, payload, payloadLength);
+        uint8_t a = 0, b = 0;
+        for (size_t i = 2; i < 6u + payloadLength; i++) {
+            a += out[i];
+            b += a;
+        }
+        out[6 + payloadLength] = a;
+        out[7 + payloadLength] = b;
+        return 8u + payloadLength;
+    }
+
+private:
+    static void formatNumber(char* out, uint32_t value) {
+        char digits[10];
+        int n = 0;
+        do {
+            digits[n++] = (char)('0' + value % 10);
+            value /= 10;
+        } while (value > 0);
+        while (n > 0) *out++ = digits[--n];
+        *out = '\0';
+    }
+};
+
+// ============================================================================
+// Snapshot
+// ============================================================================
+
+// The latest fix for any task, without a lock. One writer (the GPS task)
+// keeps two copies: it bumps the sequence, rewrites copy 0, bumps it again
+// and rewrites copy 1. A reader copies the one the sequence says is not
+// being written and retries only if the sequence moved meanwhile, so a
+// writer preempted mid-update never blocks a reader on its core. Holds
+// any small trivially copyable T.
+template <typename T = GpsFix>
+class GpsSnapshot {
+    static constexpr size_t WORDS = (sizeof(T) + 3) / 4;
+
+public:
+    void publish(const T& fix) {
+        uint32_t words[WORDS] = {};
+        memcpy(words, &fix, sizeof(fix));
+        for (int copy = 0; copy < 2; copy++) {
+            sequence_.fetch_add(1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+            for (size_t i = 0; i < WORDS; i++) copies_[copy][i].store(words[i], std::memory_order_relaxed);
+        }
+        std::atomic_thread_fence(std::memory_order_release);
+    }
+
+    T read() const {
+        uint32_t words[WORDS];
+        uint32_t sequence;
+        do {
+            sequence = sequence_.load(std::memory_order_acquire);
+            // Odd: copy 0 is being written
+            const std::atomic<uint32_t>* copy = copies_[sequence & 1 ? 1 : 0];
+            for (size_t i = 0; i < WORDS; i++) words[i] = copy[i].load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+        } while (sequence_.load(std::memory_order_relaxed) != sequence);
+        T fix;
+        memcpy(&fix, words, sizeof(fix));
+        return fix;
+    }
+
+private:
+    std::atomic<uint32_t> sequence_{0};
+    std::atomic<uint32_t> copies_[2][WORDS] = {};
+};
+
+#endif // GPS_RECEIVER_H
@@ -0,0 +1,214 @@
+/**
+ * btrpa-scan-lora RPA Resolver
+ *
+ * Phones and watches advertise from Resolvable Private Addresses that
+ * change every few minutes, so an exact MAC match finds them only until
+ * the first rotation. With the target's Identity Resolving Key (IRK) an
+ * RPA can be tied back to the device: the top 24 bits are prand (top two
+ * bits 01), the low 24 bits are ah(IRK, prand), the last three bytes of
+ * AES-128(IRK, 0^13 || prand) (Core Spec Vol 3 Part H, 2.2.2). This is
+ * the same check btrpa-scan.py makes.
+ *
+ * Keys are parsed and checked at compile time like the MAC table. AES
+ * runs through mbedtls, which the ESP32 Arduino core backs with the
+ * hardware AES accelerator; one context per key keeps the key schedule
+ * loaded. Each address is computed once: the verdict (which key, or
+ * none) goes into a 4-way set-associative cache of 8-byte entries, so a
+ * phone advertising at 10 Hz costs one pass over the keys per rotation.
+ * Public and static random addresses return before any lookup. Not
+ * thread-safe: the detection task owns the resolver. Fixed storage, no
+ * heap.
+ */
+
+#ifndef IRK_RESOLVER_H
+#define IRK_RESOLVER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <mbedtls/aes.h>
+
+#include "mac_table.h"
+
+struct TargetIrk {
+    const char* irk;        // 32 hex digits, most significant byte first
+    const char* label;      // shown in alerts
+};
+
+// "0123...ef", "01:23:...:ef" or "0x0123...ef", as btrpa-scan.py --irk
+// accepts; false if it is not exactly 16 bytes of hex
+constexpr bool parseIrk(const char* text, uint8_t (&out)[16]) {
+    const char* p = text;
+    if (p[0] == '0' && (p[1] == 'x' || p[1] == 'X')) p += 2;
+    int nibbles = 0;
+    for (; *p != '\0'; p++) {
+        if (*p == ':' || *p == '-' || *p == ' ') continue;
+        int n = macHexNibble(*p);
+        if (n < 0 || nibbles == 32) return false;
+        out[nibbles / 2] = (uint8_t)(nibbles % 2 == 0 ? n << 4 : out[nibbles / 2] | n);
+        nibbles++;
+    }
+    return nibbles == 32;
+}
+
+// An RPA: random address type, top two bits 01, and the 22 random bits
+// of prand neither all zeros nor all ones
+inline bool isResolvablePrivateAddress(uint64_t macKey, bool randomAddress) {
+    if (!randomAddress || (macKey >> 46) != 0x1) return false;
+    uint32_t random = (uint32_t)(macKey >> 24) & 0x3FFFFF;
+    return random != 0 && random != 0x3FFFFF;
+}
+
+// ah(): true if hash (low 24 bits of the address) matches prand (high 24)
+inline bool rpaHashMatches(mbedtls_aes_context* aes, uint64_t macKey) {
+    uint8_t block[16] = {};
+    block[13] = (uint8_t)(macKey >> 40);
+    block[14] = (uint8_t)(macKey >> 32);
+    block[15] = (uint8_t)(macKey >> 24);
+    uint8_t out[16];
+    mbedtls_aes_crypt_ecb(aes, MBEDTLS_AES_ENCRYPT, block, out);
+    uint32_t hash = ((uint32_t)out[13] << 16) | ((uint32_t)out[14] << 8) | out[15];
+    return hash == (uint32_t)(macKey & 0xFFFFFF);
+}
+
+// Known answers: the Core Spec sample data (Vol 3 Part H, D.7) and the
+// key/prand pair test_btrpa_scan.py resolves
+struct RpaTestVector {
+    uint8_t irk[16];
+    uint64_t address;
+};
+
+constexpr RpaTestVector RPA_TEST_VECTORS[] = {
+    {{0xec, 0x02, 0x34, 0xa3, 0x57, 0xc8, 0xad, 0x05, 0x34, 0x10, 0x10, 0xa6, 0x0a, 0x39, 0x7d, 0x9b},
+     0x7081940dfbaaULL},
+    {{0x01, 0x23, 0x45, 0x67, 0x89, 0xab, 0xcd, 0xef, 0x01, 0x23, 0x45, 0x67, 0x89, 0xab, 0xcd, 0xef},
+     0x55aa33b72802ULL},
+};
+
+// Runs ah() on each vector with its key, and with the wrong key (must fail)
+inline bool rpaSelfTest() {
+    constexpr size_t count = sizeof(RPA_TEST_VECTORS) / sizeof(RPA_TEST_VECTORS[0]);
+    bool ok = true;
+    for (size_t i = 0; i < count; i++) {
+        for (size_t k = 0; k < count; k++) {
+            mbedtls_aes_context aes;
+            mbedtls_aes_init(&aes);
+            mbedtls_aes_setkey_enc(&aes, RPA_TEST_VECTORS[k].irk, 128);
+            if (rpaHashMatches(&aes, RPA_TEST_VECTORS[i].address) != (i == k)) ok = false;
+            mbedtls_aes_free(&aes);
+        }
+    }
+    return ok;
+}
+
+// Keys from config.h, checked at compile time. The list ends in a
+// {nullptr, nullptr} sentinel so it may otherwise be empty.
+template <size_t Count>
+struct IrkTable {
+    static_assert(Count < 255, "too many IRKs for the resolver cache encoding");
+
+    uint8_t keys[Count > 0 ? Count : 1][16];
+    bool ok;
+
+    static constexpr size_t size() { return Count; }
+    constexpr bool valid() const { return ok; }
+};
+
+template <size_t N>
+constexpr IrkTable<N - 1> makeIrkTable(const TargetIrk (&irks)[N]) {
+    IrkTable<N - 1> table = {};
+    table.ok = irks[N - 1].irk == nullptr;
+    for (size_t i = 0; i + 1 < N; i++) {
+        if (irks[i].irk == nullptr || !parseIrk(irks[i].irk, table.keys[i])) table.ok = false;
+    }
+    return table;
+}
+
+struct RpaResolverStats {
+    uint32_t lookups;       // random-type adverts checked
+    uint32_t notRpa;        // returned early: not a resolvable address
+    uint32_t cacheHits;
+    uint32_t computed;      // new addresses run against every key
+    uint32_t ahCalls;       // AES blocks
+    uint32_t resolved;      // computed addresses that matched a key
+    uint32_t evictions;
+};
+
+template <size_t Keys, size_t CacheSize>
+class RpaResolver {
+    static_assert(CacheSize >= 4 && (CacheSize & (CacheSize - 1)) == 0,
+                  "RPA cache size must be a power of two");
+
+public:
+    explicit RpaResolver(const IrkTable<Keys>& table) : table_(table) {}
+
+    // Load the key schedules; call once before resolve()
+    void begin() {
+        for (size_t i = 0; i < Keys; i++) {
+            mbedtls_aes_init(&aes_[i]);
+            mbedtls_aes_setkey_enc(&aes_[i], table_.keys[i], 128);
+        }
+        ready_ = true;
+    }
+
+    const RpaResolverStats& stats() const { return stats_; }
+    static constexpr size_t keys() { return Keys; }
+
+    // Index of the key that generated macKey, or -1
+    int resolve(uint64_t macKey, bool randomAddress) {
+        if (Keys == 0 || !ready_ || !randomAddress) return -1;
+        stats_.lookups++;
+        if (!isResolvablePrivateAddress(macKey, true)) {
+            stats_.notRpa++;
+            return -1;
+        }
+
+        // Hash and prand are both random, so their xor spreads evenly
+        size_t set = (size_t)((macKey ^ (macKey >> 24)) & (SETS - 1));
+        uint64_t* ways = &cache_[set * WAYS];
+        for (size_t w = 0; w < WAYS; w++) {
+            if ((ways[w] & ADDRESS_MASK) == macKey && (ways[w] >> 48) != 0) {
+                stats_.cacheHits++;
+                return (int)(ways[w] >> 48) - 2;
+            }
+        }
+
+        int match = -1;
+        stats_.computed++;
+        for (size_t i = 0; i < Keys && match < 0; i++) {
+            stats_.ahCalls++;
+            if (rpaHashMatches(&aes_[i], macKey)) match = (int)i;
+        }
+        if (match >= 0) stats_.resolved++;
+
+        // Round-robin within the set: an RPA lives a few minutes, so the
+        // oldest insertion is as good a victim as the least recently used
+        uint8_t& next = nextWay_[set];
+        if ((ways[next] >> 48) != 0) stats_.evictions++;
+        ways[next] = macKey | ((uint64_t)(match + 2) << 48);
+        next = (uint8_t)((next + 1) % WAYS);
+        return match;
+    }
+
+    // Forget every verdict (after the key set changes)
+    void clear() {
+        memset(cache_, 0, sizeof(cache_));
+        memset(nextWay_, 0, sizeof(nextWay_));
+    }
+
+private:
+    static constexpr size_t WAYS = 4;
+    static constexpr size_t SETS = CacheSize / WAYS;
+    static constexpr uint64_t ADDRESS_MASK = (1ULL << 48) - 1;
+
+    const IrkTable<Keys>& table_;
+    mbedtls_aes_context aes_[Keys > 0 ? Keys : 1];
+    // address | (key index + 2) << 48; 1 = no key matched, 0 = empty
+    uint64_t cache_[CacheSize] = {};
+    uint8_t nextWay_[SETS] = {};
+    RpaResolverStats stats_ = {};
+    bool ready_ = false;
+};
+
+#endif // IRK_RESOLVER_H
@@ -0,0 +1,99 @@
+/**
+ * btrpa-scan-lora Link Quality Table
+ *
+ * Smoothed SNR and RSSI of each neighbour heard directly, used to pick
+ * how fast a frame can be sent and still reach everyone. Only frames
+ * that have not been relayed are counted, since a relayed copy says
+ * nothing about the link to its origin. Readings are corrected for the
+ * sender's power backoff, so they estimate the link at full power.
+ *
+ * Links are assumed symmetric: a neighbour we hear at +5 dB SNR is
+ * taken to hear us at about +5 dB too. Neighbours unheard for maxAgeMs
+ * drop out; a full table replaces the longest-silent one. Not
+ * thread-safe. Fixed storage, no heap.
+ */
+
+#ifndef LINK_QUALITY_H
+#define LINK_QUALITY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct LinkEntry {
+    uint8_t node;           // 0 = free
+    int16_t snrQ4;          // exponentially weighted mean, dB x 16
+    int16_t rssiQ4;         // dBm x 16
+    uint32_t lastHeardMs;
+    uint32_t frames;
+
+    float snrDb() const { return snrQ4 / 16.0f; }
+    int rssiDbm() const { return rssiQ4 / 16; }
+};
+
+template <size_t Capacity>
+class LinkTable {
+public:
+    explicit LinkTable(uint32_t maxAgeMs) : maxAgeMs_(maxAgeMs) {}
+
+    // One directly heard frame; SNR and RSSI already corrected to full power
+    void update(uint8_t node, float snrDb, float rssiDbm, uint32_t nowMs) {
+        if (node == 0) return;
+        int16_t snrQ4 = (int16_t)(snrDb * 16.0f);
+        int16_t rssiQ4 = (int16_t)(rssiDbm * 16.0f);
+
+        for (size_t i = 0; i < Capacity; i++) {
+            LinkEntry& link = links_[i];
+            if (link.node != node) continue;
+            if (nowMs - link.lastHeardMs > maxAgeMs_) link.frames = 0;
+            if (link.frames == 0) {
+                link.snrQ4 = snrQ4;
+                link.rssiQ4 = rssiQ4;
+            } else {
+                link.snrQ4 += (int16_t)((snrQ4 - link.snrQ4) / 4);
+                link.rssiQ4 += (int16_t)((rssiQ4 - link.rssiQ4) / 4);
+            }
+            link.lastHeardMs = nowMs;
+            link.frames++;
+            return;
+        }
+
+        // New neighbour: a free slot, else the one silent the longest
+        LinkEntry* slot = &links_[0];
+        for (size_t i = 0; i < Capacity && slot->node != 0; i++) {
+            if (links_[i].node == 0 || (int32_t)(links_[i].lastHeardMs - slot->lastHeardMs) < 0) {
+                slot = &links_[i];
+            }
+        }
+        slot->node = node;
+        slot->snrQ4 = snrQ4;
+        slot->rssiQ4 = rssiQ4;
+        slot->lastHeardMs = nowMs;
+        slot->frames = 1;
+    }
+
+    // Weakest current link; false if no neighbour has been heard lately
+    bool weakest(uint32_t nowMs, LinkEntry& out) const {
+        bool found = false;
+        for (size_t i = 0; i < Capacity; i++) {
+            const LinkEntry& link = links_[i];
+            if (link.node == 0 || nowMs - link.lastHeardMs > maxAgeMs_) continue;
+            if (!found || link.snrQ4 < out.snrQ4) out = link;
+            found = true;
+        }
+        return found;
+    }
+
+    size_t neighbours(uint32_t nowMs) const {
+        size_t count = 0;
+        for (size_t i = 0; i < Capacity; i++) {
+            if (links_[i].node != 0 && nowMs - links_[i].lastHeardMs <= maxAgeMs_) count++;
+        }
+        return count;
+    }
+
+private:
+    LinkEntry links_[Capacity] = {};
+    uint32_t maxAgeMs_;
+};
+
+#endif // LINK_QUALITY_H
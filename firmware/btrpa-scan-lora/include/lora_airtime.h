@@ -0,0 +1,62 @@
+/**
+ * btrpa-scan-lora LoRa Time-on-Air
+ *
+ * Semtech SX126x time-on-air formula (AN1200.13 / SX1262 datasheet 6.1.4),
+ * usable without a radio instance so budgets can be computed at compile
+ * time, on the host, or for settings other than the radio's current ones.
+ */
+
+#ifndef LORA_AIRTIME_H
+#define LORA_AIRTIME_H
+
+#include <stdint.h>
+
+struct LoRaModulation {
+    uint8_t spreadingFactor;   // 5..12
+    uint32_t bandwidthHz;      // e.g. 125000
+    uint8_t codingRate;        // denominator: 5..8 for 4/5..4/8
+    uint16_t preambleLength;   // symbols
+    bool explicitHeader;
+    bool crc;
+};
+
+// Default link settings used by initLoRa()
+constexpr LoRaModulation LORA_DEFAULT_MODULATION = {10, 125000, 8, 16, true, true};
+
+// Low data rate optimisation is mandatory when the symbol time exceeds 16 ms
+constexpr bool loraLowDataRateOptimize(const LoRaModulation& m) {
+    return ((1UL << m.spreadingFactor) * 1000UL) / (m.bandwidthHz / 1000UL) > 16000UL;
+}
+
+// Symbol duration in microseconds
+constexpr uint32_t loraSymbolTimeUs(const LoRaModulation& m) {
+    return (uint32_t)(((uint64_t)1000000UL << m.spreadingFactor) / m.bandwidthHz);
+}
+
+// Payload bits left after the fixed header/CRC allowance
+constexpr int32_t loraPayloadBits(const LoRaModulation& m, uint32_t payloadLen) {
+    return (int32_t)(8 * payloadLen) - 4 * (int32_t)m.spreadingFactor + 28 +
+           (m.crc ? 16 : 0) - (m.explicitHeader ? 0 : 20);
+}
+
+// Bits carried per block of (codingRate) payload symbols
+constexpr int32_t loraBitsPerBlock(const LoRaModulation& m) {
+    return 4 * ((int32_t)m.spreadingFactor - (loraLowDataRateOptimize(m) ? 2 : 0));
+}
+
+// Number of payload symbols for a frame of payloadLen bytes:
+// 8 + max(ceil(bits / (4 * (SF - 2 * DE))) * CR, 0)
+constexpr uint32_t loraPayloadSymbols(const LoRaModulation& m, uint32_t payloadLen) {
+    return 8 + (loraPayloadBits(m, payloadLen) <= 0 ? 0 :
+        (uint32_t)((loraPayloadBits(m, payloadLen) + loraBitsPerBlock(m) - 1) /
+                   loraBitsPerBlock(m)) * m.codingRate);
+}
+
+// Total time on air in microseconds (preamble + sync + header + payload)
+constexpr uint32_t loraTimeOnAirUs(const LoRaModulation& m, uint32_t payloadLen) {
+    // Preamble is (Npreamble + 4.25) symbols
+    return (uint32_t)(((uint64_t)(4 * m.preambleLength + 17) * loraSymbolTimeUs(m)) / 4) +
+           loraPayloadSymbols(m, payloadLen) * loraSymbolTimeUs(m);
+}
+
+#endif // LORA_AIRTIME_H
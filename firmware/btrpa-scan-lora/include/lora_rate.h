@@ -0,0 +1,264 @@
+/**
+ * btrpa-scan-lora Adaptive Data Rate
+ *
+ * Spreading factor, coding rate and TX power are chosen per frame from
+ * the message class and the weakest current neighbour link, instead of
+ * sending everything at SF10 CR 4/8. A position beacon to neighbours
+ * heard at +5 dB SNR goes out at SF7 in about a fifth of the airtime;
+ * TRUE HITs always use the robust rate for maximum reach. Acks, POSSIBLE
+ * HITs and gateway control frames keep the wider margin and full power;
+ * only routine traffic (beacons and status) turns its power down.
+ *
+ * An SX1262 only demodulates the spreading factor it is listening on,
+ * so every node scans the whole rate set with channel activity detection
+ * (CAD), fastest SF first, and switches to receive at the SF where it
+ * finds a preamble. Frames at the faster rates carry a preamble longer
+ * than one scan cycle so a scanning receiver cannot miss it. With a
+ * single-entry set the radio just listens continuously at that SF.
+ *
+ * Failures move the sender back to the robust rate: a transmission
+ * that never completes, or, once a relay has been heard repeating this
+ * node's frames, an adapted frame that no relay repeats. After a run
+ * of consecutive failures the robust rate is used for a hold-off
+ * period before adapting again.
+ */
+
+#ifndef LORA_RATE_H
+#define LORA_RATE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "lora_airtime.h"
+#include "lora_tx_queue.h"
+#include "wire_format.h"
+
+// CAD listens for 2 symbols (RadioLib's default) plus about half a
+// symbol of processing; switching SF and starting CAD costs the rest
+constexpr uint8_t LORA_CAD_SYMBOLS = 2;
+constexpr uint32_t LORA_CAD_OVERHEAD_US = 500;
+
+// Preamble symbols a receiver needs after it switches to RX to lock on
+constexpr uint8_t LORA_RX_LOCK_SYMBOLS = 6;
+
+// Demodulation SNR floor per spreading factor, in 0.25 dB (SX1262
+// datasheet: -7.5 dB at SF7, 2.5 dB lower per step)
+constexpr int16_t loraSnrFloorQ2(uint8_t sf) {
+    return (int16_t)(-30 - 10 * ((int)sf - 7));
+}
+
+constexpr LoRaModulation loraModulationAt(uint8_t sf, uint8_t cr, uint16_t preamble) {
+    return {sf, LORA_DEFAULT_MODULATION.bandwidthHz, cr, preamble,
+            LORA_DEFAULT_MODULATION.explicitHeader, LORA_DEFAULT_MODULATION.crc};
+}
+
+constexpr uint32_t loraCadTimeUs(uint8_t sf) {
+    return LORA_CAD_SYMBOLS * loraSymbolTimeUs(loraModulationAt(sf, 8, 8)) +
+           loraSymbolTimeUs(loraModulationAt(sf, 8, 8)) / 2;
+}
+
+// Spreading factors in use, fastest first; the last is the robust rate
+template <size_t N>
+struct LoRaRateSet {
+    uint8_t sf[N];
+
+    static constexpr size_t size() { return N; }
+    static constexpr bool scanning() { return N > 1; }
+    constexpr uint8_t robust() const { return sf[N - 1]; }
+
+    constexpr bool contains(uint8_t s) const {
+        for (size_t i = 0; i < N; i++) {
+            if (sf[i] == s) return true;
+        }
+        return false;
+    }
+
+    constexpr bool valid() const {
+        for (size_t i = 0; i < N; i++) {
+            if (sf[i] < 7 || sf[i] > 12 || (i > 0 && sf[i] <= sf[i - 1])) return false;
+        }
+        return true;
+    }
+
+    // One pass of CAD over every SF in the set
+    constexpr uint32_t scanCycleUs() const {
+        uint32_t total = 0;
+        for (size_t i = 0; i < N; i++) total += loraCadTimeUs(sf[i]) + LORA_CAD_OVERHEAD_US;
+        return total;
+    }
+
+    // Long enough that a CAD at this SF lands inside it wherever the scan
+    // is, and the receiver still has LORA_RX_LOCK_SYMBOLS left to lock on
+    constexpr uint16_t preamble(uint8_t s) const {
+        if (!scanning()) return LORA_DEFAULT_MODULATION.preambleLength;
+        uint32_t symbolUs = loraSymbolTimeUs(loraModulationAt(s, 8, 8));
+        uint32_t needed = (scanCycleUs() + symbolUs - 1) / symbolUs + LORA_CAD_SYMBOLS + 1 +
+                          LORA_RX_LOCK_SYMBOLS;
+        return (uint16_t)(needed > LORA_DEFAULT_MODULATION.preambleLength ?
+                          needed : LORA_DEFAULT_MODULATION.preambleLength);
+    }
+
+    constexpr LoRaModulation modulation(uint8_t s, uint8_t cr) const {
+        return loraModulationAt(s, cr, preamble(s));
+    }
+};
+
+template <size_t N>
+constexpr LoRaRateSet<N> makeLoRaRateSet(const uint8_t (&sfs)[N]) {
+    LoRaRateSet<N> set = {};
+    for (size_t i = 0; i < N; i++) set.sf[i] = sfs[i];
+    return set;
+}
+
+// Settings for one transmission
+struct LoRaTxRate {
+    uint8_t sf;
+    uint8_t cr;             // 5..8 for 4/5..4/8
+    uint8_t powerSteps;     // WIRE_POWER_STEP_DB below full power
+    bool robust;            // the fallback rate; failures do not count
+};
+
+struct LoRaRateStats {
+    uint32_t frames[13];            // by spreading factor
+    uint64_t airtimeUs[13];
+    uint64_t robustAirtimeUs;       // the same frames at the robust rate
+    uint32_t adapted;               // frames sent faster than robust
+    uint32_t acked;                 // adapted frames heard repeated by a relay
+    uint32_t failures;              // TX timeouts and unrepeated adapted frames
+    uint32_t fallbacks;             // times the hold-off was entered
+};
+
+struct LoRaRateConfig {
+    int16_t possibleHitMarginQ2;    // SNR margin over the SF floor, 0.25 dB (also
+                                    // acks and control frames)
+    int16_t routineMarginQ2;        // position beacons and status
+    uint8_t maxPowerSteps;
+    uint8_t fallbackFailures;       // consecutive failures before hold-off
+    uint32_t fallbackMs;
+    uint32_t echoTimeoutMs;         // relay repeat expected within this
+    uint32_t relayMemoryMs;         // expect repeats this long after the last one
+};
+
+template <size_t N>
+class LoRaRatePolicy {
+public:
+    LoRaRatePolicy(const LoRaRateSet<N>& set, const LoRaRateConfig& config)
+        : set_(set), config_(config) {}
+
+    const LoRaRateStats& stats() const { return stats_; }
+    bool holdingOff(uint32_t nowMs) const {
+        return holdOff_ && (int32_t)(nowMs - holdOffUntilMs_) < 0;
+    }
+
+    LoRaTxRate robustRate() const { return {set_.robust(), 8, 0, true}; }
+
+    // linkSnrQ2: weakest neighbour link (0.25 dB); ignored if !linkKnown
+    LoRaTxRate select(TxClass txClass, bool linkKnown, int16_t linkSnrQ2, uint32_t nowMs) const {
+        if (txClass == TX_CLASS_TRUE_HIT || !linkKnown || holdingOff(nowMs)) return robustRate();
+
+        bool routine = txClass >= TX_CLASS_POSITION;
+        int16_t target = routine ? config_.routineMarginQ2 : config_.possibleHitMarginQ2;
+        for (size_t i = 0; i + 1 < N; i++) {
+            int16_t excess = (int16_t)(linkSnrQ2 - loraSnrFloorQ2(set_.sf[i]) - target);
+            if (excess < 0) continue;
+
+            // Spare margin buys a lighter code first, then less power
+            // for routine traffic (less interference with distant nodes)
+            uint8_t cr = excess >= 24 ? 5 : excess >= 12 ? 6 : 8;
+            uint8_t steps = 0;
+            if (routine && excess > 24) {
+                steps = (uint8_t)((excess - 24) / (4 * WIRE_POWER_STEP_DB));
+                if (steps > config_.maxPowerSteps) steps = config_.maxPowerSteps;
+            }
+            return {set_.sf[i], cr, steps, false};
+        }
+        return robustRate();
+    }
+
+    // Airtime accounting for a frame of length bytes sent at rate
+    void sent(const LoRaTxRate& rate, size_t length) {
+        uint32_t airtime = loraTimeOnAirUs(set_.modulation(rate.sf, rate.cr), (uint32_t)length);
+        stats_.frames[rate.sf]++;
+        stats_.airtimeUs[rate.sf] += airtime;
+        stats_.robustAirtimeUs += loraTimeOnAirUs(set_.modulation(set_.robust(), 8), (uint32_t)length);
+        if (!rate.robust) stats_.adapted++;
+    }
+
+    // Radio-level outcome of a transmission
+    void transmitted(const LoRaTxRate& rate, bool completed, uint32_t nowMs) {
+        if (rate.robust) return;
+        completed ? succeeded() : failed(nowMs);
+    }
+
+    // An adapted frame of ours that relays should repeat (hops left); a
+    // missing repeat only counts once relays have been heard doing it
+    void expectRepeat(const LoRaTxRate& rate, uint8_t sequence, uint32_t nowMs) {
+        if (rate.robust || !relaysHeard(nowMs)) return;
+        for (size_t i = 0; i < ECHO_SLOTS; i++) {
+            if (!echoes_[i].waiting) {
+                echoes_[i] = {true, sequence, nowMs};
+                return;
+            }
+        }
+    }
+
+    // One of our own frames heard again from a relay
+    void repeatHeard(uint8_t sequence, uint32_t nowMs) {
+        lastRepeatMs_ = nowMs;
+        repeatSeen_ = true;
+        for (size_t i = 0; i < ECHO_SLOTS; i++) {
+            if (echoes_[i].waiting && echoes_[i].sequence == sequence) {
+                echoes_[i].waiting = false;
+                stats_.acked++;
+                succeeded();
+            }
+        }
+    }
+
+    // Count repeats that never came
+    void poll(uint32_t nowMs) {
+        for (size_t i = 0; i < ECHO_SLOTS; i++) {
+            if (echoes_[i].waiting && nowMs - echoes_[i].sentMs > config_.echoTimeoutMs) {
+                echoes_[i].waiting = false;
+                failed(nowMs);
+            }
+        }
+        if (holdOff_ && !holdingOff(nowMs)) holdOff_ = false;
+    }
+
+private:
+    static constexpr size_t ECHO_SLOTS = 8;
+
+    struct Echo {
+        bool waiting;
+        uint8_t sequence;
+        uint32_t sentMs;
+    };
+
+    bool relaysHeard(uint32_t nowMs) const {
+        return repeatSeen_ && nowMs - lastRepeatMs_ <= config_.relayMemoryMs;
+    }
+
+    void succeeded() { consecutiveFailures_ = 0; }
+
+    void failed(uint32_t nowMs) {
+        stats_.failures++;
+        if (++consecutiveFailures_ < config_.fallbackFailures) return;
+        consecutiveFailures_ = 0;
+        holdOff_ = true;
+        holdOffUntilMs_ = nowMs + config_.fallbackMs;
+        stats_.fallbacks++;
+    }
+
+    LoRaRateSet<N> set_;
+    LoRaRateConfig config_;
+    LoRaRateStats stats_ = {};
+    Echo echoes_[ECHO_SLOTS] = {};
+    uint8_t consecutiveFailures_ = 0;
+    bool holdOff_ = false;
+    uint32_t holdOffUntilMs_ = 0;
+    bool repeatSeen_ = false;
+    uint32_t lastRepeatMs_ = 0;
+};
+
+#endif // LORA_RATE_H
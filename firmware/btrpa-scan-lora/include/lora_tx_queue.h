@@ -0,0 +1,280 @@
+/**
+ * btrpa-scan-lora LoRa Transmit Queue
+ *
+ * Outgoing frames waiting for the asynchronous transmitter. Frames leave
+ * by priority class (TRUE_HIT, ACK, POSSIBLE_HIT, CONTROL, POSITION,
+ * STATUS) and FIFO within a class, so a queued beacon never delays a hit
+ * by more than the frame already on air. Journal acks rank just below
+ * TRUE HITs: each one lost makes its node replay the records it covers,
+ * which costs more airtime than the ack. CONTROL carries the gateway's
+ * scan commands and targets frames, which nothing resends soon if they
+ * are lost, so beacons and status frames cannot evict them either.
+ *
+ * When the queue backs up, low-priority traffic gives way:
+ *   - a frame with the same type and key as one still queued (the next
+ *     position beacon, a repeat sighting of the same MAC) replaces it in
+ *     place, keeping its place in line; its age, for expiry and the
+ *     latency counters, starts again with the new content;
+ *   - a full queue evicts the oldest frame of the lowest class below the
+ *     newcomer, or rejects the newcomer if nothing ranks lower;
+ *   - frames older than their class's maximum age are discarded at
+ *     dequeue instead of being sent late.
+ *
+ * The transmitter sends the frame at front() and only then pops it, so
+ * a frame the radio refuses stays at the head for the next try (up to
+ * TX_MAX_START_FAILURES times).
+ *
+ * Per-class counters and queueing latency (enqueue to dequeue-for-send)
+ * are kept for the statistics report. Not thread-safe: callers serialize
+ * access. Fixed storage, no heap.
+ */
+
+#ifndef LORA_TX_QUEUE_H
+#define LORA_TX_QUEUE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "mesh_protocol.h"
+
+enum TxClass : uint8_t {
+    TX_CLASS_TRUE_HIT = 0,      // highest priority
+    TX_CLASS_ACK,               // homebase acks of journaled frames
+    TX_CLASS_POSSIBLE_HIT,
+    TX_CLASS_CONTROL,           // gateway scan commands and targets
+    TX_CLASS_POSITION,
+    TX_CLASS_STATUS,
+    TX_CLASS_COUNT
+};
+
+inline TxClass txClassForType(uint8_t type) {
+    switch (type) {
+        case MSG_TRUE_HIT: return TX_CLASS_TRUE_HIT;
+        case MSG_ACK: return TX_CLASS_ACK;
+        case MSG_POSSIBLE_HIT:
+        case MSG_FUSED: return TX_CLASS_POSSIBLE_HIT;
+        case MSG_COMMAND:
+        case MSG_TARGETS: return TX_CLASS_CONTROL;
+        case MSG_POSITION: return TX_CLASS_POSITION;
+        default: return TX_CLASS_STATUS;
+    }
+}
+
+inline const char* txClassName(TxClass txClass) {
+    static const char* const names[TX_CLASS_COUNT] = {"TRUE_HIT", "ACK", "POSSIBLE_HIT", "CONTROL", "POSITION",
+                                                           "STATUS"};
+    return txClass < TX_CLASS_COUNT ? names[txClass] : "?";
+}
+
+// A frame the radio refuses to start this many times running is dropped
+constexpr uint8_t TX_MAX_START_FAILURES = 3;
+
+// Frames older than this are dropped rather than sent (0 = never expire)
+constexpr uint32_t TX_CLASS_DEFAULT_MAX_AGE_MS[TX_CLASS_COUNT] = {
+    0,          // TRUE_HIT: always worth sending
+    0,          // ACK: a late one still saves a replay
+    60000,      // POSSIBLE_HIT
+    0,          // CONTROL: queued one at a time, never resent soon
+    10000,      // POSITION: a fresher beacon will follow
+    30000,      // STATUS
+};
+
+struct TxClassStats {
+    uint32_t queued;        // accepted into the queue
+    uint32_t coalesced;     // replaced a queued frame with the same key
+    uint32_t dropped;       // rejected or evicted because the queue was full,
+                            // or given up on a busy channel
+    uint32_t expired;       // discarded at dequeue for exceeding max age
+    uint32_t failed;        // radio refused to start a transmission
+    uint32_t dequeued;      // handed to the radio
+    uint32_t latencySumMs;  // enqueue (or last coalesce) -> dequeue, over dequeued frames
+    uint32_t latencyMaxMs;
+
+    uint32_t latencyAvgMs() const { return dequeued ? latencySumMs / dequeued : 0; }
+};
+
+template <size_t MaxFrame>
+struct TxFrame {
+    uint8_t type;           // MessageType
+    uint64_t key;           // coalescing key within the type (e.g. MAC key)
+    uint32_t queuedMs;      // when its content was queued
+    uint32_t seq;           // FIFO order within a class
+    uint8_t failures;       // transmissions the radio refused
+    uint8_t length;
+    uint8_t data[MaxFrame];
+};
+
+template <size_t Capacity, size_t MaxFrame>
+class LoRaTxQueue {
+    static_assert(Capacity > 0 && Capacity <= 255, "LoRaTxQueue capacity out of range");
+    static_assert(MaxFrame <= 255, "LoRa frames are at most 255 bytes");
+
+public:
+    typedef TxFrame<MaxFrame> Frame;
+
+    LoRaTxQueue() {
+        memcpy(maxAgeMs_, TX_CLASS_DEFAULT_MAX_AGE_MS, sizeof(maxAgeMs_));
+    }
+
+    static constexpr size_t capacity() { return Capacity; }
+    size_t size() const { return count_; }
+
+    void setMaxAgeMs(TxClass txClass, uint32_t maxAgeMs) { maxAgeMs_[txClass] = maxAgeMs; }
+    const TxClassStats& stats(TxClass txClass) const { return stats_[txClass]; }
+
+    // Returns false if the frame was rejected (too long, or queue full of
+    // equal or higher priority traffic)
+    bool push(uint8_t type, uint64_t key, const uint8_t* data, size_t length, uint32_t nowMs) {
+        TxClass txClass = txClassForType(type);
+        if (length > MaxFrame) {
+            stats_[txClass].dropped++;
+            return false;
+        }
+
+        int slot = -1;
+        for (size_t i = 0; i < Capacity; i++) {
+            if (used_[i] && frames_[i].type == type && frames_[i].key == key) {
+                stats_[txClass].coalesced++;
+                frames_[i].queuedMs = nowMs;
+                store(frames_[i], data, length);
+                return true;
+            }
+            if (!used_[i] && slot < 0) slot = (int)i;
+        }
+
+        if (slot < 0) {
+            slot = lowestBelow(txClass);
+            if (slot < 0) {
+                stats_[txClass].dropped++;
+                return false;
+            }
+            stats_[txClassForType(frames_[slot].type)].dropped++;
+            count_--;
+        }
+
+        Frame& frame = frames_[slot];
+        frame.type = type;
+        frame.key = key;
+        frame.queuedMs = nowMs;
+        frame.seq = nextSeq_++;
+        frame.failures = 0;
+        store(frame, data, length);
+        used_[slot] = true;
+        count_++;
+        stats_[txClass].queued++;
+        return true;
+    }
+
+    // Highest-priority unexpired frame, left in the queue; nullptr if there
+    // is nothing to send. Valid until the queue is next modified.
+    const Frame* front(uint32_t nowMs) {
+        for (;;) {
+            int best = -1;
+            for (size_t i = 0; i < Capacity; i++) {
+                if (used_[i] && (best < 0 || before(frames_[i], frames_[best]))) best = (int)i;
+            }
+            if (best < 0) return nullptr;
+
+            const Frame& frame = frames_[best];
+            TxClass txClass = txClassForType(frame.type);
+            if (maxAgeMs_[txClass] != 0 && nowMs - frame.queuedMs > maxAgeMs_[txClass]) {
+                used_[best] = false;
+                count_--;
+                stats_[txClass].expired++;
+                continue;
+            }
+            return &frame;
+        }
+    }
+
+    // Remove and return the frame front() would; false if there is nothing to send
+    bool pop(Frame& out, uint32_t nowMs) {
+        const Frame* frame = front(nowMs);
+        if (frame == nullptr) return false;
+        out = *frame;
+        return pop(nowMs);
+    }
+
+    // Remove it without a copy, once it has been sent from front()
+    bool pop(uint32_t nowMs) {
+        const Frame* frame = front(nowMs);
+        if (frame == nullptr) return false;
+
+        size_t slot = (size_t)(frame - frames_);
+        uint32_t ageMs = nowMs - frame->queuedMs;
+        TxClassStats& stats = stats_[txClassForType(frame->type)];
+        stats.dequeued++;
+        stats.latencySumMs += ageMs;
+        if (ageMs > stats.latencyMaxMs) stats.latencyMaxMs = ageMs;
+        used_[slot] = false;
+        count_--;
+        return true;
+    }
+
+    // Give up on the frame front() returns (the channel stayed busy);
+    // false if there is nothing to send
+    bool drop(uint32_t nowMs) {
+        const Frame* frame = front(nowMs);
+        if (frame == nullptr) return false;
+
+        size_t slot = (size_t)(frame - frames_);
+        stats_[txClassForType(frame->type)].dropped++;
+        used_[slot] = false;
+        count_--;
+        return true;
+    }
+
+    // The radio refused the frame front() returns: it stays queued for the
+    // next try, unless that was its TX_MAX_START_FAILURES-th refusal.
+    // True if it is still queued.
+    bool failed(uint32_t nowMs) {
+        const Frame* frame = front(nowMs);
+        if (frame == nullptr) return false;
+
+        size_t slot = (size_t)(frame - frames_);
+        stats_[txClassForType(frame->type)].failed++;
+        if (++frames_[slot].failures < TX_MAX_START_FAILURES) return true;
+        used_[slot] = false;
+        count_--;
+        return false;
+    }
+
+private:
+    static void store(Frame& frame, const uint8_t* data, size_t length) {
+        memcpy(frame.data, data, length);
+        frame.length = (uint8_t)length;
+    }
+
+    bool before(const Frame& a, const Frame& b) const {
+        TxClass ca = txClassForType(a.type), cb = txClassForType(b.type);
+        return ca != cb ? ca < cb : (int32_t)(a.seq - b.seq) < 0;
+    }
+
+    // Oldest frame of the lowest class that ranks below txClass, or -1
+    int lowestBelow(TxClass txClass) const {
+        int victim = -1;
+        for (size_t i = 0; i < Capacity; i++) {
+            if (!used_[i] || txClassForType(frames_[i].type) <= txClass) continue;
+            if (victim < 0) {
+                victim = (int)i;
+                continue;
+            }
+            TxClass ci = txClassForType(frames_[i].type);
+            TxClass cv = txClassForType(frames_[victim].type);
+            if (ci > cv || (ci == cv && (int32_t)(frames_[i].seq - frames_[victim].seq) < 0)) {
+                victim = (int)i;
+            }
+        }
+        return victim;
+    }
+
+    Frame frames_[Capacity] = {};
+    bool used_[Capacity] = {};
+    size_t count_ = 0;
+    uint32_t nextSeq_ = 0;
+    uint32_t maxAgeMs_[TX_CLASS_COUNT];
+    TxClassStats stats_[TX_CLASS_COUNT] = {};
+};
+
+#endif // LORA_TX_QUEUE_H
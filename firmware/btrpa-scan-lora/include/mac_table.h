@@ -0,0 +1,117 @@
+/**
+ * btrpa-scan-lora MAC Address Table
+ *
+ * Target MACs from config.h are packed into 48-bit integer keys and
+ * sorted at compile time, so the table lives in flash and a lookup is a
+ * binary search over integers with no heap traffic.
+ */
+
+#ifndef MAC_TABLE_H
+#define MAC_TABLE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Returned by parseMacKey() for malformed addresses (not a valid 48-bit key)
+constexpr uint64_t MAC_KEY_INVALID = UINT64_MAX;
+
+constexpr int macHexNibble(char c) {
+    return (c >= '0' && c <= '9') ? c - '0' :
+           (c >= 'a' && c <= 'f') ? c - 'a' + 10 :
+           (c >= 'A' && c <= 'F') ? c - 'A' + 10 : -1;
+}
+
+// "aa:bb:cc:dd:ee:ff" (either case, ':' or '-' separated) -> 0xaabbccddeeff
+constexpr uint64_t parseMacKey(const char* mac) {
+    uint64_t key = 0;
+    for (int i = 0; i < 6; i++) {
+        const char* p = mac + i * 3;
+        int hi = macHexNibble(p[0]);
+        int lo = hi < 0 ? -1 : macHexNibble(p[1]);
+        if (lo < 0) return MAC_KEY_INVALID;
+        char sep = p[2];
+        if (i < 5 ? (sep != ':' && sep != '-') : sep != '\0') return MAC_KEY_INVALID;
+        key = (key << 8) | (uint64_t)(hi << 4 | lo);
+    }
+    return key;
+}
+
+// NimBLE stores addresses least significant byte first
+inline uint64_t macKeyFromNative(const uint8_t* native) {
+    return ((uint64_t)native[5] << 40) | ((uint64_t)native[4] << 32) |
+           ((uint64_t)native[3] << 24) | ((uint64_t)native[2] << 16) |
+           ((uint64_t)native[1] << 8) | (uint64_t)native[0];
+}
+
+// Format a key as "aa:bb:cc:dd:ee:ff" into a caller-provided 18-byte buffer
+inline char* formatMacKey(uint64_t key, char* out) {
+    static const char hex[] = "0123456789abcdef";
+    for (int i = 0; i < 6; i++) {
+        uint8_t b = (uint8_t)(key >> (40 - 8 * i));
+        out[i * 3] = hex[b >> 4];
+        out[i * 3 + 1] = hex[b & 0x0F];
+        out[i * 3 + 2] = i < 5 ? ':' : '\0';
+    }
+    return out;
+}
+
+template <size_t N>
+struct MacTable {
+    uint64_t keys[N];
+
+    constexpr size_t size() const { return N; }
+
+    constexpr bool contains(uint64_t key) const {
+        size_t lo = 0, hi = N;
+        while (lo < hi) {
+            size_t mid = lo + (hi - lo) / 2;
+            if (keys[mid] < key) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        return lo < N && keys[lo] == key;
+    }
+
+    constexpr bool valid() const {
+        for (size_t i = 0; i < N; i++) {
+            if (keys[i] == MAC_KEY_INVALID) return false;
+        }
+        return true;
+    }
+};
+
+template <size_t N>
+constexpr void macTableSiftDown(uint64_t (&keys)[N], size_t root, size_t end) {
+    while (2 * root + 1 < end) {
+        size_t child = 2 * root + 1;
+        if (child + 1 < end && keys[child] < keys[child + 1]) child++;
+        if (!(keys[root] < keys[child])) return;
+        uint64_t tmp = keys[root];
+        keys[root] = keys[child];
+        keys[child] = tmp;
+        root = child;
+    }
+}
+
+// Build a sorted table from string literals (heapsort: O(n log n) at compile time)
+template <size_t N>
+constexpr MacTable<N> makeMacTable(const char* const (&macs)[N]) {
+    MacTable<N> table{};
+    for (size_t i = 0; i < N; i++) {
+        table.keys[i] = parseMacKey(macs[i]);
+    }
+    for (size_t i = N / 2; i-- > 0;) {
+        macTableSiftDown(table.keys, i, N);
+    }
+    for (size_t end = N; end-- > 1;) {
+        uint64_t tmp = table.keys[0];
+        table.keys[0] = table.keys[end];
+        table.keys[end] = tmp;
+        macTableSiftDown(table.keys, 0, end);
+    }
+    return table;
+}
+
+#endif // MAC_TABLE_H
@@ -0,0 +1,105 @@
+/**
+ * btrpa-scan-lora Mesh Acknowledgements
+ *
+ * Run on the homebase node (MESH_GATEWAY): every hit or status frame it
+ * hears from a field node is acknowledged, so the node knows which of its
+ * journaled detections arrived and which to send again.
+ *
+ * Acks are not sent per frame. The first frame heard from a node opens an
+ * entry that is due delayMs later; frames from the same node arriving
+ * meanwhile are folded into it as a bit mask over the 16 sequence numbers
+ * that follow, so one 14-byte MSG_ACK covers a burst. A sequence number
+ * that does not fit opens a second entry. With the table full, the entry
+ * due first is dropped (its node will replay those records later).
+ *
+ * Not thread-safe: one task owns the table. Fixed storage, no heap.
+ */
+
+#ifndef MESH_ACK_H
+#define MESH_ACK_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "wire_format.h"
+
+struct MeshAckStats {
+    uint32_t acknowledged;  // frames covered by an ack
+    uint32_t frames;        // MSG_ACK frames handed to the transmitter
+    uint32_t dropped;       // entries lost to a full table
+};
+
+template <size_t Capacity>
+class MeshAckTable {
+    static_assert(Capacity > 0, "MeshAckTable must not be empty");
+
+public:
+    explicit MeshAckTable(uint32_t delayMs) : delayMs_(delayMs) {}
+
+    const MeshAckStats& stats() const { return stats_; }
+
+    void add(uint8_t origin, uint8_t sequence, uint32_t nowMs) {
+        for (size_t i = 0; i < count_; i++) {
+            Entry& entry = entries_[i];
+            if (entry.ack.target != origin) continue;
+            uint8_t offset = (uint8_t)(sequence - entry.ack.sequence);
+            if (offset == 0) return;
+            if (offset <= 16) {
+                uint16_t bit = (uint16_t)(1u << (offset - 1));
+                if (!(entry.ack.following & bit)) stats_.acknowledged++;
+                entry.ack.following |= bit;
+                return;
+            }
+        }
+        if (count_ == Capacity) {
+            size_t first = 0;
+            for (size_t i = 1; i < count_; i++) {
+                if ((int32_t)(entries_[i].dueMs - entries_[first].dueMs) < 0) first = i;
+            }
+            entries_[first] = entries_[--count_];
+            stats_.dropped++;
+        }
+        Entry& entry = entries_[count_++];
+        entry.ack = {origin, sequence, 0};
+        entry.dueMs = nowMs + delayMs_;
+        stats_.acknowledged++;
+    }
+
+    // Earliest ack that is due; false if none
+    bool popDue(WireAck& out, uint32_t nowMs) {
+        int best = -1;
+        for (size_t i = 0; i < count_; i++) {
+            if ((int32_t)(nowMs - entries_[i].dueMs) < 0) continue;
+            if (best < 0 || (int32_t)(entries_[i].dueMs - entries_[best].dueMs) < 0) best = (int)i;
+        }
+        if (best < 0) return false;
+        out = entries_[best].ack;
+        entries_[best] = entries_[--count_];
+        stats_.frames++;
+        return true;
+    }
+
+    // Time until the next ack is due; UINT32_MAX if none
+    uint32_t msUntilDue(uint32_t nowMs) const {
+        uint32_t wait = UINT32_MAX;
+        for (size_t i = 0; i < count_; i++) {
+            int32_t left = (int32_t)(entries_[i].dueMs - nowMs);
+            uint32_t ms = left > 0 ? (uint32_t)left : 0;
+            if (ms < wait) wait = ms;
+        }
+        return wait;
+    }
+
+private:
+    struct Entry {
+        WireAck ack;
+        uint32_t dueMs;
+    };
+
+    uint32_t delayMs_;
+    Entry entries_[Capacity] = {};
+    size_t count_ = 0;
+    MeshAckStats stats_ = {};
+};
+
+#endif // MESH_ACK_H
@@ -0,0 +1,25 @@
+/**
+ * btrpa-scan-lora Mesh Protocol
+ *
+ * Message types shared by the firmware and the host-native replay
+ * harness. The on-air layout is defined in wire_format.h.
+ */
+
+#ifndef MESH_PROTOCOL_H
+#define MESH_PROTOCOL_H
+
+#include <stdint.h>
+
+// LoRa message types
+enum MessageType {
+    MSG_TRUE_HIT = 1,      // Critical: Exact MAC match detected
+    MSG_POSSIBLE_HIT = 2,  // Lower priority: Medical device prefix
+    MSG_POSITION = 3,      // Position beacon (off the extrapolated track)
+    MSG_STATUS = 4,        // Node status update
+    MSG_COMMAND = 5,       // Gateway command to one node or all
+    MSG_ACK = 6,           // Homebase acknowledging a node's frames
+    MSG_TARGETS = 7,       // Gateway installing runtime targets on nodes
+    MSG_FUSED = 8          // Homebase location of a target several nodes heard
+};
+
+#endif // MESH_PROTOCOL_H
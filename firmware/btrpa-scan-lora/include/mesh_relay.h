@@ -0,0 +1,171 @@
+/**
+ * btrpa-scan-lora Mesh Relay
+ *
+ * Duplicate suppression and delayed rebroadcast for a flooding mesh.
+ *
+ * Every node remembers the (origin node, sequence) of frames it has
+ * recently heard, so a frame arriving again via another relay is
+ * recognised and ignored. Relay nodes additionally hold each new frame
+ * that still has hops left for a short delay before rebroadcasting it.
+ * The delay is longer the stronger the frame was heard: a relay at the
+ * edge of the sender's range adds the most coverage, so it goes first,
+ * and random jitter keeps relays that heard the frame equally well from
+ * transmitting in lockstep. If enough other relays are heard forwarding
+ * the same frame during the delay, the rebroadcast is cancelled.
+ *
+ * The seen list is a ring of the last SeenCapacity frames, forgotten
+ * after seenWindowMs; an 8-bit sequence therefore must not wrap faster
+ * than that. A node that resets within the window would reuse numbers
+ * its neighbours still remember if it counted from 0 again, so senders
+ * start from a random sequence at boot. Not thread-safe: one task owns
+ * the relay. Fixed storage, no heap.
+ */
+
+#ifndef MESH_RELAY_H
+#define MESH_RELAY_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+struct MeshRelayStats {
+    uint32_t accepted;      // new frames from other nodes
+    uint32_t duplicates;    // copies of a frame already heard
+    uint32_t ownEchoes;     // our own frames relayed back to us
+    uint32_t scheduled;     // new frames held for rebroadcast
+    uint32_t cancelled;     // rebroadcasts dropped after hearing other relays
+    uint32_t forwarded;     // rebroadcasts handed to the transmitter
+    uint32_t hopLimited;    // new frames with no hops left
+    uint32_t dropped;       // rebroadcasts lost to a full pending table or TX queue
+};
+
+template <size_t MaxFrame>
+struct RelayFrame {
+    uint8_t type;           // MessageType
+    uint8_t origin;
+    uint8_t sequence;
+    uint8_t copiesHeard;    // other relays heard forwarding it while pending
+    uint32_t dueMs;
+    uint8_t length;
+    uint8_t data[MaxFrame];
+};
+
+template <size_t SeenCapacity, size_t PendingCapacity, size_t MaxFrame>
+class MeshRelay {
+    static_assert(SeenCapacity > 0 && PendingCapacity > 0, "MeshRelay tables must not be empty");
+    static_assert(MaxFrame <= 255, "LoRa frames are at most 255 bytes");
+
+public:
+    typedef RelayFrame<MaxFrame> Frame;
+
+    // A pending rebroadcast is cancelled once duplicateLimit other copies
+    // have been heard (0 = never cancel)
+    MeshRelay(uint8_t localNode, uint32_t seenWindowMs, uint8_t duplicateLimit)
+        : localNode_(localNode), seenWindowMs_(seenWindowMs), duplicateLimit_(duplicateLimit) {}
+
+    const MeshRelayStats& stats() const { return stats_; }
+    size_t pending() const { return pendingCount_; }
+
+    // Record a received frame; true if it is new and should be processed
+    bool accept(uint8_t origin, uint8_t sequence, uint32_t nowMs) {
+        if (origin == localNode_) {
+            stats_.ownEchoes++;
+            return false;
+        }
+        uint16_t key = (uint16_t)(origin << 8 | sequence);
+        for (size_t i = 0; i < seenCount_; i++) {
+            if (seen_[i].key == key && nowMs - seen_[i].heardMs <= seenWindowMs_) {
+                stats_.duplicates++;
+                heardCopy(origin, sequence);
+                return false;
+            }
+        }
+        seen_[seenNext_].key = key;
+        seen_[seenNext_].heardMs = nowMs;
+        seenNext_ = (seenNext_ + 1) % SeenCapacity;
+        if (seenCount_ < SeenCapacity) seenCount_++;
+        stats_.accepted++;
+        return true;
+    }
+
+    // Hold an accepted frame (already rewritten with one hop fewer) until
+    // dueMs. Returns false if the pending table is full.
+    bool schedule(uint8_t type, uint8_t origin, uint8_t sequence,
+                  const uint8_t* data, size_t length, uint32_t dueMs) {
+        if (length > MaxFrame || pendingCount_ >= PendingCapacity) {
+            stats_.dropped++;
+            return false;
+        }
+        Frame& frame = pending_[pendingCount_++];
+        frame.type = type;
+        frame.origin = origin;
+        frame.sequence = sequence;
+        frame.copiesHeard = 0;
+        frame.dueMs = dueMs;
+        frame.length = (uint8_t)length;
+        memcpy(frame.data, data, length);
+        stats_.scheduled++;
+        return true;
+    }
+
+    void noteHopLimited() { stats_.hopLimited++; }
+    void noteForwarded(bool queued) { queued ? stats_.forwarded++ : stats_.dropped++; }
+
+    // Earliest pending rebroadcast that is due; false if none
+    bool popDue(Frame& out, uint32_t nowMs) {
+        int best = -1;
+        for (size_t i = 0; i < pendingCount_; i++) {
+            if ((int32_t)(nowMs - pending_[i].dueMs) < 0) continue;
+            if (best < 0 || (int32_t)(pending_[i].dueMs - pending_[best].dueMs) < 0) best = (int)i;
+        }
+        if (best < 0) return false;
+        out = pending_[best];
+        removePending((size_t)best);
+        return true;
+    }
+
+    // Time until the next rebroadcast is due; UINT32_MAX if none pending
+    uint32_t msUntilDue(uint32_t nowMs) const {
+        uint32_t wait = UINT32_MAX;
+        for (size_t i = 0; i < pendingCount_; i++) {
+            int32_t left = (int32_t)(pending_[i].dueMs - nowMs);
+            uint32_t ms = left > 0 ? (uint32_t)left : 0;
+            if (ms < wait) wait = ms;
+        }
+        return wait;
+    }
+
+private:
+    struct Seen {
+        uint16_t key;       // origin << 8 | sequence
+        uint32_t heardMs;
+    };
+
+    void heardCopy(uint8_t origin, uint8_t sequence) {
+        for (size_t i = 0; i < pendingCount_; i++) {
+            Frame& frame = pending_[i];
+            if (frame.origin != origin || frame.sequence != sequence) continue;
+            if (duplicateLimit_ != 0 && ++frame.copiesHeard >= duplicateLimit_) {
+                removePending(i);
+                stats_.cancelled++;
+            }
+            return;
+        }
+    }
+
+    void removePending(size_t i) {
+        pending_[i] = pending_[--pendingCount_];
+    }
+
+    uint8_t localNode_;
+    uint32_t seenWindowMs_;
+    uint8_t duplicateLimit_;
+    Seen seen_[SeenCapacity] = {};
+    size_t seenCount_ = 0;
+    size_t seenNext_ = 0;
+    Frame pending_[PendingCapacity];
+    size_t pendingCount_ = 0;
+    MeshRelayStats stats_ = {};
+};
+
+#endif // MESH_RELAY_H
@@ -0,0 +1,219 @@
+/**
+ * btrpa-scan-lora Position Beacon Policy
+ *
+ * Dead reckoning shared by a node and whoever hears it. Every frame that
+ * carries the node's position (a beacon or a hit) also carries its
+ * velocity while it moves; both ends extrapolate from that reference, and
+ * the node beacons again only when its true position strays from the
+ * prediction by more than a threshold, or the longest interval passes.
+ * A team walking a straight line then costs one beacon per leg rather
+ * than one every 25 m, and a node standing still one per interval.
+ *
+ * The node times its reference from when the frame is queued and a
+ * receiver from when it arrives, so both predict the same track, offset
+ * by the time the frame waits and spends on air.
+ *
+ * Distances use the local tangent plane at the reference: a degree x 1e7
+ * is a fixed 1.113 cm north and that times cos(latitude) east, the
+ * cosine taken once per reference as Q15. Compared squared in 64-bit
+ * integers, with no square root or trigonometry per fix. Over a few
+ * kilometres this is within 0.5 % of the great-circle distance, well
+ * below GPS noise. Not thread-safe. Fixed storage, no heap.
+ */
+
+#ifndef POSITION_BEACON_H
+#define POSITION_BEACON_H
+
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "gps_receiver.h"
+#include "wire_format.h"
+
+// Centimetres per degree x 1e7 along a meridian, as a fraction
+constexpr int64_t GEO_CM_PER_E7_NUM = 111319;
+constexpr int64_t GEO_CM_PER_E7_DEN = 100000;
+constexpr int64_t GEO_E7_PER_TURN = 3600000000LL;
+
+// Longitude difference a - b, the short way round
+inline int64_t geoLonDeltaE7(int32_t a, int32_t b) {
+    int64_t delta = (int64_t)a - b;
+    if (delta > GEO_E7_PER_TURN / 2) delta -= GEO_E7_PER_TURN;
+    if (delta < -GEO_E7_PER_TURN / 2) delta += GEO_E7_PER_TURN;
+    return delta;
+}
+
+// Velocity in WIRE_VELOCITY_UNIT_CMS steps from the fix's speed and
+// course; false (and zero) below stationaryCmS, where GPS course is noise
+inline bool beaconVelocity(const GpsFix& fix, uint16_t stationaryCmS, int8_t& east, int8_t& north) {
+    east = 0;
+    north = 0;
+    if (fix.speedCmS < stationaryCmS) return false;
+    float course = fix.courseCentiDeg * (float)(M_PI / 18000.0);
+    float steps = (float)fix.speedCmS / WIRE_VELOCITY_UNIT_CMS;
+    float e = roundf(steps * sinf(course));
+    float n = roundf(steps * cosf(course));
+    east = (int8_t)(e > 127.0f ? 127 : e < -127.0f ? -127 : e);
+    north = (int8_t)(n > 127.0f ? 127 : n < -127.0f ? -127 : n);
+    return east != 0 || north != 0;
+}
+
+// Last reported position and velocity, and the prediction from them
+struct PositionTrack {
+    int32_t latE7;
+    int32_t lonE7;
+    int16_t eastCmS;
+    int16_t northCmS;
+    uint16_t cosLatQ15;     // cos(latitude), 32767 = 1
+    bool known;
+    uint32_t atMs;          // sent (node) or heard (receiver)
+
+    void set(int32_t lat, int32_t lon, int8_t velocityEast, int8_t velocityNorth, uint32_t nowMs) {
+        latE7 = lat;
+        lonE7 = lon;
+        eastCmS = (int16_t)(velocityEast * WIRE_VELOCITY_UNIT_CMS);
+        northCmS = (int16_t)(velocityNorth * WIRE_VELOCITY_UNIT_CMS);
+        // Near the poles an east step is too many degrees to track anyway
+        float c = cosf(lat * (float)(M_PI / 1.8e9));
+        cosLatQ15 = (uint16_t)(c < 0.01f ? 328 : c * 32767.0f);
+        known = true;
+        atMs = nowMs;
+    }
+
+    bool moving() const { return eastCmS != 0 || northCmS != 0; }
+
+    // Predicted position at nowMs; extrapolation stops horizonMs after the reference
+    void predict(uint32_t nowMs, uint32_t horizonMs, int32_t& lat, int32_t& lon) const {
+        lat = latE7;
+        lon = lonE7;
+        if (!moving()) return;
+        uint32_t dtMs = nowMs - atMs;
+        if (dtMs > horizonMs) dtMs = horizonMs;
+        int64_t northCm = (int64_t)northCmS * dtMs / 1000;
+        int64_t eastCm = (int64_t)eastCmS * dtMs / 1000;
+        int64_t newLat = latE7 + northCm * GEO_CM_PER_E7_DEN / GEO_CM_PER_E7_NUM;
+        int64_t newLon = (lonE7 + eastCm * GEO_CM_PER_E7_DEN * 32768 / (GEO_CM_PER_E7_NUM * cosLatQ15)) % GEO_E7_PER_TURN;
+        if (newLat > 900000000) newLat = 900000000;
+        if (newLat < -900000000) newLat = -900000000;
+        if (newLon > GEO_E7_PER_TURN / 2) newLon -= GEO_E7_PER_TURN;
+        if (newLon < -GEO_E7_PER_TURN / 2) newLon += GEO_E7_PER_TURN;
+        lat = (int32_t)newLat;
+        lon = (int32_t)newLon;
+    }
+
+    // Squared distance of (lat, lon) from the prediction, cm^2
+    uint64_t deviationCm2(int32_t lat, int32_t lon, uint32_t nowMs, uint32_t horizonMs) const {
+        int32_t predictedLat, predictedLon;
+        predict(nowMs, horizonMs, predictedLat, predictedLon);
+        int64_t north = ((int64_t)lat - predictedLat) * GEO_CM_PER_E7_NUM / GEO_CM_PER_E7_DEN;
+        int64_t east = geoLonDeltaE7(lon, predictedLon) * GEO_CM_PER_E7_NUM / GEO_CM_PER_E7_DEN * cosLatQ15 >> 15;
+        // Half a circumference in cm squares to 4e18; two fit in 64 bits
+        return (uint64_t)(north * north) + (uint64_t)(east * east);
+    }
+};
+
+enum BeaconReason : uint8_t {
+    BEACON_NONE = 0,
+    BEACON_FIRST,           // no reference yet
+    BEACON_DEVIATION,       // strayed from the prediction
+    BEACON_INTERVAL,        // longest interval passed
+};
+
+inline const char* beaconReasonName(BeaconReason reason) {
+    switch (reason) {
+        case BEACON_NONE: return "none";
+        case BEACON_FIRST: return "first fix";
+        case BEACON_DEVIATION: return "off prediction";
+        case BEACON_INTERVAL: return "interval";
+    }
+    return "?";
+}
+
+struct BeaconStats {
+    uint32_t fixes;         // fixes checked against the prediction
+    uint32_t sent[4];       // beacons by BeaconReason
+    uint32_t viaHits;       // positions that went out on hit frames instead
+};
+
+// The node's side: when to beacon
+class BeaconPolicy {
+public:
+    BeaconPolicy(uint32_t deviationCm, uint32_t minIntervalMs, uint32_t maxIntervalMs)
+        : deviationCm2_((uint64_t)deviationCm * deviationCm),
+          minIntervalMs_(minIntervalMs), maxIntervalMs_(maxIntervalMs) {}
+
+    BeaconReason due(const GpsFix& fix, uint32_t nowMs) {
+        if (!fix.valid()) return BEACON_NONE;
+        if (!reference_.known) return BEACON_FIRST;
+        uint32_t sinceMs = nowMs - reference_.atMs;
+        if (sinceMs < minIntervalMs_) return BEACON_NONE;
+        if (sinceMs >= maxIntervalMs_) return BEACON_INTERVAL;
+        stats_.fixes++;
+        return reference_.deviationCm2(fix.latE7, fix.lonE7, nowMs, maxIntervalMs_) > deviationCm2_ ?
+            BEACON_DEVIATION : BEACON_NONE;
+    }
+
+    void sent(const PositionTrack& track, BeaconReason reason) {
+        reference_ = track;
+        stats_.sent[reason]++;
+    }
+
+    // A hit frame carried the position; adopted if newer than the reference
+    void sentWithHit(const PositionTrack& track) {
+        if (!track.known) return;
+        if (reference_.known && (int32_t)(track.atMs - reference_.atMs) <= 0) return;
+        reference_ = track;
+        stats_.viaHits++;
+    }
+
+    const PositionTrack& reference() const { return reference_; }
+    const BeaconStats& stats() const { return stats_; }
+
+private:
+    uint64_t deviationCm2_;
+    uint32_t minIntervalMs_;
+    uint32_t maxIntervalMs_;
+    PositionTrack reference_ = {};
+    BeaconStats stats_ = {};
+};
+
+// A receiver's side: the last position each node reported. A full table
+// replaces the longest-silent node.
+template <size_t Capacity>
+class NodeTracks {
+public:
+    void update(uint8_t node, const WireFrame& frame, uint32_t nowMs) {
+        if (node == 0 || !frame.hasPosition) return;
+        Entry* slot = nullptr;
+        for (size_t i = 0; i < Capacity; i++) {
+            if (entries_[i].node == node) {
+                slot = &entries_[i];
+                break;
+            }
+            if (!slot || entries_[i].node == 0 ||
+                (slot->node != 0 && (int32_t)(entries_[i].track.atMs - slot->track.atMs) < 0)) {
+                slot = &entries_[i];
+            }
+        }
+        slot->node = node;
+        slot->track.set(frame.latE7, frame.lonE7, frame.hasVelocity ? frame.velocityEast : 0,
+                        frame.hasVelocity ? frame.velocityNorth : 0, nowMs);
+    }
+
+    const PositionTrack* find(uint8_t node) const {
+        for (size_t i = 0; i < Capacity; i++) {
+            if (node != 0 && entries_[i].node == node) return &entries_[i].track;
+        }
+        return nullptr;
+    }
+
+private:
+    struct Entry {
+        uint8_t node;       // 0 = free
+        PositionTrack track;
+    };
+    Entry entries_[Capacity] = {};
+};
+
+#endif // POSITION_BEACON_H
@@ -0,0 +1,158 @@
+/**
+ * btrpa-scan-lora Address Prefix Index
+ *
+ * Longest-prefix-match table over 48-bit MAC keys (see mac_table.h),
+ * built at compile time from config.h. Prefixes are nibble-granular
+ * ("70:b3:d5" = 24-bit MA-L, "70:b3:d5:b3:4" = 36-bit MA-S) or carry an
+ * explicit bit length ("70:b3:d5:b3:40/34").
+ *
+ * Entries are grouped by prefix length, longest first, and sorted within
+ * each group, so a lookup is one masked binary search per distinct length
+ * (at most three for IEEE MA-L/MA-M/MA-S data) and the first hit is the
+ * most specific match. The table is const data in flash; no heap.
+ */
+
+#ifndef PREFIX_INDEX_H
+#define PREFIX_INDEX_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "mac_table.h"
+
+constexpr uint8_t MAC_KEY_BITS = 48;
+
+struct AddressPrefix {
+    uint64_t value;     // prefix bits, left-aligned in a 48-bit key
+    uint8_t bits;       // 0 = malformed
+};
+
+constexpr uint64_t prefixMask(uint8_t bits) {
+    return bits == 0 ? 0 : (((1ULL << bits) - 1) << (MAC_KEY_BITS - bits));
+}
+
+// "70:b3:d5:b3:4" -> {0x70b3d5b34 << 12, 36}; optional "/bits" suffix
+constexpr AddressPrefix parseAddressPrefix(const char* text) {
+    uint64_t value = 0;
+    int nibbles = 0;
+    const char* p = text;
+    for (; *p != '\0' && *p != '/'; p++) {
+        if (*p == ':' || *p == '-') continue;
+        int n = macHexNibble(*p);
+        if (n < 0 || nibbles == 12) return {0, 0};
+        value = (value << 4) | (uint64_t)n;
+        nibbles++;
+    }
+    if (nibbles == 0) return {0, 0};
+    int bits = nibbles * 4;
+    value <<= MAC_KEY_BITS - bits;
+    if (*p == '/') {
+        int explicitBits = 0;
+        for (p++; *p != '\0'; p++) {
+            if (*p < '0' || *p > '9') return {0, 0};
+            explicitBits = explicitBits * 10 + (*p - '0');
+        }
+        if (explicitBits < 1 || explicitBits > bits) return {0, 0};
+        // Bits beyond the stated length must be zero
+        if ((value & ~prefixMask((uint8_t)explicitBits)) != 0) return {0, 0};
+        bits = explicitBits;
+    }
+    return {value, (uint8_t)bits};
+}
+
+struct PrefixEntry {
+    uint64_t value;
+    uint8_t bits;
+    uint16_t index;     // position in the source table
+};
+
+struct PrefixLengthGroup {
+    uint8_t bits;
+    uint16_t start;
+    uint16_t count;
+};
+
+// Longer prefixes first, then by value, then by source order
+constexpr bool prefixEntryBefore(const PrefixEntry& a, const PrefixEntry& b) {
+    return a.bits != b.bits ? a.bits > b.bits :
+           a.value != b.value ? a.value < b.value : a.index < b.index;
+}
+
+template <size_t N>
+struct PrefixIndex {
+    PrefixEntry entries[N];
+    PrefixLengthGroup groups[MAC_KEY_BITS];
+    uint8_t numGroups;
+
+    constexpr size_t size() const { return N; }
+
+    constexpr bool valid() const {
+        for (size_t i = 0; i < N; i++) {
+            if (entries[i].bits == 0) return false;
+        }
+        return true;
+    }
+
+    // Index into the source table of the most specific match, or -1
+    constexpr int lookup(uint64_t key) const {
+        for (uint8_t g = 0; g < numGroups; g++) {
+            const PrefixLengthGroup& group = groups[g];
+            uint64_t masked = key & prefixMask(group.bits);
+            size_t lo = group.start, hi = group.start + group.count;
+            while (lo < hi) {
+                size_t mid = lo + (hi - lo) / 2;
+                if (entries[mid].value < masked) {
+                    lo = mid + 1;
+                } else {
+                    hi = mid;
+                }
+            }
+            if (lo < (size_t)(group.start + group.count) && entries[lo].value == masked) {
+                return entries[lo].index;
+            }
+        }
+        return -1;
+    }
+};
+
+template <size_t N>
+constexpr void prefixIndexSiftDown(PrefixEntry (&entries)[N], size_t root, size_t end) {
+    while (2 * root + 1 < end) {
+        size_t child = 2 * root + 1;
+        if (child + 1 < end && prefixEntryBefore(entries[child], entries[child + 1])) child++;
+        if (!prefixEntryBefore(entries[root], entries[child])) return;
+        PrefixEntry tmp = entries[root];
+        entries[root] = entries[child];
+        entries[child] = tmp;
+        root = child;
+    }
+}
+
+// Build from any array of records with a `const char* prefix` member
+template <typename T, size_t N>
+constexpr PrefixIndex<N> makePrefixIndex(const T (&records)[N]) {
+    static_assert(N <= UINT16_MAX, "prefix table too large");
+    PrefixIndex<N> index{};
+    for (size_t i = 0; i < N; i++) {
+        AddressPrefix prefix = parseAddressPrefix(records[i].prefix);
+        index.entries[i] = {prefix.value, prefix.bits, (uint16_t)i};
+    }
+    for (size_t i = N / 2; i-- > 0;) {
+        prefixIndexSiftDown(index.entries, i, N);
+    }
+    for (size_t end = N; end-- > 1;) {
+        PrefixEntry tmp = index.entries[0];
+        index.entries[0] = index.entries[end];
+        index.entries[end] = tmp;
+        prefixIndexSiftDown(index.entries, 0, end);
+    }
+    for (size_t i = 0; i < N; i++) {
+        if (index.numGroups == 0 || index.groups[index.numGroups - 1].bits != index.entries[i].bits) {
+            index.groups[index.numGroups++] = {index.entries[i].bits, (uint16_t)i, 0};
+        }
+        index.groups[index.numGroups - 1].count++;
+    }
+    return index;
+}
+
+#endif // PREFIX_INDEX_H
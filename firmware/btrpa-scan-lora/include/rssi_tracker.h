@@ -0,0 +1,147 @@
+/**
+ * btrpa-scan-lora RSSI Tracker
+ *
+ * Smoothed RSSI, distance and trend per tracked device, in six bytes of
+ * fixed-point state kept in its device cache entry (device_cache.h).
+ *
+ * The level is a one-state Kalman filter: between sightings the true RSSI
+ * may wander (process variance growing with the gap), and each sample
+ * carries a fixed measurement variance. A device heard ten times a second
+ * is smoothed hard; one heard every few seconds follows its samples more
+ * closely. A slower average (time constant trendTauMs) trails the level;
+ * the level standing above it means the signal is rising, the device is
+ * getting closer.
+ *
+ * Distance uses the log-distance path-loss model of btrpa-scan.py:
+ * d = 10^((rssiAt1m - rssi) / (10 n)), with n per environment. On the wire
+ * it is a log-scale code, distance = 10^(code / 16) decimetres (15 % steps,
+ * 0.1 m to 750 m), which is linear in RSSI, so no logarithm is taken on
+ * the node. It is a rough range: bodies, walls and antenna orientation
+ * move a BLE reading by 10 dB or more, a factor of two in distance.
+ */
+
+#ifndef RSSI_TRACKER_H
+#define RSSI_TRACKER_H
+
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+
+enum RssiEnvironment : uint8_t {
+    RSSI_ENV_FREE_SPACE = 0,
+    RSSI_ENV_OUTDOOR,
+    RSSI_ENV_INDOOR,
+    RSSI_ENV_COUNT,
+};
+
+// Path-loss exponent n x 10, as btrpa-scan.py --environment
+constexpr uint8_t RSSI_PATH_LOSS_X10[RSSI_ENV_COUNT] = {20, 22, 30};
+
+inline const char* rssiEnvironmentName(uint8_t environment) {
+    static const char* const NAMES[RSSI_ENV_COUNT] = {"free_space", "outdoor", "indoor"};
+    return environment < RSSI_ENV_COUNT ? NAMES[environment] : "?";
+}
+
+enum RssiTrend : uint8_t {
+    RSSI_TREND_UNKNOWN = 0,     // too little history
+    RSSI_TREND_STEADY,
+    RSSI_TREND_APPROACHING,     // signal rising
+    RSSI_TREND_RECEDING,
+};
+
+inline const char* rssiTrendName(uint8_t trend) {
+    switch (trend) {
+        case RSSI_TREND_UNKNOWN: return "trend unknown";
+        case RSSI_TREND_STEADY: return "steady";
+        case RSSI_TREND_APPROACHING: return "approaching";
+        case RSSI_TREND_RECEDING: return "receding";
+    }
+    return "?";
+}
+
+struct RssiFilterConfig {
+    uint16_t wanderQ8;      // true-RSSI variance growth, dB^2 per second x 256
+    uint16_t noiseQ8;       // one sample's variance, dB^2 x 256
+    uint32_t trendTauMs;    // time constant of the trailing average
+    int16_t trendQ4;        // level this far from it: approaching or receding, dB x 16
+};
+
+constexpr RssiFilterConfig makeRssiFilterConfig(float wanderDb, float noiseDb, uint32_t trendTauMs, float trendDb) {
+    return {(uint16_t)(wanderDb * wanderDb * 256), (uint16_t)(noiseDb * noiseDb * 256), trendTauMs,
+            (int16_t)(trendDb * 16)};
+}
+
+struct RssiFilter {
+    int16_t levelQ4;        // estimate, dBm x 16
+    int16_t trailQ4;        // trailing average of the estimate, dBm x 16
+    uint16_t varianceQ8;    // of the estimate, dB^2 x 256
+
+    void reset(int8_t rssi, const RssiFilterConfig& config) {
+        levelQ4 = (int16_t)(rssi * 16);
+        trailQ4 = levelQ4;
+        varianceQ8 = config.noiseQ8;
+    }
+
+    // A sample dtMs after the previous one
+    void update(int8_t rssi, uint32_t dtMs, const RssiFilterConfig& config) {
+        if (dtMs > 60000) dtMs = 60000;
+        uint32_t variance = varianceQ8 + (uint32_t)config.wanderQ8 * dtMs / 1000;
+        if (variance > UINT16_MAX) variance = UINT16_MAX;
+        uint32_t gainQ15 = (variance << 15) / (variance + config.noiseQ8);
+        int32_t innovation = rssi * 16 - levelQ4;
+        levelQ4 = (int16_t)(levelQ4 + ((innovation * (int32_t)gainQ15 + (1 << 14)) >> 15));
+        varianceQ8 = (uint16_t)(variance - ((variance * gainQ15) >> 15));
+
+        uint32_t alphaQ15 = (uint32_t)(((uint64_t)dtMs << 15) / (config.trendTauMs + dtMs));
+        trailQ4 = (int16_t)(trailQ4 + (((int32_t)(levelQ4 - trailQ4) * (int32_t)alphaQ15 + (1 << 14)) >> 15));
+    }
+
+    int8_t rssi() const {
+        return (int8_t)((levelQ4 + (levelQ4 < 0 ? -8 : 8)) / 16);
+    }
+
+    // Signal change, dB per minute: the lead over the trailing average is
+    // about the slope times the time constant
+    float slopeDbPerMin(const RssiFilterConfig& config) const {
+        return (levelQ4 - trailQ4) / 16.0f * 60000.0f / config.trendTauMs;
+    }
+
+    RssiTrend trend(const RssiFilterConfig& config) const {
+        int16_t lead = (int16_t)(levelQ4 - trailQ4);
+        return lead >= config.trendQ4 ? RSSI_TREND_APPROACHING :
+               lead <= -config.trendQ4 ? RSSI_TREND_RECEDING : RSSI_TREND_STEADY;
+    }
+};
+
+static_assert(sizeof(RssiFilter) == 6, "RssiFilter grew past its per-device budget");
+
+// ============================================================================
+// Range byte
+// ============================================================================
+
+// One byte per reported detection: bits 0-5 distance code + 1 (0 = no
+// estimate), bits 6-7 RssiTrend
+constexpr uint8_t RSSI_RANGE_CODE_MASK = 0x3F;
+constexpr uint8_t RSSI_RANGE_TREND_SHIFT = 6;
+constexpr uint8_t RSSI_RANGE_NONE = 0;
+constexpr int RSSI_RANGE_MAX_CODE = 62;
+
+// code = 16 log10(d / 0.1 m) = 16 + 1.6 (rssiAt1m - rssi) / n
+inline uint8_t rssiRange(int16_t levelQ4, int8_t rssiAt1m, uint8_t environment, RssiTrend trend) {
+    int32_t divisor = RSSI_PATH_LOSS_X10[environment < RSSI_ENV_COUNT ? environment : (uint8_t)RSSI_ENV_FREE_SPACE];
+    int32_t loss = rssiAt1m * 16 - levelQ4;
+    int32_t code = 16 + (loss >= 0 ? loss + divisor / 2 : loss - divisor / 2) / divisor;
+    if (code < 0) code = 0;
+    if (code > RSSI_RANGE_MAX_CODE) code = RSSI_RANGE_MAX_CODE;
+    return (uint8_t)((code + 1) | trend << RSSI_RANGE_TREND_SHIFT);
+}
+
+inline bool rssiRangeKnown(uint8_t range) { return (range & RSSI_RANGE_CODE_MASK) != RSSI_RANGE_NONE; }
+
+inline float rssiRangeMeters(uint8_t range) {
+    return powf(10.0f, ((range & RSSI_RANGE_CODE_MASK) - 1) / 16.0f) / 10.0f;
+}
+
+inline RssiTrend rssiRangeTrend(uint8_t range) { return (RssiTrend)(range >> RSSI_RANGE_TREND_SHIFT); }
+
+#endif // RSSI_TRACKER_H
@@ -0,0 +1,294 @@
+/**
+ * btrpa-scan-lora Scan Scheduler
+ *
+ * Chooses how hard the node scans. Three profiles:
+ *   ACTIVE        the configured BLE interval/window (90% by default)
+ *   CONSERVATION  one scan window per interval, light sleep in between
+ *                 (the PRD's 10% duty cycle for long deployments)
+ *   BURST         continuous scanning for a while after a hit
+ * In order of precedence: a mesh command (for a set time or until the
+ * next one), a recent hit, a low battery (with hysteresis), a long time
+ * without any hit, else ACTIVE.
+ *
+ * A profile whose gap between windows is long enough to sleep through is
+ * "windowed": the caller switches the scanner on and off at the window
+ * edges this class reports. Shorter gaps are left to the BLE controller's
+ * own interval/window.
+ *
+ * The scheduler also keeps time spent per profile (scanning, asleep,
+ * awake) and turns it into an estimated average current with a simple
+ * per-state model. Everything takes the time as an argument, so the
+ * policy runs the same against the simulated clock. Not thread-safe: the
+ * main loop owns it. Fixed storage, no heap.
+ */
+
+#ifndef SCAN_SCHEDULER_H
+#define SCAN_SCHEDULER_H
+
+#include <stdint.h>
+
+enum ScanProfile : uint8_t {
+    SCAN_PROFILE_ACTIVE = 0,
+    SCAN_PROFILE_CONSERVATION,
+    SCAN_PROFILE_BURST,
+    SCAN_PROFILE_COUNT
+};
+
+// A command for SCAN_PROFILE_COUNT hands control back to the policy
+constexpr uint8_t SCAN_PROFILE_AUTO = SCAN_PROFILE_COUNT;
+
+inline const char* scanProfileName(uint8_t profile) {
+    static const char* const names[SCAN_PROFILE_COUNT + 1] = {"active", "conservation", "burst", "auto"};
+    return profile <= SCAN_PROFILE_COUNT ? names[profile] : "?";
+}
+
+// Why the current profile was chosen
+enum ScanReason : uint8_t {
+    SCAN_REASON_DEFAULT = 0,
+    SCAN_REASON_HIT,
+    SCAN_REASON_BATTERY,
+    SCAN_REASON_IDLE,
+    SCAN_REASON_COMMAND,
+};
+
+inline const char* scanReasonName(uint8_t reason) {
+    static const char* const names[] = {"default", "recent hit", "battery low", "no hits", "command"};
+    return reason <= SCAN_REASON_COMMAND ? names[reason] : "?";
+}
+
+struct ScanTiming {
+    uint16_t intervalMs;
+    uint16_t windowMs;
+
+    constexpr uint16_t dutyPermille() const {
+        return intervalMs > 0 && windowMs < intervalMs ? (uint16_t)(windowMs * 1000UL / intervalMs) : 1000;
+    }
+};
+
+struct ScanPolicy {
+    ScanTiming timing[SCAN_PROFILE_COUNT];
+    uint32_t burstMs;               // burst after a hit (0 = never)
+    uint32_t idleMs;                // conserve after this long without a hit (0 = never)
+    uint16_t batteryLowMv;          // conserve below this (0 = ignore the battery)
+    uint16_t batteryRecoverMv;      // until back above this
+    uint16_t sleepMinGapMs;         // shortest gap between windows worth sleeping through
+};
+
+// Board current draw by state, mA. The BLE figure is on top of awake.
+struct PowerModel {
+    float awakeMa;                  // CPUs running, radios idle
+    float bleScanMa;                // BLE receiver on
+    float lightSleepMa;             // whole board in light sleep, LoRa in RX
+    float loraRxMa;                 // SX1262 listening (always)
+    float displayMa;                // OLED lit (off in conservation)
+};
+
+// Rough Heltec V3 figures: ESP32-S3 at 240 MHz, SX1262 in RX, 0.96" OLED
+constexpr PowerModel HELTEC_V3_POWER_MODEL = {40.0f, 50.0f, 1.5f, 5.0f, 10.0f};
+
+struct ScanProfileUsage {
+    uint64_t totalMs;
+    uint64_t scanMs;                // BLE receiver on (window x controller duty)
+    uint64_t sleepMs;               // light sleep
+    uint32_t entered;               // times switched into
+};
+
+struct ScanCommand {
+    uint8_t profile;                // ScanProfile, or SCAN_PROFILE_AUTO
+    uint32_t durationMs;            // 0 = until the next command
+};
+
+class ScanScheduler {
+public:
+    ScanScheduler(const ScanPolicy& policy, const PowerModel& model) : policy_(policy), model_(model) {}
+
+    ScanProfile profile() const { return profile_; }
+    ScanReason reason() const { return reason_; }
+    const ScanTiming& timing() const { return policy_.timing[profile_]; }
+    const ScanProfileUsage& usage(ScanProfile profile) const { return usage_[profile]; }
+    uint16_t batteryMv() const { return batteryMv_; }
+
+    // Inputs
+    void hit(uint32_t nowMs) {
+        lastHitMs_ = nowMs;
+        hitSeen_ = true;
+    }
+
+    // Filtered battery voltage; 0 = not measured
+    void battery(uint16_t mv) {
+        batteryMv_ = mv;
+        if (policy_.batteryLowMv == 0 || mv == 0) {
+            batteryLow_ = false;
+        } else if (mv < policy_.batteryLowMv) {
+            batteryLow_ = true;
+        } else if (mv > policy_.batteryRecoverMv) {
+            batteryLow_ = false;
+        }
+    }
+
+    void command(const ScanCommand& cmd, uint32_t nowMs) {
+        commanded_ = cmd.profile < SCAN_PROFILE_COUNT;
+        commandProfile_ = cmd.profile;
+        commandStartMs_ = nowMs;
+        commandMs_ = cmd.durationMs;
+    }
+
+    // Re-evaluate the policy and book the time since the last call to the
+    // profile that ran; scanning says whether the scanner was on. True if
+    // the profile changed (the caller then applies timing()).
+    bool update(uint32_t nowMs, bool scanning) {
+        account(nowMs, scanning);
+
+        if (commanded_ && commandMs_ > 0 && nowMs - commandStartMs_ >= commandMs_) commanded_ = false;
+
+        ScanProfile next = SCAN_PROFILE_ACTIVE;
+        ScanReason why = SCAN_REASON_DEFAULT;
+        uint32_t sinceHitMs = nowMs - (hitSeen_ ? lastHitMs_ : startMs_);
+        if ((int32_t)sinceHitMs < 0) sinceHitMs = 0;     // hit stamped after nowMs
+        if (commanded_) {
+            next = (ScanProfile)commandProfile_;
+            why = SCAN_REASON_COMMAND;
+        } else if (hitSeen_ && policy_.burstMs > 0 && sinceHitMs < policy_.burstMs) {
+            next = SCAN_PROFILE_BURST;
+            why = SCAN_REASON_HIT;
+        } else if (batteryLow_) {
+            next = SCAN_PROFILE_CONSERVATION;
+            why = SCAN_REASON_BATTERY;
+        } else if (policy_.idleMs > 0 && sinceHitMs >= policy_.idleMs) {
+            next = SCAN_PROFILE_CONSERVATION;
+            why = SCAN_REASON_IDLE;
+        }
+
+        reason_ = why;
+        if (next == profile_ && started_) return false;
+        profile_ = next;
+        phaseMs_ = nowMs;
+        usage_[profile_].entered++;
+        if (started_) switches_++;
+        started_ = true;
+        return true;
+    }
+
+    // Call once before the first update()
+    void begin(uint32_t nowMs) {
+        startMs_ = nowMs;
+        lastAccountMs_ = nowMs;
+        phaseMs_ = nowMs;
+    }
+
+    uint32_t switches() const { return switches_; }
+
+    // The caller runs the windows of this profile itself
+    bool windowed() const { return windowed(profile_); }
+    bool windowed(ScanProfile profile) const {
+        const ScanTiming& t = policy_.timing[profile];
+        return t.windowMs < t.intervalMs && t.intervalMs - t.windowMs >= policy_.sleepMinGapMs;
+    }
+
+    // Whether a windowed profile should be scanning now (always true for
+    // the others), and the time to the next window edge
+    bool windowOpen(uint32_t nowMs) const {
+        if (!windowed()) return true;
+        return (nowMs - phaseMs_) % timing().intervalMs < timing().windowMs;
+    }
+
+    uint32_t msUntilEdge(uint32_t nowMs) const {
+        if (!windowed()) return UINT32_MAX;
+        uint32_t phase = (nowMs - phaseMs_) % timing().intervalMs;
+        return phase < timing().windowMs ? timing().windowMs - phase : timing().intervalMs - phase;
+    }
+
+    // Time until update() could change anything without a new input: the
+    // next window edge, the end of a command or burst, or the idle limit
+    uint32_t msUntilNextEvent(uint32_t nowMs) const {
+        uint32_t wait = msUntilEdge(nowMs);
+        if (commanded_) {
+            uint32_t ranMs = nowMs - commandStartMs_;
+            if (commandMs_ > 0) wait = earlier(wait, ranMs < commandMs_ ? commandMs_ - ranMs : 0);
+            return wait;
+        }
+        uint32_t sinceHitMs = nowMs - (hitSeen_ ? lastHitMs_ : startMs_);
+        if ((int32_t)sinceHitMs < 0) sinceHitMs = 0;
+        if (hitSeen_ && policy_.burstMs > sinceHitMs) wait = earlier(wait, policy_.burstMs - sinceHitMs);
+        if (policy_.idleMs > sinceHitMs) wait = earlier(wait, policy_.idleMs - sinceHitMs);
+        return wait;
+    }
+
+    // Time the caller spent in light sleep, booked at the next update()
+    void slept(uint32_t ms) { pendingSleepMs_ += ms; }
+
+    // Average current for a profile: from the time actually spent in it,
+    // or from its nominal timing until it has run for ten intervals
+    float estimatedMa(ScanProfile profile) const {
+        const ScanProfileUsage& u = usage_[profile];
+        float scan, sleep;
+        if (u.totalMs >= 10ULL * policy_.timing[profile].intervalMs) {
+            scan = (float)u.scanMs / u.totalMs;
+            sleep = (float)u.sleepMs / u.totalMs;
+        } else {
+            scan = policy_.timing[profile].dutyPermille() / 1000.0f;
+            sleep = windowed(profile) ? 1.0f - scan : 0.0f;
+        }
+        float ma = (1.0f - sleep) * model_.awakeMa + scan * model_.bleScanMa +
+                   sleep * model_.lightSleepMa + model_.loraRxMa;
+        if (displayOn(profile)) ma += model_.displayMa;
+        return ma;
+    }
+
+    // Average over everything so far
+    float estimatedMa() const {
+        uint64_t total = 0;
+        float charge = 0.0f;
+        for (int p = 0; p < SCAN_PROFILE_COUNT; p++) {
+            total += usage_[p].totalMs;
+            charge += estimatedMa((ScanProfile)p) * usage_[p].totalMs;
+        }
+        return total > 0 ? charge / total : estimatedMa(profile_);
+    }
+
+    static constexpr bool displayOn(ScanProfile profile) { return profile != SCAN_PROFILE_CONSERVATION; }
+
+private:
+    static uint32_t earlier(uint32_t a, uint32_t b) { return a < b ? a : b; }
+
+    void account(uint32_t nowMs, bool scanning) {
+        uint32_t elapsed = nowMs - lastAccountMs_;
+        lastAccountMs_ = nowMs;
+        if (!started_) {
+            pendingSleepMs_ = 0;
+            return;
+        }
+        ScanProfileUsage& u = usage_[profile_];
+        uint32_t sleepMs = pendingSleepMs_ < elapsed ? pendingSleepMs_ : elapsed;
+        pendingSleepMs_ = 0;
+        u.totalMs += elapsed;
+        u.sleepMs += sleepMs;
+        // In a windowed profile the scanner runs flat out while it is on
+        if (scanning) {
+            uint32_t awake = elapsed - sleepMs;
+            u.scanMs += windowed() ? awake : (uint64_t)awake * timing().dutyPermille() / 1000;
+        }
+    }
+
+    ScanPolicy policy_;
+    PowerModel model_;
+    ScanProfile profile_ = SCAN_PROFILE_ACTIVE;
+    ScanReason reason_ = SCAN_REASON_DEFAULT;
+    ScanProfileUsage usage_[SCAN_PROFILE_COUNT] = {};
+    uint32_t startMs_ = 0;
+    uint32_t phaseMs_ = 0;
+    uint32_t lastAccountMs_ = 0;
+    uint32_t lastHitMs_ = 0;
+    uint32_t pendingSleepMs_ = 0;
+    uint32_t commandStartMs_ = 0;
+    uint32_t commandMs_ = 0;
+    uint32_t switches_ = 0;
+    uint16_t batteryMv_ = 0;
+    uint8_t commandProfile_ = SCAN_PROFILE_AUTO;
+    bool commanded_ = false;
+    bool hitSeen_ = false;
+    bool batteryLow_ = false;
+    bool started_ = false;
+};
+
+#endif // SCAN_SCHEDULER_H
@@ -0,0 +1,108 @@
+/**
+ * btrpa-scan-lora Gateway Serial Frames
+ *
+ * Machine-readable output of the homebase node (GATEWAY_SERIAL_FRAMES):
+ * every frame it accepts from the mesh, and each of its own detections,
+ * goes to the USB serial port as a binary frame, as does each target
+ * location it fuses (target_fusion.h), so the host no longer scrapes the
+ * human log for MACs and positions.
+ *
+ *   Offset  Size  Field
+ *   0       1     SERIAL_FRAME_VERSION
+ *   1       1     source: SERIAL_SOURCE_MESH, _LOCAL or _FUSION
+ *   2       4     gateway uptime at arrival (detection, fusion), ms
+ *   6       2     RX RSSI, dBm (int16; 0 unless from the mesh)
+ *   8       1     RX SNR, 0.25 dB steps (int8; 0 unless from the mesh)
+ *   9       1     RX spreading factor (0 unless from the mesh)
+ *   10      1     hops travelled: relays between the origin and the gateway
+ *   11      1     n, length of the LoRa frame
+ *   12      n     the LoRa frame as received (wire_format.h), CRC included;
+ *                 origin node, sequence, hops left and power are in its
+ *                 header
+ *   12+n    2     CRC-16/CCITT-FALSE over bytes 0 .. 11+n
+ *
+ * All fields are little-endian. On the port each frame is COBS-encoded,
+ * so it holds no zero byte, and sent between two zero bytes in a single
+ * write. The human log keeps running on the same port and never
+ * contains a zero byte: a reader splits the stream at zeros, keeps the
+ * chunks that decode with a good CRC and passes the rest on as log text
+ * (homebase/gateway_frames.py). COBS adds one byte per 254, against the
+ * two to one worst case of escaping.
+ */
+
+#ifndef SERIAL_FRAME_H
+#define SERIAL_FRAME_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "wire_format.h"
+
+constexpr uint8_t SERIAL_FRAME_VERSION = 1;
+constexpr uint8_t SERIAL_SOURCE_MESH = 0;       // received over LoRa
+constexpr uint8_t SERIAL_SOURCE_LOCAL = 1;      // the gateway's own detection
+constexpr uint8_t SERIAL_SOURCE_FUSION = 2;     // a MSG_FUSED location the gateway fitted
+constexpr uint8_t SERIAL_SOURCE_COUNT = 3;
+
+constexpr size_t SERIAL_FRAME_HEADER_BYTES = 12;
+constexpr size_t SERIAL_FRAME_MAX_RAW = SERIAL_FRAME_HEADER_BYTES + WIRE_MAX_FRAME + WIRE_CRC_BYTES;
+// COBS overhead byte per 254, plus the two delimiters
+constexpr size_t SERIAL_FRAME_MAX_BYTES = SERIAL_FRAME_MAX_RAW + SERIAL_FRAME_MAX_RAW / 254 + 1 + 2;
+
+static_assert(WIRE_MAX_FRAME <= 255, "LoRa frame length must fit the serial frame's length byte");
+
+struct SerialFrameInfo {
+    uint8_t source;
+    uint32_t uptimeMs;
+    int16_t rssi;
+    int8_t snrQ2;
+    uint8_t sf;
+    uint8_t hops;
+};
+
+// Consistent Overhead Byte Stuffing: out gets length + length / 254 + 1
+// bytes at most, none of them zero
+inline size_t cobsEncode(const uint8_t* in, size_t length, uint8_t* out) {
+    size_t code = 0, o = 1;
+    uint8_t run = 1;
+    for (size_t i = 0; i < length; i++) {
+        if (in[i] != 0) {
+            out[o++] = in[i];
+            run++;
+        }
+        if (in[i] == 0 || run == 0xFF) {
+            out[code] = run;
+            code = o++;
+            run = 1;
+        }
+    }
+    out[code] = run;
+    return o;
+}
+
+// The delimited frame for a LoRa frame of wireLength bytes; 0 if out is
+// too small or the LoRa frame too long
+inline size_t serialFrameEncode(const SerialFrameInfo& info, const uint8_t* wire, size_t wireLength,
+                                uint8_t* out, size_t capacity) {
+    if (wireLength > WIRE_MAX_FRAME || capacity < SERIAL_FRAME_MAX_BYTES) return 0;
+    uint8_t raw[SERIAL_FRAME_MAX_RAW];
+    raw[0] = SERIAL_FRAME_VERSION;
+    raw[1] = info.source;
+    wirePut32(raw + 2, info.uptimeMs);
+    wirePut16(raw + 6, (uint16_t)info.rssi);
+    raw[8] = (uint8_t)info.snrQ2;
+    raw[9] = info.sf;
+    raw[10] = info.hops;
+    raw[11] = (uint8_t)wireLength;
+    memcpy(raw + SERIAL_FRAME_HEADER_BYTES, wire, wireLength);
+    size_t length = SERIAL_FRAME_HEADER_BYTES + wireLength;
+    wirePut16(raw + length, wireCrc16(raw, length));
+    length += WIRE_CRC_BYTES;
+
+    out[0] = 0;
+    size_t encoded = cobsEncode(raw, length, out + 1);
+    out[1 + encoded] = 0;
+    return encoded + 2;
+}
+
+#endif // SERIAL_FRAME_H
@@ -0,0 +1,74 @@
+/**
+ * btrpa-scan-lora Single-Producer/Single-Consumer Ring Buffer
+ *
+ * Fixed-capacity, lock-free queue for handing records from one task to
+ * another (e.g. the NimBLE host task to the detection task). The producer
+ * only writes head_, the consumer only writes tail_, so a push or pop is
+ * a copy plus one release store: no mutex, no heap, safe across cores.
+ *
+ * Capacity must be a power of two. Indices run freely and are masked on
+ * access, so all N slots are usable.
+ */
+
+#ifndef SPSC_RING_H
+#define SPSC_RING_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+
+template <typename T, size_t N>
+class SpscRing {
+    static_assert(N >= 2 && (N & (N - 1)) == 0, "SpscRing capacity must be a power of two");
+
+public:
+    static constexpr size_t capacity() { return N; }
+
+    // Producer side. Returns false (and counts an overflow) when full.
+    bool push(const T& item) {
+        uint32_t head = head_.load(std::memory_order_relaxed);
+        uint32_t tail = tail_.load(std::memory_order_acquire);
+        uint32_t used = head - tail;
+        if (used >= N) {
+            overflows_.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        slots_[head & (N - 1)] = item;
+        head_.store(head + 1, std::memory_order_release);
+        if (used + 1 > highWater_.load(std::memory_order_relaxed)) {
+            highWater_.store(used + 1, std::memory_order_relaxed);
+        }
+        return true;
+    }
+
+    // Consumer side. Returns false when empty.
+    bool pop(T& item) {
+        uint32_t tail = tail_.load(std::memory_order_relaxed);
+        uint32_t head = head_.load(std::memory_order_acquire);
+        if (head == tail) return false;
+        item = slots_[tail & (N - 1)];
+        tail_.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Approximate when called from a third task; exact from either end
+    size_t size() const {
+        return head_.load(std::memory_order_acquire) - tail_.load(std::memory_order_acquire);
+    }
+
+    // Most entries ever queued at once
+    uint32_t highWater() const { return highWater_.load(std::memory_order_relaxed); }
+
+    // Pushes rejected because the consumer had fallen a full ring behind
+    uint32_t overflows() const { return overflows_.load(std::memory_order_relaxed); }
+
+private:
+    T slots_[N];
+    // Producer-written and consumer-written words on separate cache lines
+    alignas(32) std::atomic<uint32_t> head_{0};
+    std::atomic<uint32_t> highWater_{0};
+    std::atomic<uint32_t> overflows_{0};
+    alignas(32) std::atomic<uint32_t> tail_{0};
+};
+
+#endif // SPSC_RING_H
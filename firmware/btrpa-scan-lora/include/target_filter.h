@@ -0,0 +1,290 @@
+/**
+ * btrpa-scan-lora Runtime Target Sets
+ *
+ * Targets installed after flashing, from the mesh or the USB console, on
+ * top of the compiled-in TARGET_MACS:
+ *
+ *   RuntimeTargets  a few exact MACs (TRUE HIT), e.g. a person reported
+ *                   missing after the teams went out. Sorted keys, binary
+ *                   search.
+ *   XorFilter       a registry of tens of thousands of pre-registered
+ *                   identity addresses as an xor filter (Graf & Lemire):
+ *                   3 x blockLength fingerprints of 8 or 16 bits, about
+ *                   1.23 per entry. A lookup hashes the address once and
+ *                   reads three fingerprints, whatever the registry size.
+ *                   Any address not in the registry matches with
+ *                   probability 2^-bits (1/256 or 1/65536), so a match is
+ *                   only a candidate; the homebase confirms it against the
+ *                   registry itself.
+ *
+ * Filters are built off the node (homebase/target_filter.py), since
+ * construction needs the whole key set in memory, and arrive in
+ * TARGET_FILTER_CHUNK_BYTES chunks. TargetFilterLoader collects them into
+ * whichever of its two buffers is not in use, checks the CRC and swaps,
+ * so the old filter keeps matching until the new one is complete.
+ *
+ * Filter header (16 bytes, little-endian, as sent and as kept in NVS):
+ *   0   1  fingerprint bits (8 or 16)
+ *   1   1  reserved, 0
+ *   2   2  CRC-16/CCITT-FALSE of the fingerprints; names the filter
+ *   4   4  hash seed
+ *   8   4  block length (fingerprints per hash function)
+ *   12  4  entries the filter was built from
+ *
+ * Not thread-safe: one task owns each object. Fixed storage, no heap.
+ */
+
+#ifndef TARGET_FILTER_H
+#define TARGET_FILTER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "wire_format.h"
+
+constexpr size_t TARGET_FILTER_HEADER_BYTES = 16;
+constexpr size_t TARGET_FILTER_CHUNK_BYTES = 112;
+
+// The filter's 64-bit hash of an address (murmur3 finalizer of key + seed)
+constexpr uint64_t targetFilterHash(uint64_t key, uint32_t seed) {
+    uint64_t h = key + (uint64_t)seed * 0x9E3779B97F4A7C15ULL;
+    h = (h ^ (h >> 33)) * 0xFF51AFD7ED558CCDULL;
+    h = (h ^ (h >> 33)) * 0xC4CEB9FE1A85EC53ULL;
+    return h ^ (h >> 33);
+}
+
+// Map 32 random bits onto [0, n) without a division
+constexpr uint32_t targetFilterReduce(uint32_t hash, uint32_t n) {
+    return (uint32_t)(((uint64_t)hash * n) >> 32);
+}
+
+constexpr uint64_t targetFilterRotl(uint64_t x, int bits) {
+    return (x << bits) | (x >> (64 - bits));
+}
+
+struct XorFilterHeader {
+    uint8_t fingerprintBits;
+    uint16_t crc;
+    uint32_t seed;
+    uint32_t blockLength;
+    uint32_t entries;
+
+    size_t bytes() const { return (size_t)blockLength * 3 * (fingerprintBits / 8); }
+    uint16_t chunks() const {
+        return (uint16_t)((bytes() + TARGET_FILTER_CHUNK_BYTES - 1) / TARGET_FILTER_CHUNK_BYTES);
+    }
+
+    void encode(uint8_t* out) const {
+        out[0] = fingerprintBits;
+        out[1] = 0;
+        wirePut16(out + 2, crc);
+        wirePut32(out + 4, seed);
+        wirePut32(out + 8, blockLength);
+        wirePut32(out + 12, entries);
+    }
+
+    static XorFilterHeader decode(const uint8_t* in) {
+        return {in[0], wireGet16(in + 2), wireGet32(in + 4), wireGet32(in + 8), wireGet32(in + 12)};
+    }
+};
+
+// A filter in someone else's buffer; empty (matches nothing) by default
+class XorFilter {
+public:
+    XorFilter() = default;
+    XorFilter(const XorFilterHeader& header, const uint8_t* fingerprints)
+        : header_(header), fingerprints_(fingerprints) {}
+
+    bool empty() const { return fingerprints_ == nullptr; }
+    const XorFilterHeader& header() const { return header_; }
+    const uint8_t* fingerprints() const { return fingerprints_; }
+
+    bool contains(uint64_t key) const {
+        if (fingerprints_ == nullptr) return false;
+        uint64_t h = targetFilterHash(key, header_.seed);
+        uint32_t n = header_.blockLength;
+        uint32_t h0 = targetFilterReduce((uint32_t)h, n);
+        uint32_t h1 = targetFilterReduce((uint32_t)targetFilterRotl(h, 21), n) + n;
+        uint32_t h2 = targetFilterReduce((uint32_t)targetFilterRotl(h, 42), n) + 2 * n;
+        uint32_t fingerprint = (uint32_t)(h ^ (h >> 32));
+        if (header_.fingerprintBits == 8) {
+            return (uint8_t)fingerprint == (fingerprints_[h0] ^ fingerprints_[h1] ^ fingerprints_[h2]);
+        }
+        return (uint16_t)fingerprint == (wireGet16(fingerprints_ + 2 * h0) ^ wireGet16(fingerprints_ + 2 * h1) ^
+                                         wireGet16(fingerprints_ + 2 * h2));
+    }
+
+private:
+    XorFilterHeader header_ = {};
+    const uint8_t* fingerprints_ = nullptr;
+};
+
+enum TargetFilterChunkResult : uint8_t {
+    FILTER_CHUNK_IGNORED,   // not the filter being loaded
+    FILTER_CHUNK_STORED,
+    FILTER_CHUNK_REPEATED,  // already had it
+    FILTER_CHUNK_COMPLETE,  // last one missing: call commit()
+    FILTER_CHUNK_BAD_CRC,   // complete, but the fingerprints do not check out
+};
+
+struct TargetFilterStats {
+    uint32_t loads;         // new filters announced
+    uint32_t chunks;        // chunks stored
+    uint32_t installed;     // filters committed
+    uint32_t crcFailures;   // complete filters that failed their CRC
+    uint32_t rejected;      // headers too large or malformed
+};
+
+template <size_t MaxBytes>
+class TargetFilterLoader {
+    static constexpr size_t MAX_CHUNKS = (MaxBytes + TARGET_FILTER_CHUNK_BYTES - 1) / TARGET_FILTER_CHUNK_BYTES;
+
+public:
+    const TargetFilterStats& stats() const { return stats_; }
+    static constexpr size_t maxBytes() { return MaxBytes; }
+
+    // The filter in use, or an empty one
+    XorFilter installed() const {
+        return active_ < 2 ? XorFilter(headers_[active_], buffers_[active_]) : XorFilter();
+    }
+
+    bool loading() const { return loading_; }
+    const XorFilterHeader& loadingHeader() const { return headers_[spare()]; }
+    uint16_t received() const { return received_; }
+
+    // Start collecting a filter. False if it is already installed, does
+    // not fit or is malformed. Announcing the filter being loaded again
+    // keeps the chunks collected so far. The spare buffer is overwritten
+    // from here on: the caller makes sure nothing still reads it.
+    bool begin(const XorFilterHeader& header) {
+        if (active_ < 2 && headers_[active_].crc == header.crc && headers_[active_].seed == header.seed) return false;
+        if (loading_ && headers_[spare()].crc == header.crc && headers_[spare()].seed == header.seed) return true;
+        if ((header.fingerprintBits != 8 && header.fingerprintBits != 16) || header.blockLength == 0 ||
+            header.bytes() > MaxBytes) {
+            stats_.rejected++;
+            return false;
+        }
+        headers_[spare()] = header;
+        memset(have_, 0, sizeof(have_));
+        received_ = 0;
+        loading_ = true;
+        stats_.loads++;
+        return true;
+    }
+
+    TargetFilterChunkResult store(uint16_t crc, uint16_t index, const uint8_t* data, size_t length) {
+        const XorFilterHeader& header = headers_[spare()];
+        if (!loading_ || crc != header.crc || index >= header.chunks()) return FILTER_CHUNK_IGNORED;
+        if (have_[index / 8] & (1u << (index % 8))) return FILTER_CHUNK_REPEATED;
+        size_t offset = (size_t)index * TARGET_FILTER_CHUNK_BYTES;
+        size_t n = header.bytes() - offset < TARGET_FILTER_CHUNK_BYTES ? header.bytes() - offset :
+                                                                         TARGET_FILTER_CHUNK_BYTES;
+        if (length < n) return FILTER_CHUNK_IGNORED;
+        memcpy(buffers_[spare()] + offset, data, n);
+        have_[index / 8] |= (uint8_t)(1u << (index % 8));
+        received_++;
+        stats_.chunks++;
+        if (received_ < header.chunks()) return FILTER_CHUNK_STORED;
+        if (wireCrc16(buffers_[spare()], header.bytes()) != header.crc) {
+            // Start over: a corrupt chunk cannot be told from the good ones
+            memset(have_, 0, sizeof(have_));
+            received_ = 0;
+            stats_.crcFailures++;
+            return FILTER_CHUNK_BAD_CRC;
+        }
+        return FILTER_CHUNK_COMPLETE;
+    }
+
+    // The complete filter becomes the installed one; the old one's buffer
+    // is the spare for the next load
+    XorFilter commit() {
+        active_ = spare();
+        loading_ = false;
+        stats_.installed++;
+        return installed();
+    }
+
+    // Install a filter kept elsewhere (NVS at boot): fill spareBuffer(),
+    // then restore()
+    uint8_t* spareBuffer() { return buffers_[spare()]; }
+
+    bool restore(const XorFilterHeader& header) {
+        if ((header.fingerprintBits != 8 && header.fingerprintBits != 16) || header.bytes() > MaxBytes ||
+            wireCrc16(buffers_[spare()], header.bytes()) != header.crc) {
+            return false;
+        }
+        headers_[spare()] = header;
+        active_ = spare();
+        loading_ = false;
+        return true;
+    }
+
+    // No filter in use; a load in progress is abandoned too
+    void drop() {
+        active_ = NONE;
+        loading_ = false;
+    }
+
+private:
+    static constexpr uint8_t NONE = 2;
+
+    uint8_t spare() const { return active_ == 0 ? 1 : 0; }
+
+    uint8_t buffers_[2][MaxBytes > 0 ? MaxBytes : 1];
+    XorFilterHeader headers_[2] = {};
+    uint8_t have_[MAX_CHUNKS / 8 + 1] = {};
+    uint16_t received_ = 0;
+    uint8_t active_ = NONE;
+    bool loading_ = false;
+    TargetFilterStats stats_ = {};
+};
+
+// Exact MACs added at runtime, sorted for binary search
+template <size_t Capacity>
+class RuntimeTargets {
+public:
+    size_t size() const { return count_; }
+    static constexpr size_t capacity() { return Capacity; }
+    const uint64_t* keys() const { return keys_; }
+
+    bool contains(uint64_t key) const {
+        size_t lo = 0, hi = count_;
+        while (lo < hi) {
+            size_t mid = (lo + hi) / 2;
+            if (keys_[mid] < key) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        return lo < count_ && keys_[lo] == key;
+    }
+
+    // False if already present or full
+    bool add(uint64_t key) {
+        if (count_ == Capacity || contains(key)) return false;
+        size_t i = count_++;
+        for (; i > 0 && keys_[i - 1] > key; i--) keys_[i] = keys_[i - 1];
+        keys_[i] = key;
+        return true;
+    }
+
+    bool remove(uint64_t key) {
+        for (size_t i = 0; i < count_; i++) {
+            if (keys_[i] != key) continue;
+            for (size_t k = i + 1; k < count_; k++) keys_[k - 1] = keys_[k];
+            count_--;
+            return true;
+        }
+        return false;
+    }
+
+    void clear() { count_ = 0; }
+
+private:
+    uint64_t keys_[Capacity > 0 ? Capacity : 1] = {};
+    size_t count_ = 0;
+};
+
+#endif // TARGET_FILTER_H
@@ -0,0 +1,329 @@
+/**
+ * btrpa-scan-lora Target Fusion
+ *
+ * Homebase localization of a target several field nodes hear. Each hit
+ * record reaching the gateway is an observation: where its observer was
+ * (the frame's position, or the prediction from the node's last beacon,
+ * position_beacon.h) and how far off the target seemed (the record's
+ * path-loss range, rssi_tracker.h). Observations are grouped per target
+ * MAC; each observer counts once, with its latest report, and reports
+ * older than the window drop out.
+ *
+ * The location is the weighted least-squares fit of the ranges,
+ *
+ *   minimise  sum_i w_i (|p - o_i| - d_i)^2,   w_i = 1 / (k d_i)^2
+ *
+ * since a path-loss range is off by a share of itself (k; the 10 dB a body
+ * or wall adds is a factor of two), not by a fixed distance: the nearest
+ * observers dominate. Solved by Levenberg-Marquardt in the local tangent
+ * plane at the target's first observer, each iteration one pass over the
+ * observers accumulating the 2x2 normal equations J^T W J and J^T W r,
+ * and one Cramer solve. The first fit starts from the observers' weighted
+ * centroid, later ones from the previous fit, so a new report converges
+ * in a few iterations (two with ten observers, five with three; the
+ * native sim's --fusion-bench): O(observers) work per report, in
+ * single-precision floats (the ESP32-S3 has an FPU for them).
+ *
+ * Uncertainty is the covariance (J^T W J)^-1, scaled up by the reduced
+ * chi-square when the ranges disagree more than k allows; the radius is
+ * 2.45 times its major-axis sigma, a 95 % circle. Two observers, or
+ * observers in a line, leave a mirror ambiguity that shows as a long
+ * axis, so a large radius rather than a false precision.
+ *
+ * Fixed storage (Targets x Observers observations), no heap. Not
+ * thread-safe.
+ */
+
+#ifndef TARGET_FUSION_H
+#define TARGET_FUSION_H
+
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "position_beacon.h"
+
+constexpr uint8_t FUSION_MAX_ITERATIONS = 12;
+constexpr float FUSION_CONVERGED_M = 0.25f;     // a fit is done when its step is below this,
+constexpr float FUSION_CONVERGED_CHI2 = 1e-3f;  // or it moves the residuals by this share
+constexpr float FUSION_MIN_SIGMA_M = 1.0f;      // GPS error floor under a range
+constexpr float FUSION_RADIUS_95 = 2.45f;       // sigmas in a 2-D 95 % circle
+constexpr float FUSION_MAX_RADIUS_M = 6553.5f;  // what the wire's decimetres hold
+
+struct FusionConfig {
+    uint32_t windowMs;          // observations older than this drop out
+    uint8_t minObservers;       // distinct observers before a location is reported
+    uint32_t reportIntervalMs;  // per target, between reported locations
+    float rangeSigma;           // range error as a share of the range (k)
+};
+
+// One observer in the target's tangent plane, metres east and north of
+// its anchor
+struct FusionObservation {
+    float east;
+    float north;
+    float rangeM;
+    float weight;
+};
+
+// A fit; east and north in, as the starting point, when warm
+struct FusionFix {
+    float east;
+    float north;
+    float radiusM;              // 95 % uncertainty
+    float rmsResidualM;         // range residuals, weighted
+    uint8_t iterations;
+};
+
+struct FusedLocation {
+    uint64_t mac;
+    uint8_t deviceIndex;        // WIRE_NO_DEVICE for a TRUE HIT
+    int32_t latE7;
+    int32_t lonE7;
+    float radiusM;
+    uint8_t observers;
+};
+
+struct FusionStats {
+    uint32_t observations;
+    uint32_t solves;
+    uint32_t iterations;        // over all solves
+    uint32_t located;           // locations reported
+    uint32_t evicted;           // targets dropped from a full table
+};
+
+inline float fusionWeight(float rangeM, float rangeSigma) {
+    float sigma = rangeM * rangeSigma;
+    if (sigma < FUSION_MIN_SIGMA_M) sigma = FUSION_MIN_SIGMA_M;
+    return 1.0f / (sigma * sigma);
+}
+
+// Normal equations of the range residuals at (east, north)
+struct FusionNormal {
+    float hxx, hxy, hyy;        // J^T W J
+    float gx, gy;               // J^T W r
+    float chi2;                 // sum w r^2
+
+    void accumulate(const FusionObservation* obs, size_t count, float east, float north) {
+        hxx = hxy = hyy = gx = gy = chi2 = 0.0f;
+        for (size_t i = 0; i < count; i++) {
+            float dx = east - obs[i].east;
+            float dy = north - obs[i].north;
+            float distance = sqrtf(dx * dx + dy * dy);
+            if (distance < 1e-3f) distance = 1e-3f;
+            float ux = dx / distance, uy = dy / distance;
+            float residual = distance - obs[i].rangeM;
+            float w = obs[i].weight;
+            hxx += w * ux * ux;
+            hxy += w * ux * uy;
+            hyy += w * uy * uy;
+            gx += w * ux * residual;
+            gy += w * uy * residual;
+            chi2 += w * residual * residual;
+        }
+    }
+};
+
+// Weighted least-squares fit of count observations; from fix.east/north
+// when warm, else from their weighted centroid. False with none.
+inline bool fusionSolve(const FusionObservation* obs, size_t count, bool warm, FusionFix& fix) {
+    if (count == 0) return false;
+    if (!warm) {
+        float sum = 0.0f, east = 0.0f, north = 0.0f;
+        for (size_t i = 0; i < count; i++) {
+            sum += obs[i].weight;
+            east += obs[i].weight * obs[i].east;
+            north += obs[i].weight * obs[i].north;
+        }
+        fix.east = east / sum;
+        fix.north = north / sum;
+    }
+
+    FusionNormal normal, trial;
+    normal.accumulate(obs, count, fix.east, fix.north);
+    float lambda = 1e-3f;
+    fix.iterations = 0;
+    while (fix.iterations < FUSION_MAX_ITERATIONS) {
+        fix.iterations++;
+        // Marquardt damping keeps a step bounded where the geometry is
+        // nearly singular (two observers, or a line of them)
+        float a = normal.hxx * (1.0f + lambda) + 1e-9f;
+        float c = normal.hyy * (1.0f + lambda) + 1e-9f;
+        float det = a * c - normal.hxy * normal.hxy;
+        if (!(det > 0.0f)) break;
+        float stepEast = (c * normal.gx - normal.hxy * normal.gy) / det;
+        float stepNorth = (a * normal.gy - normal.hxy * normal.gx) / det;
+        trial.accumulate(obs, count, fix.east - stepEast, fix.north - stepNorth);
+        // Along a flat valley (the long axis of the uncertainty) steps
+        // stay metres long while the residuals barely change
+        bool flat = fabsf(normal.chi2 - trial.chi2) <= FUSION_CONVERGED_CHI2 * normal.chi2;
+        if (trial.chi2 <= normal.chi2) {
+            fix.east -= stepEast;
+            fix.north -= stepNorth;
+            normal = trial;
+            lambda = lambda > 1e-6f ? lambda * 0.1f : lambda;
+            if (flat || stepEast * stepEast + stepNorth * stepNorth < FUSION_CONVERGED_M * FUSION_CONVERGED_M) break;
+        } else {
+            lambda *= 10.0f;
+            if (flat || lambda > 1e6f) break;
+        }
+    }
+
+    // Covariance major axis: 1 / the smaller eigenvalue of J^T W J
+    float trace = normal.hxx + normal.hyy;
+    float det = normal.hxx * normal.hyy - normal.hxy * normal.hxy;
+    float discriminant = trace * trace - 4.0f * det;
+    float smallest = (trace - sqrtf(discriminant > 0.0f ? discriminant : 0.0f)) / 2.0f;
+    float scale = count > 2 ? normal.chi2 / (count - 2) : 1.0f;
+    if (scale < 1.0f) scale = 1.0f;
+    fix.radiusM = smallest > 0.0f ? FUSION_RADIUS_95 * sqrtf(scale / smallest) : FUSION_MAX_RADIUS_M;
+    if (!(fix.radiusM < FUSION_MAX_RADIUS_M)) fix.radiusM = FUSION_MAX_RADIUS_M;
+    float weights = 0.0f;
+    for (size_t i = 0; i < count; i++) weights += obs[i].weight;
+    fix.rmsResidualM = sqrtf(normal.chi2 / weights);
+    return true;
+}
+
+template <size_t Targets, size_t Observers>
+class TargetFusion {
+public:
+    explicit TargetFusion(const FusionConfig& config) : config_(config) {}
+
+    // node's report of mac from (latE7, lonE7), rangeM away. True when the
+    // target's location is due to be reported, which is then in out: at
+    // least minObservers observers and reportIntervalMs since the last.
+    bool observe(uint64_t mac, uint8_t deviceIndex, uint8_t node, int32_t latE7, int32_t lonE7,
+                 float rangeM, uint32_t nowMs, FusedLocation& out) {
+        if (node == 0 || !(rangeM > 0.0f)) return false;
+        stats_.observations++;
+        Target& target = findTarget(mac, latE7, lonE7, nowMs);
+        target.deviceIndex = deviceIndex;
+        target.lastMs = nowMs;
+
+        Observer* slot = nullptr;
+        for (size_t i = 0; i < Observers; i++) {
+            Observer& o = target.observers[i];
+            if (o.node == node) {
+                slot = &o;
+                break;
+            }
+            if (!slot || o.node == 0 || (slot->node != 0 && (int32_t)(o.atMs - slot->atMs) < 0)) slot = &o;
+        }
+        slot->node = node;
+        slot->atMs = nowMs;
+        slot->observation.north = (float)(((int64_t)latE7 - target.anchorLatE7) * GEO_CM_PER_E7_NUM /
+                                          GEO_CM_PER_E7_DEN) / 100.0f;
+        slot->observation.east = (float)(geoLonDeltaE7(lonE7, target.anchorLonE7) * GEO_CM_PER_E7_NUM /
+                                         GEO_CM_PER_E7_DEN) / 100.0f * target.cosLat;
+        slot->observation.rangeM = rangeM;
+        slot->observation.weight = fusionWeight(rangeM, config_.rangeSigma);
+
+        // The live observations, dropping expired ones as they go
+        FusionObservation live[Observers];
+        size_t count = 0;
+        for (size_t i = 0; i < Observers; i++) {
+            Observer& o = target.observers[i];
+            if (o.node == 0) continue;
+            if (nowMs - o.atMs > config_.windowMs) {
+                o.node = 0;
+                continue;
+            }
+            live[count++] = o.observation;
+        }
+        if (count < 2) {
+            target.fitted = false;
+            return false;
+        }
+
+        FusionFix fix = {target.east, target.north, 0, 0, 0};
+        fusionSolve(live, count, target.fitted, fix);
+        stats_.solves++;
+        stats_.iterations += fix.iterations;
+        target.fitted = true;
+        target.east = fix.east;
+        target.north = fix.north;
+
+        if (count < config_.minObservers) return false;
+        if (target.located && nowMs - target.locatedMs < config_.reportIntervalMs) return false;
+        target.located = true;
+        target.locatedMs = nowMs;
+        stats_.located++;
+
+        out.mac = mac;
+        out.deviceIndex = target.deviceIndex;
+        out.latE7 = (int32_t)(target.anchorLatE7 +
+                              (int64_t)lroundf(fix.north * 100.0f) * GEO_CM_PER_E7_DEN / GEO_CM_PER_E7_NUM);
+        int64_t lon = target.anchorLonE7 +
+                      (int64_t)lroundf(fix.east * 100.0f / target.cosLat) * GEO_CM_PER_E7_DEN / GEO_CM_PER_E7_NUM;
+        if (lon > GEO_E7_PER_TURN / 2) lon -= GEO_E7_PER_TURN;
+        if (lon < -GEO_E7_PER_TURN / 2) lon += GEO_E7_PER_TURN;
+        out.lonE7 = (int32_t)lon;
+        out.radiusM = fix.radiusM;
+        out.observers = (uint8_t)count;
+        return true;
+    }
+
+    // Targets with an observation inside the window
+    size_t tracked(uint32_t nowMs) const {
+        size_t count = 0;
+        for (size_t i = 0; i < Targets; i++) {
+            if (targets_[i].used && nowMs - targets_[i].lastMs <= config_.windowMs) count++;
+        }
+        return count;
+    }
+
+    const FusionStats& stats() const { return stats_; }
+
+private:
+    struct Observer {
+        uint8_t node;           // 0 = free
+        uint32_t atMs;
+        FusionObservation observation;
+    };
+
+    struct Target {
+        bool used;
+        bool fitted;            // east, north hold the last fit
+        bool located;           // a location was reported at locatedMs
+        uint8_t deviceIndex;
+        uint64_t mac;
+        int32_t anchorLatE7;    // tangent plane origin: the first observer
+        int32_t anchorLonE7;
+        float cosLat;
+        uint32_t lastMs;
+        uint32_t locatedMs;
+        float east;
+        float north;
+        Observer observers[Observers];
+    };
+
+    // The target's slot; a new one (anchored at this observer) replaces an
+    // expired target, else the longest-silent
+    Target& findTarget(uint64_t mac, int32_t latE7, int32_t lonE7, uint32_t nowMs) {
+        Target* slot = nullptr;
+        for (size_t i = 0; i < Targets; i++) {
+            Target& t = targets_[i];
+            if (t.used && t.mac == mac) {
+                if (nowMs - t.lastMs <= config_.windowMs) return t;
+                slot = &t;
+                break;
+            }
+            if (!slot || !t.used || (slot->used && (int32_t)(t.lastMs - slot->lastMs) < 0)) slot = &t;
+        }
+        if (slot->used && slot->mac != mac && nowMs - slot->lastMs <= config_.windowMs) stats_.evicted++;
+        *slot = {};
+        slot->used = true;
+        slot->mac = mac;
+        slot->anchorLatE7 = latE7;
+        slot->anchorLonE7 = lonE7;
+        float c = cosf(latE7 * (float)(M_PI / 1.8e9));
+        slot->cosLat = c < 0.01f ? 0.01f : c;
+        return *slot;
+    }
+
+    FusionConfig config_;
+    Target targets_[Targets] = {};
+    FusionStats stats_ = {};
+};
+
+#endif // TARGET_FUSION_H
@@ -0,0 +1,73 @@
+/**
+ * btrpa-scan-lora Task Monitor
+ *
+ * Per-task load for the statistics report. Every firmware task blocks in
+ * one place, waiting for a notification or a timeout; TaskLoad brackets
+ * that wait, so the time between waking and blocking again is the task's
+ * work and each return from the wait is one wakeup. Few wakeups and little
+ * work per task is what lets the CPUs idle and the node sleep.
+ *
+ * The work time is wall time, so a task is also charged while a
+ * higher-priority task on its core preempts it: an upper bound. It needs
+ * no FreeRTOS run-time statistics in the build, and the native sim reports
+ * the same figures in virtual time. Each entry is written by its own task
+ * only and read unlocked by the report.
+ */
+
+#ifndef TASK_MONITOR_H
+#define TASK_MONITOR_H
+
+#include <stdint.h>
+#include <atomic>
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+struct TaskLoad {
+    const char* name;
+    uint32_t stackBytes;
+    uint8_t priority;
+    int8_t core;
+    TaskHandle_t handle = nullptr;
+    std::atomic<uint32_t> busyUs{0};        // wraps after 71 min; report deltas
+    std::atomic<uint32_t> wakeups{0};
+    uint32_t wokeAtUs = 0;
+
+    TaskLoad(const char* taskName, uint32_t stack, uint8_t prio, int8_t coreId)
+        : name(taskName), stackBytes(stack), priority(prio), core(coreId) {}
+
+    // When the task starts; then by the task itself around its blocking wait
+    void started(uint32_t nowUs) { wokeAtUs = nowUs; }
+
+    void blocking(uint32_t nowUs) {
+        busyUs.fetch_add(nowUs - wokeAtUs, std::memory_order_relaxed);
+    }
+
+    void woke(uint32_t nowUs) {
+        wokeAtUs = nowUs;
+        wakeups.fetch_add(1, std::memory_order_relaxed);
+    }
+};
+
+// Load since the previous sample, per task
+struct TaskLoadSample {
+    uint32_t busyUs;
+    uint32_t wakeups;
+};
+
+template <size_t N>
+class TaskLoadReport {
+public:
+    TaskLoadSample sample(size_t task, const TaskLoad& load) {
+        uint32_t busy = load.busyUs.load(std::memory_order_relaxed);
+        uint32_t wakeups = load.wakeups.load(std::memory_order_relaxed);
+        TaskLoadSample delta = {busy - last_[task].busyUs, wakeups - last_[task].wakeups};
+        last_[task] = {busy, wakeups};
+        return delta;
+    }
+
+private:
+    TaskLoadSample last_[N] = {};
+};
+
+#endif // TASK_MONITOR_H
@@ -0,0 +1,524 @@
+/**
+ * btrpa-scan-lora Wire Format
+ *
+ * Explicitly serialized LoRa frame, replacing the memcpy'd MeshMessage
+ * struct (88 bytes of strings, floats and padding). All multi-byte fields
+ * are little-endian; nothing depends on compiler layout.
+ *
+ *   Offset  Size  Field
+ *   0       1     version (high nibble) | MessageType (low nibble)
+ *   1       1     node index (1..254, see nodeIndexFromId)
+ *   2       1     sequence number (per originating node, wraps)
+ *   3       1     flags: bit 0 = position present,
+ *                        bits 1-3 = hops left for relays (0-7),
+ *                        bits 4-7 = TX power below LORA_TX_POWER, 2 dB steps
+ *   4       3     base time: sender uptime in whole seconds; in a
+ *                 replayed frame, the oldest record's age in seconds
+ *                 (WIRE_AGE_UNKNOWN if the node cannot tell)
+ *   7       1     record count (bits 0-3; MSG_TARGETS: 8-byte data
+ *                 blocks) | bit 4 = velocity present
+ *                 | bit 7 = replayed from the sender's journal
+ *   8       8     [position] latitude, longitude as int32 degrees x 1e7;
+ *                 MSG_FUSED: the target's, not the sender's
+ *   ...     2     [velocity, position frames only] east, north as int8
+ *                 in WIRE_VELOCITY_UNIT_CMS steps; absent while the
+ *                 node stands still (see position_beacon.h)
+ *   ...     11*n  records:
+ *                   2  detection time, ms after base time
+ *                   6  MAC address, most significant byte first
+ *                   1  smoothed RSSI (dBm, int8)
+ *                   1  device type: index into MEDICAL_DEVICE_PREFIXES,
+ *                      or WIRE_NO_DEVICE
+ *                   1  range: path-loss distance code and trend, 0 =
+ *                      none (see rssi_tracker.h)
+ *   ...     n     [body] fixed per type, record count 0:
+ *                 MSG_STATUS (10 bytes)
+ *                   2  battery mV (0 = not measured)
+ *                   1  scan profile (low nibble) | reason (high nibble)
+ *                   1  scan duty cycle, percent
+ *                   6  estimated average current per profile
+ *                      (active, conservation, burst), 0.1 mA units
+ *                 MSG_COMMAND (6 bytes)
+ *                   1  target node index (0 = every node)
+ *                   1  command (WIRE_CMD_*)
+ *                   1  argument
+ *                   1  reserved, 0
+ *                   2  duration in minutes (0 = until the next command)
+ *                 MSG_ACK (4 bytes)
+ *                   1  target node index
+ *                   1  sequence number acknowledged
+ *                   2  bit n set: sequence + 1 + n acknowledged too
+ *                 MSG_TARGETS (6 bytes + 8 per data block)
+ *                   1  target node index (0 = every node)
+ *                   1  operation (WIRE_TARGETS_*)
+ *                   2  filter CRC (filter operations), else 0
+ *                   2  chunk index (WIRE_TARGETS_CHUNK), else 0
+ *                   8n data: a MAC (most significant byte first), a
+ *                      filter header or a filter chunk, zero-padded
+ *                 MSG_FUSED (10 bytes, with a position)
+ *                   6  target MAC, most significant byte first
+ *                   1  device type, as in a record
+ *                   1  observers the location was fitted from
+ *                   2  uncertainty radius (95 %), 0.1 m units
+ *   end-2   2     CRC-16/CCITT-FALSE over everything before it
+ *
+ * Relays forward frames unchanged apart from the hop count, power field
+ * and CRC, so node index and sequence number always name the originating
+ * node and (origin, sequence) identifies a frame across the mesh.
+ *
+ * Device types travel as an index, so every node in a mesh must be
+ * flashed with the same MEDICAL_DEVICE_PREFIXES table.
+ *
+ * Airtime budget (default SF10 / 125 kHz / CR 4/8 / 16-symbol preamble):
+ *   position beacon          18 bytes   ~494 ms   (moving: 20 bytes, ~559 ms)
+ *   single detection + GPS   29 bytes   ~625 ms   (was 88 bytes, ~1411 ms;
+ *                                                  moving: 31 bytes, ~690 ms,
+ *                                                  which spares a beacon)
+ *   fused location           28 bytes   ~625 ms
+ *   target filter chunk     128 bytes  ~1935 ms  (~340 ms at SF7)
+ * The budgets are checked at compile time below.
+ */
+
+#ifndef WIRE_FORMAT_H
+#define WIRE_FORMAT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "lora_airtime.h"
+#include "mesh_protocol.h"
+
+constexpr uint8_t WIRE_VERSION = 2;     // 2: range byte in records
+constexpr uint8_t WIRE_NO_DEVICE = 0xFF;
+constexpr uint8_t WIRE_FLAG_POSITION = 0x01;
+constexpr uint8_t WIRE_HOPS_SHIFT = 1;
+constexpr uint8_t WIRE_HOPS_MASK = 0x0E;
+constexpr uint8_t WIRE_MAX_HOPS = WIRE_HOPS_MASK >> WIRE_HOPS_SHIFT;
+constexpr uint8_t WIRE_POWER_SHIFT = 4;
+constexpr uint8_t WIRE_POWER_MASK = 0xF0;
+constexpr uint8_t WIRE_POWER_STEP_DB = 2;
+constexpr uint8_t WIRE_MAX_POWER_STEPS = WIRE_POWER_MASK >> WIRE_POWER_SHIFT;
+constexpr uint8_t WIRE_COUNT_MASK = 0x0F;
+constexpr uint8_t WIRE_FLAG_VELOCITY = 0x10;
+constexpr uint8_t WIRE_FLAG_REPLAYED = 0x80;
+constexpr uint32_t WIRE_AGE_UNKNOWN = 0xFFFFFF;
+
+constexpr size_t WIRE_HEADER_BYTES = 8;
+constexpr size_t WIRE_POSITION_BYTES = 8;
+constexpr size_t WIRE_VELOCITY_BYTES = 2;
+constexpr size_t WIRE_RECORD_BYTES = 11;
+constexpr size_t WIRE_CRC_BYTES = 2;
+
+// Velocity steps: +-25.4 m/s in 0.2 m/s
+constexpr int16_t WIRE_VELOCITY_UNIT_CMS = 20;
+
+// Records per frame the decoder accepts
+constexpr uint8_t WIRE_MAX_RECORDS = 8;
+
+constexpr size_t WIRE_STATUS_BYTES = 10;
+constexpr size_t WIRE_COMMAND_BYTES = 6;
+constexpr size_t WIRE_ACK_BYTES = 4;
+constexpr size_t WIRE_TARGETS_BYTES = 6;
+constexpr size_t WIRE_FUSED_BYTES = 10;
+constexpr size_t WIRE_BLOCK_BYTES = 8;
+constexpr uint8_t WIRE_TARGETS_MAX_BLOCKS = 15;
+constexpr size_t WIRE_TARGETS_MAX_DATA = WIRE_BLOCK_BYTES * WIRE_TARGETS_MAX_BLOCKS;
+constexpr uint8_t WIRE_STATUS_PROFILES = 3;
+
+// Commands carried by MSG_COMMAND
+constexpr uint8_t WIRE_CMD_SCAN_PROFILE = 1;    // argument: ScanProfile, or 0xFF for automatic
+constexpr uint8_t WIRE_CMD_ARG_AUTO = 0xFF;
+
+// Operations carried by MSG_TARGETS
+constexpr uint8_t WIRE_TARGETS_ADD = 1;         // data: MAC, exact TRUE HIT target
+constexpr uint8_t WIRE_TARGETS_REMOVE = 2;      // data: MAC
+constexpr uint8_t WIRE_TARGETS_CLEAR = 3;       // every runtime MAC
+constexpr uint8_t WIRE_TARGETS_FILTER = 4;      // data: registry filter header (target_filter.h)
+constexpr uint8_t WIRE_TARGETS_CHUNK = 5;       // data: registry filter chunk
+constexpr uint8_t WIRE_TARGETS_DROP_FILTER = 6;
+
+// Device index of a POSSIBLE HIT matched by the registry filter
+constexpr uint8_t WIRE_DEVICE_REGISTRY = 0xFE;
+
+// blocks: MSG_TARGETS data blocks (the record count on the wire)
+constexpr size_t wireBodyLength(uint8_t type, uint8_t blocks = 0) {
+    return type == MSG_STATUS ? WIRE_STATUS_BYTES : type == MSG_COMMAND ? WIRE_COMMAND_BYTES :
+           type == MSG_ACK ? WIRE_ACK_BYTES :
+           type == MSG_TARGETS ? WIRE_TARGETS_BYTES + WIRE_BLOCK_BYTES * blocks :
+           type == MSG_FUSED ? WIRE_FUSED_BYTES : 0;
+}
+
+// hasVelocity: only with a position
+constexpr size_t wireFrameLength(bool hasPosition, uint8_t records, uint8_t type = 0, uint8_t blocks = 0,
+                                 bool hasVelocity = false) {
+    return WIRE_HEADER_BYTES + (hasPosition ? WIRE_POSITION_BYTES : 0) +
+           (hasPosition && hasVelocity ? WIRE_VELOCITY_BYTES : 0) +
+           WIRE_RECORD_BYTES * records + wireBodyLength(type, blocks) + WIRE_CRC_BYTES;
+}
+
+constexpr size_t wireMaxFrame(size_t a, size_t b) { return a > b ? a : b; }
+constexpr size_t WIRE_MAX_FRAME = wireMaxFrame(wireFrameLength(true, WIRE_MAX_RECORDS, 0, 0, true),
+                                               wireFrameLength(false, 0, MSG_TARGETS, WIRE_TARGETS_MAX_BLOCKS));
+
+// Airtime budgets at the default modulation (see table above)
+constexpr uint32_t WIRE_BEACON_AIRTIME_BUDGET_US = 500000;
+constexpr uint32_t WIRE_MOVING_BEACON_AIRTIME_BUDGET_US = 560000;
+constexpr uint32_t WIRE_DETECTION_AIRTIME_BUDGET_US = 640000;
+constexpr uint32_t WIRE_MOVING_DETECTION_AIRTIME_BUDGET_US = 700000;
+static_assert(loraTimeOnAirUs(LORA_DEFAULT_MODULATION, wireFrameLength(true, 0)) <=
+              WIRE_BEACON_AIRTIME_BUDGET_US, "position beacon exceeds its airtime budget");
+static_assert(loraTimeOnAirUs(LORA_DEFAULT_MODULATION, wireFrameLength(true, 0, 0, 0, true)) <=
+              WIRE_MOVING_BEACON_AIRTIME_BUDGET_US, "moving position beacon exceeds its airtime budget");
+static_assert(loraTimeOnAirUs(LORA_DEFAULT_MODULATION, wireFrameLength(true, 1)) <=
+              WIRE_DETECTION_AIRTIME_BUDGET_US, "detection frame exceeds its airtime budget");
+static_assert(loraTimeOnAirUs(LORA_DEFAULT_MODULATION, wireFrameLength(true, 0, MSG_FUSED)) <=
+              WIRE_DETECTION_AIRTIME_BUDGET_US, "fused location frame exceeds its airtime budget");
+static_assert(loraTimeOnAirUs(LORA_DEFAULT_MODULATION, wireFrameLength(true, 1, 0, 0, true)) <=
+              WIRE_MOVING_DETECTION_AIRTIME_BUDGET_US, "moving detection frame exceeds its airtime budget");
+
+struct WireRecord {
+    uint32_t timestampMs;   // sender uptime at detection
+    uint64_t mac;           // 48-bit key (see mac_table.h)
+    int8_t rssi;            // smoothed
+    uint8_t deviceIndex;    // WIRE_NO_DEVICE unless a POSSIBLE HIT
+    uint8_t range;          // distance code and trend (rssi_tracker.h), 0 = none
+};
+
+struct WireStatus {
+    uint16_t batteryMv;
+    uint8_t profile;
+    uint8_t reason;
+    uint8_t dutyPercent;
+    uint16_t estimatedDeciMa[WIRE_STATUS_PROFILES];
+};
+
+struct WireCommand {
+    uint8_t target;         // node index, 0 = all
+    uint8_t command;        // WIRE_CMD_*
+    uint8_t argument;
+    uint16_t durationMin;
+};
+
+struct WireAck {
+    uint8_t target;         // node index
+    uint8_t sequence;
+    uint16_t following;     // bit n: sequence + 1 + n
+};
+
+struct WireTargets {
+    uint8_t target;         // node index, 0 = all
+    uint8_t op;             // WIRE_TARGETS_*
+    uint16_t filterCrc;
+    uint16_t chunk;
+    uint8_t length;         // data bytes, a multiple of WIRE_BLOCK_BYTES once decoded
+    uint8_t data[WIRE_TARGETS_MAX_DATA];
+};
+
+struct WireFused {
+    uint64_t mac;           // 48-bit key
+    uint8_t deviceIndex;    // WIRE_NO_DEVICE for a TRUE HIT target
+    uint8_t observers;
+    uint16_t radiusDm;      // 95 % uncertainty, 0.1 m
+};
+
+struct WireFrame {
+    uint8_t type;           // MessageType
+    uint8_t node;
+    uint8_t sequence;
+    uint8_t hopLimit;       // relays left to cross (0 = do not forward)
+    uint8_t powerSteps;     // sent this many WIRE_POWER_STEP_DB below full power
+    uint32_t timestampMs;   // sender uptime, for frames without records (whole seconds on air)
+    bool replayed;          // records sent again from the journal
+    uint32_t replayAgeS;    // replayed: age of the oldest record, or WIRE_AGE_UNKNOWN
+    bool hasPosition;
+    int32_t latE7;
+    int32_t lonE7;
+    bool hasVelocity;       // with a position: the node is moving
+    int8_t velocityEast;    // WIRE_VELOCITY_UNIT_CMS steps
+    int8_t velocityNorth;
+    uint8_t recordCount;
+    WireRecord records[WIRE_MAX_RECORDS];
+    WireStatus status;      // MSG_STATUS only
+    WireCommand command;    // MSG_COMMAND only
+    WireAck ack;            // MSG_ACK only
+    WireTargets targets;    // MSG_TARGETS only
+    WireFused fused;        // MSG_FUSED only
+};
+
+enum WireDecodeResult {
+    WIRE_OK = 0,
+    WIRE_TOO_SHORT,
+    WIRE_BAD_CRC,
+    WIRE_BAD_VERSION,
+    WIRE_BAD_LENGTH,        // length disagrees with flags/record count
+};
+
+inline const char* wireDecodeResultName(WireDecodeResult result) {
+    switch (result) {
+        case WIRE_OK: return "ok";
+        case WIRE_TOO_SHORT: return "too short";
+        case WIRE_BAD_CRC: return "bad CRC";
+        case WIRE_BAD_VERSION: return "unknown version";
+        case WIRE_BAD_LENGTH: return "bad length";
+    }
+    return "?";
+}
+
+// CRC-16/CCITT-FALSE (poly 0x1021, init 0xFFFF); frames are short, so bitwise
+constexpr uint16_t wireCrc16(const uint8_t* data, size_t length) {
+    uint16_t crc = 0xFFFF;
+    for (size_t i = 0; i < length; i++) {
+        crc ^= (uint16_t)data[i] << 8;
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x1021) : (uint16_t)(crc << 1);
+        }
+    }
+    return crc;
+}
+
+// Node index from the trailing digits of a node ID ("NODE-007" -> 7);
+// 0 if there are none or they do not fit 1..254
+constexpr uint8_t nodeIndexFromId(const char* id) {
+    const char* end = id;
+    while (*end) end++;
+    const char* digits = end;
+    while (digits > id && digits[-1] >= '0' && digits[-1] <= '9') digits--;
+    if (digits == end || end - digits > 3) return 0;
+    int value = 0;
+    for (const char* p = digits; p < end; p++) value = value * 10 + (*p - '0');
+    return value >= 1 && value <= 254 ? (uint8_t)value : 0;
+}
+
+constexpr int32_t wireDegreesToE7(double degrees) {
+    return (int32_t)(degrees * 1e7 + (degrees < 0 ? -0.5 : 0.5));
+}
+
+constexpr double wireE7ToDegrees(int32_t e7) {
+    return e7 / 1e7;
+}
+
+inline void wirePut16(uint8_t* p, uint16_t v) {
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+}
+
+inline void wirePut32(uint8_t* p, uint32_t v) {
+    for (int i = 0; i < 4; i++) p[i] = (uint8_t)(v >> (8 * i));
+}
+
+inline uint16_t wireGet16(const uint8_t* p) {
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+inline uint32_t wireGet32(const uint8_t* p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+// Serialize into out; returns the frame length, or 0 if it does not fit,
+// has too many records (or any, for a type with a body), is a fused
+// location without a position, or a record is more than 65 s after the oldest
+inline size_t wireEncode(const WireFrame& frame, uint8_t* out, size_t capacity) {
+    if (frame.recordCount > WIRE_MAX_RECORDS) return 0;
+    if (wireBodyLength(frame.type) > 0 && frame.recordCount > 0) return 0;
+    if (frame.type == MSG_TARGETS && frame.targets.length > WIRE_TARGETS_MAX_DATA) return 0;
+    if (frame.type == MSG_FUSED && !frame.hasPosition) return 0;
+    uint8_t blocks = frame.type == MSG_TARGETS ?
+        (uint8_t)((frame.targets.length + WIRE_BLOCK_BYTES - 1) / WIRE_BLOCK_BYTES) : 0;
+    bool hasVelocity = frame.hasPosition && frame.hasVelocity;
+    size_t length = wireFrameLength(frame.hasPosition, frame.recordCount, frame.type, blocks, hasVelocity);
+    if (length > capacity) return 0;
+
+    // Base time: the oldest record (or the frame time) rounded down to seconds
+    uint32_t baseMs = frame.timestampMs;
+    for (uint8_t i = 0; i < frame.recordCount; i++) {
+        if (i == 0 || frame.records[i].timestampMs < baseMs) baseMs = frame.records[i].timestampMs;
+    }
+    uint32_t baseSec = baseMs / 1000;
+    // A replayed frame's records keep their spacing; the header says how old they are
+    uint32_t headerTime = frame.replayed ? frame.replayAgeS : baseSec;
+
+    out[0] = (uint8_t)(WIRE_VERSION << 4 | (frame.type & 0x0F));
+    out[1] = frame.node;
+    out[2] = frame.sequence;
+    out[3] = (uint8_t)((frame.hasPosition ? WIRE_FLAG_POSITION : 0) |
+                       ((frame.hopLimit << WIRE_HOPS_SHIFT) & WIRE_HOPS_MASK) |
+                       ((frame.powerSteps << WIRE_POWER_SHIFT) & WIRE_POWER_MASK));
+    out[4] = (uint8_t)headerTime;
+    out[5] = (uint8_t)(headerTime >> 8);
+    out[6] = (uint8_t)(headerTime >> 16);
+    out[7] = (uint8_t)((frame.recordCount | blocks) | (hasVelocity ? WIRE_FLAG_VELOCITY : 0) |
+                       (frame.replayed ? WIRE_FLAG_REPLAYED : 0));
+    uint8_t* p = out + WIRE_HEADER_BYTES;
+
+    if (frame.hasPosition) {
+        wirePut32(p, (uint32_t)frame.latE7);
+        wirePut32(p + 4, (uint32_t)frame.lonE7);
+        p += WIRE_POSITION_BYTES;
+    }
+    if (hasVelocity) {
+        p[0] = (uint8_t)frame.velocityEast;
+        p[1] = (uint8_t)frame.velocityNorth;
+        p += WIRE_VELOCITY_BYTES;
+    }
+
+    for (uint8_t i = 0; i < frame.recordCount; i++) {
+        const WireRecord& record = frame.records[i];
+        uint32_t deltaMs = record.timestampMs - baseSec * 1000;
+        if (deltaMs > UINT16_MAX) return 0;
+        wirePut16(p, (uint16_t)deltaMs);
+        for (int b = 0; b < 6; b++) p[2 + b] = (uint8_t)(record.mac >> (40 - 8 * b));
+        p[8] = (uint8_t)record.rssi;
+        p[9] = record.deviceIndex;
+        p[10] = record.range;
+        p += WIRE_RECORD_BYTES;
+    }
+
+    if (frame.type == MSG_STATUS) {
+        wirePut16(p, frame.status.batteryMv);
+        p[2] = (uint8_t)((frame.status.profile & 0x0F) | frame.status.reason << 4);
+        p[3] = frame.status.dutyPercent;
+        for (int i = 0; i < WIRE_STATUS_PROFILES; i++) wirePut16(p + 4 + 2 * i, frame.status.estimatedDeciMa[i]);
+        p += WIRE_STATUS_BYTES;
+    } else if (frame.type == MSG_COMMAND) {
+        p[0] = frame.command.target;
+        p[1] = frame.command.command;
+        p[2] = frame.command.argument;
+        p[3] = 0;
+        wirePut16(p + 4, frame.command.durationMin);
+        p += WIRE_COMMAND_BYTES;
+    } else if (frame.type == MSG_ACK) {
+        p[0] = frame.ack.target;
+        p[1] = frame.ack.sequence;
+        wirePut16(p + 2, frame.ack.following);
+        p += WIRE_ACK_BYTES;
+    } else if (frame.type == MSG_TARGETS) {
+        p[0] = frame.targets.target;
+        p[1] = frame.targets.op;
+        wirePut16(p + 2, frame.targets.filterCrc);
+        wirePut16(p + 4, frame.targets.chunk);
+        memset(p + WIRE_TARGETS_BYTES, 0, blocks * WIRE_BLOCK_BYTES);
+        memcpy(p + WIRE_TARGETS_BYTES, frame.targets.data, frame.targets.length);
+        p += wireBodyLength(MSG_TARGETS, blocks);
+    } else if (frame.type == MSG_FUSED) {
+        for (int b = 0; b < 6; b++) p[b] = (uint8_t)(frame.fused.mac >> (40 - 8 * b));
+        p[6] = frame.fused.deviceIndex;
+        p[7] = frame.fused.observers;
+        wirePut16(p + 8, frame.fused.radiusDm);
+        p += WIRE_FUSED_BYTES;
+    }
+
+    wirePut16(p, wireCrc16(out, length - WIRE_CRC_BYTES));
+    return length;
+}
+
+inline WireDecodeResult wireDecode(const uint8_t* data, size_t length, WireFrame& frame) {
+    if (length < wireFrameLength(false, 0)) return WIRE_TOO_SHORT;
+    if (wireGet16(data + length - WIRE_CRC_BYTES) != wireCrc16(data, length - WIRE_CRC_BYTES)) {
+        return WIRE_BAD_CRC;
+    }
+    if ((data[0] >> 4) != WIRE_VERSION) return WIRE_BAD_VERSION;
+
+    frame.type = data[0] & 0x0F;
+    frame.node = data[1];
+    frame.sequence = data[2];
+    frame.hasPosition = (data[3] & WIRE_FLAG_POSITION) != 0;
+    frame.hopLimit = (data[3] & WIRE_HOPS_MASK) >> WIRE_HOPS_SHIFT;
+    frame.powerSteps = (data[3] & WIRE_POWER_MASK) >> WIRE_POWER_SHIFT;
+    uint32_t headerTime = (uint32_t)data[4] | ((uint32_t)data[5] << 8) | ((uint32_t)data[6] << 16);
+    frame.replayed = (data[7] & WIRE_FLAG_REPLAYED) != 0;
+    frame.hasVelocity = (data[7] & WIRE_FLAG_VELOCITY) != 0;
+    frame.replayAgeS = frame.replayed ? headerTime : 0;
+    // Replayed records are timed from the oldest one
+    uint32_t baseMs = frame.replayed ? 0 : headerTime * 1000;
+    frame.timestampMs = baseMs;
+    frame.recordCount = data[7] & WIRE_COUNT_MASK;
+    uint8_t blocks = 0;
+    if (frame.type == MSG_TARGETS) {
+        blocks = frame.recordCount;
+        frame.recordCount = 0;
+    }
+    if (frame.recordCount > WIRE_MAX_RECORDS ||
+        (wireBodyLength(frame.type) > 0 && frame.recordCount > 0) ||
+        (frame.hasVelocity && !frame.hasPosition) ||
+        (frame.type == MSG_FUSED && !frame.hasPosition) ||
+        length != wireFrameLength(frame.hasPosition, frame.recordCount, frame.type, blocks, frame.hasVelocity)) {
+        return WIRE_BAD_LENGTH;
+    }
+    const uint8_t* p = data + WIRE_HEADER_BYTES;
+
+    frame.latE7 = 0;
+    frame.lonE7 = 0;
+    if (frame.hasPosition) {
+        frame.latE7 = (int32_t)wireGet32(p);
+        frame.lonE7 = (int32_t)wireGet32(p + 4);
+        p += WIRE_POSITION_BYTES;
+    }
+    frame.velocityEast = 0;
+    frame.velocityNorth = 0;
+    if (frame.hasVelocity) {
+        frame.velocityEast = (int8_t)p[0];
+        frame.velocityNorth = (int8_t)p[1];
+        p += WIRE_VELOCITY_BYTES;
+    }
+
+    for (uint8_t i = 0; i < frame.recordCount; i++) {
+        WireRecord& record = frame.records[i];
+        record.timestampMs = baseMs + wireGet16(p);
+        record.mac = 0;
+        for (int b = 0; b < 6; b++) record.mac = (record.mac << 8) | p[2 + b];
+        record.rssi = (int8_t)p[8];
+        record.deviceIndex = p[9];
+        record.range = p[10];
+        p += WIRE_RECORD_BYTES;
+    }
+
+    if (frame.type == MSG_STATUS) {
+        frame.status.batteryMv = wireGet16(p);
+        frame.status.profile = p[2] & 0x0F;
+        frame.status.reason = p[2] >> 4;
+        frame.status.dutyPercent = p[3];
+        for (int i = 0; i < WIRE_STATUS_PROFILES; i++) frame.status.estimatedDeciMa[i] = wireGet16(p + 4 + 2 * i);
+    } else if (frame.type == MSG_COMMAND) {
+        frame.command.target = p[0];
+        frame.command.command = p[1];
+        frame.command.argument = p[2];
+        frame.command.durationMin = wireGet16(p + 4);
+    } else if (frame.type == MSG_ACK) {
+        frame.ack.target = p[0];
+        frame.ack.sequence = p[1];
+        frame.ack.following = wireGet16(p + 2);
+    } else if (frame.type == MSG_TARGETS) {
+        frame.targets.target = p[0];
+        frame.targets.op = p[1];
+        frame.targets.filterCrc = wireGet16(p + 2);
+        frame.targets.chunk = wireGet16(p + 4);
+        frame.targets.length = (uint8_t)(blocks * WIRE_BLOCK_BYTES);
+        memcpy(frame.targets.data, p + WIRE_TARGETS_BYTES, frame.targets.length);
+    } else if (frame.type == MSG_FUSED) {
+        frame.fused.mac = 0;
+        for (int b = 0; b < 6; b++) frame.fused.mac = (frame.fused.mac << 8) | p[b];
+        frame.fused.deviceIndex = p[6];
+        frame.fused.observers = p[7];
+        frame.fused.radiusDm = wireGet16(p + 8);
+    }
+    return WIRE_OK;
+}
+
+// Rewrite one field of an encoded frame's flags byte and its CRC in place
+inline void wireSetFlagsField(uint8_t* data, size_t length, uint8_t mask, uint8_t shift, uint8_t value) {
+    data[3] = (uint8_t)((data[3] & ~mask) | ((value << shift) & mask));
+    wirePut16(data + length - WIRE_CRC_BYTES, wireCrc16(data, length - WIRE_CRC_BYTES));
+}
+
+// Hop count, lowered by each relay
+inline void wireSetHopLimit(uint8_t* data, size_t length, uint8_t hopLimit) {
+    wireSetFlagsField(data, length, WIRE_HOPS_MASK, WIRE_HOPS_SHIFT, hopLimit);
+}
+
+// Power backoff, set by whoever puts the frame on air
+inline void wireSetPowerSteps(uint8_t* data, size_t length, uint8_t steps) {
+    wireSetFlagsField(data, length, WIRE_POWER_MASK, WIRE_POWER_SHIFT, steps);
+}
+
+#endif // WIRE_FORMAT_H
@@ -0,0 +1,128 @@
+/**
+ * btrpa-scan-lora native stand-in: Arduino core
+ *
+ * Just enough of the ESP32 Arduino API for src/main.cpp to build on the
+ * host. Time comes from the simulation kernel; UART writes are charged
+ * at the configured baud rate through a 128-byte hardware FIFO model.
+ * UART1 is wired to a simulated GPS module (sim::gps()).
+ */
+
+#ifndef SIM_ARDUINO_H
+#define SIM_ARDUINO_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <math.h>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "sim_kernel.h"
+
+#define HIGH 0x1
+#define LOW 0x0
+#define INPUT 0x01
+#define OUTPUT 0x03
+#define INPUT_PULLUP 0x05
+
+#define RISING 0x01
+#define FALLING 0x02
+
+#define DEG_TO_RAD 0.017453292519943295769236907684886
+#define RAD_TO_DEG 57.295779513082320876798154814105
+
+#define SERIAL_8N1 0x800001c
+
+#define IRAM_ATTR
+
+typedef bool boolean;
+typedef uint8_t byte;
+
+unsigned long millis();
+unsigned long micros();
+void delay(uint32_t ms);
+void delayMicroseconds(uint32_t us);
+void yield();
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t val);
+int digitalRead(uint8_t pin);
+uint16_t analogRead(uint8_t pin);
+uint32_t analogReadMilliVolts(uint8_t pin);
+
+long random(long max);
+long random(long min, long max);
+void randomSeed(unsigned long seed);
+uint32_t esp_random();
+
+class Print {
+public:
+    virtual ~Print() {}
+    virtual size_t write(const uint8_t* buffer, size_t size) = 0;
+    virtual size_t write(uint8_t c) { return write(&c, 1); }
+
+    size_t printf(const char* format, ...) __attribute__((format(printf, 2, 3)));
+    size_t print(const char* s) { return write((const uint8_t*)s, strlen(s)); }
+    size_t print(const std::string& s) { return write((const uint8_t*)s.data(), s.size()); }
+    size_t print(char c) { return write((uint8_t)c); }
+    size_t print(int n) { return printf("%d", n); }
+    size_t print(unsigned int n) { return printf("%u", n); }
+    size_t print(long n) { return printf("%ld", n); }
+    size_t print(unsigned long n) { return printf("%lu", n); }
+    size_t print(double n, int digits = 2) { return printf("%.*f", digits, n); }
+    size_t println() { return print("\r\n"); }
+    template <typename T>
+    size_t println(const T& value) { size_t n = print(value); return n + println(); }
+};
+
+typedef std::function<void(void)> OnReceiveCb;
+
+typedef enum {
+    UART_NO_ERROR,
+    UART_BREAK_ERROR,
+    UART_BUFFER_FULL_ERROR,
+    UART_FIFO_OVF_ERROR,
+    UART_FRAME_ERROR,
+    UART_PARITY_ERROR,
+} hardwareSerial_error_t;
+typedef std::function<void(hardwareSerial_error_t)> OnReceiveErrorCb;
+
+class HardwareSerial : public Print {
+public:
+    explicit HardwareSerial(int uartNum) : _uartNum(uartNum) {}
+
+    void begin(unsigned long baud, uint32_t config = SERIAL_8N1,
+               int8_t rxPin = -1, int8_t txPin = -1);
+    void end() {}
+    void setRxBufferSize(size_t size) { _rxBufferSize = size; }
+    // Called once per burst of GPS sentences, and per line typed on the
+    // console (sim::typeConsoleLine())
+    void onReceive(OnReceiveCb function, bool onlyOnTimeout = false);
+    // Bytes dropped because the RX buffer was full (UART1 only)
+    void onReceiveError(OnReceiveErrorCb function);
+    void updateBaudRate(unsigned long baud);
+    int available();
+    int read();
+    size_t read(uint8_t* buffer, size_t size);
+    void flush();
+    size_t write(const uint8_t* buffer, size_t size) override;
+    using Print::write;
+    operator bool() const { return true; }
+
+private:
+    int _uartNum;
+    unsigned long _baud = 115200;
+    size_t _rxBufferSize = 256;
+    uint64_t _fifoEmptyAtUs = 0;   // virtual time the TX FIFO drains
+};
+
+extern HardwareSerial Serial;
+
+#endif // SIM_ARDUINO_H
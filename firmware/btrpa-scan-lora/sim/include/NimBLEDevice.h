@@ -0,0 +1,127 @@
+/**
+ * btrpa-scan-lora native stand-in: NimBLE-Arduino 1.4
+ *
+ * Address, advertised device and scan classes with the same signatures
+ * as NimBLE-Arduino 1.4.x. The replay harness feeds advertisements in
+ * through NimBLEScan::deliver(), which applies the host-side duplicate
+ * handling selected by setAdvertisedDeviceCallbacks()/setMaxResults().
+ * The controller's own duplicate filter is not modelled.
+ */
+
+#ifndef SIM_NIMBLE_DEVICE_H
+#define SIM_NIMBLE_DEVICE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <time.h>
+#include <string>
+#include <vector>
+
+#define BLE_ADDR_PUBLIC 0x00
+#define BLE_ADDR_RANDOM 0x01
+
+#define BLE_HCI_ADV_TYPE_ADV_IND 0x00
+#define BLE_HCI_ADV_TYPE_ADV_SCAN_IND 0x02
+#define BLE_HCI_ADV_TYPE_ADV_NONCONN_IND 0x03
+#define BLE_HCI_ADV_RPT_EVTYPE_SCAN_RSP 0x04
+
+class NimBLEAddress {
+public:
+    NimBLEAddress() : m_address{0}, m_addrType(BLE_ADDR_PUBLIC) {}
+    NimBLEAddress(const uint8_t address[6], uint8_t type = BLE_ADDR_PUBLIC);
+    NimBLEAddress(const uint64_t& address, uint8_t type = BLE_ADDR_PUBLIC);
+
+    bool equals(const NimBLEAddress& other) const;
+    const uint8_t* getNative() const { return m_address; }
+    uint8_t getType() const { return m_addrType; }
+    std::string toString() const;
+
+    bool operator==(const NimBLEAddress& rhs) const { return equals(rhs); }
+    bool operator!=(const NimBLEAddress& rhs) const { return !equals(rhs); }
+    operator std::string() const { return toString(); }
+    operator uint64_t() const;
+
+private:
+    uint8_t m_address[6];   // least significant byte first, as in NimBLE
+    uint8_t m_addrType;
+};
+
+class NimBLEAdvertisedDevice {
+public:
+    NimBLEAdvertisedDevice() {}
+
+    NimBLEAddress getAddress() { return m_address; }
+    uint8_t getAddressType() { return m_address.getType(); }
+    uint8_t getAdvType() { return m_advType; }
+    int getRSSI() { return m_rssi; }
+    time_t getTimestamp() { return m_timestamp; }
+    bool haveName();
+    std::string getName();
+    uint8_t* getPayload() { return m_payload.data(); }
+    size_t getPayloadLength() { return m_payload.size(); }
+
+    // Simulation only: populate the device from a trace record
+    void simSet(const NimBLEAddress& address, int rssi, uint8_t advType,
+                const uint8_t* payload, size_t payloadLen);
+
+private:
+    NimBLEAddress m_address;
+    int m_rssi = -127;
+    uint8_t m_advType = BLE_HCI_ADV_TYPE_ADV_IND;
+    time_t m_timestamp = 0;
+    std::vector<uint8_t> m_payload;
+};
+
+class NimBLEAdvertisedDeviceCallbacks {
+public:
+    virtual ~NimBLEAdvertisedDeviceCallbacks() {}
+    virtual void onResult(NimBLEAdvertisedDevice* advertisedDevice) = 0;
+};
+
+class NimBLEScanResults {
+public:
+    int getCount() { return 0; }
+};
+
+class NimBLEScan {
+public:
+    void setAdvertisedDeviceCallbacks(NimBLEAdvertisedDeviceCallbacks* pAdvertisedDeviceCallbacks,
+                                      bool wantDuplicates = false);
+    void setActiveScan(bool active) { m_active = active; }
+    void setInterval(uint16_t intervalMSecs) { m_intervalMs = intervalMSecs; }
+    void setWindow(uint16_t windowMSecs) { m_windowMs = windowMSecs; }
+    void setDuplicateFilter(bool enabled) { m_duplicateFilter = enabled; }
+    void setMaxResults(uint8_t maxResults) { m_maxResults = maxResults; }
+    bool start(uint32_t duration, void (*scanCompleteCB)(NimBLEScanResults) = nullptr,
+               bool is_continue = false);
+    void stop() { m_scanning = false; }
+    bool isScanning() { return m_scanning; }
+    void clearResults() { m_stored.clear(); }
+
+    // Simulation only
+    uint16_t getInterval() const { return m_intervalMs; }
+    uint16_t getWindow() const { return m_windowMs; }
+    // Run the result callback the way NimBLE's GAP handler would; returns
+    // false when the advert was swallowed as a duplicate of a stored result
+    bool deliver(NimBLEAdvertisedDevice* device);
+
+private:
+    NimBLEAdvertisedDeviceCallbacks* m_callbacks = nullptr;
+    bool m_wantDuplicates = false;
+    bool m_active = false;
+    bool m_duplicateFilter = true;
+    bool m_scanning = false;
+    uint8_t m_maxResults = 0xFF;
+    uint16_t m_intervalMs = 100;
+    uint16_t m_windowMs = 100;
+    std::vector<uint64_t> m_stored;
+};
+
+class NimBLEDevice {
+public:
+    static void init(const std::string& deviceName);
+    static void deinit(bool clearAll = false);
+    static NimBLEScan* getScan();
+};
+
+#endif // SIM_NIMBLE_DEVICE_H
@@ -0,0 +1,122 @@
+/**
+ * btrpa-scan-lora native stand-in: RadioLib 6.x SX1262
+ *
+ * Transmissions take their real time-on-air (from lora_airtime.h, using
+ * the modulation last configured) and are appended to sim::txLog().
+ * startTransmit() returns at once and raises DIO1 when the frame is off
+ * the air, as the chip's TX_DONE interrupt would. Frames from other nodes
+ * (sim::injectLoRaFrame) raise DIO1 as RX_DONE when fully received, if
+ * the radio was listening at the frame's spreading factor early enough
+ * in its preamble to lock on and stayed in receive until the end. Frames
+ * below the demodulation SNR floor of their spreading factor are lost.
+ * startChannelScan() runs CAD at the configured spreading factor and
+ * raises DIO1 when done; it detects a frame at that SF on air for the
+ * whole listening window.
+ */
+
+#ifndef SIM_RADIOLIB_H
+#define SIM_RADIOLIB_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <SPI.h>
+#include <vector>
+
+#include "lora_airtime.h"
+
+#define RADIOLIB_NC (0xFFFFFFFF)
+
+#define RADIOLIB_ERR_NONE (0)
+#define RADIOLIB_ERR_UNKNOWN (-1)
+#define RADIOLIB_ERR_CHIP_NOT_FOUND (-2)
+#define RADIOLIB_ERR_PACKET_TOO_LONG (-4)
+#define RADIOLIB_ERR_TX_TIMEOUT (-5)
+#define RADIOLIB_ERR_RX_TIMEOUT (-6)
+#define RADIOLIB_ERR_CRC_MISMATCH (-7)
+#define RADIOLIB_PREAMBLE_DETECTED (-14)
+#define RADIOLIB_CHANNEL_FREE (-15)
+#define RADIOLIB_LORA_DETECTED (-702)
+
+#define RADIOLIB_SX126X_MAX_PACKET_LENGTH 255
+
+class Module {
+public:
+    Module(uint32_t cs, uint32_t irq, uint32_t rst, uint32_t gpio = RADIOLIB_NC)
+        : cs(cs), irq(irq), rst(rst), gpio(gpio) {}
+    uint32_t cs, irq, rst, gpio;
+};
+
+class SX1262 {
+public:
+    SX1262(Module* mod);
+
+    int16_t begin(float freq = 434.0, float bw = 125.0, uint8_t sf = 9, uint8_t cr = 7,
+                  uint8_t syncWord = 0x12, int8_t power = 10, uint16_t preambleLength = 8);
+    int16_t setFrequency(float freq) { _freqMHz = freq; return RADIOLIB_ERR_NONE; }
+    int16_t setSpreadingFactor(uint8_t sf);
+    int16_t setBandwidth(float bw);
+    int16_t setCodingRate(uint8_t cr);
+    int16_t setOutputPower(int8_t power) { _powerDbm = power; return RADIOLIB_ERR_NONE; }
+    int16_t setPreambleLength(uint16_t preambleLength);
+    int16_t setSyncWord(uint8_t syncWord, uint8_t controlBits = 0x44) {
+        (void)controlBits; _syncWord = syncWord; return RADIOLIB_ERR_NONE;
+    }
+
+    int16_t transmit(uint8_t* data, size_t len, uint8_t addr = 0);
+    int16_t startTransmit(uint8_t* data, size_t len, uint8_t addr = 0);
+    int16_t finishTransmit();
+    void setDio1Action(void (*func)(void)) { _dio1Action = func; }
+    void clearDio1Action() { _dio1Action = nullptr; }
+    int16_t startReceive();
+    int16_t startChannelScan();
+    int16_t getChannelScanResult() { return _cadDetected ? RADIOLIB_LORA_DETECTED : RADIOLIB_CHANNEL_FREE; }
+    int16_t standby();
+    int16_t available();
+    int16_t readData(uint8_t* data, size_t len);
+    size_t getPacketLength(bool update = true);
+    float getRSSI() { return _lastRssi; }
+    float getSNR() { return _lastSnr; }
+    uint32_t getTimeOnAir(size_t len) { return loraTimeOnAirUs(_modulation, (uint32_t)len); }
+
+    // Simulation only
+    const LoRaModulation& simModulation() const { return _modulation; }
+    int8_t simOutputPower() const { return _powerDbm; }
+    void simOnAir(const LoRaModulation& modulation, const std::vector<uint8_t>& data, float rssi, float snr);
+
+private:
+    // A frame from another node, from its first preamble symbol to its CRC
+    struct AirFrame {
+        uint32_t id;
+        uint64_t startUs;
+        uint64_t lockByUs;          // last moment a receiver can still lock on
+        uint64_t endUs;
+        uint8_t spreadingFactor;
+        std::vector<uint8_t> data;
+        float rssi;
+        float snr;
+        bool resolved;              // received, or counted as lost
+    };
+
+    void enterMode();
+    void tryLock(AirFrame& frame);
+
+    Module* _mod;
+    LoRaModulation _modulation = {9, 125000, 7, 8, true, true};
+    float _freqMHz = 434.0;
+    int8_t _powerDbm = 10;
+    uint8_t _syncWord = 0x12;
+    bool _receiving = false;
+    bool _transmitting = false;
+    uint32_t _opId = 0;               // bumped whenever the chip changes mode
+    uint64_t _rxBusyUntilUs = 0;      // end of the frame being received
+    bool _cadDetected = false;
+    std::vector<AirFrame> _air;
+    uint32_t _airId = 0;
+    bool _rxReady = false;            // FIFO holds an unread frame
+    std::vector<uint8_t> _rxBuffer;
+    void (*_dio1Action)(void) = nullptr;
+    float _lastRssi = 0;
+    float _lastSnr = 0;
+};
+
+#endif // SIM_RADIOLIB_H
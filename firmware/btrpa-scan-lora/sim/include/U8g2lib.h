@@ -0,0 +1,62 @@
+/**
+ * btrpa-scan-lora native stand-in: U8g2 (SSD1306 128x64, full buffer, HW I2C)
+ *
+ * Drawing only touches the local frame buffer; sendBuffer() and
+ * updateDisplayArea() block for the time their transfer takes on the I2C
+ * bus. A font array holds the font's ascent and descent.
+ */
+
+#ifndef SIM_U8G2LIB_H
+#define SIM_U8G2LIB_H
+
+#include <stdint.h>
+
+typedef uint8_t u8g2_uint_t;
+typedef const uint8_t* u8g2_font_t;
+
+struct u8g2_cb_t {};
+extern const u8g2_cb_t* U8G2_R0;
+
+extern const uint8_t u8g2_font_ncenB08_tr[2];
+extern const uint8_t u8g2_font_ncenB10_tr[2];
+extern const uint8_t u8g2_font_ncenB14_tr[2];
+
+#define U8X8_PIN_NONE 255
+
+class U8G2 {
+public:
+    bool begin() { return true; }
+    void clearBuffer();
+    void sendBuffer();
+    void updateDisplayArea(uint8_t tx, uint8_t ty, uint8_t tw, uint8_t th);
+    void setFont(const uint8_t* font) { _font = font; }
+    int8_t getAscent() const { return _font ? (int8_t)_font[0] : 0; }
+    int8_t getDescent() const { return _font ? (int8_t)_font[1] : 0; }
+    void setDrawColor(uint8_t color) { _color = color; }
+    void setPowerSave(uint8_t isEnable) { (void)isEnable; }
+    void drawBox(u8g2_uint_t x, u8g2_uint_t y, u8g2_uint_t w, u8g2_uint_t h);
+    u8g2_uint_t drawStr(u8g2_uint_t x, u8g2_uint_t y, const char* s);
+
+    // Simulation only
+    uint32_t simFramesSent() const { return _framesSent; }
+    uint32_t simTileRowsSent() const { return _tileRowsSent; }
+
+protected:
+    uint8_t _buffer[1024] = {0};
+    const uint8_t* _font = nullptr;
+    uint8_t _color = 1;
+    uint32_t _framesSent = 0;
+    uint32_t _tileRowsSent = 0;
+};
+
+class U8G2_SSD1306_128X64_NONAME_F_HW_I2C : public U8G2 {
+public:
+    U8G2_SSD1306_128X64_NONAME_F_HW_I2C(const u8g2_cb_t* rotation,
+                                        uint8_t reset = U8X8_PIN_NONE,
+                                        uint8_t clock = U8X8_PIN_NONE,
+                                        uint8_t data = U8X8_PIN_NONE) {
+        (void)rotation; (void)reset; (void)clock; (void)data;
+    }
+};
+
+#endif // SIM_U8G2LIB_H
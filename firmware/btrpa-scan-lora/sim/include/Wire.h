@@ -0,0 +1,21 @@
+/**
+ * btrpa-scan-lora native stand-in: Wire (I2C)
+ */
+
+#ifndef SIM_WIRE_H
+#define SIM_WIRE_H
+
+#include <stdint.h>
+
+class TwoWire {
+public:
+    bool begin(int sda = -1, int scl = -1, uint32_t frequency = 0) {
+        (void)sda; (void)scl; (void)frequency;
+        return true;
+    }
+    bool setClock(uint32_t frequency) { (void)frequency; return true; }
+};
+
+extern TwoWire Wire;
+
+#endif // SIM_WIRE_H
@@ -0,0 +1,23 @@
+/**
+ * btrpa-scan-lora native stand-in: ESP-IDF heap capability queries
+ *
+ * The host has no ESP32 heap to measure. These report a fixed internal
+ * heap of the size a Heltec V3 has left after boot, so the statistics
+ * line keeps its device shape; allocation counts come from the wrapped
+ * malloc instead (alloc_counter.h).
+ */
+
+#ifndef SIM_ESP_HEAP_CAPS_H
+#define SIM_ESP_HEAP_CAPS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define MALLOC_CAP_8BIT (1 << 2)
+#define MALLOC_CAP_INTERNAL (1 << 11)
+
+size_t heap_caps_get_free_size(uint32_t caps);
+size_t heap_caps_get_largest_free_block(uint32_t caps);
+size_t heap_caps_get_minimum_free_size(uint32_t caps);
+
+#endif // SIM_ESP_HEAP_CAPS_H
@@ -0,0 +1,22 @@
+/**
+ * btrpa-scan-lora native stand-in: ESP-IDF light sleep
+ *
+ * Light sleep blocks the calling context until the timer wakeup, like a
+ * delay. Other contexts keep running in virtual time, so a LoRa frame
+ * arriving meanwhile is handled when the radio interrupt fires, which is
+ * what the DIO1 GPIO wakeup gives on the device. The harness counts the
+ * time slept.
+ */
+
+#ifndef SIM_ESP_SLEEP_H
+#define SIM_ESP_SLEEP_H
+
+#include <stdint.h>
+
+#include "esp_err.h"
+
+esp_err_t esp_sleep_enable_timer_wakeup(uint64_t timeUs);
+esp_err_t esp_sleep_enable_gpio_wakeup();
+esp_err_t esp_light_sleep_start();
+
+#endif // SIM_ESP_SLEEP_H
@@ -0,0 +1,33 @@
+/**
+ * btrpa-scan-lora native stand-in: mbedtls AES (single-block ECB)
+ *
+ * On the ESP32 the Arduino core's mbedtls routes these calls to the AES
+ * accelerator. Here they run a plain software AES (FIPS-197), enough to
+ * check RPA resolution against the same vectors as the Python tool.
+ * Encryption only, 128/192/256-bit keys.
+ */
+
+#ifndef SIM_MBEDTLS_AES_H
+#define SIM_MBEDTLS_AES_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define MBEDTLS_AES_ENCRYPT 1
+#define MBEDTLS_AES_DECRYPT 0
+
+#define MBEDTLS_ERR_AES_INVALID_KEY_LENGTH (-0x0020)
+#define MBEDTLS_ERR_AES_BAD_INPUT_DATA (-0x0021)
+
+typedef struct mbedtls_aes_context {
+    int nr;                     // rounds
+    uint32_t rk[60];            // expanded encryption key
+} mbedtls_aes_context;
+
+void mbedtls_aes_init(mbedtls_aes_context* ctx);
+void mbedtls_aes_free(mbedtls_aes_context* ctx);
+int mbedtls_aes_setkey_enc(mbedtls_aes_context* ctx, const unsigned char* key, unsigned int keybits);
+int mbedtls_aes_crypt_ecb(mbedtls_aes_context* ctx, int mode, const unsigned char input[16],
+                          unsigned char output[16]);
+
+#endif // SIM_MBEDTLS_AES_H
@@ -0,0 +1,13 @@
+/**
+ * btrpa-scan-lora native stand-in: ESP-IDF NVS partition setup
+ */
+
+#ifndef SIM_NVS_FLASH_H
+#define SIM_NVS_FLASH_H
+
+#include "nvs.h"
+
+esp_err_t nvs_flash_init_partition(const char* partition_label);
+esp_err_t nvs_flash_erase_partition(const char* part_name);
+
+#endif // SIM_NVS_FLASH_H
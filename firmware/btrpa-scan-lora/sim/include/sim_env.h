@@ -0,0 +1,131 @@
+/**
+ * btrpa-scan-lora Host Simulation Environment
+ *
+ * Shared state between the native stand-ins and the replay harness:
+ * simulated peripherals the harness configures and logs it reads back.
+ */
+
+#ifndef SIM_ENV_H
+#define SIM_ENV_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "lora_airtime.h"
+
+class NimBLEScan;
+
+namespace sim {
+
+// GPS receiver attached to UART1. It starts with its factory output (GGA,
+// GLL, GSA, 3 x GSV, RMC and VTG once a second, ~500 bytes at 9600 baud)
+// and obeys configuration commands in its own dialect.
+enum GpsDialect { GPS_SIM_UBX, GPS_SIM_PMTK, GPS_SIM_NMEA_ONLY };
+
+enum GpsSentence : uint8_t {
+    GPS_SIM_GGA = 1 << 0,
+    GPS_SIM_GLL = 1 << 1,
+    GPS_SIM_GSA = 1 << 2,
+    GPS_SIM_GSV = 1 << 3,
+    GPS_SIM_RMC = 1 << 4,
+    GPS_SIM_VTG = 1 << 5,
+};
+
+struct GpsState {
+    bool present = false;        // module answers on the UART
+    bool fix = false;            // location valid
+    double lat = 0.0;            // at virtual time 0
+    double lon = 0.0;
+    double speedMs = 0.0;        // walking from there, turning right by
+    double courseDeg = 0.0;      // turnDeg every turnSec (0 = straight on)
+    double turnDeg = 90.0;
+    uint32_t turnSec = 0;
+    GpsDialect dialect = GPS_SIM_UBX;
+    uint32_t baud = 9600;        // the module's current rate
+    uint32_t rateMs = 1000;      // one burst of sentences per fix
+    uint8_t sentences = 0x3F;    // GpsSentence bits
+    uint32_t utcAtBoot = 1772323200;  // Unix time at virtual time 0 (2026-03-01)
+
+    // Read back by the report
+    uint64_t bytesSent = 0;      // sentences and replies put on the line
+    uint32_t commands = 0;       // configuration commands obeyed
+    uint32_t bytesDropped = 0;   // lost to a full RX buffer
+};
+GpsState& gps();
+
+// Battery behind the ADC divider: a straight line from startMv at startUs
+// to endMv at endUs; 0 mV reads as no battery fitted
+struct BatteryState {
+    float startMv = 0.0f;
+    float endMv = 0.0f;
+    uint64_t startUs = 0;
+    uint64_t endUs = 0;
+    float dividerRatio = 1.0f;
+    float mvAt(uint64_t us) const;
+};
+BatteryState& battery();
+
+// Light sleep taken by the firmware (esp_light_sleep_start)
+struct SleepStats {
+    uint64_t sleeps = 0;
+    uint64_t sleptUs = 0;
+};
+SleepStats& sleepStats();
+
+// SPI flash behind the "journal" partition and the "targets" NVS
+struct FlashState {
+    uint32_t journalBytes = 0x140000;   // as in partitions.csv; 0 = no partition
+    std::string path;                   // loaded at boot, saved by saveFlash() (NVS in path + ".nvs")
+    uint64_t powerCutUs = UINT64_MAX;   // flash operations stop here
+    uint32_t reads = 0;
+    uint32_t writes = 0;
+    uint32_t erases = 0;
+    bool torn = false;                  // an operation was cut short
+};
+FlashState& flash();
+bool saveFlash();
+
+// Echo firmware Serial output to stdout
+void setSerialEcho(bool enabled);
+
+// Append firmware Serial output to out as well (nullptr: stop)
+void captureSerial(std::string* out);
+
+// A line arriving on the USB console at virtual time atUs
+void typeConsoleLine(uint64_t atUs, const std::string& line);
+
+// I2C bus clock used to cost OLED transfers
+void setI2cClockHz(uint32_t hz);
+
+// One LoRa transmission as seen on air
+struct TxRecord {
+    uint64_t startUs;
+    uint64_t endUs;
+    std::vector<uint8_t> data;
+    LoRaModulation modulation;
+    int8_t powerDbm;
+};
+std::vector<TxRecord>& txLog();
+
+// LoRa frame from another node arriving at the simulated SX1262 at atUs
+void injectLoRaFrame(uint64_t atUs, const std::vector<uint8_t>& data, float rssi, float snr,
+                     const LoRaModulation& modulation = LORA_DEFAULT_MODULATION);
+
+struct LoRaRxStats {
+    uint64_t offered = 0;       // frames injected
+    uint64_t deaf = 0;          // not in RX at the frame's SF during its preamble
+    uint64_t weak = 0;          // SNR below the spreading factor's floor
+    uint64_t collided = 0;      // overlapped a frame already being received
+    uint64_t aborted = 0;       // radio left RX (started a TX) mid-frame
+    uint64_t overwritten = 0;   // previous frame still unread in the FIFO
+    uint64_t delivered = 0;     // RX_DONE raised
+};
+LoRaRxStats& loraRxStats();
+
+// Implemented by the harness: called when the firmware starts a BLE scan
+void onScanStart(NimBLEScan* scan);
+
+} // namespace sim
+
+#endif // SIM_ENV_H
@@ -0,0 +1,87 @@
+/**
+ * btrpa-scan-lora Host Simulation Kernel
+ *
+ * Discrete-event scheduler behind the native stand-ins. Every firmware
+ * execution context (Arduino loop task, NimBLE host task, ...) runs on its
+ * own host thread, but only one runs at a time: the context with the
+ * earliest virtual time. Blocking calls (delay, radio airtime, I2C/UART
+ * transfers) advance that context's clock and hand control back, so
+ * contexts interleave in virtual time the way they would across the two
+ * ESP32-S3 cores.
+ *
+ * CPU work between blocking calls is charged one of two ways. By default
+ * each call into the kernel (clock reads, notifications, blocking) costs
+ * a fixed time and the driver charges a fixed time per advert, so a run
+ * repeats exactly and a regression shows as a changed number. Measured
+ * host time multiplied by cpuScale (host-to-ESP32 slowdown factor)
+ * follows the real cost of the code more closely, but moves with the
+ * host's load: drops and queue overflows then vary by tens of percent
+ * between identical runs.
+ */
+
+#ifndef SIM_KERNEL_H
+#define SIM_KERNEL_H
+
+#include <stdint.h>
+#include <functional>
+
+namespace sim {
+
+struct Context;
+
+constexpr uint64_t NEVER = UINT64_MAX;
+
+// Charge perCallNs of CPU for each call into the kernel (the default,
+// 1 us); must be above zero, or a loop polling micros() never ends
+void setFixedCpuCost(uint64_t perCallNs);
+
+// Charge measured host time instead, slowed down by scale
+void setCpuScale(double scale);
+
+// With fixed costs, charge us of CPU work to the calling context without
+// blocking; with measured time the work is timed instead and this does
+// nothing
+void chargeCpu(uint64_t us);
+
+// Start a new context; its body runs the first time it is scheduled
+Context* spawn(const char* name, std::function<void()> body, uint64_t startUs = 0);
+
+// Run the scheduler until every context is blocked past untilUs
+void run(uint64_t untilUs);
+
+// Move the end of the current run() (may be called from inside a context)
+void stopAt(uint64_t untilUs);
+
+// Context currently executing (nullptr outside the scheduler)
+Context* current();
+const char* contextName(const Context* ctx);
+
+// Virtual time of the calling context in microseconds
+uint64_t nowUs();
+
+// Block the calling context until the given virtual time
+void sleepUntil(uint64_t wakeUs);
+
+// Block the calling context for a modelled busy period (I/O, airtime)
+void consume(uint64_t us);
+
+// Block until notified or until timeoutUs elapses; returns pending count
+uint32_t waitNotify(uint64_t timeoutUs, bool clearOnExit);
+
+// Wake a context blocked in waitNotify (callable from any context)
+void notify(Context* ctx);
+
+// Block until unpark() or until timeoutUs elapses; true when unparked.
+// Separate from notifications so mutexes and queues don't consume them.
+bool park(uint64_t timeoutUs);
+void unpark(Context* ctx);
+
+// Run fn at virtual time atUs outside any task context (ISR model)
+void schedule(uint64_t atUs, std::function<void()> fn);
+
+// Busy time accumulated by a context (modelled blocking + scaled CPU)
+uint64_t busyUs(const Context* ctx);
+
+} // namespace sim
+
+#endif // SIM_KERNEL_H
@@ -0,0 +1,1494 @@
+/**
+ * btrpa-scan-lora Advertisement Trace Replay
+ *
+ * Host-native driver for `pio run -e native`. Boots the real firmware
+ * (setup()/loop() from src/main.cpp) on the simulation kernel and replays
+ * a recorded or synthetic advertisement trace into the NimBLE scan
+ * callbacks, then reports:
+ *
+ *   - adverts/sec sustained by the BLE host task
+ *   - adverts dropped because the host fell behind (HCI event buffers)
+ *   - detection-to-TX-start latency percentiles for TRUE/POSSIBLE HIT frames
+ *   - LoRa frames from other nodes received vs. lost (with --rx-rate)
+ *
+ * Usage:
+ *   .pio/build/native/program [options]
+ *
+ *   --trace FILE         CSV trace: time_ms,address,rssi[,addr_type[,payload_hex]]
+ *                        or a btrpa-scan.py --log/--output csv file
+ *   --synthetic N        N random advertisers (default 2000 when no trace)
+ *   --duration SEC       synthetic trace length (default 30)
+ *   --adv-interval MS    synthetic advertising interval (default 250)
+ *   --inject MAC         add an advertiser with this address (repeatable)
+ *   --inject-ramp FROM,TO
+ *                        injected advertisers' RSSI moves from FROM to TO dBm
+ *                        over the trace, as a device walking up or away
+ *   --inject-ad HEX      add an advertiser with a random address and this raw
+ *                        advertising payload (repeatable)
+ *   --rpa IRK            add an advertiser with resolvable private addresses
+ *                        generated from this key (repeatable)
+ *   --rpa-rotate SEC     RPA lifetime before a new address (default 900)
+ *   --rpa-share PCT      share of synthetic advertisers using (unresolvable)
+ *                        RPAs instead of static random addresses (default 0)
+ *   --hci-depth N        controller-to-host advert report buffers (default 8)
+ *   --cpu-cost CALL,ADVERT
+ *                        fixed CPU cost in us of each call into the
+ *                        simulation kernel and of each advert the BLE host
+ *                        handles (default 1,8): runs repeat exactly
+ *   --cpu-scale X        charge measured host time slowed down by X instead
+ *                        (more faithful, but varies between runs); also the
+ *                        factor of --fusion-bench's ESP32 estimate (default 10)
+ *   --gps LAT,LON[,DIALECT]
+ *                        simulate a GPS module with a fix; it takes ubx
+ *                        (default), pmtk or no (nmea) configuration commands
+ *   --gps-walk SPEED,COURSE[,TURN_SEC[,TURN_DEG]]
+ *                        the module moves from there at SPEED m/s towards
+ *                        COURSE degrees, turning right by TURN_DEG (default
+ *                        90) every TURN_SEC seconds (default: straight on)
+ *   --rx-rate N          LoRa frames per minute from other nodes (default 0);
+ *                        beacons and POSSIBLE HITs at the rate their link
+ *                        allows, half also heard via a relay
+ *   --peer-rssi LO,HI    range of other nodes' RSSI in dBm (default -115,-70)
+ *   --peer-target MAC[,EAST,NORTH]
+ *                        other nodes stand scattered up to 200 m around this
+ *                        one, and those within 100 m of a target EAST, NORTH
+ *                        metres from it (default 0,0) report MAC in their
+ *                        POSSIBLE HITs, at the RSSI its distance gives; the
+ *                        report compares a MESH_GATEWAY node's fused
+ *                        locations with where the target is (repeatable: a
+ *                        node near several targets reports one at random)
+ *   --fusion-bench N     time N target fusion fits (target_fusion.h) per
+ *                        observer count from 3 to 20 on the host, and exit
+ *   --golden-frames      print a fixed set of frames of every message type
+ *                        as the homebase writes them to its serial port
+ *                        (wireEncode, serialFrameEncode), in hex, and exit;
+ *                        homebase/test_gateway_frames.py decodes them
+ *   --battery MV[,END]   battery voltage, falling linearly to END over the
+ *                        trace (default: no battery)
+ *   --command SEC:NODE:PROFILE[:MIN]
+ *                        gateway scan-profile command heard SEC s into the
+ *                        trace; NODE is a node index or "all" (repeatable)
+ *   --target SEC:NODE:OP[:MAC]
+ *                        gateway targets operation (add, remove or clear)
+ *                        heard SEC s into the trace (repeatable)
+ *   --filter SEC:FILE    gateway broadcast of a registry filter built by
+ *                        homebase/target_filter.py --out FILE, starting SEC
+ *                        s into the trace, TARGET_FILTER_ROUNDS times
+ *   --console SEC:LINE   LINE typed on the USB console SEC s into the trace;
+ *                        @FILE types FILE's lines, one every 100 ms
+ *                        (repeatable)
+ *   --homebase FROM[,TO] a homebase in range from FROM s into the trace
+ *                        (to TO, default the end) acknowledges this node's
+ *                        hit and status frames, as a MESH_GATEWAY node does
+ *   --flash FILE         journal partition image: loaded at boot if it
+ *                        exists, saved at the end (runs share the journal);
+ *                        the targets NVS goes to FILE.nvs
+ *   --power-cut SEC      cut power SEC s into the trace: the flash operation
+ *                        in progress is torn and the run ends there
+ *   --drain SEC          keep running after the trace ends (default 5)
+ *   --seed N             synthetic trace seed (default 1)
+ *   --serial             echo firmware Serial output
+ *   --check              exit with status 1 if the firmware lost adverts to
+ *                        a full detection queue or alerts to a full alert
+ *                        log, or (MESH_GATEWAY with FUSION_BROADCAST) sent
+ *                        fewer fused locations than it made: with the
+ *                        default fixed CPU costs, a regression check to run
+ *                        before flashing
+ */
+
+#include <Arduino.h>
+#include <NimBLEDevice.h>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <deque>
+#include <fstream>
+#include <map>
+#include <random>
+#include <sstream>
+#include <stdio.h>
+
+#include "config.h"
+#include "config_defaults.h"
+#include "mesh_protocol.h"
+#include "irk_resolver.h"
+#include "lora_rate.h"
+#include "mac_table.h"
+#include "mesh_ack.h"
+#include "rssi_tracker.h"
+#include "target_filter.h"
+#include "scan_scheduler.h"
+#include "serial_frame.h"
+#include "target_fusion.h"
+#include "wire_format.h"
+#include "sim_env.h"
+#include "sim_kernel.h"
+
+void setup();
+void loop();
+void printStatistics();
+
+// ============================================================================
+// TRACE MODEL
+// ============================================================================
+
+struct Advertiser {
+    uint64_t address;
+    uint8_t addrType;
+    std::vector<uint8_t> payload;
+};
+
+struct AdvertEvent {
+    uint64_t timeUs;        // relative to scan start
+    uint32_t advertiser;
+    int8_t rssi;
+};
+
+struct Trace {
+    std::string description;
+    std::vector<Advertiser> advertisers;
+    std::vector<AdvertEvent> events;
+    uint64_t durationUs = 0;
+};
+
+// --peer-target: a device EAST, NORTH metres from this node
+struct PeerTarget {
+    uint64_t mac;
+    double east;
+    double north;
+};
+
+struct Options {
+    std::string tracePath;
+    uint32_t synthetic = 2000;
+    double durationSec = 30.0;
+    uint32_t advIntervalMs = 250;
+    std::vector<uint64_t> inject;
+    bool injectRamp = false;
+    int injectRampFrom = 0;
+    int injectRampTo = 0;
+    std::vector<std::vector<uint8_t>> injectPayloads;
+    std::vector<std::array<uint8_t, 16>> rpaKeys;
+    double rpaRotateSec = 900.0;
+    uint32_t rpaShare = 0;
+    uint32_t hciDepth = 8;
+    bool measuredCpu = false;
+    double callCostUs = 1.0;
+    double advertCostUs = 8.0;
+    double cpuScale = 10.0;
+    bool gps = false;
+    double lat = 0.0;
+    double lon = 0.0;
+    sim::GpsDialect gpsDialect = sim::GPS_SIM_UBX;
+    double walkSpeed = 0.0;
+    double walkCourse = 0.0;
+    double walkTurnSec = 0.0;
+    double walkTurnDeg = 90.0;
+    double rxPerMin = 0.0;
+    float peerRssiLo = -115.0f;
+    float peerRssiHi = -70.0f;
+    std::vector<PeerTarget> peerTargets;
+    uint32_t fusionBench = 0;
+    float batteryMv = 0.0f;
+    float batteryEndMv = -1.0f;
+    std::vector<std::string> commands;
+    std::vector<std::string> targets;
+    std::string filterPath;
+    double filterSec = -1.0;
+    std::vector<std::string> console;
+    double homebaseFromSec = -1.0;
+    double homebaseToSec = -1.0;
+    std::string flashPath;
+    double powerCutSec = -1.0;
+    double drainSec = 5.0;
+    uint32_t seed = 1;
+    bool serialEcho = false;
+    bool check = false;
+    bool goldenFrames = false;
+};
+
+static bool parseMac(const std::string& text, uint64_t& out) {
+    unsigned int b[6];
+    char sep[5];
+    if (sscanf(text.c_str(), "%2x%c%2x%c%2x%c%2x%c%2x%c%2x",
+               &b[0], &sep[0], &b[1], &sep[1], &b[2], &sep[2],
+               &b[3], &sep[3], &b[4], &sep[4], &b[5]) != 11) {
+        return false;
+    }
+    out = 0;
+    for (int i = 0; i < 6; i++) out = (out << 8) | b[i];
+    return true;
+}
+
+static std::vector<uint8_t> parseHex(const std::string& text) {
+    std::vector<uint8_t> bytes;
+    for (size_t i = 0; i + 1 < text.size(); i += 2) {
+        bytes.push_back((uint8_t)strtoul(text.substr(i, 2).c_str(), nullptr, 16));
+    }
+    return bytes;
+}
+
+static std::vector<std::string> splitCsv(const std::string& line) {
+    std::vector<std::string> fields(1);
+    bool quoted = false;
+    for (size_t i = 0; i < line.size(); i++) {
+        char c = line[i];
+        if (c == '"') {
+            if (quoted && i + 1 < line.size() && line[i + 1] == '"') {
+                fields.back() += '"';
+                i++;
+            } else {
+                quoted = !quoted;
+            }
+        } else if (c == ',' && !quoted) {
+            fields.emplace_back();
+        } else if (c != '\r') {
+            fields.back() += c;
+        }
+    }
+    return fields;
+}
+
+static uint32_t advertiserIndex(Trace& trace, std::map<std::pair<uint64_t, std::string>, uint32_t>& index,
+                                uint64_t address, uint8_t addrType, const std::vector<uint8_t>& payload) {
+    auto key = std::make_pair(address, std::string(payload.begin(), payload.end()));
+    auto it = index.find(key);
+    if (it != index.end()) return it->second;
+    uint32_t id = (uint32_t)trace.advertisers.size();
+    trace.advertisers.push_back({address, addrType, payload});
+    index[key] = id;
+    return id;
+}
+
+// btrpa-scan.py logs have 1 s timestamps: spread each second's records evenly
+static bool loadBtrpaCsv(std::ifstream& in, Trace& trace, size_t& skipped) {
+    std::map<std::pair<uint64_t, std::string>, uint32_t> index;
+    std::vector<std::pair<int64_t, AdvertEvent>> rows;
+    std::string line;
+    int64_t firstSec = -1;
+    int64_t daysOffset = 0;
+    int64_t lastSec = 0;
+    while (std::getline(in, line)) {
+        auto f = splitCsv(line);
+        if (f.size() < 4) { skipped++; continue; }
+        size_t t = f[0].find('T');
+        int hh, mm, ss;
+        uint64_t address;
+        if (t == std::string::npos || sscanf(f[0].c_str() + t + 1, "%d:%d:%d", &hh, &mm, &ss) != 3 ||
+            !parseMac(f[1], address) || f[3].empty()) {
+            skipped++;
+            continue;
+        }
+        int64_t sec = hh * 3600 + mm * 60 + ss + daysOffset;
+        if (firstSec >= 0 && sec + 43200 < lastSec) {
+            daysOffset += 86400;
+            sec += 86400;
+        }
+        if (firstSec < 0) firstSec = sec;
+        lastSec = sec;
+        std::vector<uint8_t> payload = {0x02, 0x01, 0x06};
+        uint8_t type = ((address >> 46) != 0) ? BLE_ADDR_RANDOM : BLE_ADDR_PUBLIC;
+        uint32_t id = advertiserIndex(trace, index, address, type, payload);
+        rows.push_back({sec - firstSec, {0, id, (int8_t)atoi(f[3].c_str())}});
+    }
+    size_t i = 0;
+    while (i < rows.size()) {
+        size_t j = i;
+        while (j < rows.size() && rows[j].first == rows[i].first) j++;
+        for (size_t k = i; k < j; k++) {
+            AdvertEvent ev = rows[k].second;
+            ev.timeUs = (uint64_t)rows[k].first * 1000000ULL +
+                        (uint64_t)((k - i) * 2 + 1) * 500000ULL / (j - i);
+            trace.events.push_back(ev);
+        }
+        i = j;
+    }
+    return true;
+}
+
+static bool loadTrace(const std::string& path, Trace& trace) {
+    std::ifstream in(path);
+    if (!in) {
+        fprintf(stderr, "Cannot open trace %s\n", path.c_str());
+        return false;
+    }
+    std::string header;
+    std::getline(in, header);
+    size_t skipped = 0;
+    trace.description = "trace " + path;
+
+    if (header.rfind("timestamp,address", 0) == 0) {
+        loadBtrpaCsv(in, trace, skipped);
+    } else {
+        std::map<std::pair<uint64_t, std::string>, uint32_t> index;
+        std::string line = header;
+        bool first = true;
+        do {
+            if (!first && !std::getline(in, line)) break;
+            first = false;
+            if (line.empty() || line[0] == '#') continue;
+            auto f = splitCsv(line);
+            uint64_t address;
+            if (f.size() < 3 || !parseMac(f[1], address)) { skipped++; continue; }
+            uint8_t type = BLE_ADDR_PUBLIC;
+            if (f.size() > 3) {
+                type = (f[3] == "random" || f[3] == "1") ? BLE_ADDR_RANDOM : BLE_ADDR_PUBLIC;
+            }
+            std::vector<uint8_t> payload = f.size() > 4 ? parseHex(f[4]) : std::vector<uint8_t>{0x02, 0x01, 0x06};
+            uint32_t id = advertiserIndex(trace, index, address, type, payload);
+            trace.events.push_back({(uint64_t)(atof(f[0].c_str()) * 1000.0), id,
+                                    (int8_t)atoi(f[2].c_str())});
+        } while (true);
+    }
+
+    std::stable_sort(trace.events.begin(), trace.events.end(),
+                     [](const AdvertEvent& a, const AdvertEvent& b) { return a.timeUs < b.timeUs; });
+    if (!trace.events.empty()) trace.durationUs = trace.events.back().timeUs;
+    if (skipped) fprintf(stderr, "Trace: skipped %zu unparseable lines\n", skipped);
+    return !trace.events.empty();
+}
+
+static void synthesizeTrace(const Options& opt, Trace& trace) {
+    std::mt19937_64 rng(opt.seed);
+    std::uniform_int_distribution<uint64_t> addrDist(0, (1ULL << 46) - 1);
+    std::uniform_int_distribution<int> rssiDist(-95, -45);
+    std::uniform_int_distribution<int> noiseDist(-3, 3);
+    std::uniform_int_distribution<uint32_t> delayDist(0, 10000);    // advDelay 0-10 ms
+    const uint64_t intervalUs = (uint64_t)opt.advIntervalMs * 1000;
+    std::uniform_int_distribution<uint64_t> phaseDist(0, intervalUs);
+
+    trace.durationUs = (uint64_t)(opt.durationSec * 1e6);
+    std::vector<int> baseRssi;
+
+    for (uint32_t i = 0; i < opt.synthetic + opt.inject.size(); i++) {
+        Advertiser adv;
+        if (i < opt.synthetic) {
+            // Static random address: two most significant bits set; or a
+            // private address no target key resolves (01)
+            bool rpa = opt.rpaShare > 0 && rng() % 100 < opt.rpaShare;
+            adv.address = addrDist(rng) | (rpa ? 1ULL << 46 : 3ULL << 46);
+            adv.addrType = BLE_ADDR_RANDOM;
+            adv.payload = {0x02, 0x01, 0x06, 0x0b, 0xff, 0x4c, 0x00, 0x10, 0x06,
+                           (uint8_t)rng(), (uint8_t)rng(), (uint8_t)rng(), (uint8_t)rng(),
+                           (uint8_t)rng(), (uint8_t)rng()};
+        } else {
+            adv.address = opt.inject[i - opt.synthetic];
+            adv.addrType = BLE_ADDR_PUBLIC;
+            adv.payload = {0x02, 0x01, 0x06};
+        }
+        trace.advertisers.push_back(adv);
+        baseRssi.push_back(rssiDist(rng));
+
+        bool ramp = opt.injectRamp && i >= opt.synthetic;
+        for (uint64_t t = phaseDist(rng); t < trace.durationUs; t += intervalUs + delayDist(rng)) {
+            int level = ramp ? opt.injectRampFrom + (int)((opt.injectRampTo - opt.injectRampFrom) *
+                                                          (double)t / trace.durationUs) : baseRssi[i];
+            trace.events.push_back({t, i, (int8_t)(level + noiseDist(rng))});
+        }
+    }
+
+    // Devices recognised by their payload, from static random addresses
+    for (const auto& payload : opt.injectPayloads) {
+        Advertiser adv;
+        adv.address = addrDist(rng) | (3ULL << 46);
+        adv.addrType = BLE_ADDR_RANDOM;
+        adv.payload = payload;
+        uint32_t index = (uint32_t)trace.advertisers.size();
+        trace.advertisers.push_back(adv);
+        int rssi = rssiDist(rng);
+        for (uint64_t t = phaseDist(rng); t < trace.durationUs; t += intervalUs + delayDist(rng)) {
+            trace.events.push_back({t, index, (int8_t)(rssi + noiseDist(rng))});
+        }
+    }
+
+    // Targets with rotating RPAs: one advertiser per address lifetime
+    const uint64_t rotateUs = (uint64_t)(opt.rpaRotateSec * 1e6);
+    for (const auto& key : opt.rpaKeys) {
+        mbedtls_aes_context aes;
+        mbedtls_aes_init(&aes);
+        mbedtls_aes_setkey_enc(&aes, key.data(), 128);
+        int rssi = rssiDist(rng);
+        for (uint64_t start = 0; start < trace.durationUs; start += rotateUs) {
+            uint64_t prand = (rng() & 0x3FFFFF) | 0x400000;
+            uint8_t block[16] = {};
+            uint8_t out[16];
+            block[13] = (uint8_t)(prand >> 16);
+            block[14] = (uint8_t)(prand >> 8);
+            block[15] = (uint8_t)prand;
+            mbedtls_aes_crypt_ecb(&aes, MBEDTLS_AES_ENCRYPT, block, out);
+            Advertiser adv;
+            adv.address = (prand << 24) | ((uint64_t)out[13] << 16) | ((uint64_t)out[14] << 8) | out[15];
+            adv.addrType = BLE_ADDR_RANDOM;
+            adv.payload = {0x02, 0x01, 0x1a};
+            uint32_t index = (uint32_t)trace.advertisers.size();
+            trace.advertisers.push_back(adv);
+            uint64_t end = std::min(start + rotateUs, trace.durationUs);
+            for (uint64_t t = start + phaseDist(rng); t < end; t += intervalUs + delayDist(rng)) {
+                trace.events.push_back({t, index, (int8_t)(rssi + noiseDist(rng))});
+            }
+        }
+        mbedtls_aes_free(&aes);
+    }
+
+    std::sort(trace.events.begin(), trace.events.end(),
+              [](const AdvertEvent& a, const AdvertEvent& b) { return a.timeUs < b.timeUs; });
+
+    char buffer[128];
+    snprintf(buffer, sizeof(buffer), "synthetic %u advertisers (+%zu injected, +%zu RPA) @ %u ms, %.1f s",
+             opt.synthetic, opt.inject.size() + opt.injectPayloads.size(), opt.rpaKeys.size(), opt.advIntervalMs, opt.durationSec);
+    trace.description = buffer;
+}
+
+// ============================================================================
+// BLE HOST REPLAY
+// ============================================================================
+
+struct Delivery {
+    uint64_t entryUs;       // onResult entered
+    uint64_t arrivalUs;     // advert received by the controller
+};
+
+struct ReplayStats {
+    uint64_t scanStartUs = 0;
+    uint64_t offered = 0;
+    uint64_t missedScanDuty = 0;
+    uint64_t missedScannerOff = 0;
+    uint64_t droppedHci = 0;
+    uint64_t filtered = 0;
+    uint64_t delivered = 0;
+    uint64_t lastDeliveryUs = 0;
+    sim::Context* host = nullptr;
+    std::map<uint64_t, std::vector<Delivery>> deliveries;
+    bool peerNodes[256] = {};       // node indices of simulated other nodes
+    uint64_t homebaseHeard = 0;     // frames the homebase acknowledged
+    uint64_t homebaseAcks = 0;      // MSG_ACK frames it sent
+    uint64_t gatewayTargetFrames = 0;   // --target frames
+    uint64_t gatewayFilterFrames = 0;   // --filter frames
+    std::string firmwareStats;          // its statistics report at the end
+};
+
+static Options g_options;
+static Trace g_trace;
+static ReplayStats g_stats;
+
+// NimBLE host task: pull advert reports off a bounded HCI queue and run the
+// scan callbacks; reports arriving while the queue is full are lost
+static void nimbleHostTask(NimBLEScan* scan) {
+    const uint64_t base = g_stats.scanStartUs;
+    std::mt19937 rng(g_options.seed);
+    std::uniform_real_distribution<double> coin(0.0, 1.0);
+    std::deque<const AdvertEvent*> pending;
+    size_t next = 0;
+    NimBLEAdvertisedDevice device;
+
+    while (next < g_trace.events.size() || !pending.empty()) {
+        uint64_t now = sim::nowUs();
+        while (next < g_trace.events.size() && base + g_trace.events[next].timeUs <= now) {
+            const AdvertEvent* ev = &g_trace.events[next++];
+            g_stats.offered++;
+            // The firmware changes the scan settings and stops the scanner
+            // between windows as it goes
+            double duty = scan->getInterval() > 0 ?
+                (double)scan->getWindow() / (double)scan->getInterval() : 1.0;
+            if (!scan->isScanning()) {
+                g_stats.missedScannerOff++;
+            } else if (coin(rng) >= duty) {
+                g_stats.missedScanDuty++;
+            } else if (pending.size() >= g_options.hciDepth) {
+                g_stats.droppedHci++;
+            } else {
+                pending.push_back(ev);
+            }
+        }
+        if (pending.empty()) {
+            sim::sleepUntil(base + g_trace.events[next].timeUs);
+            continue;
+        }
+
+        const AdvertEvent* ev = pending.front();
+        pending.pop_front();
+        const Advertiser& adv = g_trace.advertisers[ev->advertiser];
+        device.simSet(NimBLEAddress(adv.address, adv.addrType), ev->rssi,
+                      BLE_HCI_ADV_TYPE_ADV_IND, adv.payload.data(), adv.payload.size());
+
+        sim::chargeCpu((uint64_t)g_options.advertCostUs);
+        uint64_t entry = sim::nowUs();
+        if (scan->deliver(&device)) {
+            g_stats.delivered++;
+            g_stats.lastDeliveryUs = entry;
+            g_stats.deliveries[adv.address].push_back({entry, base + ev->timeUs});
+        } else {
+            g_stats.filtered++;
+        }
+    }
+}
+
+// --peer-target: how far the peers stand from this node, how far one hears
+// the target, and the spread of its RSSI about the path-loss model
+static constexpr double SIM_PEER_SCATTER_M = 200.0;
+static constexpr double SIM_TARGET_RANGE_M = 100.0;
+static constexpr double SIM_SHADOWING_DB = 4.0;
+
+// The --peer-target a peer at (east, north) hears, with its distance: the
+// only one in range, or one of several at random; nullptr if none
+static const PeerTarget* heardTarget(double east, double north, std::mt19937& rng, double& distanceM) {
+    std::vector<std::pair<const PeerTarget*, double>> inRange;
+    for (const PeerTarget& target : g_options.peerTargets) {
+        double distance = hypot(east - target.east, north - target.north);
+        if (distance <= SIM_TARGET_RANGE_M) inRange.push_back({&target, distance});
+    }
+    if (inRange.empty()) return nullptr;
+    size_t pick = inRange.size() == 1 ? 0 : rng() % inRange.size();
+    distanceM = inRange[pick].second;
+    return inRange[pick].first;
+}
+
+// A peer's hit on a --peer-target, distanceM away
+static WireRecord peerTargetRecord(const PeerTarget& target, double distanceM, uint32_t timestampMs,
+                                   std::mt19937& rng) {
+    std::normal_distribution<double> shadowing(0.0, SIM_SHADOWING_DB);
+    double pathLoss = RSSI_PATH_LOSS_X10[RSSI_ENVIRONMENT] / 10.0;
+    double rssi = RSSI_AT_1M - 10.0 * pathLoss * log10(std::max(distanceM, 1.0)) + shadowing(rng);
+    rssi = std::min(0.0, std::max(-127.0, rssi));
+    WireRecord record = {};
+    record.timestampMs = timestampMs;
+    record.mac = target.mac;
+    record.rssi = (int8_t)lround(rssi);
+    record.deviceIndex = 0;
+    record.range = rssiRange((int16_t)lround(rssi * 16), RSSI_AT_1M, RSSI_ENVIRONMENT, RSSI_TREND_STEADY);
+    return record;
+}
+
+// Frames from other field nodes, Poisson-distributed over the trace: mostly
+// position beacons, some POSSIBLE HITs (half without a position), half of
+// them heard a second time as a relayed copy with one hop fewer. With
+// --gps-walk the peers walk in a straight line too. Each peer picks its rate with the
+// firmware's policy from how well it hears this node (links are symmetric).
+static void scheduleMeshTraffic(uint64_t startUs) {
+    if (g_options.rxPerMin <= 0) return;
+    static constexpr uint8_t sfList[] = LORA_SPREADING_FACTORS;
+    static constexpr auto rates = makeLoRaRateSet(sfList);
+    LoRaRatePolicy<rates.size()> policy(rates, {LORA_POSSIBLE_HIT_MARGIN_DB * 4, LORA_ROUTINE_MARGIN_DB * 4,
+                                                LORA_MAX_POWER_BACKOFF_DB / WIRE_POWER_STEP_DB, 1, 0, 0, 0});
+    std::mt19937 rng(g_options.seed + 1);
+    std::exponential_distribution<double> gapSec(g_options.rxPerMin / 60.0);
+    std::uniform_int_distribution<int> peer(2, 40);
+    std::uniform_real_distribution<float> rssi(g_options.peerRssiLo, g_options.peerRssiHi);
+    std::uniform_real_distribution<double> unit(0.0, 1.0);
+    uint8_t sequence[256] = {};
+    float peerRssi[256] = {};
+    for (int node = 0; node < 256; node++) peerRssi[node] = rssi(rng);
+    // Their own generator, so the rest of the traffic stays as it was
+    std::mt19937 targetRng(g_options.seed + 2);
+    std::uniform_real_distribution<double> scatter(-SIM_PEER_SCATTER_M, SIM_PEER_SCATTER_M);
+    double peerEast[256] = {}, peerNorth[256] = {};
+    for (int node = 0; !g_options.peerTargets.empty() && node < 256; node++) {
+        peerEast[node] = scatter(targetRng);
+        peerNorth[node] = scatter(targetRng);
+    }
+    for (double t = gapSec(rng); t * 1e6 < g_trace.durationUs; t += gapSec(rng)) {
+        WireFrame frame = {};
+        frame.node = (uint8_t)peer(rng);
+        frame.sequence = sequence[frame.node]++;
+        frame.hopLimit = MESH_HOP_LIMIT;
+        frame.timestampMs = (uint32_t)(t * 1000);
+        frame.hasPosition = true;
+        double course = g_options.walkCourse * DEG_TO_RAD;
+        double meters = g_options.walkSpeed * t;
+        double east = peerEast[frame.node] + meters * sin(course);
+        double north = peerNorth[frame.node] + meters * cos(course);
+        frame.latE7 = wireDegreesToE7(g_options.lat + north / 111319.5);
+        frame.lonE7 = wireDegreesToE7(g_options.lon + east / (111319.5 * cos(g_options.lat * DEG_TO_RAD)));
+        frame.hasVelocity = g_options.walkSpeed > 0;
+        frame.velocityEast = (int8_t)lround(g_options.walkSpeed * 100 * sin(course) / WIRE_VELOCITY_UNIT_CMS);
+        frame.velocityNorth = (int8_t)lround(g_options.walkSpeed * 100 * cos(course) / WIRE_VELOCITY_UNIT_CMS);
+        if (unit(rng) < 0.3) {
+            frame.type = MSG_POSSIBLE_HIT;
+            frame.hasPosition = unit(rng) < 0.5;
+            frame.recordCount = 1;
+            frame.records[0].timestampMs = frame.timestampMs;
+            frame.records[0].mac = ((uint64_t)rng() << 16 ^ rng()) & 0xFFFFFFFFFFFFULL;
+            frame.records[0].rssi = -80;
+            frame.records[0].deviceIndex = 0;
+            frame.records[0].range = rssiRange(-80 * 16, RSSI_AT_1M, RSSI_ENVIRONMENT,
+                                               (RssiTrend)(RSSI_TREND_STEADY + rng() % 3));
+            double distance = 0.0;
+            const PeerTarget* target = heardTarget(east, north, targetRng, distance);
+            if (target) frame.records[0] = peerTargetRecord(*target, distance, frame.timestampMs, targetRng);
+        } else {
+            frame.type = MSG_POSITION;
+        }
+        g_stats.peerNodes[frame.node] = true;
+
+        float r = peerRssi[frame.node];
+        float snr = (r + 125.0f) / 4.0f;
+        LoRaTxRate rate = policy.select(txClassForType(frame.type), true, (int16_t)(snr * 4), 0);
+        frame.powerSteps = rate.powerSteps;
+        float backoff = (float)(WIRE_POWER_STEP_DB * rate.powerSteps);
+
+        uint8_t bytes[WIRE_MAX_FRAME];
+        size_t length = wireEncode(frame, bytes, sizeof(bytes));
+        sim::injectLoRaFrame(startUs + (uint64_t)(t * 1e6), std::vector<uint8_t>(bytes, bytes + length),
+                             r - backoff, snr - backoff, rates.modulation(rate.sf, rate.cr));
+
+        // The relay sends at full power and the robust rate
+        if (frame.hopLimit > 0 && unit(rng) < 0.5) {
+            wireSetHopLimit(bytes, length, frame.hopLimit - 1);
+            wireSetPowerSteps(bytes, length, 0);
+            double relayedAt = t + 0.3 + 2.2 * unit(rng);
+            r = rssi(rng);
+            sim::injectLoRaFrame(startUs + (uint64_t)(relayedAt * 1e6),
+                                 std::vector<uint8_t>(bytes, bytes + length), r, (r + 125.0f) / 4.0f,
+                                 rates.modulation(rates.robust(), 8));
+        }
+    }
+}
+
+// Gateway commands (--command, --target, --filter) and acks, sent by a
+// node the simulated mesh reserves for the gateway and heard straight
+// from it; one sequence number series, as on a real node
+static constexpr uint8_t SIM_GATEWAY_NODE = 250;
+static uint8_t g_gatewaySequence = 0;
+
+static void injectGatewayFrame(WireFrame& frame, uint64_t atUs) {
+    frame.node = SIM_GATEWAY_NODE;
+    frame.sequence = g_gatewaySequence++;
+    frame.hopLimit = MESH_HOP_LIMIT;
+    g_stats.peerNodes[SIM_GATEWAY_NODE] = true;
+    uint8_t bytes[WIRE_MAX_FRAME];
+    size_t length = wireEncode(frame, bytes, sizeof(bytes));
+    sim::injectLoRaFrame(atUs, std::vector<uint8_t>(bytes, bytes + length), -90.0f, 5.0f);
+}
+
+static void scheduleCommands(uint64_t startUs) {
+    for (const std::string& text : g_options.commands) {
+        double sec = 0.0;
+        char node[8] = "", profile[16] = "";
+        unsigned minutes = 0;
+        if (sscanf(text.c_str(), "%lf:%7[^:]:%15[^:]:%u", &sec, node, profile, &minutes) < 3) continue;
+        WireFrame frame = {};
+        frame.type = MSG_COMMAND;
+        frame.timestampMs = (uint32_t)(sec * 1000);
+        frame.command.target = strcmp(node, "all") == 0 ? 0 : (uint8_t)atoi(node);
+        frame.command.command = WIRE_CMD_SCAN_PROFILE;
+        frame.command.argument = WIRE_CMD_ARG_AUTO;
+        for (uint8_t p = 0; p < SCAN_PROFILE_COUNT; p++) {
+            if (strcmp(profile, scanProfileName(p)) == 0) frame.command.argument = p;
+        }
+        frame.command.durationMin = (uint16_t)minutes;
+        injectGatewayFrame(frame, startUs + (uint64_t)(sec * 1e6));
+    }
+
+    for (const std::string& text : g_options.targets) {
+        double sec = 0.0;
+        char node[8] = "", op[8] = "", mac[18] = "";
+        if (sscanf(text.c_str(), "%lf:%7[^:]:%7[^:]:%17s", &sec, node, op, mac) < 3) continue;
+        WireFrame frame = {};
+        frame.type = MSG_TARGETS;
+        frame.timestampMs = (uint32_t)(sec * 1000);
+        frame.targets.target = strcmp(node, "all") == 0 ? 0 : (uint8_t)atoi(node);
+        frame.targets.op = strcmp(op, "add") == 0 ? WIRE_TARGETS_ADD :
+                           strcmp(op, "remove") == 0 ? WIRE_TARGETS_REMOVE : WIRE_TARGETS_CLEAR;
+        uint64_t key = parseMacKey(mac);
+        if (frame.targets.op != WIRE_TARGETS_CLEAR) {
+            if (key == MAC_KEY_INVALID) continue;
+            for (int i = 0; i < 6; i++) frame.targets.data[i] = (uint8_t)(key >> (40 - 8 * i));
+            frame.targets.length = 6;
+        }
+        g_stats.gatewayTargetFrames++;
+        injectGatewayFrame(frame, startUs + (uint64_t)(sec * 1e6));
+    }
+}
+
+// Console input (--console)
+static void scheduleConsole(uint64_t startUs) {
+    for (const std::string& text : g_options.console) {
+        size_t colon = text.find(':');
+        if (colon == std::string::npos) continue;
+        uint64_t atUs = startUs + (uint64_t)(atof(text.c_str()) * 1e6);
+        std::string line = text.substr(colon + 1);
+        if (line.empty() || line[0] != '@') {
+            sim::typeConsoleLine(atUs, line);
+            continue;
+        }
+        std::ifstream in(line.substr(1));
+        if (!in) fprintf(stderr, "Console: cannot read %s\n", line.c_str() + 1);
+        while (std::getline(in, line)) {
+            sim::typeConsoleLine(atUs, line);
+            atUs += 100000;
+        }
+    }
+}
+
+// The gateway's filter broadcast (--filter): the header, then every chunk,
+// one frame per TARGET_FILTER_FRAME_INTERVAL_MS, TARGET_FILTER_ROUNDS times
+static void scheduleFilter(uint64_t startUs) {
+    if (g_options.filterSec < 0) return;
+    std::ifstream in(g_options.filterPath, std::ios::binary);
+    std::vector<uint8_t> file((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    if (file.size() < TARGET_FILTER_HEADER_BYTES) {
+        fprintf(stderr, "Filter %s: not a filter file\n", g_options.filterPath.c_str());
+        return;
+    }
+    XorFilterHeader header = XorFilterHeader::decode(file.data());
+    if (file.size() != TARGET_FILTER_HEADER_BYTES + header.bytes()) {
+        fprintf(stderr, "Filter %s: %zu bytes, header says %zu\n", g_options.filterPath.c_str(),
+                file.size() - TARGET_FILTER_HEADER_BYTES, header.bytes());
+        return;
+    }
+    uint64_t atUs = startUs + (uint64_t)(g_options.filterSec * 1e6);
+    for (int round = 0; round < TARGET_FILTER_ROUNDS; round++) {
+        for (uint32_t next = 0; next <= header.chunks(); next++) {
+            WireFrame frame = {};
+            frame.type = MSG_TARGETS;
+            frame.timestampMs = (uint32_t)((atUs - startUs) / 1000);
+            frame.targets.filterCrc = header.crc;
+            if (next == 0) {
+                frame.targets.op = WIRE_TARGETS_FILTER;
+                memcpy(frame.targets.data, file.data(), TARGET_FILTER_HEADER_BYTES);
+                frame.targets.length = TARGET_FILTER_HEADER_BYTES;
+            } else {
+                size_t offset = (size_t)(next - 1) * TARGET_FILTER_CHUNK_BYTES;
+                size_t length = std::min(TARGET_FILTER_CHUNK_BYTES, header.bytes() - offset);
+                frame.targets.op = WIRE_TARGETS_CHUNK;
+                frame.targets.chunk = (uint16_t)(next - 1);
+                memcpy(frame.targets.data, file.data() + TARGET_FILTER_HEADER_BYTES + offset, length);
+                frame.targets.length = (uint8_t)length;
+            }
+            g_stats.gatewayFilterFrames++;
+            injectGatewayFrame(frame, atUs);
+            atUs += TARGET_FILTER_FRAME_INTERVAL_MS * 1000ULL;
+        }
+    }
+}
+
+// The homebase (--homebase): listens to this node's transmissions while in
+// range and answers them with MSG_ACKs, batched like the firmware does
+static void homebaseTask(uint64_t startUs) {
+    static constexpr uint8_t sfList[] = LORA_SPREADING_FACTORS;
+    static constexpr auto rates = makeLoRaRateSet(sfList);
+    MeshAckTable<8> acks(MESH_ACK_DELAY_MS);
+    uint64_t fromUs = startUs + (uint64_t)(g_options.homebaseFromSec * 1e6);
+    uint64_t toUs = g_options.homebaseToSec >= 0 ? startUs + (uint64_t)(g_options.homebaseToSec * 1e6) : UINT64_MAX;
+    size_t seen = 0;
+    for (;;) {
+        sim::sleepUntil(sim::nowUs() + 100000);
+        uint64_t now = sim::nowUs();
+        uint32_t nowMs = (uint32_t)(now / 1000);
+        const auto& log = sim::txLog();
+        for (; seen < log.size() && log[seen].endUs <= now; seen++) {
+            WireFrame frame;
+            if (log[seen].startUs < fromUs || log[seen].startUs >= toUs) continue;
+            if (wireDecode(log[seen].data.data(), log[seen].data.size(), frame) != WIRE_OK) continue;
+            if (g_stats.peerNodes[frame.node]) continue;
+            if (frame.type != MSG_TRUE_HIT && frame.type != MSG_POSSIBLE_HIT && frame.type != MSG_STATUS) continue;
+            acks.add(frame.node, frame.sequence, nowMs);
+            g_stats.homebaseHeard++;
+        }
+        WireFrame ack = {};
+        while (now < toUs && acks.popDue(ack.ack, nowMs)) {
+            ack.type = MSG_ACK;
+            ack.node = SIM_GATEWAY_NODE;
+            ack.sequence = g_gatewaySequence++;
+            ack.hopLimit = MESH_HOP_LIMIT;
+            ack.timestampMs = nowMs;
+            uint8_t bytes[WIRE_MAX_FRAME];
+            size_t length = wireEncode(ack, bytes, sizeof(bytes));
+            sim::injectLoRaFrame(now, std::vector<uint8_t>(bytes, bytes + length), -90.0f, 5.0f,
+                                 rates.modulation(rates.robust(), 8));
+            g_stats.homebaseAcks++;
+        }
+    }
+}
+
+// Called on every scan start; the first one starts the replay
+void sim::onScanStart(NimBLEScan* scan) {
+    if (g_stats.host != nullptr) return;
+    g_stats.scanStartUs = sim::nowUs();
+    sim::battery().startUs = g_stats.scanStartUs;
+    sim::battery().endUs = g_stats.scanStartUs + g_trace.durationUs;
+    scheduleMeshTraffic(g_stats.scanStartUs);
+    scheduleCommands(g_stats.scanStartUs);
+    scheduleFilter(g_stats.scanStartUs);
+    scheduleConsole(g_stats.scanStartUs);
+    g_stats.host = sim::spawn("nimble_host", [scan] { nimbleHostTask(scan); }, g_stats.scanStartUs);
+    if (g_options.homebaseFromSec >= 0) {
+        g_stats.peerNodes[SIM_GATEWAY_NODE] = true;
+        uint64_t startUs = g_stats.scanStartUs;
+        sim::spawn("homebase", [startUs] { homebaseTask(startUs); }, startUs);
+    }
+    uint64_t endUs = g_stats.scanStartUs + g_trace.durationUs + (uint64_t)(g_options.drainSec * 1e6);
+    if (g_options.powerCutSec >= 0) {
+        sim::flash().powerCutUs = g_stats.scanStartUs + (uint64_t)(g_options.powerCutSec * 1e6);
+        if (sim::flash().powerCutUs < endUs) endUs = sim::flash().powerCutUs;
+    }
+    sim::stopAt(endUs);
+}
+
+// ============================================================================
+// REPORT
+// ============================================================================
+
+struct DetectionFrame {
+    uint64_t address;
+    uint32_t timestampMs;
+    uint8_t type;
+};
+
+// Pull the detections out of one transmitted frame
+static std::vector<DetectionFrame> decodeFrame(const sim::TxRecord& tx) {
+    std::vector<DetectionFrame> out;
+    WireFrame frame;
+    if (wireDecode(tx.data.data(), tx.data.size(), frame) != WIRE_OK) return out;
+    if (g_stats.peerNodes[frame.node]) return out;     // relayed for another node
+    if (frame.type != MSG_TRUE_HIT && frame.type != MSG_POSSIBLE_HIT) return out;
+    if (frame.replayed) return out;                     // counted as replays
+    for (uint8_t i = 0; i < frame.recordCount; i++) {
+        out.push_back({frame.records[i].mac, frame.records[i].timestampMs, frame.type});
+    }
+    return out;
+}
+
+static double percentile(const std::vector<uint64_t>& sorted, double p) {
+    if (sorted.empty()) return 0.0;
+    size_t idx = (size_t)(p / 100.0 * (sorted.size() - 1) + 0.5);
+    return sorted[idx] / 1000.0;
+}
+
+// Fused locations of a --peer-target this node sent: error from where it
+// is and the radius given, in mm
+struct FusedReport {
+    std::vector<uint64_t> errorMm;
+    std::vector<uint64_t> radiusMm;
+    size_t withinRadius = 0;
+};
+
+static FusedReport fusedReport(const PeerTarget& target) {
+    FusedReport out;
+    for (const auto& tx : sim::txLog()) {
+        WireFrame frame;
+        if (wireDecode(tx.data.data(), tx.data.size(), frame) != WIRE_OK) continue;
+        if (frame.type != MSG_FUSED || g_stats.peerNodes[frame.node]) continue;
+        if (frame.fused.mac != target.mac) continue;
+        double north = (wireE7ToDegrees(frame.latE7) - g_options.lat) * 111319.5;
+        double east = (wireE7ToDegrees(frame.lonE7) - g_options.lon) * 111319.5 * cos(g_options.lat * DEG_TO_RAD);
+        double error = hypot(east - target.east, north - target.north);
+        double radius = frame.fused.radiusDm / 10.0;
+        out.errorMm.push_back((uint64_t)(error * 1000));
+        out.radiusMm.push_back((uint64_t)(radius * 1000));
+        if (error <= radius) out.withinRadius++;
+    }
+    std::sort(out.errorMm.begin(), out.errorMm.end());
+    std::sort(out.radiusMm.begin(), out.radiusMm.end());
+    return out;
+}
+
+static void report(double wallSec) {
+    std::vector<uint64_t> latencies, trueHitLatencies, possibleHitLatencies;
+    uint64_t frames = 0, detectionFrames = 0, relayedFrames = 0, unmatched = 0, airtimeUs = 0;
+    uint64_t replayFrames = 0, replayRecords = 0;
+    std::map<uint8_t, std::pair<uint64_t, uint64_t>> bySf;     // frames, airtime
+
+    for (const auto& tx : sim::txLog()) {
+        frames++;
+        airtimeUs += tx.endUs - tx.startUs;
+        bySf[tx.modulation.spreadingFactor].first++;
+        bySf[tx.modulation.spreadingFactor].second += tx.endUs - tx.startUs;
+        if (tx.data.size() > 1 && g_stats.peerNodes[tx.data[1]]) relayedFrames++;
+        WireFrame decoded;
+        if (wireDecode(tx.data.data(), tx.data.size(), decoded) == WIRE_OK && decoded.replayed &&
+            !g_stats.peerNodes[decoded.node]) {
+            replayFrames++;
+            replayRecords += decoded.recordCount;
+        }
+        auto detections = decodeFrame(tx);
+        if (!detections.empty()) detectionFrames++;
+        for (const auto& det : detections) {
+            // Attribute to the latest delivery of that address that entered
+            // onResult no later than the detection was timestamped
+            auto it = g_stats.deliveries.find(det.address);
+            const Delivery* cause = nullptr;
+            if (it != g_stats.deliveries.end()) {
+                uint64_t stampUs = (uint64_t)det.timestampMs * 1000 + 999;
+                auto d = std::upper_bound(it->second.begin(), it->second.end(), stampUs,
+                    [](uint64_t t, const Delivery& x) { return t < x.entryUs; });
+                if (d != it->second.begin()) cause = &*(d - 1);
+            }
+            if (cause == nullptr || cause->arrivalUs > tx.startUs) {
+                unmatched++;
+                continue;
+            }
+            uint64_t latency = tx.startUs - cause->arrivalUs;
+            latencies.push_back(latency);
+            (det.type == MSG_TRUE_HIT ? trueHitLatencies : possibleHitLatencies).push_back(latency);
+        }
+    }
+    std::sort(latencies.begin(), latencies.end());
+    std::sort(trueHitLatencies.begin(), trueHitLatencies.end());
+    std::sort(possibleHitLatencies.begin(), possibleHitLatencies.end());
+
+    const double traceSec = g_trace.durationUs / 1e6;
+    const double hostBusySec = sim::busyUs(g_stats.host) / 1e6;
+
+    printf("\n=== btrpa-scan-lora native replay ===\n");
+    printf("Trace:                  %s\n", g_trace.description.c_str());
+    if (g_options.measuredCpu) {
+        printf("CPU scale:              x%.1f measured   HCI report buffers: %u\n",
+               g_options.cpuScale, g_options.hciDepth);
+    } else {
+        printf("CPU cost:               %.1f us per call, %.1f us per advert   HCI report buffers: %u\n",
+               g_options.callCostUs, g_options.advertCostUs, g_options.hciDepth);
+    }
+    printf("Adverts offered:        %llu\n", (unsigned long long)g_stats.offered);
+    printf("  missed (scan window): %llu\n", (unsigned long long)g_stats.missedScanDuty);
+    if (g_stats.missedScannerOff) {
+        printf("  missed (scanner off): %llu\n", (unsigned long long)g_stats.missedScannerOff);
+    }
+    printf("  dropped (host busy):  %llu (%.2f%%)\n", (unsigned long long)g_stats.droppedHci,
+           g_stats.offered ? 100.0 * g_stats.droppedHci / g_stats.offered : 0.0);
+    printf("  NimBLE duplicates:    %llu\n", (unsigned long long)g_stats.filtered);
+    printf("  delivered (onResult): %llu\n", (unsigned long long)g_stats.delivered);
+    printf("Sustained rate:         %.0f adverts/s over %.1f s\n",
+           traceSec > 0 ? g_stats.delivered / traceSec : 0.0, traceSec);
+    printf("BLE host busy:          %.1f%% (capacity ~%.0f adverts/s)\n",
+           traceSec > 0 ? 100.0 * hostBusySec / traceSec : 0.0,
+           hostBusySec > 0 ? (g_stats.delivered + g_stats.filtered) / hostBusySec : 0.0);
+    printf("LoRa frames:            %llu (%llu with detections, %llu relayed), %.1f s on air\n",
+           (unsigned long long)frames, (unsigned long long)detectionFrames,
+           (unsigned long long)relayedFrames, airtimeUs / 1e6);
+    if (bySf.size() > 1) {
+        printf("  by spreading factor: ");
+        for (const auto& sf : bySf) {
+            printf(" SF%u %llu (%.1f s)", sf.first, (unsigned long long)sf.second.first, sf.second.second / 1e6);
+        }
+        printf("\n");
+    }
+    printf("Detection->TX start:    n=%zu  p50=%.1f ms  p90=%.1f ms  p99=%.1f ms  max=%.1f ms\n",
+           latencies.size(), percentile(latencies, 50), percentile(latencies, 90),
+           percentile(latencies, 99), percentile(latencies, 100));
+    if (!trueHitLatencies.empty() && !possibleHitLatencies.empty()) {
+        printf("  TRUE HIT:             n=%zu  p50=%.1f ms  max=%.1f ms\n", trueHitLatencies.size(),
+               percentile(trueHitLatencies, 50), percentile(trueHitLatencies, 100));
+        printf("  POSSIBLE HIT:         n=%zu  p50=%.1f ms  max=%.1f ms\n", possibleHitLatencies.size(),
+               percentile(possibleHitLatencies, 50), percentile(possibleHitLatencies, 100));
+    }
+    const sim::LoRaRxStats& rx = sim::loraRxStats();
+    if (rx.offered) {
+        printf("LoRa RX offered:        %llu (%.1f/min)\n", (unsigned long long)rx.offered,
+               traceSec > 0 ? rx.offered * 60.0 / traceSec : 0.0);
+        printf("  lost (not listening): %llu (transmitting or scanning other SFs)\n",
+               (unsigned long long)(rx.deaf + rx.aborted));
+        printf("  lost (below floor):   %llu\n", (unsigned long long)rx.weak);
+        printf("  lost (collision):     %llu\n", (unsigned long long)rx.collided);
+        printf("  overwritten unread:   %llu\n", (unsigned long long)rx.overwritten);
+        printf("  received (RX_DONE):   %llu\n", (unsigned long long)rx.delivered);
+    }
+    const sim::GpsState& gps = sim::gps();
+    if (gps.present) {
+        printf("GPS module:             %.1f kB sent (%.0f B/s), %u commands obeyed, now every %u ms at %u baud, "
+               "%u bytes dropped\n",
+               gps.bytesSent / 1000.0, traceSec > 0 ? gps.bytesSent / traceSec : 0.0, gps.commands,
+               gps.rateMs, gps.baud, gps.bytesDropped);
+    }
+    const sim::SleepStats& sleep = sim::sleepStats();
+    if (sleep.sleeps) {
+        printf("Light sleep:            %llu times, %.1f s (%.1f%% of the trace)\n",
+               (unsigned long long)sleep.sleeps, sleep.sleptUs / 1e6,
+               traceSec > 0 ? 100.0 * sleep.sleptUs / 1e6 / traceSec : 0.0);
+    }
+    if (g_options.homebaseFromSec >= 0) {
+        printf("Homebase:               heard %llu frames, sent %llu acks\n",
+               (unsigned long long)g_stats.homebaseHeard, (unsigned long long)g_stats.homebaseAcks);
+    }
+    if (g_stats.gatewayTargetFrames || g_stats.gatewayFilterFrames) {
+        printf("Gateway targets:        %llu target frames, %llu filter frames\n",
+               (unsigned long long)g_stats.gatewayTargetFrames, (unsigned long long)g_stats.gatewayFilterFrames);
+    }
+    // With several targets, one line each, led by its MAC
+    for (size_t i = 0; i < g_options.peerTargets.size(); i++) {
+        const PeerTarget& target = g_options.peerTargets[i];
+        FusedReport fused = fusedReport(target);
+        char mac[18] = "";
+        if (g_options.peerTargets.size() > 1) {
+            formatMacKey(target.mac, mac);
+        }
+        printf("%-24s%s%sn=%zu  error p50=%.1f m  p90=%.1f m  radius p50=%.1f m  "
+               "target within radius %.0f%%\n", i == 0 ? "Fused locations:" : "", mac, mac[0] ? "  " : "",
+               fused.errorMm.size(), percentile(fused.errorMm, 50), percentile(fused.errorMm, 90),
+               percentile(fused.radiusMm, 50),
+               fused.errorMm.empty() ? 0.0 : 100.0 * fused.withinRadius / fused.errorMm.size());
+    }
+    if (replayFrames) {
+        printf("Journal replays:        %llu records in %llu frames\n",
+               (unsigned long long)replayRecords, (unsigned long long)replayFrames);
+    }
+    const sim::FlashState& flash = sim::flash();
+    if (flash.writes || flash.erases) {
+        printf("Journal flash:          %u reads, %u page writes, %u sector erases\n",
+               flash.reads, flash.writes, flash.erases);
+    }
+    if (g_options.powerCutSec >= 0) {
+        printf("Power cut:              at %.1f s%s\n", g_options.powerCutSec,
+               flash.torn ? ", a flash operation was torn" : "");
+    }
+    if (unmatched) printf("  (%llu detections without a matching advert)\n", (unsigned long long)unmatched);
+    printf("Host wall time:         %.2f s (%.0f adverts/s)\n", wallSec,
+           wallSec > 0 ? g_stats.delivered / wallSec : 0.0);
+
+    printf("\nFirmware statistics at end of run:\n");
+    sim::setSerialEcho(true);
+    sim::captureSerial(&g_stats.firmwareStats);
+    printStatistics();
+    sim::captureSerial(nullptr);
+    fflush(stdout);
+}
+
+// Overflow count on the firmware statistics line starting with label
+static bool statisticsOverflows(const char* label, unsigned& overflows) {
+    const std::string& stats = g_stats.firmwareStats;
+    size_t at = stats.find(label);
+    if (at == std::string::npos) return false;
+    size_t count = stats.find("overflows ", at);
+    return count != std::string::npos && count < stats.find('\n', at) &&
+           sscanf(stats.c_str() + count, "overflows %u", &overflows) == 1;
+}
+
+// Locations the firmware's target fusion reported, from its statistics
+static bool statisticsFusedLocations(unsigned& located) {
+    const std::string& stats = g_stats.firmwareStats;
+    size_t at = stats.find("Target fusion:");
+    if (at == std::string::npos) return false;
+    size_t count = stats.find("iterations), ", at);
+    return count != std::string::npos && count < stats.find('\n', at) &&
+           sscanf(stats.c_str() + count, "iterations), %u locations", &located) == 1;
+}
+
+// MSG_FUSED frames this node put on air
+static unsigned fusedFramesSent() {
+    unsigned sent = 0;
+    for (const auto& tx : sim::txLog()) {
+        WireFrame frame;
+        if (wireDecode(tx.data.data(), tx.data.size(), frame) != WIRE_OK) continue;
+        if (frame.type == MSG_FUSED && !g_stats.peerNodes[frame.node]) sent++;
+    }
+    return sent;
+}
+
+// --check: the detection task must keep up with the scanner, so a few
+// hits in a crowd lose no advert to a full queue and no alert to a full
+// log; a homebase that broadcasts fused locations sends every one, even
+// for several targets located at once
+static bool checkRun() {
+    unsigned detection = 0, alertLog = 0;
+    bool found = statisticsOverflows("Detection queue:", detection) &&
+                 statisticsOverflows("Alert log queue:", alertLog);
+    bool passed = found && detection == 0 && alertLog == 0;
+    printf("Check:                  detection queue overflows %u, alert log overflows %u: %s\n",
+           detection, alertLog, !found ? "FAILED (no statistics)" : passed ? "passed" : "FAILED");
+    if (MESH_GATEWAY && FUSION_ENABLED && FUSION_BROADCAST) {
+        unsigned located = 0, sent = fusedFramesSent();
+        bool fusedFound = statisticsFusedLocations(located);
+        bool fusedPassed = fusedFound && sent == located;
+        printf("Check:                  fused locations sent %u of %u: %s\n", sent, located,
+               !fusedFound ? "FAILED (no statistics)" : fusedPassed ? "passed" : "FAILED");
+        passed = passed && fusedPassed;
+    }
+    fflush(stdout);
+    return passed;
+}
+
+// ============================================================================
+// FUSION BENCHMARK
+// ============================================================================
+
+// --fusion-bench: target_fusion.h fit latency on the host for 3 to 20
+// observers scattered within SIM_TARGET_RANGE_M of a target, their ranges
+// off by SIM_SHADOWING_DB of shadowing. "cold" fits a new target from the
+// observers' centroid; "add" is the gateway's usual case, one more report
+// into a target already fitted, through the engine's bookkeeping too.
+static int fusionBenchmark(uint32_t fits) {
+    static constexpr size_t MAX_OBSERVERS = 20;
+    std::mt19937 rng(g_options.seed);
+    std::uniform_real_distribution<double> unit(0.0, 1.0);
+    std::normal_distribution<double> shadowing(0.0, SIM_SHADOWING_DB);
+    const double pathLoss = RSSI_PATH_LOSS_X10[RSSI_ENVIRONMENT] / 10.0;
+    const double cosLat = cos(g_options.lat * DEG_TO_RAD);
+    const float sigma = (float)FUSION_RANGE_SIGMA;
+    volatile float sink = 0.0f;
+
+    printf("\n=== btrpa-scan-lora target fusion benchmark ===\n");
+    printf("%u fits per row, observers within %.0f m, %.0f dB shadowing, range sigma %.2f, "
+           "ESP32 estimate x%.1f (--cpu-scale)\n\n", fits, SIM_TARGET_RANGE_M, SIM_SHADOWING_DB,
+           (double)sigma, g_options.cpuScale);
+    printf("observers  cold us  iters   add us  iters  ESP32 add us  error p50  radius p50  within radius\n");
+
+    for (size_t n = 3; n <= MAX_OBSERVERS; n++) {
+        TargetFusion<1, MAX_OBSERVERS> engine({UINT32_MAX / 2, 2, 0, sigma});
+        FusionObservation obs[MAX_OBSERVERS];
+        int32_t latE7[MAX_OBSERVERS], lonE7[MAX_OBSERVERS];
+        double coldNs = 0, addNs = 0;
+        uint64_t coldIterations = 0, addIterations = 0;
+        std::vector<uint64_t> errorMm, radiusMm;
+        size_t within = 0;
+
+        for (uint32_t fit = 0; fit < fits; fit++) {
+            // Target at the origin, observers uniform over a disc around it
+            for (size_t i = 0; i < n; i++) {
+                double r = SIM_TARGET_RANGE_M * sqrt(unit(rng)), angle = 2 * M_PI * unit(rng);
+                double east = r * sin(angle), north = r * cos(angle);
+                double rssi = RSSI_AT_1M - 10.0 * pathLoss * log10(std::max(r, 1.0)) + shadowing(rng);
+                float rangeM = rssiRangeMeters(rssiRange((int16_t)lround(rssi * 16), RSSI_AT_1M,
+                                                         RSSI_ENVIRONMENT, RSSI_TREND_STEADY));
+                obs[i] = {(float)east, (float)north, rangeM, fusionWeight(rangeM, sigma)};
+                latE7[i] = wireDegreesToE7(g_options.lat + north / 111319.5);
+                lonE7[i] = wireDegreesToE7(g_options.lon + east / (111319.5 * cosLat));
+            }
+
+            FusionFix fix;
+            auto start = std::chrono::steady_clock::now();
+            fusionSolve(obs, n, false, fix);
+            coldNs += std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+            coldIterations += fix.iterations;
+            sink = sink + fix.east;
+
+            FusedLocation location = {};
+            for (size_t i = 0; i + 1 < n; i++) {
+                engine.observe(fit, 0, (uint8_t)(i + 1), latE7[i], lonE7[i], obs[i].rangeM, 0, location);
+            }
+            uint32_t iterationsBefore = engine.stats().iterations;
+            start = std::chrono::steady_clock::now();
+            engine.observe(fit, 0, (uint8_t)n, latE7[n - 1], lonE7[n - 1], obs[n - 1].rangeM, 0, location);
+            addNs += std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+            addIterations += engine.stats().iterations - iterationsBefore;
+
+            double north = (wireE7ToDegrees(location.latE7) - g_options.lat) * 111319.5;
+            double east = (wireE7ToDegrees(location.lonE7) - g_options.lon) * 111319.5 * cosLat;
+            double error = hypot(east, north);
+            errorMm.push_back((uint64_t)(error * 1000));
+            radiusMm.push_back((uint64_t)(location.radiusM * 1000));
+            if (error <= location.radiusM) within++;
+        }
+        std::sort(errorMm.begin(), errorMm.end());
+        std::sort(radiusMm.begin(), radiusMm.end());
+        printf("%9zu  %7.2f  %5.1f  %7.2f  %5.1f  %12.1f  %7.1f m  %8.1f m  %12.0f%%\n", n,
+               coldNs / fits / 1000.0, (double)coldIterations / fits, addNs / fits / 1000.0,
+               (double)addIterations / fits, addNs / fits / 1000.0 * g_options.cpuScale,
+               percentile(errorMm, 50), percentile(radiusMm, 50), 100.0 * within / fits);
+    }
+    return 0;
+}
+
+// ============================================================================
+// GOLDEN FRAMES
+// ============================================================================
+
+// --golden-frames: one frame per message type and wire feature, encoded by
+// the firmware's own wireEncode() and serialFrameEncode(), so the Python
+// reference decoder is tested against the C++ encoders. The values are
+// fixed; change them only together with the tests that check them.
+static void printGoldenFrame(const char* name, const WireFrame& frame, const SerialFrameInfo& info) {
+    uint8_t wire[WIRE_MAX_FRAME];
+    uint8_t out[SERIAL_FRAME_MAX_BYTES];
+    size_t length = wireEncode(frame, wire, sizeof(wire));
+    size_t encoded = length ? serialFrameEncode(info, wire, length, out, sizeof(out)) : 0;
+    printf("%-20s ", name);
+    for (size_t i = 0; i < encoded; i++) printf("%02x", out[i]);
+    printf("%s\n", encoded ? "" : "(did not encode)");
+}
+
+// A record's range byte: distance code (rssi_tracker.h) and trend
+static uint8_t rangeCode(RssiTrend trend, uint8_t code) {
+    return (uint8_t)(trend << RSSI_RANGE_TREND_SHIFT | code);
+}
+
+static int goldenFrames() {
+    const SerialFrameInfo mesh = {SERIAL_SOURCE_MESH, 3600250, -101, -18, 8, 2};
+    const SerialFrameInfo local = {SERIAL_SOURCE_LOCAL, 7200500, 0, 0, 0, 0};
+
+    // A moving node's POSSIBLE HIT batch at reduced power: three records,
+    // a prefix match, a registry match and a payload rule without range
+    WireFrame frame = {};
+    frame.type = MSG_POSSIBLE_HIT;
+    frame.node = 7;
+    frame.sequence = 200;
+    frame.hopLimit = 3;
+    frame.powerSteps = 2;
+    frame.hasPosition = true;
+    frame.latE7 = 515007000;
+    frame.lonE7 = -1246000;
+    frame.hasVelocity = true;
+    frame.velocityEast = -7;
+    frame.velocityNorth = 5;
+    frame.recordCount = 3;
+    frame.records[0] = {125400, 0x70b3d5b34122ULL, -71, 0, rangeCode(RSSI_TREND_APPROACHING, 30)};
+    frame.records[1] = {126150, 0xaabbccddeeffULL, -88, WIRE_DEVICE_REGISTRY, rangeCode(RSSI_TREND_STEADY, 45)};
+    frame.records[2] = {127999, 0xc01dcafe0042ULL, -97, 3, 0};
+    printGoldenFrame("possible_hit_batch", frame, mesh);
+
+    // TRUE HITs replayed from the journal, 4000 s after the oldest
+    frame = {};
+    frame.type = MSG_TRUE_HIT;
+    frame.node = 21;
+    frame.sequence = 5;
+    frame.hopLimit = 2;
+    frame.replayed = true;
+    frame.replayAgeS = 4000;
+    frame.recordCount = 2;
+    frame.records[0] = {50000, 0x2834ff74aa99ULL, -60, WIRE_NO_DEVICE, rangeCode(RSSI_TREND_RECEDING, 12)};
+    frame.records[1] = {52500, 0x2834ff74aa99ULL, -64, WIRE_NO_DEVICE, rangeCode(RSSI_TREND_RECEDING, 20)};
+    printGoldenFrame("replayed_true_hit", frame, mesh);
+
+    // A walking node's position beacon
+    frame = {};
+    frame.type = MSG_POSITION;
+    frame.node = 3;
+    frame.sequence = 77;
+    frame.hopLimit = 3;
+    frame.timestampMs = 86399000;
+    frame.hasPosition = true;
+    frame.latE7 = -338688000;
+    frame.lonE7 = 1512093000;
+    frame.hasVelocity = true;
+    frame.velocityEast = 5;
+    frame.velocityNorth = 0;
+    printGoldenFrame("position", frame, mesh);
+
+    frame = {};
+    frame.type = MSG_STATUS;
+    frame.node = 9;
+    frame.sequence = 255;
+    frame.hopLimit = 3;
+    frame.timestampMs = 600000;
+    frame.status = {3712, SCAN_PROFILE_CONSERVATION, 2, 35, {1105, 482, 1530}};
+    printGoldenFrame("status", frame, mesh);
+
+    frame = {};
+    frame.type = MSG_COMMAND;
+    frame.node = 1;
+    frame.sequence = 1;
+    frame.hopLimit = 3;
+    frame.timestampMs = 42000;
+    frame.command = {12, WIRE_CMD_SCAN_PROFILE, SCAN_PROFILE_BURST, 30};
+    printGoldenFrame("command", frame, local);
+
+    frame = {};
+    frame.type = MSG_ACK;
+    frame.node = 1;
+    frame.sequence = 2;
+    frame.hopLimit = 3;
+    frame.timestampMs = 43000;
+    frame.ack = {21, 250, 0x8005};
+    printGoldenFrame("ack", frame, local);
+
+    // A registry filter chunk: 13 data bytes, padded to two blocks
+    frame = {};
+    frame.type = MSG_TARGETS;
+    frame.node = 1;
+    frame.sequence = 3;
+    frame.hopLimit = 3;
+    frame.timestampMs = 44000;
+    frame.targets.target = 0;
+    frame.targets.op = WIRE_TARGETS_CHUNK;
+    frame.targets.filterCrc = 0xbeef;
+    frame.targets.chunk = 17;
+    frame.targets.length = 13;
+    for (uint8_t i = 0; i < 13; i++) frame.targets.data[i] = (uint8_t)(0xa0 + i);
+    printGoldenFrame("targets_chunk", frame, local);
+    return 0;
+}
+
+// ============================================================================
+// MAIN
+// ============================================================================
+
+static void usage() {
+    fprintf(stderr,
+            "usage: program [--trace FILE | --synthetic N] [--duration SEC] [--adv-interval MS]\n"
+            "               [--inject MAC]... [--inject-ramp FROM,TO] [--inject-ad HEX]...\n"
+            "               [--rpa IRK]... [--rpa-rotate SEC] [--rpa-share PCT]\n"
+            "               [--hci-depth N] [--cpu-cost CALL,ADVERT | --cpu-scale X]\n"
+            "               [--gps LAT,LON[,ubx|pmtk|nmea]]\n"
+            "               [--gps-walk SPEED,COURSE[,TURN_SEC[,TURN_DEG]]]\n"
+            "               [--rx-rate N] [--peer-rssi LO,HI] [--peer-target MAC[,EAST,NORTH]]...\n"
+            "               [--fusion-bench N] [--golden-frames] [--battery MV[,END]]\n"
+            "               [--command SEC:NODE:PROFILE[:MIN]]... [--homebase FROM[,TO]]\n"
+            "               [--target SEC:NODE:OP[:MAC]]... [--filter SEC:FILE] [--console SEC:LINE]...\n"
+            "               [--flash FILE] [--power-cut SEC] [--drain SEC] [--seed N] [--serial]\n"
+            "               [--check]\n");
+}
+
+static bool parseArgs(int argc, char** argv, Options& opt) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        auto value = [&]() -> const char* { return i + 1 < argc ? argv[++i] : nullptr; };
+        const char* v = nullptr;
+        if (arg == "--serial") {
+            opt.serialEcho = true;
+        } else if (arg == "--check") {
+            opt.check = true;
+        } else if (arg == "--golden-frames") {
+            opt.goldenFrames = true;
+        } else if (arg == "--help" || arg == "-h") {
+            return false;
+        } else if ((v = value()) == nullptr) {
+            return false;
+        } else if (arg == "--trace") {
+            opt.tracePath = v;
+        } else if (arg == "--synthetic") {
+            opt.synthetic = (uint32_t)atoi(v);
+        } else if (arg == "--duration") {
+            opt.durationSec = atof(v);
+        } else if (arg == "--adv-interval") {
+            opt.advIntervalMs = (uint32_t)atoi(v);
+        } else if (arg == "--inject") {
+            uint64_t address;
+            if (!parseMac(v, address)) return false;
+            opt.inject.push_back(address);
+        } else if (arg == "--inject-ramp") {
+            if (sscanf(v, "%d,%d", &opt.injectRampFrom, &opt.injectRampTo) != 2) return false;
+            opt.injectRamp = true;
+        } else if (arg == "--inject-ad") {
+            opt.injectPayloads.push_back(parseHex(v));
+        } else if (arg == "--rpa") {
+            std::array<uint8_t, 16> key;
+            uint8_t bytes[16] = {};
+            if (!parseIrk(v, bytes)) return false;
+            std::copy(bytes, bytes + 16, key.begin());
+            opt.rpaKeys.push_back(key);
+        } else if (arg == "--rpa-rotate") {
+            opt.rpaRotateSec = atof(v);
+        } else if (arg == "--rpa-share") {
+            opt.rpaShare = (uint32_t)atoi(v);
+        } else if (arg == "--hci-depth") {
+            opt.hciDepth = (uint32_t)atoi(v);
+        } else if (arg == "--cpu-cost") {
+            if (sscanf(v, "%lf,%lf", &opt.callCostUs, &opt.advertCostUs) < 1 || opt.callCostUs <= 0) {
+                return false;
+            }
+            opt.measuredCpu = false;
+        } else if (arg == "--cpu-scale") {
+            opt.cpuScale = atof(v);
+            opt.measuredCpu = true;
+        } else if (arg == "--gps") {
+            char dialect[8] = "ubx";
+            if (sscanf(v, "%lf,%lf,%7s", &opt.lat, &opt.lon, dialect) < 2) return false;
+            if (strcmp(dialect, "ubx") == 0) {
+                opt.gpsDialect = sim::GPS_SIM_UBX;
+            } else if (strcmp(dialect, "pmtk") == 0) {
+                opt.gpsDialect = sim::GPS_SIM_PMTK;
+            } else if (strcmp(dialect, "nmea") == 0) {
+                opt.gpsDialect = sim::GPS_SIM_NMEA_ONLY;
+            } else {
+                return false;
+            }
+            opt.gps = true;
+        } else if (arg == "--gps-walk") {
+            if (sscanf(v, "%lf,%lf,%lf,%lf", &opt.walkSpeed, &opt.walkCourse, &opt.walkTurnSec,
+                       &opt.walkTurnDeg) < 2) {
+                return false;
+            }
+        } else if (arg == "--rx-rate") {
+            opt.rxPerMin = atof(v);
+        } else if (arg == "--peer-rssi") {
+            if (sscanf(v, "%f,%f", &opt.peerRssiLo, &opt.peerRssiHi) != 2) return false;
+        } else if (arg == "--peer-target") {
+            std::string text = v;
+            size_t comma = text.find(',');
+            PeerTarget target = {0, 0.0, 0.0};
+            if (!parseMac(text.substr(0, comma), target.mac)) return false;
+            if (comma != std::string::npos &&
+                sscanf(text.c_str() + comma + 1, "%lf,%lf", &target.east, &target.north) != 2) {
+                return false;
+            }
+            opt.peerTargets.push_back(target);
+        } else if (arg == "--fusion-bench") {
+            opt.fusionBench = (uint32_t)atoi(v);
+            if (opt.fusionBench == 0) return false;
+        } else if (arg == "--battery") {
+            if (sscanf(v, "%f,%f", &opt.batteryMv, &opt.batteryEndMv) < 1) return false;
+        } else if (arg == "--command") {
+            opt.commands.push_back(v);
+        } else if (arg == "--target") {
+            opt.targets.push_back(v);
+        } else if (arg == "--filter") {
+            char path[256] = "";
+            if (sscanf(v, "%lf:%255s", &opt.filterSec, path) != 2) return false;
+            opt.filterPath = path;
+        } else if (arg == "--console") {
+            opt.console.push_back(v);
+        } else if (arg == "--homebase") {
+            if (sscanf(v, "%lf,%lf", &opt.homebaseFromSec, &opt.homebaseToSec) < 1) return false;
+        } else if (arg == "--flash") {
+            opt.flashPath = v;
+        } else if (arg == "--power-cut") {
+            opt.powerCutSec = atof(v);
+        } else if (arg == "--drain") {
+            opt.drainSec = atof(v);
+        } else if (arg == "--seed") {
+            opt.seed = (uint32_t)atoi(v);
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char** argv) {
+    if (!parseArgs(argc, argv, g_options)) {
+        usage();
+        return 2;
+    }
+    if (g_options.fusionBench) return fusionBenchmark(g_options.fusionBench);
+    if (g_options.goldenFrames) return goldenFrames();
+
+    if (!g_options.tracePath.empty()) {
+        if (!loadTrace(g_options.tracePath, g_trace)) return 1;
+    } else {
+        synthesizeTrace(g_options, g_trace);
+    }
+
+    if (g_options.measuredCpu) {
+        sim::setCpuScale(g_options.cpuScale);
+    } else {
+        sim::setFixedCpuCost((uint64_t)(g_options.callCostUs * 1000));
+    }
+    sim::setSerialEcho(g_options.serialEcho);
+    sim::gps().present = g_options.gps;
+    sim::gps().fix = g_options.gps;
+    sim::gps().lat = g_options.lat;
+    sim::gps().lon = g_options.lon;
+    sim::gps().dialect = g_options.gpsDialect;
+    sim::gps().speedMs = g_options.walkSpeed;
+    sim::gps().courseDeg = g_options.walkCourse;
+    sim::gps().turnSec = (uint32_t)g_options.walkTurnSec;
+    sim::gps().turnDeg = g_options.walkTurnDeg;
+    sim::battery().startMv = g_options.batteryMv;
+    sim::battery().endMv = g_options.batteryEndMv >= 0 ? g_options.batteryEndMv : g_options.batteryMv;
+    sim::battery().dividerRatio = (float)BATTERY_DIVIDER;
+    sim::flash().path = g_options.flashPath;
+
+    sim::spawn("loopTask", [] {
+        setup();
+        for (;;) loop();
+    });
+
+    // Boot (scan must start within 60 s), then replay the trace plus drain
+    // time; onScanStart() moves the end of the run
+    auto wallStart = std::chrono::steady_clock::now();
+    sim::run(60ULL * 1000000ULL);
+    if (g_stats.host == nullptr) {
+        fprintf(stderr, "Firmware never started a BLE scan\n");
+        return 1;
+    }
+    double wallSec = std::chrono::duration<double>(std::chrono::steady_clock::now() - wallStart).count();
+
+    report(wallSec);
+    bool passed = !g_options.check || checkRun();
+    if (!g_options.flashPath.empty() && !sim::saveFlash()) {
+        fprintf(stderr, "Could not save %s\n", g_options.flashPath.c_str());
+    }
+
+    // Context threads are parked mid-firmware; leave without unwinding them
+    std::_Exit(passed ? 0 : 1);
+}
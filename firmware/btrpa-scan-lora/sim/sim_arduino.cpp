@@ -0,0 +1,447 @@
+/**
+ * btrpa-scan-lora native stand-in: Arduino core implementation
+ */
+
+#include <Arduino.h>
+#include <esp_sleep.h>
+#include <stdio.h>
+#include <time.h>
+#include <deque>
+#include <random>
+#include <string>
+
+#include "sim_env.h"
+
+HardwareSerial Serial(0);
+
+static bool g_serialEcho = false;
+static std::string* g_serialCapture = nullptr;
+static std::mt19937 g_rng(1);
+static std::deque<char> g_consoleInput;     // typed on the USB console
+static OnReceiveCb g_consoleReceive;
+
+namespace sim {
+
+void typeConsoleLine(uint64_t atUs, const std::string& line) {
+    schedule(atUs, [line] {
+        g_consoleInput.insert(g_consoleInput.end(), line.begin(), line.end());
+        g_consoleInput.push_back('\n');
+        if (g_consoleReceive) g_consoleReceive();
+    });
+}
+
+GpsState& gps() {
+    static GpsState state;
+    return state;
+}
+
+void setSerialEcho(bool enabled) {
+    g_serialEcho = enabled;
+}
+
+void captureSerial(std::string* out) {
+    g_serialCapture = out;
+}
+
+float BatteryState::mvAt(uint64_t us) const {
+    if (us <= startUs || endUs <= startUs) return startMv;
+    if (us >= endUs) return endMv;
+    return startMv + (endMv - startMv) * (float)(us - startUs) / (float)(endUs - startUs);
+}
+
+BatteryState& battery() {
+    static BatteryState state;
+    return state;
+}
+
+SleepStats& sleepStats() {
+    static SleepStats stats;
+    return stats;
+}
+
+} // namespace sim
+
+unsigned long millis() {
+    return (unsigned long)(sim::nowUs() / 1000);
+}
+
+unsigned long micros() {
+    return (unsigned long)sim::nowUs();
+}
+
+void delay(uint32_t ms) {
+    sim::sleepUntil(sim::nowUs() + (uint64_t)ms * 1000);
+}
+
+void delayMicroseconds(uint32_t us) {
+    sim::consume(us);
+}
+
+void yield() {}
+
+void pinMode(uint8_t, uint8_t) {}
+void digitalWrite(uint8_t, uint8_t) {}
+int digitalRead(uint8_t) { return LOW; }
+uint16_t analogRead(uint8_t) { return 0; }
+
+// Every ADC pin reads the battery divider
+uint32_t analogReadMilliVolts(uint8_t) {
+    const sim::BatteryState& b = sim::battery();
+    return (uint32_t)(b.mvAt(sim::nowUs()) / b.dividerRatio + 0.5f);
+}
+
+static uint64_t g_sleepTimerUs = 0;
+
+esp_err_t esp_sleep_enable_timer_wakeup(uint64_t timeUs) {
+    g_sleepTimerUs = timeUs;
+    return ESP_OK;
+}
+
+esp_err_t esp_sleep_enable_gpio_wakeup() {
+    return ESP_OK;
+}
+
+esp_err_t esp_light_sleep_start() {
+    sim::sleepStats().sleeps++;
+    sim::sleepStats().sleptUs += g_sleepTimerUs;
+    sim::sleepUntil(sim::nowUs() + g_sleepTimerUs);
+    return ESP_OK;
+}
+
+long random(long max) {
+    return max > 0 ? (long)(g_rng() % (unsigned long)max) : 0;
+}
+
+long random(long min, long max) {
+    return max > min ? min + random(max - min) : min;
+}
+
+void randomSeed(unsigned long seed) {
+    g_rng.seed(seed);
+}
+
+uint32_t esp_random() {
+    return (uint32_t)g_rng();
+}
+
+size_t Print::printf(const char* format, ...) {
+    char buffer[512];
+    va_list args;
+    va_start(args, format);
+    int len = vsnprintf(buffer, sizeof(buffer), format, args);
+    va_end(args);
+    if (len < 0) return 0;
+    if ((size_t)len >= sizeof(buffer)) len = sizeof(buffer) - 1;
+    return write((const uint8_t*)buffer, (size_t)len);
+}
+
+// ============================================================================
+// GPS module on UART1
+// ============================================================================
+
+// What the UART side holds: bytes received and not yet read, and the
+// driver callbacks
+static std::deque<uint8_t> g_gpsRx;
+static size_t g_gpsRxBufferSize = 256;
+static unsigned long g_gpsUartBaud = 9600;
+static OnReceiveCb g_gpsReceive;
+static OnReceiveErrorCb g_gpsReceiveError;
+static bool g_gpsRunning = false;
+static std::vector<uint8_t> g_gpsCommand;   // partial command from the firmware
+
+static std::string nmea(const std::string& body) {
+    uint8_t checksum = 0;
+    for (char c : body) checksum ^= (uint8_t)c;
+    char tail[8];
+    snprintf(tail, sizeof(tail), "*%02X\r\n", checksum);
+    return "$" + body + tail;
+}
+
+// "ddmm.mmmmm,N" / "dddmm.mmmmm,E"
+static std::string nmeaCoordinate(double degrees, bool latitude) {
+    char hemisphere = latitude ? (degrees < 0 ? 'S' : 'N') : (degrees < 0 ? 'W' : 'E');
+    degrees = fabs(degrees);
+    int whole = (int)degrees;
+    char text[24];
+    snprintf(text, sizeof(text), "%0*d%08.5f,%c", latitude ? 2 : 3, whole, (degrees - whole) * 60.0, hemisphere);
+    return text;
+}
+
+// Where the walk has got to by now, leg by leg on a flat earth
+static void gpsWalk(double& lat, double& lon, double& course) {
+    const sim::GpsState& gps = sim::gps();
+    lat = gps.lat;
+    lon = gps.lon;
+    course = gps.courseDeg;
+    double remaining = sim::nowUs() / 1e6;
+    while (gps.speedMs > 0 && remaining > 0) {
+        double leg = gps.turnSec > 0 && gps.turnSec < remaining ? gps.turnSec : remaining;
+        double meters = gps.speedMs * leg;
+        lat += meters * cos(course * DEG_TO_RAD) / 111319.5;
+        lon += meters * sin(course * DEG_TO_RAD) / (111319.5 * cos(lat * DEG_TO_RAD));
+        remaining -= leg;
+        if (remaining > 0) course = fmod(course + gps.turnDeg, 360.0);
+    }
+}
+
+// One burst in the order u-blox modules send it
+static std::string gpsBurst() {
+    const sim::GpsState& gps = sim::gps();
+    time_t utc = (time_t)(gps.utcAtBoot + sim::nowUs() / 1000000);
+    struct tm t;
+    gmtime_r(&utc, &t);
+    char clock[40], date[40];
+    snprintf(clock, sizeof(clock), "%02d%02d%02d.00", t.tm_hour, t.tm_min, t.tm_sec);
+    snprintf(date, sizeof(date), "%02d%02d%02d", t.tm_mday, t.tm_mon + 1, t.tm_year % 100);
+    double lat, lon, course;
+    gpsWalk(lat, lon, course);
+    std::string position = gps.fix ? nmeaCoordinate(lat, true) + "," + nmeaCoordinate(lon, false) : ",,,";
+    char motion[40];
+    if (gps.speedMs > 0) {
+        snprintf(motion, sizeof(motion), ",%.3f,%.2f,", gps.speedMs / 0.514444, course);
+    } else {
+        snprintf(motion, sizeof(motion), ",0.012,,");
+    }
+
+    std::string burst;
+    if (gps.sentences & sim::GPS_SIM_RMC) {
+        burst += nmea(std::string("GNRMC,") + clock + (gps.fix ? ",A," : ",V,") + position + motion + date +
+                      ",,," + (gps.fix ? "A" : "N"));
+    }
+    if (gps.sentences & sim::GPS_SIM_VTG) burst += nmea(gps.fix ? "GNVTG,,T,,M,0.012,N,0.022,K,A" : "GNVTG,,,,,,,,,N");
+    if (gps.sentences & sim::GPS_SIM_GGA) {
+        burst += nmea(std::string("GNGGA,") + clock + "," + position +
+                      (gps.fix ? ",1,09,0.92,152.3,M,-25.1,M,," : ",0,00,99.99,,,,,,"));
+    }
+    if (gps.sentences & sim::GPS_SIM_GSA) {
+        burst += nmea(gps.fix ? "GNGSA,A,3,02,05,07,09,13,15,20,30,,,,,1.63,0.92,1.35"
+                              : "GNGSA,A,1,,,,,,,,,,,,,99.99,99.99,99.99");
+    }
+    if (gps.sentences & sim::GPS_SIM_GSV) {
+        burst += nmea("GPGSV,3,1,11,02,68,284,43,05,49,073,41,07,13,321,30,09,21,160,38");
+        burst += nmea("GPGSV,3,2,11,13,55,199,44,15,18,231,33,20,34,052,39,30,40,117,42");
+        burst += nmea("GPGSV,3,3,11,16,07,276,,18,03,035,,29,02,101,");
+    }
+    if (gps.sentences & sim::GPS_SIM_GLL) {
+        burst += nmea(std::string("GNGLL,") + position + "," + clock + (gps.fix ? ",A,A" : ",V,N"));
+    }
+    return burst;
+}
+
+// Bytes on the wire from the module. They reach the UART whole only when
+// both ends run at the same rate; the driver raises the callback once the
+// line goes idle after them.
+static void gpsSend(const std::vector<uint8_t>& bytes) {
+    sim::GpsState& gps = sim::gps();
+    gps.bytesSent += bytes.size();
+    uint64_t lineUs = bytes.size() * 10000000ULL / gps.baud;
+    bool garbled = gps.baud != g_gpsUartBaud;
+    sim::schedule(sim::nowUs() + lineUs, [bytes, garbled] {
+        size_t dropped = 0;
+        for (uint8_t b : bytes) {
+            if (g_gpsRx.size() >= g_gpsRxBufferSize) {
+                dropped++;
+                continue;
+            }
+            // Sampled at the wrong rate: framing errors and junk, never '$'
+            g_gpsRx.push_back(garbled ? (uint8_t)(b ^ 0xA5) : b);
+        }
+        sim::gps().bytesDropped += (uint32_t)dropped;
+        if (garbled && g_gpsReceiveError) g_gpsReceiveError(UART_FRAME_ERROR);
+        if (dropped > 0 && g_gpsReceiveError) g_gpsReceiveError(UART_BUFFER_FULL_ERROR);
+        if (g_gpsReceive) g_gpsReceive();
+    });
+}
+
+static void gpsFixLoop(uint64_t atUs) {
+    sim::schedule(atUs, [atUs] {
+        if (sim::gps().present) {
+            std::string burst = gpsBurst();
+            gpsSend(std::vector<uint8_t>(burst.begin(), burst.end()));
+        }
+        gpsFixLoop(atUs + (uint64_t)sim::gps().rateMs * 1000);
+    });
+}
+
+static void gpsReplyUbx(uint8_t cls, uint8_t id, bool ack) {
+    std::vector<uint8_t> frame = {0xB5, 0x62, 0x05, (uint8_t)(ack ? 0x01 : 0x00), 2, 0, cls, id};
+    uint8_t a = 0, b = 0;
+    for (size_t i = 2; i < frame.size(); i++) {
+        a += frame[i];
+        b += a;
+    }
+    frame.push_back(a);
+    frame.push_back(b);
+    gpsSend(frame);
+}
+
+// UBX CFG-MSG (NMEA class), CFG-RATE and CFG-PRT; every other frame is NAKed
+static void gpsUbxCommand(const std::vector<uint8_t>& frame) {
+    static const uint8_t SENTENCE_BITS[] = {sim::GPS_SIM_GGA, sim::GPS_SIM_GLL, sim::GPS_SIM_GSA,
+                                            sim::GPS_SIM_GSV, sim::GPS_SIM_RMC, sim::GPS_SIM_VTG};
+    sim::GpsState& gps = sim::gps();
+    uint8_t cls = frame[2], id = frame[3];
+    const uint8_t* payload = frame.data() + 6;
+    size_t length = frame.size() - 8;
+    uint32_t newBaud = 0;
+    bool ok = true;
+    if (cls == 0x06 && id == 0x01 && length == 3 && payload[0] == 0xF0 && payload[1] < 6) {
+        if (payload[2]) gps.sentences |= SENTENCE_BITS[payload[1]];
+        else gps.sentences &= (uint8_t)~SENTENCE_BITS[payload[1]];
+    } else if (cls == 0x06 && id == 0x08 && length == 6 && (payload[0] | payload[1] << 8) >= 25) {
+        gps.rateMs = (uint32_t)(payload[0] | payload[1] << 8);
+    } else if (cls == 0x06 && id == 0x00 && length == 20 && payload[0] == 1) {
+        newBaud = (uint32_t)payload[8] | (uint32_t)payload[9] << 8 | (uint32_t)payload[10] << 16 |
+                  (uint32_t)payload[11] << 24;
+    } else {
+        ok = false;
+    }
+    if (ok) gps.commands++;
+    gpsReplyUbx(cls, id, ok);
+    // The acknowledgement still goes out at the old rate
+    if (newBaud != 0) {
+        uint64_t atUs = sim::nowUs() + 20000;
+        sim::schedule(atUs, [newBaud] { sim::gps().baud = newBaud; });
+    }
+}
+
+// $PMTK314 (GLL, RMC, VTG, GGA, GSA, GSV ...), $PMTK220 and $PMTK251
+static void gpsPmtkCommand(const std::string& body) {
+    static const uint8_t SENTENCE_BITS[] = {sim::GPS_SIM_GLL, sim::GPS_SIM_RMC, sim::GPS_SIM_VTG,
+                                            sim::GPS_SIM_GGA, sim::GPS_SIM_GSA, sim::GPS_SIM_GSV};
+    sim::GpsState& gps = sim::gps();
+    int command = atoi(body.c_str() + 4);
+    std::vector<long> fields;
+    for (size_t comma = body.find(','); comma != std::string::npos; comma = body.find(',', comma + 1)) {
+        fields.push_back(atol(body.c_str() + comma + 1));
+    }
+    uint32_t newBaud = 0;
+    bool ok = true;
+    if (command == 314 && fields.size() >= 6) {
+        gps.sentences = 0;
+        for (size_t i = 0; i < 6; i++) {
+            if (fields[i]) gps.sentences |= SENTENCE_BITS[i];
+        }
+    } else if (command == 220 && fields.size() == 1 && fields[0] >= 100) {
+        gps.rateMs = (uint32_t)fields[0];
+    } else if (command == 251 && fields.size() == 1) {
+        newBaud = (uint32_t)fields[0];
+    } else {
+        ok = false;
+    }
+    if (ok) gps.commands++;
+    std::string reply = nmea("PMTK001," + std::to_string(command) + (ok ? ",3" : ",1"));
+    gpsSend(std::vector<uint8_t>(reply.begin(), reply.end()));
+    if (newBaud != 0) {
+        uint64_t atUs = sim::nowUs() + 20000;
+        sim::schedule(atUs, [newBaud] { sim::gps().baud = newBaud; });
+    }
+}
+
+// Bytes the firmware sends the module, taken apart into commands in the
+// module's dialect; it ignores the other one
+static void gpsReceiveCommand(const uint8_t* data, size_t size) {
+    sim::GpsState& gps = sim::gps();
+    if (!gps.present || gps.baud != g_gpsUartBaud) return;
+    for (size_t i = 0; i < size; i++) {
+        uint8_t c = data[i];
+        std::vector<uint8_t>& command = g_gpsCommand;
+        if (command.empty() && c != 0xB5 && c != '$') continue;
+        command.push_back(c);
+        if (command[0] == 0xB5) {
+            if (command.size() == 2 && c != 0x62) command.clear();
+            if (command.size() < 6 || command.size() < 8u + (command[4] | command[5] << 8)) continue;
+            uint8_t a = 0, b = 0;
+            for (size_t k = 2; k < command.size() - 2; k++) {
+                a += command[k];
+                b += a;
+            }
+            if (gps.dialect == sim::GPS_SIM_UBX && a == command[command.size() - 2] && b == command.back()) {
+                gpsUbxCommand(command);
+            }
+            command.clear();
+        } else if (c == '\n') {
+            std::string line(command.begin() + 1, command.end());
+            command.clear();
+            size_t star = line.find('*');
+            if (gps.dialect != sim::GPS_SIM_PMTK || star == std::string::npos || line.compare(0, 4, "PMTK") != 0) {
+                continue;
+            }
+            std::string body = line.substr(0, star);
+            if (nmea(body) == "$" + line) gpsPmtkCommand(body);
+        }
+    }
+}
+
+void HardwareSerial::begin(unsigned long baud, uint32_t, int8_t, int8_t) {
+    _baud = baud;
+    if (_uartNum != 1) return;
+    g_gpsUartBaud = baud;
+    g_gpsRxBufferSize = _rxBufferSize;
+    if (!g_gpsRunning) {
+        g_gpsRunning = true;
+        // The first burst a little after power-up
+        gpsFixLoop(sim::nowUs() + 300000);
+    }
+}
+
+void HardwareSerial::updateBaudRate(unsigned long baud) {
+    _baud = baud;
+    if (_uartNum == 1) g_gpsUartBaud = baud;
+}
+
+size_t HardwareSerial::write(const uint8_t* buffer, size_t size) {
+    // 10 bits per byte; the call blocks once the 128-byte FIFO is full
+    const uint64_t byteUs = 10000000ULL / _baud;
+    uint64_t now = sim::nowUs();
+    uint64_t start = _fifoEmptyAtUs > now ? _fifoEmptyAtUs : now;
+    _fifoEmptyAtUs = start + size * byteUs;
+    uint64_t fifoSpan = 128 * byteUs;
+    if (_fifoEmptyAtUs > now + fifoSpan) {
+        sim::consume(_fifoEmptyAtUs - fifoSpan - now);
+    }
+    if (_uartNum == 0 && g_serialEcho) {
+        fwrite(buffer, 1, size, stdout);
+    }
+    if (_uartNum == 0 && g_serialCapture) g_serialCapture->append((const char*)buffer, size);
+    if (_uartNum == 1) gpsReceiveCommand(buffer, size);
+    return size;
+}
+
+void HardwareSerial::flush() {
+    uint64_t now = sim::nowUs();
+    if (_fifoEmptyAtUs > now) sim::consume(_fifoEmptyAtUs - now);
+}
+
+int HardwareSerial::available() {
+    if (_uartNum == 0) return (int)g_consoleInput.size();
+    if (_uartNum == 1) return (int)g_gpsRx.size();
+    return 0;
+}
+
+void HardwareSerial::onReceive(OnReceiveCb function, bool) {
+    if (_uartNum == 0) g_consoleReceive = function;
+    if (_uartNum == 1) g_gpsReceive = function;
+}
+
+void HardwareSerial::onReceiveError(OnReceiveErrorCb function) {
+    if (_uartNum == 1) g_gpsReceiveError = function;
+}
+
+int HardwareSerial::read() {
+    if (available() == 0) return -1;
+    if (_uartNum == 0) {
+        char c = g_consoleInput.front();
+        g_consoleInput.pop_front();
+        return c;
+    }
+    uint8_t c = g_gpsRx.front();
+    g_gpsRx.pop_front();
+    return c;
+}
+
+size_t HardwareSerial::read(uint8_t* buffer, size_t size) {
+    size_t n = 0;
+    while (n < size && available() > 0) buffer[n++] = (uint8_t)read();
+    return n;
+}
@@ -0,0 +1,235 @@
+/**
+ * btrpa-scan-lora native stand-in: SPI flash behind the journal partition
+ * and the NVS partition holding runtime targets
+ *
+ * Timing from a typical 80 MHz quad SPI NOR part (W25Q64-class):
+ * reads stream at about 20 MB/s after the command, a page program takes
+ * 0.4 ms per 256-byte page, a 4 KB sector erase 45 ms.
+ */
+
+#include <esp_partition.h>
+#include <nvs_flash.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "sim_env.h"
+#include "sim_kernel.h"
+
+static constexpr uint32_t SECTOR_BYTES = 4096;
+static constexpr uint32_t PAGE_BYTES = 256;
+static constexpr uint64_t READ_SETUP_US = 5;
+static constexpr uint64_t READ_BYTES_PER_US = 20;
+static constexpr uint64_t PAGE_SETUP_US = 40;
+static constexpr uint64_t PAGE_PROGRAM_US = 360;
+static constexpr uint64_t SECTOR_ERASE_US = 45000;
+
+static esp_partition_t g_partition;
+static std::vector<uint8_t> g_data;
+static bool g_loaded = false;
+
+// NVS blobs by "namespace/key", and the namespace behind each handle
+static std::map<std::string, std::vector<uint8_t>> g_nvs;
+static std::vector<std::string> g_nvsHandles;
+static bool g_nvsLoaded = false;
+
+namespace sim {
+
+FlashState& flash() {
+    static FlashState state;
+    return state;
+}
+
+// NVS file: per blob a 2-byte name length, the name, a 4-byte size and
+// the bytes (host order; the file never leaves the host)
+static bool saveNvs(const std::string& path) {
+    FILE* f = fopen(path.c_str(), "wb");
+    if (f == nullptr) return false;
+    bool ok = true;
+    for (const auto& entry : g_nvs) {
+        uint16_t nameLength = (uint16_t)entry.first.size();
+        uint32_t size = (uint32_t)entry.second.size();
+        ok = ok && fwrite(&nameLength, sizeof(nameLength), 1, f) == 1 &&
+             fwrite(entry.first.data(), 1, nameLength, f) == nameLength &&
+             fwrite(&size, sizeof(size), 1, f) == 1 && fwrite(entry.second.data(), 1, size, f) == size;
+    }
+    fclose(f);
+    return ok;
+}
+
+bool saveFlash() {
+    const FlashState& state = flash();
+    if (state.path.empty() || g_data.empty()) return false;
+    FILE* f = fopen(state.path.c_str(), "wb");
+    if (f == nullptr) return false;
+    bool ok = fwrite(g_data.data(), 1, g_data.size(), f) == g_data.size();
+    fclose(f);
+    return ok && (!g_nvsLoaded || saveNvs(state.path + ".nvs"));
+}
+
+} // namespace sim
+
+// Partition contents from the saved image, else erased
+static void loadFlash() {
+    if (g_loaded) return;
+    g_loaded = true;
+    const sim::FlashState& state = sim::flash();
+    g_data.assign(state.journalBytes, 0xFF);
+    if (state.path.empty()) return;
+    FILE* f = fopen(state.path.c_str(), "rb");
+    if (f == nullptr) return;
+    size_t n = fread(g_data.data(), 1, g_data.size(), f);
+    fclose(f);
+    if (n != g_data.size()) fprintf(stderr, "Flash image %s: %zu of %zu bytes\n", state.path.c_str(), n, g_data.size());
+}
+
+// How much of an operation starting now and lasting us completes before
+// the power is cut (1.0 = all of it)
+static double beforeCut(uint64_t us) {
+    sim::FlashState& state = sim::flash();
+    if (state.torn) return 0.0;
+    uint64_t now = sim::nowUs();
+    if (now >= state.powerCutUs) return 0.0;
+    if (now + us <= state.powerCutUs) return 1.0;
+    state.torn = true;
+    return (double)(state.powerCutUs - now) / (double)us;
+}
+
+const esp_partition_t* esp_partition_find_first(esp_partition_type_t type, esp_partition_subtype_t,
+                                                const char* label) {
+    if (type != ESP_PARTITION_TYPE_DATA || sim::flash().journalBytes == 0) return nullptr;
+    if (label != nullptr && strcmp(label, "journal") != 0) return nullptr;
+    loadFlash();
+    g_partition.type = ESP_PARTITION_TYPE_DATA;
+    g_partition.subtype = (esp_partition_subtype_t)0x40;
+    g_partition.address = 0x290000;
+    g_partition.size = (uint32_t)g_data.size();
+    g_partition.erase_size = SECTOR_BYTES;
+    strcpy(g_partition.label, "journal");
+    g_partition.encrypted = false;
+    return &g_partition;
+}
+
+esp_err_t esp_partition_read(const esp_partition_t* partition, size_t offset, void* dst, size_t size) {
+    if (partition != &g_partition || offset + size > g_data.size()) return ESP_ERR_INVALID_ARG;
+    sim::flash().reads++;
+    memcpy(dst, g_data.data() + offset, size);
+    sim::consume(READ_SETUP_US + size / READ_BYTES_PER_US);
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_write(const esp_partition_t* partition, size_t offset, const void* src, size_t size) {
+    if (partition != &g_partition || offset + size > g_data.size()) return ESP_ERR_INVALID_ARG;
+    sim::flash().writes++;
+    size_t pages = (offset + size - 1) / PAGE_BYTES - offset / PAGE_BYTES + 1;
+    uint64_t us = pages * PAGE_SETUP_US + (PAGE_PROGRAM_US * size + PAGE_BYTES - 1) / PAGE_BYTES;
+    size_t done = (size_t)(size * beforeCut(us));
+    const uint8_t* bytes = (const uint8_t*)src;
+    for (size_t i = 0; i < done; i++) g_data[offset + i] &= bytes[i];
+    sim::consume(us);
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_erase_range(const esp_partition_t* partition, size_t offset, size_t size) {
+    if (partition != &g_partition || offset % SECTOR_BYTES || size % SECTOR_BYTES ||
+        offset + size > g_data.size()) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    sim::flash().erases++;
+    uint64_t us = size / SECTOR_BYTES * SECTOR_ERASE_US;
+    size_t done = (size_t)(size * beforeCut(us));
+    memset(g_data.data() + offset, 0xFF, done);
+    sim::consume(us);
+    return ESP_OK;
+}
+
+static void loadNvs() {
+    if (g_nvsLoaded) return;
+    g_nvsLoaded = true;
+    const sim::FlashState& state = sim::flash();
+    if (state.path.empty()) return;
+    FILE* f = fopen((state.path + ".nvs").c_str(), "rb");
+    if (f == nullptr) return;
+    uint16_t nameLength;
+    while (fread(&nameLength, sizeof(nameLength), 1, f) == 1) {
+        std::string name(nameLength, '\0');
+        uint32_t size;
+        if (fread(&name[0], 1, nameLength, f) != nameLength || fread(&size, sizeof(size), 1, f) != 1) break;
+        std::vector<uint8_t> value(size);
+        if (fread(value.data(), 1, size, f) != size) break;
+        g_nvs[name] = value;
+    }
+    fclose(f);
+}
+
+static std::string nvsName(nvs_handle_t handle, const char* key) {
+    return g_nvsHandles[handle - 1] + "/" + key;
+}
+
+esp_err_t nvs_flash_init_partition(const char* partition_label) {
+    if (strcmp(partition_label, "targets") != 0) return ESP_ERR_NVS_NOT_FOUND;
+    loadNvs();
+    return ESP_OK;
+}
+
+esp_err_t nvs_flash_erase_partition(const char* part_name) {
+    if (strcmp(part_name, "targets") != 0) return ESP_ERR_NVS_NOT_FOUND;
+    g_nvs.clear();
+    sim::consume(0x20000 / SECTOR_BYTES * SECTOR_ERASE_US);
+    return ESP_OK;
+}
+
+esp_err_t nvs_open_from_partition(const char* part_name, const char* namespace_name, nvs_open_mode_t,
+                                  nvs_handle_t* out_handle) {
+    if (!g_nvsLoaded) return ESP_ERR_NVS_NOT_INITIALIZED;
+    if (strcmp(part_name, "targets") != 0) return ESP_ERR_NVS_NOT_FOUND;
+    g_nvsHandles.push_back(namespace_name);
+    *out_handle = (nvs_handle_t)g_nvsHandles.size();
+    return ESP_OK;
+}
+
+esp_err_t nvs_get_blob(nvs_handle_t handle, const char* key, void* out_value, size_t* length) {
+    if (handle == 0 || handle > g_nvsHandles.size()) return ESP_ERR_NVS_INVALID_HANDLE;
+    auto it = g_nvs.find(nvsName(handle, key));
+    if (it == g_nvs.end()) return ESP_ERR_NVS_NOT_FOUND;
+    size_t size = it->second.size();
+    if (out_value != nullptr) {
+        if (*length < size) return ESP_ERR_NVS_INVALID_LENGTH;
+        memcpy(out_value, it->second.data(), size);
+        sim::consume(READ_SETUP_US + size / READ_BYTES_PER_US);
+    }
+    *length = size;
+    return ESP_OK;
+}
+
+esp_err_t nvs_set_blob(nvs_handle_t handle, const char* key, const void* value, size_t length) {
+    if (handle == 0 || handle > g_nvsHandles.size()) return ESP_ERR_NVS_INVALID_HANDLE;
+    // Each 32-byte entry of the blob is programmed, plus its header entry
+    size_t pages = (length + 32 + PAGE_BYTES - 1) / PAGE_BYTES;
+    uint64_t us = pages * (PAGE_SETUP_US + PAGE_PROGRAM_US);
+    if (beforeCut(us) == 1.0) {
+        const uint8_t* bytes = (const uint8_t*)value;
+        g_nvs[nvsName(handle, key)].assign(bytes, bytes + length);
+        sim::flash().writes++;
+    }
+    sim::consume(us);
+    return ESP_OK;
+}
+
+esp_err_t nvs_erase_key(nvs_handle_t handle, const char* key) {
+    if (handle == 0 || handle > g_nvsHandles.size()) return ESP_ERR_NVS_INVALID_HANDLE;
+    if (beforeCut(PAGE_SETUP_US + PAGE_PROGRAM_US) == 1.0 && g_nvs.erase(nvsName(handle, key)) == 0) {
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+    sim::consume(PAGE_SETUP_US + PAGE_PROGRAM_US);
+    return ESP_OK;
+}
+
+esp_err_t nvs_commit(nvs_handle_t handle) {
+    return handle == 0 || handle > g_nvsHandles.size() ? ESP_ERR_NVS_INVALID_HANDLE : ESP_OK;
+}
+
+void nvs_close(nvs_handle_t) {}
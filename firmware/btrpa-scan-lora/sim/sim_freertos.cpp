@@ -0,0 +1,102 @@
+/**
+ * btrpa-scan-lora native stand-in: FreeRTOS implementation
+ */
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+
+#include <deque>
+
+#include "sim_kernel.h"
+
+static uint64_t ticksToUs(TickType_t ticks) {
+    return ticks == portMAX_DELAY ? sim::NEVER : (uint64_t)ticks * (1000000ULL / configTICK_RATE_HZ);
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t pvTaskCode, const char* pcName,
+                                   uint32_t usStackDepth, void* pvParameters,
+                                   UBaseType_t uxPriority, TaskHandle_t* pvCreatedTask,
+                                   BaseType_t xCoreID) {
+    (void)usStackDepth; (void)uxPriority; (void)xCoreID;
+    TaskHandle_t handle = sim::spawn(pcName, [pvTaskCode, pvParameters] { pvTaskCode(pvParameters); },
+                                     sim::nowUs());
+    if (pvCreatedTask) *pvCreatedTask = handle;
+    return pdPASS;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t pvTaskCode, const char* pcName, uint32_t usStackDepth,
+                       void* pvParameters, UBaseType_t uxPriority, TaskHandle_t* pvCreatedTask) {
+    return xTaskCreatePinnedToCore(pvTaskCode, pcName, usStackDepth, pvParameters,
+                                   uxPriority, pvCreatedTask, tskNO_AFFINITY);
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle() {
+    return sim::current();
+}
+
+void vTaskDelay(TickType_t xTicksToDelay) {
+    sim::sleepUntil(sim::nowUs() + ticksToUs(xTicksToDelay));
+}
+
+TickType_t xTaskGetTickCount() {
+    return (TickType_t)(sim::nowUs() / (1000000ULL / configTICK_RATE_HZ));
+}
+
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t) {
+    return 0;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t xClearCountOnExit, TickType_t xTicksToWait) {
+    return sim::waitNotify(ticksToUs(xTicksToWait), xClearCountOnExit == pdTRUE);
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t xTaskToNotify) {
+    sim::notify(xTaskToNotify);
+    return pdPASS;
+}
+
+void vTaskNotifyGiveFromISR(TaskHandle_t xTaskToNotify, BaseType_t* pxHigherPriorityTaskWoken) {
+    sim::notify(xTaskToNotify);
+    if (pxHigherPriorityTaskWoken) *pxHigherPriorityTaskWoken = pdTRUE;
+}
+
+// Mutex with direct hand-off to the longest waiter
+struct SimSemaphore {
+    sim::Context* owner = nullptr;
+    std::deque<sim::Context*> waiters;
+};
+
+SemaphoreHandle_t xSemaphoreCreateMutex() {
+    return new SimSemaphore();
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t xSemaphore, TickType_t xBlockTime) {
+    sim::Context* self = sim::current();
+    if (xSemaphore->owner == nullptr) {
+        xSemaphore->owner = self;
+        return pdTRUE;
+    }
+    if (xBlockTime == 0) return pdFALSE;
+    xSemaphore->waiters.push_back(self);
+    sim::park(ticksToUs(xBlockTime));
+    if (xSemaphore->owner == self) return pdTRUE;
+    for (auto it = xSemaphore->waiters.begin(); it != xSemaphore->waiters.end(); ++it) {
+        if (*it == self) {
+            xSemaphore->waiters.erase(it);
+            break;
+        }
+    }
+    return pdFALSE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t xSemaphore) {
+    if (xSemaphore->waiters.empty()) {
+        xSemaphore->owner = nullptr;
+    } else {
+        xSemaphore->owner = xSemaphore->waiters.front();
+        xSemaphore->waiters.pop_front();
+        sim::unpark(xSemaphore->owner);
+    }
+    return pdTRUE;
+}
@@ -0,0 +1,55 @@
+/**
+ * btrpa-scan-lora native stand-ins: heap
+ *
+ * On the ESP32, libstdc++ is linked statically and its operator new calls
+ * malloc, so -Wl,--wrap=malloc sees every C++ allocation. On the host
+ * libstdc++ is a shared library the linker cannot wrap, so new and delete
+ * are defined here on top of malloc and free to give the same coverage.
+ * Replay bookkeeping runs on the simulated NimBLE host task and shows up
+ * in its counts, where NimBLE's own allocations would be on the device.
+ */
+
+#include <esp_heap_caps.h>
+
+#include <new>
+#include <stdlib.h>
+
+void* operator new(size_t size) {
+    void* p = malloc(size > 0 ? size : 1);
+    if (p == nullptr) throw std::bad_alloc();
+    return p;
+}
+
+void* operator new[](size_t size) {
+    return operator new(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+    return malloc(size > 0 ? size : 1);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+    return malloc(size > 0 ? size : 1);
+}
+
+void operator delete(void* p) noexcept { free(p); }
+void operator delete[](void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+void operator delete[](void* p, size_t) noexcept { free(p); }
+
+// Round figures for an ESP32-S3 after NimBLE and the radio are up; not a
+// measurement
+static constexpr size_t SIM_HEAP_FREE = 236 * 1024;
+static constexpr size_t SIM_HEAP_LARGEST_BLOCK = 108 * 1024;
+
+size_t heap_caps_get_free_size(uint32_t) {
+    return SIM_HEAP_FREE;
+}
+
+size_t heap_caps_get_largest_free_block(uint32_t) {
+    return SIM_HEAP_LARGEST_BLOCK;
+}
+
+size_t heap_caps_get_minimum_free_size(uint32_t) {
+    return SIM_HEAP_FREE;
+}
@@ -0,0 +1,277 @@
+/**
+ * btrpa-scan-lora Host Simulation Kernel
+ *
+ * See sim_kernel.h. Contexts hand a single baton back and forth with the
+ * scheduler thread, so firmware globals are never touched concurrently.
+ */
+
+#include "sim_kernel.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace sim {
+
+using Clock = std::chrono::steady_clock;
+
+struct Context {
+    std::string name;
+    std::function<void()> body;
+    uint64_t clockUs = 0;
+    uint64_t wakeUs = 0;
+    bool waitingNotify = false;
+    uint32_t notifyCount = 0;
+    uint64_t notifyAtUs = 0;
+    bool parked = false;
+    bool unparked = false;
+    uint64_t unparkAtUs = 0;
+    bool finished = false;
+    bool resume = false;
+    uint64_t busyUs = 0;
+    uint64_t fixedCpuNs = 0;        // fixed costs charged since the last fold
+    Clock::time_point resumedAt;
+    std::condition_variable cv;
+    std::thread thread;
+};
+
+static std::mutex g_mutex;
+static std::condition_variable g_schedulerCv;
+static bool g_yielded = false;
+static Context* g_running = nullptr;
+static std::vector<std::unique_ptr<Context>> g_contexts;
+static std::multimap<uint64_t, std::function<void()>> g_events;
+static Context g_isrContext;
+static uint64_t g_lastUs = 0;
+static uint64_t g_stopUs = NEVER;
+static double g_cpuScale = 10.0;
+static bool g_fixedCpu = true;
+static uint64_t g_callCostNs = 1000;
+
+void setFixedCpuCost(uint64_t perCallNs) {
+    g_fixedCpu = true;
+    g_callCostNs = perCallNs;
+}
+
+void setCpuScale(double scale) {
+    g_fixedCpu = false;
+    g_cpuScale = scale;
+}
+
+Context* current() {
+    return g_running;
+}
+
+const char* contextName(const Context* ctx) {
+    return ctx ? ctx->name.c_str() : "host";
+}
+
+uint64_t busyUs(const Context* ctx) {
+    return ctx ? ctx->busyUs : 0;
+}
+
+static uint64_t scaledCpuUs(const Context* ctx) {
+    if (ctx == &g_isrContext) return 0;
+    if (g_fixedCpu) return ctx->fixedCpuNs / 1000;
+    auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        Clock::now() - ctx->resumedAt).count();
+    return (uint64_t)(elapsed * g_cpuScale / 1000.0);
+}
+
+// Charge host CPU time spent since the context last resumed
+static void foldCpuTime(Context* ctx) {
+    uint64_t cpu = scaledCpuUs(ctx);
+    ctx->clockUs += cpu;
+    ctx->busyUs += cpu;
+    if (g_fixedCpu) ctx->fixedCpuNs -= cpu * 1000;
+    ctx->resumedAt = Clock::now();
+}
+
+// Fixed cost of a call into the kernel from a task context
+static void chargeCall(Context* ctx) {
+    if (g_fixedCpu && ctx != nullptr && ctx != &g_isrContext) ctx->fixedCpuNs += g_callCostNs;
+}
+
+void chargeCpu(uint64_t us) {
+    Context* ctx = g_running;
+    if (g_fixedCpu && ctx != nullptr && ctx != &g_isrContext) ctx->fixedCpuNs += us * 1000;
+}
+
+uint64_t nowUs() {
+    Context* ctx = g_running;
+    if (ctx == nullptr) return g_lastUs;
+    chargeCall(ctx);
+    return ctx->clockUs + scaledCpuUs(ctx);
+}
+
+// Hand the baton back to the scheduler and wait to be resumed
+static void block(Context* ctx) {
+    std::unique_lock<std::mutex> lock(g_mutex);
+    g_yielded = true;
+    g_schedulerCv.notify_one();
+    ctx->cv.wait(lock, [ctx] { return ctx->resume; });
+    ctx->resume = false;
+    ctx->resumedAt = Clock::now();
+}
+
+Context* spawn(const char* name, std::function<void()> body, uint64_t startUs) {
+    g_contexts.emplace_back(new Context());
+    Context* ctx = g_contexts.back().get();
+    ctx->name = name;
+    ctx->body = std::move(body);
+    ctx->clockUs = startUs;
+    ctx->wakeUs = startUs;
+    ctx->thread = std::thread([ctx] {
+        {
+            std::unique_lock<std::mutex> lock(g_mutex);
+            ctx->cv.wait(lock, [ctx] { return ctx->resume; });
+            ctx->resume = false;
+            ctx->resumedAt = Clock::now();
+        }
+        ctx->body();
+        foldCpuTime(ctx);
+        std::unique_lock<std::mutex> lock(g_mutex);
+        ctx->finished = true;
+        g_yielded = true;
+        g_schedulerCv.notify_one();
+    });
+    ctx->thread.detach();
+    return ctx;
+}
+
+void sleepUntil(uint64_t wakeUs) {
+    Context* ctx = g_running;
+    if (ctx == nullptr || ctx == &g_isrContext) return;
+    chargeCall(ctx);
+    foldCpuTime(ctx);
+    ctx->wakeUs = wakeUs > ctx->clockUs ? wakeUs : ctx->clockUs;
+    ctx->waitingNotify = false;
+    block(ctx);
+}
+
+void consume(uint64_t us) {
+    Context* ctx = g_running;
+    if (ctx == nullptr || ctx == &g_isrContext) return;
+    ctx->busyUs += us;
+    sleepUntil(nowUs() + us);
+}
+
+uint32_t waitNotify(uint64_t timeoutUs, bool clearOnExit) {
+    Context* ctx = g_running;
+    if (ctx == nullptr || ctx == &g_isrContext) return 0;
+    chargeCall(ctx);
+    foldCpuTime(ctx);
+    if (ctx->notifyCount == 0 && timeoutUs > 0) {
+        ctx->waitingNotify = true;
+        ctx->wakeUs = timeoutUs == NEVER ? NEVER : ctx->clockUs + timeoutUs;
+        block(ctx);
+        ctx->waitingNotify = false;
+    }
+    uint32_t count = ctx->notifyCount;
+    if (clearOnExit) {
+        ctx->notifyCount = 0;
+    } else if (count > 0) {
+        ctx->notifyCount--;
+    }
+    return count;
+}
+
+void notify(Context* ctx) {
+    if (ctx == nullptr) return;
+    chargeCall(g_running);
+    if (ctx->notifyCount == 0) ctx->notifyAtUs = nowUs();
+    ctx->notifyCount++;
+}
+
+bool park(uint64_t timeoutUs) {
+    Context* ctx = g_running;
+    if (ctx == nullptr || ctx == &g_isrContext) return false;
+    chargeCall(ctx);
+    foldCpuTime(ctx);
+    ctx->parked = true;
+    ctx->unparked = false;
+    ctx->wakeUs = timeoutUs == NEVER ? NEVER : ctx->clockUs + timeoutUs;
+    block(ctx);
+    ctx->parked = false;
+    return ctx->unparked;
+}
+
+void unpark(Context* ctx) {
+    chargeCall(g_running);
+    if (ctx == nullptr || !ctx->parked || ctx->unparked) return;
+    ctx->unparked = true;
+    ctx->unparkAtUs = nowUs();
+}
+
+void schedule(uint64_t atUs, std::function<void()> fn) {
+    g_events.emplace(atUs, std::move(fn));
+}
+
+// Earliest virtual time at which a blocked context can continue
+static uint64_t readyTime(const Context* ctx) {
+    if (ctx->finished) return NEVER;
+    if (ctx->waitingNotify && ctx->notifyCount > 0) {
+        return ctx->notifyAtUs > ctx->clockUs ? ctx->notifyAtUs : ctx->clockUs;
+    }
+    if (ctx->parked && ctx->unparked) {
+        return ctx->unparkAtUs > ctx->clockUs ? ctx->unparkAtUs : ctx->clockUs;
+    }
+    return ctx->wakeUs;
+}
+
+void stopAt(uint64_t untilUs) {
+    g_stopUs = untilUs;
+}
+
+void run(uint64_t untilUs) {
+    g_isrContext.name = "isr";
+    g_stopUs = untilUs;
+    for (;;) {
+        untilUs = g_stopUs;
+        Context* next = nullptr;
+        uint64_t nextUs = NEVER;
+        for (auto& ctx : g_contexts) {
+            uint64_t t = readyTime(ctx.get());
+            if (t < nextUs) {
+                nextUs = t;
+                next = ctx.get();
+            }
+        }
+
+        // Interrupt handlers run before any task due at the same instant
+        if (!g_events.empty() && g_events.begin()->first <= nextUs) {
+            auto event = g_events.begin();
+            if (event->first > untilUs) break;
+            g_isrContext.clockUs = event->first;
+            if (event->first > g_lastUs) g_lastUs = event->first;
+            std::function<void()> fn = std::move(event->second);
+            g_events.erase(event);
+            g_running = &g_isrContext;
+            fn();
+            g_running = nullptr;
+            continue;
+        }
+
+        if (next == nullptr || nextUs > untilUs) break;
+
+        next->clockUs = nextUs;
+        if (nextUs > g_lastUs) g_lastUs = nextUs;
+
+        std::unique_lock<std::mutex> lock(g_mutex);
+        g_running = next;
+        g_yielded = false;
+        next->resume = true;
+        next->cv.notify_one();
+        g_schedulerCv.wait(lock, [] { return g_yielded; });
+        g_running = nullptr;
+        if (next->clockUs > g_lastUs) g_lastUs = next->clockUs;
+    }
+    if (g_stopUs != NEVER && g_stopUs > g_lastUs) g_lastUs = g_stopUs;
+}
+
+} // namespace sim
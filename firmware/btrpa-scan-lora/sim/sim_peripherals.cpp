@@ -0,0 +1,430 @@
+/**
+ * btrpa-scan-lora native stand-ins: NimBLE, RadioLib, U8g2, SPI, Wire
+ */
+
+#include <Arduino.h>
+#include <NimBLEDevice.h>
+#include <RadioLib.h>
+#include <U8g2lib.h>
+#include <Wire.h>
+#include <stdio.h>
+
+#include <algorithm>
+
+#include "sim_env.h"
+
+SPIClass SPI;
+TwoWire Wire;
+
+static uint32_t g_i2cClockHz = 400000;
+
+namespace sim {
+
+std::vector<TxRecord>& txLog() {
+    static std::vector<TxRecord> log;
+    return log;
+}
+
+void setI2cClockHz(uint32_t hz) {
+    g_i2cClockHz = hz;
+}
+
+} // namespace sim
+
+// ============================================================================
+// NimBLE
+// ============================================================================
+
+NimBLEAddress::NimBLEAddress(const uint8_t address[6], uint8_t type) : m_addrType(type) {
+    memcpy(m_address, address, sizeof(m_address));
+}
+
+NimBLEAddress::NimBLEAddress(const uint64_t& address, uint8_t type) : m_addrType(type) {
+    for (int i = 0; i < 6; i++) {
+        m_address[i] = (uint8_t)(address >> (8 * i));
+    }
+}
+
+bool NimBLEAddress::equals(const NimBLEAddress& other) const {
+    return m_addrType == other.m_addrType && memcmp(m_address, other.m_address, 6) == 0;
+}
+
+std::string NimBLEAddress::toString() const {
+    char buffer[18];
+    snprintf(buffer, sizeof(buffer), "%02x:%02x:%02x:%02x:%02x:%02x",
+             m_address[5], m_address[4], m_address[3],
+             m_address[2], m_address[1], m_address[0]);
+    return std::string(buffer);
+}
+
+NimBLEAddress::operator uint64_t() const {
+    uint64_t address = 0;
+    for (int i = 5; i >= 0; i--) {
+        address = (address << 8) | m_address[i];
+    }
+    return address;
+}
+
+void NimBLEAdvertisedDevice::simSet(const NimBLEAddress& address, int rssi, uint8_t advType,
+                                    const uint8_t* payload, size_t payloadLen) {
+    m_address = address;
+    m_rssi = rssi;
+    m_advType = advType;
+    m_timestamp = (time_t)(sim::nowUs() / 1000000);
+    m_payload.assign(payload, payload + payloadLen);
+}
+
+bool NimBLEAdvertisedDevice::haveName() {
+    return !getName().empty();
+}
+
+std::string NimBLEAdvertisedDevice::getName() {
+    size_t i = 0;
+    while (i + 1 < m_payload.size()) {
+        uint8_t len = m_payload[i];
+        if (len == 0 || i + 1 + len > m_payload.size()) break;
+        uint8_t type = m_payload[i + 1];
+        if (type == 0x08 || type == 0x09) {
+            return std::string((const char*)&m_payload[i + 2], len - 1);
+        }
+        i += 1 + len;
+    }
+    return std::string();
+}
+
+void NimBLEScan::setAdvertisedDeviceCallbacks(NimBLEAdvertisedDeviceCallbacks* pAdvertisedDeviceCallbacks,
+                                              bool wantDuplicates) {
+    m_callbacks = pAdvertisedDeviceCallbacks;
+    m_wantDuplicates = wantDuplicates;
+}
+
+bool NimBLEScan::start(uint32_t, void (*)(NimBLEScanResults), bool) {
+    if (m_scanning) return false;
+    m_scanning = true;
+    sim::onScanStart(this);
+    return true;
+}
+
+bool NimBLEScan::deliver(NimBLEAdvertisedDevice* device) {
+    if (!m_scanning || m_callbacks == nullptr) return false;
+
+    // Mirrors NimBLEScan::handleGapEvent(): results are kept in a vector
+    // searched linearly per advert. maxResults 0xFF stores without limit,
+    // 0 stores nothing (so every advert is new), and once a bounded table
+    // is full further new devices are ignored. Stored devices only call
+    // back once unless duplicates are wanted.
+    uint64_t key = (uint64_t)device->getAddress();
+    bool stored = false;
+    for (uint64_t k : m_stored) {
+        if (k == key) {
+            stored = true;
+            break;
+        }
+    }
+    if (!stored && m_maxResults > 0) {
+        if (m_maxResults != 0xFF && m_stored.size() >= m_maxResults) return false;
+        m_stored.push_back(key);
+    } else if (stored && !m_wantDuplicates) {
+        return false;
+    }
+    m_callbacks->onResult(device);
+    return true;
+}
+
+void NimBLEDevice::init(const std::string&) {}
+
+void NimBLEDevice::deinit(bool) {}
+
+NimBLEScan* NimBLEDevice::getScan() {
+    static NimBLEScan scan;
+    return &scan;
+}
+
+// ============================================================================
+// RadioLib SX1262
+// ============================================================================
+
+// SPI command + buffer write at 8 MHz (1 us per byte), plus BUSY handshakes
+static uint64_t spiTransferUs(size_t len) {
+    return 50 + len;
+}
+
+static SX1262* g_radio = nullptr;
+static sim::LoRaRxStats g_loraRxStats;
+
+// Preamble symbols the receiver needs to detect the frame and lock on
+static constexpr uint32_t RX_LOCK_SYMBOLS = 4;
+
+// Demodulation floor (SX1262 datasheet: -7.5 dB at SF7, 2.5 dB lower per SF)
+static float snrFloorDb(uint8_t sf) {
+    return -7.5f - 2.5f * (sf - 7);
+}
+
+sim::LoRaRxStats& sim::loraRxStats() {
+    return g_loraRxStats;
+}
+
+void sim::injectLoRaFrame(uint64_t atUs, const std::vector<uint8_t>& data, float rssi, float snr,
+                          const LoRaModulation& modulation) {
+    g_loraRxStats.offered++;
+    sim::schedule(atUs, [data, rssi, snr, modulation] {
+        if (g_radio == nullptr) {
+            g_loraRxStats.deaf++;
+            return;
+        }
+        g_radio->simOnAir(modulation, data, rssi, snr);
+    });
+}
+
+SX1262::SX1262(Module* mod) : _mod(mod) {
+    g_radio = this;
+}
+
+// Preamble starts now. The frame is received if the radio is (or gets) in
+// RX at its spreading factor before lockByUs and stays there to the end.
+void SX1262::simOnAir(const LoRaModulation& modulation, const std::vector<uint8_t>& data,
+                      float rssi, float snr) {
+    if (snr < snrFloorDb(modulation.spreadingFactor)) {
+        g_loraRxStats.weak++;
+        return;
+    }
+    uint64_t now = sim::nowUs();
+    _air.erase(std::remove_if(_air.begin(), _air.end(),
+                              [now](const AirFrame& f) { return f.endUs <= now; }),
+               _air.end());
+
+    uint32_t symbolUs = loraSymbolTimeUs(modulation);
+    uint32_t lockSymbols = modulation.preambleLength > RX_LOCK_SYMBOLS ?
+                           modulation.preambleLength - RX_LOCK_SYMBOLS : 0;
+    AirFrame frame = {++_airId, now, now + (uint64_t)lockSymbols * symbolUs,
+                      now + loraTimeOnAirUs(modulation, (uint32_t)data.size()),
+                      modulation.spreadingFactor, data, rssi, snr, false};
+    _air.push_back(frame);
+    tryLock(_air.back());
+
+    uint32_t id = frame.id;
+    sim::schedule(frame.lockByUs, [this, id] {
+        for (AirFrame& f : _air) {
+            if (f.id == id && !f.resolved) {
+                f.resolved = true;
+                g_loraRxStats.deaf++;
+            }
+        }
+    });
+}
+
+void SX1262::tryLock(AirFrame& frame) {
+    uint64_t now = sim::nowUs();
+    if (frame.resolved || !_receiving || _transmitting) return;
+    if (frame.spreadingFactor != _modulation.spreadingFactor || now > frame.lockByUs) return;
+    frame.resolved = true;
+    if (now < _rxBusyUntilUs) {
+        g_loraRxStats.collided++;
+        return;
+    }
+    _rxBusyUntilUs = frame.endUs;
+    uint32_t opId = _opId;
+    std::vector<uint8_t> data = frame.data;
+    float rssi = frame.rssi, snr = frame.snr;
+    sim::schedule(frame.endUs, [this, data, rssi, snr, opId] {
+        if (!_receiving || _opId != opId) {
+            g_loraRxStats.aborted++;
+            return;
+        }
+        if (_rxReady) g_loraRxStats.overwritten++;
+        _rxBuffer = data;
+        _rxReady = true;
+        _lastRssi = rssi;
+        _lastSnr = snr;
+        g_loraRxStats.delivered++;
+        if (_dio1Action) _dio1Action();
+    });
+}
+
+// Any mode change ends a reception, CAD or transmission in progress
+void SX1262::enterMode() {
+    ++_opId;
+    _receiving = false;
+    _rxBusyUntilUs = 0;
+}
+
+int16_t SX1262::begin(float freq, float bw, uint8_t sf, uint8_t cr, uint8_t syncWord,
+                      int8_t power, uint16_t preambleLength) {
+    (void)_mod;
+    _freqMHz = freq;
+    _syncWord = syncWord;
+    _powerDbm = power;
+    _modulation.bandwidthHz = (uint32_t)(bw * 1000.0f);
+    _modulation.spreadingFactor = sf;
+    _modulation.codingRate = cr;
+    _modulation.preambleLength = preambleLength;
+    delay(10);
+    return RADIOLIB_ERR_NONE;
+}
+
+int16_t SX1262::setSpreadingFactor(uint8_t sf) {
+    if (sf < 5 || sf > 12) return RADIOLIB_ERR_UNKNOWN;
+    _modulation.spreadingFactor = sf;
+    return RADIOLIB_ERR_NONE;
+}
+
+int16_t SX1262::setBandwidth(float bw) {
+    _modulation.bandwidthHz = (uint32_t)(bw * 1000.0f);
+    return RADIOLIB_ERR_NONE;
+}
+
+int16_t SX1262::setCodingRate(uint8_t cr) {
+    if (cr < 5 || cr > 8) return RADIOLIB_ERR_UNKNOWN;
+    _modulation.codingRate = cr;
+    return RADIOLIB_ERR_NONE;
+}
+
+int16_t SX1262::setPreambleLength(uint16_t preambleLength) {
+    _modulation.preambleLength = preambleLength;
+    return RADIOLIB_ERR_NONE;
+}
+
+int16_t SX1262::transmit(uint8_t* data, size_t len, uint8_t) {
+    if (len > RADIOLIB_SX126X_MAX_PACKET_LENGTH) return RADIOLIB_ERR_PACKET_TOO_LONG;
+    enterMode();
+    sim::consume(spiTransferUs(len));
+
+    uint64_t start = sim::nowUs();
+    uint32_t airtime = getTimeOnAir(len);
+    sim::txLog().push_back({start, start + airtime, std::vector<uint8_t>(data, data + len),
+                            _modulation, _powerDbm});
+
+    // RadioLib polls DIO1 until TX_DONE, so the caller is blocked on air
+    sim::consume(airtime);
+    return RADIOLIB_ERR_NONE;
+}
+
+int16_t SX1262::startTransmit(uint8_t* data, size_t len, uint8_t) {
+    if (len > RADIOLIB_SX126X_MAX_PACKET_LENGTH) return RADIOLIB_ERR_PACKET_TOO_LONG;
+    enterMode();
+    sim::consume(spiTransferUs(len));
+
+    uint64_t start = sim::nowUs();
+    uint32_t airtime = getTimeOnAir(len);
+    sim::txLog().push_back({start, start + airtime, std::vector<uint8_t>(data, data + len),
+                            _modulation, _powerDbm});
+
+    _transmitting = true;
+    uint32_t opId = _opId;
+    sim::schedule(start + airtime, [this, opId] {
+        if (_transmitting && _opId == opId && _dio1Action) _dio1Action();
+    });
+    return RADIOLIB_ERR_NONE;
+}
+
+int16_t SX1262::finishTransmit() {
+    sim::consume(spiTransferUs(0));
+    _transmitting = false;
+    return RADIOLIB_ERR_NONE;
+}
+
+int16_t SX1262::startReceive() {
+    sim::consume(spiTransferUs(0));
+    enterMode();
+    _receiving = true;
+
+    // Lock on to a frame whose preamble is already on air
+    for (AirFrame& frame : _air) tryLock(frame);
+    return RADIOLIB_ERR_NONE;
+}
+
+int16_t SX1262::standby() {
+    enterMode();
+    return RADIOLIB_ERR_NONE;
+}
+
+// CAD listens for two symbols and decides about half a symbol later
+int16_t SX1262::startChannelScan() {
+    sim::consume(spiTransferUs(0));
+    enterMode();
+    uint32_t symbolUs = loraSymbolTimeUs(_modulation);
+    uint64_t start = sim::nowUs();
+    uint64_t listenEnd = start + 2 * symbolUs;
+    uint8_t sf = _modulation.spreadingFactor;
+    uint32_t opId = _opId;
+    sim::schedule(listenEnd + symbolUs / 2, [this, opId, start, listenEnd, sf] {
+        if (_opId != opId) return;
+        _cadDetected = false;
+        for (const AirFrame& frame : _air) {
+            if (frame.spreadingFactor == sf && frame.startUs <= start && frame.endUs >= listenEnd) {
+                _cadDetected = true;
+            }
+        }
+        if (_dio1Action) _dio1Action();
+    });
+    return RADIOLIB_ERR_NONE;
+}
+
+int16_t SX1262::available() {
+    return _rxReady ? 1 : 0;
+}
+
+int16_t SX1262::readData(uint8_t* data, size_t len) {
+    if (!_rxReady) return RADIOLIB_ERR_RX_TIMEOUT;
+    size_t n = len == 0 || len > _rxBuffer.size() ? _rxBuffer.size() : len;
+    sim::consume(spiTransferUs(n));
+    memcpy(data, _rxBuffer.data(), n);
+    _rxReady = false;
+    return RADIOLIB_ERR_NONE;
+}
+
+size_t SX1262::getPacketLength(bool) {
+    return _rxReady ? _rxBuffer.size() : 0;
+}
+
+// ============================================================================
+// U8g2
+// ============================================================================
+
+static const u8g2_cb_t g_rotation0 = {};
+const u8g2_cb_t* U8G2_R0 = &g_rotation0;
+
+// Ascent of 'A' and descent of 'g' (negative), as U8g2 reports them
+const uint8_t u8g2_font_ncenB08_tr[2] = {8, (uint8_t)-2};
+const uint8_t u8g2_font_ncenB10_tr[2] = {10, (uint8_t)-3};
+const uint8_t u8g2_font_ncenB14_tr[2] = {14, (uint8_t)-4};
+
+void U8G2::clearBuffer() {
+    memset(_buffer, 0, sizeof(_buffer));
+}
+
+// The buffer is 8 pages of 128 columns, one byte per 8-pixel column
+void U8G2::drawBox(u8g2_uint_t x, u8g2_uint_t y, u8g2_uint_t w, u8g2_uint_t h) {
+    for (unsigned page = y / 8; page < 8 && page * 8 < (unsigned)y + h; page++) {
+        for (unsigned col = x; col < 128 && col < (unsigned)x + w; col++) {
+            _buffer[page * 128 + col] = _color ? 0xFF : 0x00;
+        }
+    }
+}
+
+u8g2_uint_t U8G2::drawStr(u8g2_uint_t x, u8g2_uint_t y, const char* s) {
+    (void)y;
+    size_t len = strlen(s);
+    for (size_t i = 0; i < len && x + i < sizeof(_buffer); i++) {
+        _buffer[x + i] ^= (uint8_t)s[i];
+    }
+    return (u8g2_uint_t)(len * 6);
+}
+
+void U8G2::sendBuffer() {
+    // 8 pages x (128 data bytes + 4 chunks of address/control bytes +
+    // page addressing commands), 9 clocks per byte
+    const uint64_t bytes = 8 * (128 + 4 * 2 + 6);
+    sim::consume(bytes * 9 * 1000000ULL / g_i2cClockHz);
+    _framesSent++;
+    _tileRowsSent += 8;
+}
+
+void U8G2::updateDisplayArea(uint8_t tx, uint8_t ty, uint8_t tw, uint8_t th) {
+    (void)tx; (void)ty;
+    // Per page: the tiles' columns plus address/control bytes and commands
+    const uint64_t bytes = th * (tw * 8 + 4 * 2 + 6);
+    sim::consume(bytes * 9 * 1000000ULL / g_i2cClockHz);
+    _framesSent++;
+    _tileRowsSent += th;
+}
@@ -10,9 +10,39 @@
 
 #include <Arduino.h>
 #include <NimBLEDevice.h>
-#include <TinyGPSPlus.h>
 #include <RadioLib.h>
+#include <esp_heap_caps.h>
+#include <esp_sleep.h>
+#include <esp_partition.h>
+#include <nvs_flash.h>
+#include <driver/gpio.h>
 #include "config.h"
+#include "config_defaults.h"
+#include "mesh_protocol.h"
+#include "mac_table.h"
+#include "prefix_index.h"
+#include "irk_resolver.h"
+#include "adv_matcher.h"
+#include "spsc_ring.h"
+#include "lora_tx_queue.h"
+#include "device_cache.h"
+#include "detection_batch.h"
+#include "mesh_relay.h"
+#include "wire_format.h"
+#include "link_quality.h"
+#include "lora_rate.h"
+#include "channel_access.h"
+#include "alloc_counter.h"
+#include "scan_scheduler.h"
+#include "task_monitor.h"
+#include "display_model.h"
+#include "flash_journal.h"
+#include "mesh_ack.h"
+#include "target_filter.h"
+#include "gps_receiver.h"
+#include "position_beacon.h"
+#include "serial_frame.h"
+#include "target_fusion.h"
 
 // Heltec V3 Display Support - Using U8g2
 #if defined(HELTEC_V3)
@@ -22,12 +52,99 @@
     // Heltec V3: SSD1306 128X64 OLED
     // I2C pins: SDA=17, SCL=18, RST=21
     U8G2_SSD1306_128X64_NONAME_F_HW_I2C u8g2(U8G2_R0, /* reset=*/ 21);
-
-    // Display lock to prevent scanning screen from overwriting alerts
-    volatile bool displayLocked = false;
-    unsigned long displayLockUntil = 0;
 #endif
 
+// Guards the display mailbox: alerts from the detection task and
+// meshRxTask for the display task, which alone drives the OLED
+SemaphoreHandle_t displayMutex = nullptr;
+
+// ============================================================================
+// HUMAN LOG
+// ============================================================================
+
+// All text goes out through `logger`, binary frames straight to Serial. A
+// homebase built with GATEWAY_SERIAL_FRAMES and GATEWAY_HUMAN_LOG false
+// keeps the text off the port, except for CONSOLE_REPLY_MS after each
+// console line so commands (and target_filter.py) still get their replies.
+constexpr uint32_t CONSOLE_REPLY_MS = 30000;
+static volatile uint32_t consoleLineMs = 0;     // 0: no console line yet
+
+class HumanLog : public Print {
+public:
+    size_t write(const uint8_t* buffer, size_t size) override {
+        if (!enabled()) return size;
+        return Serial.write(buffer, size);
+    }
+    size_t write(uint8_t c) override { return write(&c, 1); }
+
+private:
+    static bool enabled() {
+        if (!(MESH_GATEWAY && GATEWAY_SERIAL_FRAMES) || GATEWAY_HUMAN_LOG) return true;
+        uint32_t since = consoleLineMs;
+        return since != 0 && millis() - since < CONSOLE_REPLY_MS;
+    }
+};
+
+static HumanLog logger;
+
+// ============================================================================
+// TASKS
+// ============================================================================
+
+// Every task blocks until an interrupt, a UART event, another task or a
+// timeout wakes it; none of them polls. The statistics report shows the
+// load of each.
+enum FirmwareTask : uint8_t {
+    TASK_LOOP,          // Arduino loop: scan profile, power, console
+    TASK_DETECTION,
+    TASK_LORA_RADIO,
+    TASK_MESH_RX,
+    TASK_GPS,
+    TASK_DISPLAY,
+    TASK_JOURNAL,
+    TASK_TELEMETRY,
+    TASK_ALERT_LOG,
+    TASK_COUNT
+};
+
+TaskLoad taskLoads[TASK_COUNT] = {
+    {"loop", 8192, 1, 1},       // Arduino's loopTask
+    {"detect", DETECTION_TASK_STACK, DETECTION_TASK_PRIORITY, DETECTION_TASK_CORE},
+    {"lora", LORA_RADIO_TASK_STACK, LORA_RADIO_TASK_PRIORITY, DETECTION_TASK_CORE},
+    {"mesh_rx", LORA_RX_TASK_STACK, LORA_RX_TASK_PRIORITY, DETECTION_TASK_CORE},
+    {"gps", GPS_TASK_STACK, GPS_TASK_PRIORITY, BACKGROUND_TASK_CORE},
+    {"display", DISPLAY_TASK_STACK, DISPLAY_TASK_PRIORITY, BACKGROUND_TASK_CORE},
+    {"journal", JOURNAL_TASK_STACK, JOURNAL_TASK_PRIORITY, BACKGROUND_TASK_CORE},
+    {"telemetry", TELEMETRY_TASK_STACK, TELEMETRY_TASK_PRIORITY, BACKGROUND_TASK_CORE},
+    {"alert_log", ALERT_LOG_TASK_STACK, ALERT_LOG_TASK_PRIORITY, BACKGROUND_TASK_CORE},
+};
+
+// The Arduino loop task, woken by hits, scan commands and console input
+TaskHandle_t mainLoopTaskHandle = nullptr;
+
+// The handle is stored before the task first runs, so the task (and the
+// interrupts that notify it) can rely on it
+static void startTask(FirmwareTask task, TaskFunction_t body, TaskHandle_t* handle) {
+    TaskLoad& load = taskLoads[task];
+    load.started(micros());
+    xTaskCreatePinnedToCore(body, load.name, load.stackBytes, nullptr, load.priority, handle, load.core);
+    load.handle = *handle;
+}
+
+// Where a task blocks for its next event: a notification, or the timeout.
+// The time since it last woke is booked as its work.
+static uint32_t waitForEvent(FirmwareTask task, TickType_t timeout) {
+    TaskLoad& load = taskLoads[task];
+    load.blocking(micros());
+    uint32_t events = ulTaskNotifyTake(pdTRUE, timeout);
+    load.woke(micros());
+    return events;
+}
+
+static TickType_t ticksFor(uint32_t ms) {
+    return ms == UINT32_MAX ? portMAX_DELAY : pdMS_TO_TICKS(ms) + 1;
+}
+
 // ============================================================================
 // DISPLAY FUNCTIONS
 // ============================================================================
@@ -38,25 +155,27 @@ void initDisplay() {
     pinMode(36, OUTPUT);
     digitalWrite(36, LOW);  // LOW = power ON for Vext
     delay(100);
-    Serial.println("Display: Vext power enabled");
+    logger.println("Display: Vext power enabled");
 
     // Initialize I2C with Heltec V3 pins: SDA=17, SCL=18
     Wire.begin(17, 18);
     delay(100);
 
-    Serial.println("Display: Initializing OLED...");
+    logger.println("Display: Initializing OLED...");
     u8g2.begin();
-    Serial.println("Display: OLED initialized");
+    logger.println("Display: OLED initialized");
 
     u8g2.clearBuffer();
     u8g2.setFont(u8g2_font_ncenB08_tr);
     u8g2.drawStr(0, 10, "btrpa-scan-lora");
     u8g2.drawStr(0, 25, "Initializing...");
     u8g2.sendBuffer();
-    Serial.println("Display: Startup screen displayed");
+    logger.println("Display: Startup screen displayed");
     #endif
 }
 
+// Draws straight to the panel: only for setup(), before the display task
+// takes the OLED over
 void displayStatus(const char* line1, const char* line2 = "", const char* line3 = "", const char* line4 = "") {
     #if defined(HELTEC_V3)
     u8g2.clearBuffer();
@@ -69,104 +188,149 @@ void displayStatus(const char* line1, const char* line2 = "", const char* line3
     #endif
 }
 
-void displayTrueHit(const char* mac, int rssi) {
-    #if defined(HELTEC_V3)
-    u8g2.clearBuffer();
-
-    // Large alert text
-    u8g2.setFont(u8g2_font_ncenB14_tr);
-    u8g2.drawStr(5, 18, "TRUE HIT!");
+// How long an alert stays up, the scanning animation's frame period, and
+// the shortest gap between frames: alerts arriving within it share a frame
+static constexpr uint16_t TRUE_HIT_HOLD_MS = 3000;
+static constexpr uint16_t POSSIBLE_HIT_HOLD_MS = 2000;
+static constexpr uint32_t DISPLAY_FRAME_MS = 500;
+static constexpr uint32_t DISPLAY_MIN_FRAME_MS = 100;
 
-    // MAC and RSSI
-    u8g2.setFont(u8g2_font_ncenB08_tr);
-    char buffer[32];
-    snprintf(buffer, sizeof(buffer), "%s", mac);
-    u8g2.drawStr(0, 35, buffer);
-    snprintf(buffer, sizeof(buffer), "RSSI: %d dBm", rssi);
-    u8g2.drawStr(0, 48, buffer);
-    snprintf(buffer, sizeof(buffer), "Time: %lus", millis() / 1000);
-    u8g2.drawStr(0, 61, buffer);
+DisplayMailbox displayMailbox;
+TaskHandle_t displayTaskHandle = nullptr;
 
-    u8g2.sendBuffer();
+// Off in the conservation profile; set by the main loop
+volatile bool displayPowered = true;
 
-    // Lock display for 3 seconds using timer (non-blocking)
-    displayLocked = true;
-    displayLockUntil = millis() + 3000;
+// Hand an alert to the display task and return: no drawing, no I2C
+static void postDisplayAlert(DisplayAlertKind kind, const char* mac, int rssi, const char* detail) {
+    #if defined(HELTEC_V3)
+    DisplayAlert alert = {};
+    alert.kind = kind;
+    alert.rssi = (int16_t)rssi;
+    alert.atMs = millis();
+    strncpy(alert.mac, mac, sizeof(alert.mac) - 1);
+    strncpy(alert.detail, detail, sizeof(alert.detail) - 1);
+    xSemaphoreTake(displayMutex, portMAX_DELAY);
+    displayMailbox.post(alert);
+    xSemaphoreGive(displayMutex);
+    if (displayTaskHandle) xTaskNotifyGive(displayTaskHandle);
     #endif
 }
 
-void displayPossibleHit(const char* mac, int rssi, const char* deviceType) {
-    #if defined(HELTEC_V3)
-    u8g2.clearBuffer();
-
-    // Alert text
-    u8g2.setFont(u8g2_font_ncenB10_tr);
-    u8g2.drawStr(0, 14, "POSSIBLE HIT");
-
-    // Device info
-    u8g2.setFont(u8g2_font_ncenB08_tr);
-    u8g2.drawStr(0, 28, deviceType);
-    char buffer[32];
-    snprintf(buffer, sizeof(buffer), "%s", mac);
-    u8g2.drawStr(0, 42, buffer);
-    snprintf(buffer, sizeof(buffer), "RSSI: %d dBm", rssi);
-    u8g2.drawStr(0, 56, buffer);
+void displayTrueHit(const char* mac, int rssi) {
+    postDisplayAlert(DISPLAY_ALERT_TRUE_HIT, mac, rssi, "");
+}
 
-    u8g2.sendBuffer();
+void displayPossibleHit(const char* mac, int rssi, const char* deviceType) {
+    postDisplayAlert(DISPLAY_ALERT_POSSIBLE_HIT, mac, rssi, deviceType);
+}
 
-    // Lock display for 2 seconds using timer (non-blocking)
-    displayLocked = true;
-    displayLockUntil = millis() + 2000;
-    #endif
+#if defined(HELTEC_V3)
+// Owned by the display task
+static TileRenderer<U8G2> displayRenderer(u8g2);
+static AlertView alertView(TRUE_HIT_HOLD_MS, POSSIBLE_HIT_HOLD_MS);
+static uint64_t displayI2cUs = 0;
+static uint32_t displayI2cMaxUs = 0;
+
+static void addLine(DisplayScreen& screen, const uint8_t* font, uint8_t x, uint8_t y, const char* format, ...)
+    __attribute__((format(printf, 5, 6)));
+
+static void addLine(DisplayScreen& screen, const uint8_t* font, uint8_t x, uint8_t y, const char* format, ...) {
+    DisplayLine& line = screen.add(font, x, y);
+    va_list args;
+    va_start(args, format);
+    vsnprintf(line.text, sizeof(line.text), format, args);
+    va_end(args);
 }
 
-void displayScanning() {
-    #if defined(HELTEC_V3)
-    // Check if lock timer expired
-    if (displayLocked && millis() >= displayLockUntil) {
-        displayLocked = false;
+// Same layouts as before the display task; alerts merged into the one on
+// screen are counted on its last line
+static void buildAlertScreen(DisplayScreen& screen, const DisplayAlert& alert, uint32_t more) {
+    char extra[12] = "";
+    if (more > 0) snprintf(extra, sizeof(extra), "  +%lu", (unsigned long)(more > 999 ? 999 : more));
+    if (alert.kind == DISPLAY_ALERT_TRUE_HIT) {
+        addLine(screen, u8g2_font_ncenB14_tr, 5, 18, "TRUE HIT!");
+        addLine(screen, u8g2_font_ncenB08_tr, 0, 35, "%s", alert.mac);
+        addLine(screen, u8g2_font_ncenB08_tr, 0, 48, "RSSI: %d dBm", alert.rssi);
+        addLine(screen, u8g2_font_ncenB08_tr, 0, 61, "Time: %lus%s", (unsigned long)(alert.atMs / 1000), extra);
+    } else {
+        addLine(screen, u8g2_font_ncenB10_tr, 0, 14, "POSSIBLE HIT");
+        addLine(screen, u8g2_font_ncenB08_tr, 0, 28, "%s", alert.detail);
+        addLine(screen, u8g2_font_ncenB08_tr, 0, 42, "%s", alert.mac);
+        addLine(screen, u8g2_font_ncenB08_tr, 0, 56, "RSSI: %d dBm%s", alert.rssi, extra);
     }
+}
 
-    // Don't update if display is still locked (showing alert)
-    if (displayLocked) return;
-
-    static unsigned long lastUpdate = 0;
-    static int dotCount = 0;
-
-    // Update display every 500ms
-    if (millis() - lastUpdate > 500) {
-        lastUpdate = millis();
-
-        extern uint32_t totalScans;
-        extern uint32_t trueHits;
-        extern uint32_t possibleHits;
+static void buildScanningScreen(DisplayScreen& screen, uint8_t dots) {
+    extern uint32_t totalScans;
+    extern uint32_t trueHits;
+    extern uint32_t possibleHits;
 
-        u8g2.clearBuffer();
-        u8g2.setFont(u8g2_font_ncenB10_tr);
-        u8g2.drawStr(20, 16, "SCANNING");
+    addLine(screen, u8g2_font_ncenB10_tr, 20, 16, "SCANNING");
+    addLine(screen, u8g2_font_ncenB10_tr, 50, 32, "%.*s", dots, "...");
+    addLine(screen, u8g2_font_ncenB08_tr, 0, 50, "Scans: %u", totalScans);
+    addLine(screen, u8g2_font_ncenB08_tr, 0, 62, "Hits: %u/%u", trueHits, possibleHits);
+}
 
-        // Animated dots
-        char dots[5] = "";
-        for (int i = 0; i < dotCount; i++) {
-            dots[i] = '.';
+// Owns the OLED once setup() is done, below detection and the radio.
+// Woken by a posted alert, the end of an alert's hold, the next scanning
+// frame or a profile change; sends only the tile rows that changed. With
+// the display off (conservation) it sleeps until woken.
+void displayTask(void* param) {
+    bool panelOn = true;
+    uint8_t dots = 0;
+    uint32_t lastFrameMs = millis() - DISPLAY_MIN_FRAME_MS;
+    uint32_t nextScanMs = millis() + DISPLAY_FRAME_MS;
+    uint32_t waitMs = DISPLAY_FRAME_MS;
+    for (;;) {
+        waitForEvent(TASK_DISPLAY, ticksFor(waitMs));
+        uint32_t now = millis();
+
+        if (panelOn != displayPowered) {
+            panelOn = displayPowered;
+            u8g2.setPowerSave(panelOn ? 0 : 1);
+        }
+        if (!panelOn) {
+            waitMs = UINT32_MAX;
+            continue;
+        }
+        // Alerts posted meanwhile stay in the mailbox and merge
+        if (now - lastFrameMs < DISPLAY_MIN_FRAME_MS) {
+            waitMs = DISPLAY_MIN_FRAME_MS - (now - lastFrameMs);
+            continue;
         }
-        dots[dotCount] = '\0';
-        u8g2.drawStr(50, 32, dots);
-
-        dotCount = (dotCount + 1) % 4;
 
-        // Stats
-        u8g2.setFont(u8g2_font_ncenB08_tr);
-        char buffer[32];
-        snprintf(buffer, sizeof(buffer), "Scans: %u", totalScans);
-        u8g2.drawStr(0, 50, buffer);
-        snprintf(buffer, sizeof(buffer), "Hits: %u/%u", trueHits, possibleHits);
-        u8g2.drawStr(0, 62, buffer);
+        DisplayAlert alert;
+        uint32_t merged;
+        xSemaphoreTake(displayMutex, portMAX_DELAY);
+        bool posted = displayMailbox.take(alert, merged);
+        xSemaphoreGive(displayMutex);
+        if (posted) alertView.offer(alert, merged, now);
+
+        DisplayScreen screen = {};
+        if (alertView.showing(now)) {
+            buildAlertScreen(screen, alertView.shown(), alertView.more());
+            waitMs = alertView.msLeft(now);
+        } else {
+            if ((int32_t)(now - nextScanMs) >= 0) {
+                dots = (dots + 1) % 4;
+                nextScanMs = now + DISPLAY_FRAME_MS;
+            }
+            buildScanningScreen(screen, dots);
+            waitMs = nextScanMs - now;
+        }
 
-        u8g2.sendBuffer();
+        uint8_t dirty = displayRenderer.prepare(screen);
+        if (dirty == 0) continue;
+        uint32_t start = micros();
+        displayRenderer.flush(dirty);
+        uint32_t i2cUs = micros() - start;
+        displayI2cUs += i2cUs;
+        if (i2cUs > displayI2cMaxUs) displayI2cMaxUs = i2cUs;
+        lastFrameMs = now;
     }
-    #endif
 }
+#endif
 
 // ============================================================================
 // LORA MESH COMMUNICATION
@@ -194,474 +358,3242 @@ void displayScanning() {
 // Create LoRa radio instance
 SX1262 radio = new Module(LORA_NSS, LORA_DIO1, LORA_RST, LORA_BUSY);
 
-// LoRa message types
-enum MessageType {
-    MSG_TRUE_HIT = 1,      // Critical: Exact MAC match detected
-    MSG_POSSIBLE_HIT = 2,  // Lower priority: Medical device prefix
-    MSG_POSITION = 3,      // Position beacon (movement-based)
-    MSG_STATUS = 4         // Node status update
+bool loraInitialized = false;
+
+// Sequence of our next frame, from a random start at boot (initLoRa());
+// taken under loraTxQueueMutex
+static uint8_t loraSequence = 0;
+
+// Short node index carried in every frame instead of the NODE_ID string
+#ifdef NODE_INDEX
+static constexpr uint8_t LOCAL_NODE_INDEX = NODE_INDEX;
+#else
+static constexpr uint8_t LOCAL_NODE_INDEX = nodeIndexFromId(NODE_ID_CONFIG);
+#endif
+static_assert(LOCAL_NODE_INDEX >= 1 && LOCAL_NODE_INDEX <= 254,
+              "NODE_ID_CONFIG must end in a number 1-254, or define NODE_INDEX in config.h");
+
+// After setup only loraRadioTask() talks to the SX1262, so the radio
+// itself needs no lock.
+
+// Spreading factors this node sends at and scans for (see lora_rate.h)
+static constexpr uint8_t LORA_SF_LIST[] = LORA_SPREADING_FACTORS;
+static constexpr auto LORA_RATES = makeLoRaRateSet(LORA_SF_LIST);
+static_assert(LORA_RATES.valid(), "LORA_SPREADING_FACTORS must be ascending, within SF7-SF12");
+static_assert(LORA_MAX_POWER_BACKOFF_DB / WIRE_POWER_STEP_DB <= WIRE_MAX_POWER_STEPS,
+              "LORA_MAX_POWER_BACKOFF_DB must be 0-30");
+
+// Neighbour links, updated by meshRxTask(), and the rate policy that
+// loraRadioTask() consults per frame; loraRateMutex guards both
+LinkTable<LORA_LINK_TABLE_SIZE> loraLinks(LORA_LINK_MAX_AGE_MS);
+LoRaRatePolicy<LORA_RATES.size()> loraRatePolicy(LORA_RATES, {
+    LORA_POSSIBLE_HIT_MARGIN_DB * 4,
+    LORA_ROUTINE_MARGIN_DB * 4,
+    LORA_MAX_POWER_BACKOFF_DB / WIRE_POWER_STEP_DB,
+    LORA_RATE_FALLBACK_FAILURES,
+    LORA_RATE_FALLBACK_MS,
+    // A relay repeats within its longest delay plus a robust-rate frame
+    MESH_RELAY_MIN_DELAY_MS + MESH_RELAY_DELAY_SPREAD_MS + MESH_RELAY_JITTER_MS + 3000,
+    LORA_LINK_MAX_AGE_MS,
+});
+SemaphoreHandle_t loraRateMutex = nullptr;
+
+// Regional duty-cycle limit: LORA_DUTY_CYCLE_PERMILLE, or the band
+// LORA_FREQUENCY falls in
+static constexpr int LORA_DUTY_CYCLE_BAND = dutyCycleBandIndex(LORA_FREQUENCY * 1000UL);
+static constexpr uint16_t LORA_DUTY_CYCLE_LIMIT =
+    LORA_DUTY_CYCLE_PERMILLE >= 0 ? LORA_DUTY_CYCLE_PERMILLE :
+    LORA_DUTY_CYCLE_BAND >= 0 ? DUTY_CYCLE_BANDS[LORA_DUTY_CYCLE_BAND].permille : 0;
+static_assert(LORA_DUTY_ROUTINE_PERCENT <= LORA_DUTY_POSSIBLE_HIT_PERCENT &&
+              LORA_DUTY_POSSIBLE_HIT_PERCENT <= 100,
+              "LORA_DUTY_*_PERCENT must rise with priority, up to 100");
+
+// Channel access, owned by loraRadioTask(): airtime over the last hour
+// and CAD backoff before each frame
+DutyCycleLedger<60> loraDutyCycle(3600000UL, LORA_DUTY_CYCLE_LIMIT);
+ListenBeforeTalk loraLbt(LORA_LBT_BACKOFF_MS, LORA_LBT_MAX_BACKOFFS);
+uint32_t loraDutyDeferred[TX_CLASS_COUNT] = {};
+
+// Airtime our POSSIBLE HIT batches saved against one frame per record, at
+// the rate each batch went out; owned by loraRadioTask()
+static uint64_t batchAirtimeSavedUs = 0;
+
+// Outgoing frames, filled by the detection task and main loop and drained
+// by loraRadioTask() in priority order
+LoRaTxQueue<LORA_TX_QUEUE_DEPTH, WIRE_MAX_FRAME> loraTxQueue;
+SemaphoreHandle_t loraTxQueueMutex = nullptr;
+TaskHandle_t loraRadioTaskHandle = nullptr;
+
+// One received frame, as read out of the SX1262 FIFO
+struct LoRaRxFrame {
+    uint32_t arrivalUs;     // micros() at the RX_DONE interrupt
+    int16_t rssi;           // dBm
+    int8_t snrQ2;           // SNR in 0.25 dB steps, as the SX126x reports it
+    uint8_t sf;             // spreading factor it arrived at
+    uint8_t length;
+    uint8_t data[RADIOLIB_SX126X_MAX_PACKET_LENGTH];
 };
 
-// Mesh message structure (max 255 bytes for LoRa)
-struct MeshMessage {
-    uint8_t type;           // MessageType
-    char nodeId[17];        // Node ID (max 16 chars + null)
-    char mac[18];           // MAC address (xx:xx:xx:xx:xx:xx + null)
-    int16_t rssi;           // RSSI in dBm
-    float lat;              // Latitude
-    float lon;              // Longitude
-    uint32_t timestamp;     // Milliseconds since boot
-    char deviceType[32];    // For POSSIBLE_HIT messages
+// Received frames, filled by loraRadioTask() and drained by meshRxTask()
+SpscRing<LoRaRxFrame, LORA_RX_QUEUE_DEPTH> loraRxQueue;
+TaskHandle_t meshRxTaskHandle = nullptr;
+
+// Scan profile commands for this node, filled by meshRxTask() and applied
+// by the main loop
+SpscRing<ScanCommand, 4> scanCommandQueue;
+
+// Receive counters (each written by one task only)
+uint32_t loraRxFrames = 0;          // valid frames handled
+uint32_t loraRxCrcErrors = 0;       // RX_DONE with a payload CRC error
+uint32_t loraRxBadLength = 0;       // zero or oversized length from the chip
+uint32_t loraRxMalformed = 0;       // failed wireDecode()
+
+// Homebase only: binary copies of the frames it accepts, of its own hits
+// and of its fused locations, for the host (serial_frame.h). Counted per
+// source, each written by one task: mesh frames and fused locations by
+// meshRxTask(), local ones by alertLogTask().
+constexpr bool SERIAL_FRAMES = MESH_GATEWAY && GATEWAY_SERIAL_FRAMES;
+uint32_t serialFrames[SERIAL_SOURCE_COUNT] = {};
+uint32_t serialFrameBytes[SERIAL_SOURCE_COUNT] = {};
+
+static void writeSerialFrame(const SerialFrameInfo& info, const uint8_t* wire, size_t length) {
+    uint8_t out[SERIAL_FRAME_MAX_BYTES];
+    size_t encoded = serialFrameEncode(info, wire, length, out, sizeof(out));
+    if (encoded == 0) return;
+    // One write, which the UART driver keeps whole among other tasks' log lines
+    Serial.write(out, encoded);
+    serialFrames[info.source]++;
+    serialFrameBytes[info.source] += encoded;
+}
+
+// Seen frames and pending rebroadcasts, owned by meshRxTask()
+static_assert(MESH_HOP_LIMIT <= WIRE_MAX_HOPS, "MESH_HOP_LIMIT must be 0-7");
+typedef MeshRelay<MESH_SEEN_CACHE_SIZE, MESH_RELAY_PENDING, WIRE_MAX_FRAME> MeshRelayTable;
+MeshRelayTable meshRelay(LOCAL_NODE_INDEX, MESH_SEEN_WINDOW_MS, MESH_RELAY_DUPLICATE_LIMIT);
+
+// Homebase only: acks collecting for field nodes, owned by meshRxTask()
+MeshAckTable<8> meshAcks(MESH_ACK_DELAY_MS);
+
+// What the SX1262 is doing, and so what a DIO1 interrupt means
+enum RadioMode : uint8_t {
+    RADIO_LISTEN,       // continuous RX at the only spreading factor: RX_DONE
+    RADIO_SCAN,         // CAD at one spreading factor of the set: CAD_DONE
+    RADIO_RECEIVE,      // RX where CAD found a preamble: RX_DONE
+    RADIO_TRANSMIT,     // TX_DONE
 };
 
-bool loraInitialized = false;
+// Radio state, owned by loraRadioTask()
+static RadioMode radioMode = RADIO_LISTEN;
+static uint8_t radioSf = 0;             // spreading factor currently set
+static size_t scanIndex = 0;            // position in LORA_RATES during a scan
+static LoRaTxRate txRate;               // settings of the frame on air
+static int txDeferredClass = -1;        // class held back by the duty cycle
+static bool txExpectRepeat = false;     // our own frame, relays should repeat it
+static uint8_t txSequence = 0;
+
+// Set by the main loop between scan windows: listen continuously at the
+// robust rate instead of cycling CAD through the rate set
+volatile bool radioRobustOnly = false;
+
+// Set when DIO1 fires; cleared by the task when it handles the event
+volatile bool radioIrqPending = false;
+volatile uint32_t radioIrqAtUs = 0;
+
+void IRAM_ATTR onRadioDio1() {
+    BaseType_t higherPriorityTaskWoken = pdFALSE;
+    radioIrqAtUs = micros();
+    radioIrqPending = true;
+    vTaskNotifyGiveFromISR(loraRadioTaskHandle, &higherPriorityTaskWoken);
+    if (higherPriorityTaskWoken) portYIELD_FROM_ISR();
+}
 
 void initLoRa() {
-    Serial.println("Initializing LoRa...");
+    logger.println("Initializing LoRa...");
 
     // Initialize SPI for LoRa with custom pins
     SPI.begin(LORA_SCK, LORA_MISO, LORA_MOSI, LORA_NSS);
 
     // Initialize SX1262 with frequency from config
-    Serial.printf("LoRa: Configuring SX1262 at %d MHz\n", LORA_FREQUENCY);
+    logger.printf("LoRa: Configuring SX1262 at %d MHz\n", LORA_FREQUENCY);
     int state = radio.begin(LORA_FREQUENCY);
 
     if (state == RADIOLIB_ERR_NONE) {
-        Serial.println("LoRa: SX1262 initialized successfully");
+        logger.println("LoRa: SX1262 initialized successfully");
     } else {
-        Serial.printf("LoRa: Init failed, code %d\n", state);
+        logger.printf("LoRa: Init failed, code %d\n", state);
         return;
     }
 
-    // Set LoRa parameters for long range
-    radio.setSpreadingFactor(10);        // SF10 for good range
-    radio.setBandwidth(125.0);           // 125 kHz
+    // Start at the robust rate; frames to close neighbours may go faster
+    radio.setSpreadingFactor(LORA_RATES.robust());
+    radio.setBandwidth(LORA_DEFAULT_MODULATION.bandwidthHz / 1000.0);
     radio.setCodingRate(8);              // CR 4/8 for error correction
     radio.setOutputPower(LORA_TX_POWER); // TX power from config
-    radio.setPreambleLength(16);
+    radio.setPreambleLength(LORA_RATES.preamble(LORA_RATES.robust()));
+    radioSf = LORA_RATES.robust();
 
     // Set sync word for private network
     radio.setSyncWord(0x12);
 
-    // Start in receive mode
-    radio.startReceive();
+    // TX, RX and CAD completion are signalled on DIO1
+    radio.setDio1Action(onRadioDio1);
+
+    // Neighbours and the homebase remember (node, sequence) for
+    // MESH_SEEN_WINDOW_MS: counting from 0 again after a reset would reuse
+    // numbers they heard just before it, and drop our first frames (boot
+    // status, beacons, hits) as duplicates
+    loraSequence = (uint8_t)esp_random();
 
+    // loraRadioTask() starts receiving (or scanning the rate set)
     loraInitialized = true;
-    Serial.println("LoRa: Mesh ready");
+    logger.println("LoRa: Mesh ready");
 }
 
-void sendLoRaMessage(const MeshMessage& msg) {
-    if (!loraInitialized) return;
-
-    // Serialize message to byte array
-    uint8_t buffer[sizeof(MeshMessage)];
-    memcpy(buffer, &msg, sizeof(MeshMessage));
-
-    // Transmit via LoRa (blocking but feeds watchdog)
-    Serial.printf("LoRa: Sending message (type %d, %d bytes)\n", msg.type, sizeof(MeshMessage));
-    int state = radio.transmit(buffer, sizeof(MeshMessage));
+// Encode a frame and queue it for loraRadioTask() without a log line;
+// returns immediately, true if queued (frame.sequence then names it), with
+// its length and the frames then waiting
+static bool queueLoRaMessage(WireFrame& frame, size_t& length, size_t& depth) {
+    length = 0;
+    depth = 0;
+    if (!loraInitialized) return false;
+
+    frame.node = LOCAL_NODE_INDEX;
+    frame.hopLimit = MESH_HOP_LIMIT;
+
+    uint8_t buffer[WIRE_MAX_FRAME];
+    xSemaphoreTake(loraTxQueueMutex, portMAX_DELAY);
+    frame.sequence = loraSequence++;
+
+    // Repeat sightings of the same MAC (and successive beacons or status
+    // reports) coalesce, fused locations per target, commands per target
+    // node; a batch or a replay never replaces another frame, nor does an
+    // ack or a targets frame, whatever its first record (bit 63; relayed
+    // frames use bit 62, MAC keys are 48-bit)
+    uint64_t key = frame.recordCount == 1 && !frame.replayed ? frame.records[0].mac :
+                   frame.recordCount > 0 || frame.type == MSG_ACK || frame.type == MSG_TARGETS ?
+                   (1ULL << 63) | frame.sequence :
+                   frame.type == MSG_FUSED ? frame.fused.mac :
+                   frame.type == MSG_COMMAND ? frame.command.target : 0;
+    length = wireEncode(frame, buffer, sizeof(buffer));
+    bool queued = length > 0 && loraTxQueue.push(frame.type, key, buffer, length, millis());
+    depth = loraTxQueue.size();
+    xSemaphoreGive(loraTxQueueMutex);
+
+    if (queued) xTaskNotifyGive(loraRadioTaskHandle);
+    return queued;
+}
 
-    if (state == RADIOLIB_ERR_NONE) {
-        Serial.println("LoRa: Message sent successfully");
-        // Return to receive mode
-        radio.startReceive();
+static void printQueued(uint8_t type, bool queued, size_t length, size_t depth) {
+    if (queued) {
+        logger.printf("LoRa: Queued message (type %d, %u bytes, %u waiting)\n",
+                      type, (unsigned)length, (unsigned)depth);
     } else {
-        Serial.printf("LoRa: Send failed, code %d\n", state);
-        radio.startReceive();
+        logger.printf("LoRa: TX queue full, dropped message (type %d)\n", type);
     }
 }
 
-void sendTrueHitAlert(const char* mac, int rssi, double lat, double lon) {
-    MeshMessage msg;
-    msg.type = MSG_TRUE_HIT;
-    strncpy(msg.nodeId, NODE_ID_CONFIG, sizeof(msg.nodeId) - 1);
-    strncpy(msg.mac, mac, sizeof(msg.mac) - 1);
-    msg.rssi = rssi;
-    msg.lat = lat;
-    msg.lon = lon;
-    msg.timestamp = millis();
-    msg.deviceType[0] = '\0';
-
-    Serial.println("📡 Sending TRUE HIT via LoRa mesh...");
-    sendLoRaMessage(msg);
+// queueLoRaMessage() with a log line
+bool sendLoRaMessage(WireFrame& frame) {
+    if (!loraInitialized) return false;
+    size_t length, depth;
+    bool queued = queueLoRaMessage(frame, length, depth);
+    printQueued(frame.type, queued, length, depth);
+    return queued;
 }
 
-void sendPossibleHitAlert(const char* mac, int rssi, double lat, double lon, const char* deviceType) {
-    MeshMessage msg;
-    msg.type = MSG_POSSIBLE_HIT;
-    strncpy(msg.nodeId, NODE_ID_CONFIG, sizeof(msg.nodeId) - 1);
-    strncpy(msg.mac, mac, sizeof(msg.mac) - 1);
-    msg.rssi = rssi;
-    msg.lat = lat;
-    msg.lon = lon;
-    msg.timestamp = millis();
-    strncpy(msg.deviceType, deviceType, sizeof(msg.deviceType) - 1);
-
-    Serial.println("📡 Sending POSSIBLE HIT via LoRa mesh...");
-    sendLoRaMessage(msg);
+// Spreading factor with its preamble; other settings only matter for TX
+static void setRadioSf(uint8_t sf) {
+    if (sf == radioSf) return;
+    radio.setSpreadingFactor(sf);
+    radio.setPreambleLength(LORA_RATES.preamble(sf));
+    radioSf = sf;
 }
 
-void sendPositionBeaconLoRa(double lat, double lon) {
-    MeshMessage msg;
-    msg.type = MSG_POSITION;
-    strncpy(msg.nodeId, NODE_ID_CONFIG, sizeof(msg.nodeId) - 1);
-    msg.mac[0] = '\0';
-    msg.rssi = 0;
-    msg.lat = lat;
-    msg.lon = lon;
-    msg.timestamp = millis();
-    msg.deviceType[0] = '\0';
+// CAD at the current scan position; DIO1 fires when it is done
+static void startScanStep(uint32_t& deadlineMs) {
+    uint8_t sf = LORA_RATES.sf[scanIndex];
+    setRadioSf(sf);
+    radio.startChannelScan();
+    radioMode = RADIO_SCAN;
+    deadlineMs = millis() + loraCadTimeUs(sf) / 1000 + 10;
+}
 
-    Serial.println("📡 Sending position beacon via LoRa...");
-    sendLoRaMessage(msg);
+// Back to waiting for frames: continuous RX with a single rate (or while
+// the node sleeps), else a new CAD scan from the fastest rate
+static void resumeListening(uint32_t& deadlineMs) {
+    if (!LORA_RATES.scanning() || radioRobustOnly) {
+        setRadioSf(LORA_RATES.robust());
+        radio.startReceive();
+        radioMode = RADIO_LISTEN;
+        return;
+    }
+    scanIndex = 0;
+    startScanStep(deadlineMs);
 }
 
-void checkLoRaMessages() {
-    if (!loraInitialized) return;
+// CAD found a preamble: receive at that rate until RX_DONE, or give up
+// once even the longest frame would have ended
+static void startReceiving(uint32_t& deadlineMs) {
+    radio.startReceive();
+    radioMode = RADIO_RECEIVE;
+    LoRaModulation longest = LORA_RATES.modulation(radioSf, 8);
+    deadlineMs = millis() + loraTimeOnAirUs(longest, WIRE_MAX_FRAME) / 1000 + 50;
+}
 
-    // Check if there's a message available (non-blocking)
-    if (radio.available()) {
-        uint8_t buffer[sizeof(MeshMessage)];
-        int state = radio.readData(buffer, sizeof(MeshMessage));
-
-        if (state == RADIOLIB_ERR_NONE) {
-            // Message received successfully
-            MeshMessage* msg = (MeshMessage*)buffer;
-
-            Serial.println("\n📩 LoRa message received:");
-            Serial.printf("  From: %s\n", msg->nodeId);
-            Serial.printf("  Type: %d\n", msg->type);
-
-            if (msg->type == MSG_TRUE_HIT) {
-                Serial.println("  🚨 TRUE HIT ALERT from mesh!");
-                Serial.printf("  MAC: %s\n", msg->mac);
-                Serial.printf("  RSSI: %d dBm\n", msg->rssi);
-                if (msg->lat != 0.0 && msg->lon != 0.0) {
-                    Serial.printf("  GPS: %.6f, %.6f\n", msg->lat, msg->lon);
-                }
+// A POSSIBLE HIT batch of ours going out: add what its records would have
+// cost one frame each at this modulation, less the batch's airtime
+static void noteBatchAirtime(const LoRaTxQueue<LORA_TX_QUEUE_DEPTH, WIRE_MAX_FRAME>::Frame& frame,
+                             const LoRaModulation& modulation, uint32_t airtimeUs) {
+    if (frame.type != MSG_POSSIBLE_HIT || frame.length < WIRE_HEADER_BYTES) return;
+    if (frame.data[1] != LOCAL_NODE_INDEX || (frame.data[7] & WIRE_FLAG_REPLAYED)) return;
+    uint8_t count = frame.data[7] & WIRE_COUNT_MASK;
+    if (count < 2) return;
+    size_t singleLength = frame.length - (count - 1) * WIRE_RECORD_BYTES;
+    batchAirtimeSavedUs += (uint64_t)loraTimeOnAirUs(modulation, (uint32_t)singleLength) * count - airtimeUs;
+}
 
-                // Display alert on local OLED
-                displayTrueHit(msg->mac, msg->rssi);
+// Share of the duty-cycle budget each class may fill
+static uint8_t dutyCyclePercent(TxClass txClass) {
+    return txClass == TX_CLASS_TRUE_HIT ? 100 :
+           txClass <= TX_CLASS_POSSIBLE_HIT ? LORA_DUTY_POSSIBLE_HIT_PERCENT : LORA_DUTY_ROUTINE_PERCENT;
+}
 
-                // TODO: Forward to homebase if this is a relay node
-            } else if (msg->type == MSG_POSSIBLE_HIT) {
-                Serial.println("  ⚠️  POSSIBLE HIT from mesh");
-                Serial.printf("  MAC: %s\n", msg->mac);
-                Serial.printf("  Device: %s\n", msg->deviceType);
-            } else if (msg->type == MSG_POSITION) {
-                Serial.printf("  📍 Position beacon: %.6f, %.6f\n", msg->lat, msg->lon);
-            }
+// Rate for the frame at the head of the queue (the policy picks it from its
+// class and our weakest neighbour); false if it cannot go yet because it is
+// backing off or its class is out of duty-cycle budget, with retryMs set to
+// when that may change. Caller holds loraTxQueueMutex.
+static bool planTransmission(const LoRaTxQueue<LORA_TX_QUEUE_DEPTH, WIRE_MAX_FRAME>::Frame& frame,
+                             LoRaTxRate& rate, uint32_t nowMs, uint32_t& retryMs) {
+    TxClass txClass = txClassForType(frame.type);
+    if (loraLbt.backingOff(txClass, nowMs)) {
+        retryMs = loraLbt.msUntilClear(nowMs);
+        return false;
+    }
 
-            // Return to receive mode
-            radio.startReceive();
-        }
+    LinkEntry weakest = {};
+    xSemaphoreTake(loraRateMutex, portMAX_DELAY);
+    loraRatePolicy.poll(nowMs);
+    bool linkKnown = loraLinks.weakest(nowMs, weakest);
+    rate = loraRatePolicy.select(txClass, linkKnown, (int16_t)(weakest.snrQ4 / 4), nowMs);
+    xSemaphoreGive(loraRateMutex);
+
+    uint32_t airtimeUs = loraTimeOnAirUs(LORA_RATES.modulation(rate.sf, rate.cr), frame.length);
+    if (!loraDutyCycle.admits(airtimeUs, dutyCyclePercent(txClass), nowMs)) {
+        if (txDeferredClass != txClass) loraDutyDeferred[txClass]++;
+        txDeferredClass = txClass;
+        retryMs = loraDutyCycle.msUntilRelease(nowMs);
+        return false;
     }
+    txDeferredClass = -1;
+    return true;
 }
 
-// ============================================================================
-// CONFIGURATION
-// ============================================================================
+// Whether a queued frame may go now (it still has to pass CAD); retryMs is
+// how long to wait if one is held back, 0 if the queue is empty
+static bool transmissionReady(uint32_t& retryMs) {
+    retryMs = 0;
+    uint32_t nowMs = millis();
+    LoRaTxRate rate;
+    xSemaphoreTake(loraTxQueueMutex, portMAX_DELAY);
+    const auto* frame = loraTxQueue.front(nowMs);
+    bool ready = frame != nullptr && planTransmission(*frame, rate, nowMs, retryMs);
+    xSemaphoreGive(loraTxQueueMutex);
+    return ready;
+}
 
-#define NODE_ID NODE_ID_CONFIG
-#define SCAN_INTERVAL BLE_SCAN_INTERVAL
-#define SCAN_WINDOW BLE_SCAN_WINDOW
-#define SCAN_DURATION BLE_SCAN_DURATION
+// A CAD at the current spreading factor has just finished. If the next
+// frame goes at this rate, listen-before-talk decides: a free channel
+// sends it, a busy one backs off (or, out of patience, sends a hit anyway
+// and drops anything else). True if a transmission started.
+static bool transmitAfterCad(bool busy, uint32_t& deadlineMs) {
+    static LoRaTxQueue<LORA_TX_QUEUE_DEPTH, WIRE_MAX_FRAME>::Frame frame;
+
+    uint32_t nowMs = millis();
+    uint32_t retryMs;
+    xSemaphoreTake(loraTxQueueMutex, portMAX_DELAY);
+    const auto* next = loraTxQueue.front(nowMs);
+    if (next == nullptr || !planTransmission(*next, txRate, nowMs, retryMs) || txRate.sf != radioSf) {
+        xSemaphoreGive(loraTxQueueMutex);
+        return false;
+    }
+    LbtDecision decision = loraLbt.check(txClassForType(next->type), busy, nowMs, (uint32_t)random(0, 0x7FFFFFFF));
+    if (decision == LBT_BACK_OFF) {
+        xSemaphoreGive(loraTxQueueMutex);
+        return false;
+    }
+    loraLbt.reset();
+    if (decision == LBT_DROP) {
+        uint8_t type = next->type;
+        loraTxQueue.drop(nowMs);
+        xSemaphoreGive(loraTxQueueMutex);
+        logger.printf("LoRa: Channel busy, dropped message (type %d)\n", type);
+        return false;
+    }
 
-// GPS Serial (adjust for your Heltec version)
-HardwareSerial GPSSerial(1);
+    // Receivers correct their link estimate for our power backoff
+    frame = *next;
+    wireSetPowerSteps(frame.data, frame.length, txRate.powerSteps);
+    radio.setCodingRate(txRate.cr);
+    radio.setOutputPower(LORA_TX_POWER - WIRE_POWER_STEP_DB * txRate.powerSteps);
+
+    // The frame leaves the queue, and its airtime is charged, only once the
+    // radio has taken it (the mutex is held over the SPI transfer, a
+    // millisecond at most); a refused frame stays at the head
+    int state = radio.startTransmit(frame.data, frame.length);
+    if (state != RADIOLIB_ERR_NONE) {
+        bool kept = loraTxQueue.failed(nowMs);
+        xSemaphoreGive(loraTxQueueMutex);
+        logger.printf("LoRa: Send failed, code %d (type %d%s)\n", state, frame.type,
+                      kept ? ", will retry" : ", dropped");
+        return false;
+    }
+    loraTxQueue.pop(nowMs);
+    xSemaphoreGive(loraTxQueueMutex);
+    radioMode = RADIO_TRANSMIT;
+
+    LoRaModulation modulation = LORA_RATES.modulation(txRate.sf, txRate.cr);
+    uint32_t airtimeUs = loraTimeOnAirUs(modulation, frame.length);
+    loraDutyCycle.record(airtimeUs, nowMs);
+    noteBatchAirtime(frame, modulation, airtimeUs);
+    xSemaphoreTake(loraRateMutex, portMAX_DELAY);
+    loraRatePolicy.sent(txRate, frame.length);
+    xSemaphoreGive(loraRateMutex);
+    txExpectRepeat = frame.data[1] == LOCAL_NODE_INDEX && MESH_HOP_LIMIT > 0;
+    txSequence = frame.data[2];
+
+    // Airtime plus margin in case the DIO1 edge is missed
+    deadlineMs = millis() + airtimeUs / 1000 + 100;
+    return true;
+}
 
-// ============================================================================
-// GLOBAL VARIABLES
-// ============================================================================
+// Collect the TX_DONE interrupt (or give up at the deadline)
+void finishTransmission(bool completed) {
+    radioIrqPending = false;
+    radio.finishTransmit();
 
-TinyGPSPlus gps;
-bool gpsAvailable = false;
+    uint32_t nowMs = millis();
+    xSemaphoreTake(loraRateMutex, portMAX_DELAY);
+    loraRatePolicy.transmitted(txRate, completed, nowMs);
+    if (completed && txExpectRepeat) loraRatePolicy.expectRepeat(txRate, txSequence, nowMs);
+    xSemaphoreGive(loraRateMutex);
 
-// Target MAC addresses (TRUE HIT) - loaded from config.h
-std::vector<std::string> targetMACs;
+    if (completed) {
+        logger.printf("LoRa: Message sent successfully (SF%u CR 4/%u, %d dBm)\n", txRate.sf, txRate.cr,
+                      LORA_TX_POWER - WIRE_POWER_STEP_DB * txRate.powerSteps);
+    } else {
+        logger.printf("LoRa: Send failed, code %d\n", RADIOLIB_ERR_TX_TIMEOUT);
+    }
+}
 
-// Medical device MAC prefixes (POSSIBLE HIT) - loaded from config.h
-struct MedicalDevicePrefix {
-    std::string prefix;
-    std::string deviceType;
-    std::string manufacturer;
-};
+// Read the frame behind an RX_DONE interrupt into loraRxQueue
+void receiveFrame() {
+    static LoRaRxFrame frame;
 
-std::vector<MedicalDevicePrefix> medicalPrefixes;
+    uint32_t arrivalUs = radioIrqAtUs;
+    radioIrqPending = false;
 
-// Detection statistics
-uint32_t totalScans = 0;
-uint32_t trueHits = 0;
-uint32_t possibleHits = 0;
+    size_t length = radio.getPacketLength();
+    if (length == 0 || length > sizeof(frame.data)) {
+        loraRxBadLength++;
+        return;
+    }
 
-// GPS tracking for movement-based beaconing
-double lastBeaconLat = 0.0;
-double lastBeaconLon = 0.0;
-#define MOVEMENT_THRESHOLD_METERS 25.0
+    int state = radio.readData(frame.data, length);
+    frame.arrivalUs = arrivalUs;
+    frame.rssi = (int16_t)radio.getRSSI();
+    frame.snrQ2 = (int8_t)(radio.getSNR() * 4.0f);
+    frame.sf = radioSf;
+    frame.length = (uint8_t)length;
 
-// ============================================================================
-// BLE SCANNING CALLBACKS
-// ============================================================================
+    if (state == RADIOLIB_ERR_CRC_MISMATCH) {
+        loraRxCrcErrors++;
+        return;
+    }
+    if (state != RADIOLIB_ERR_NONE) return;
 
-class BLEScanCallbacks : public NimBLEAdvertisedDeviceCallbacks {
+    // A full ring is counted by loraRxQueue.overflows()
+    if (loraRxQueue.push(frame)) xTaskNotifyGive(meshRxTaskHandle);
+}
 
-    bool isTrueHit(const std::string& macAddr) {
-        for (const auto& targetMAC : targetMACs) {
-            if (strcasecmp(macAddr.c_str(), targetMAC.c_str()) == 0) {
-                return true;
-            }
+// Owns the SX1262: sends queued frames one at a time and reads out received
+// ones. With several spreading factors it cycles CAD through them, switching
+// to RX where it finds a preamble; with one it listens continuously. Every
+// frame goes out straight after a CAD at its own spreading factor found
+// the channel free. Woken by sendLoRaMessage() and the DIO1 interrupt;
+// never blocks on airtime.
+void loraRadioTask(void* param) {
+    uint32_t deadlineMs = 0;
+    uint32_t retryMs = 0;
+    resumeListening(deadlineMs);
+    for (;;) {
+        // Listening at the only rate: leave RX for a CAD when a frame is due
+        if (radioMode == RADIO_LISTEN && !radioIrqPending && transmissionReady(retryMs)) {
+            startScanStep(deadlineMs);
+        } else if (radioMode == RADIO_LISTEN && !radioIrqPending && LORA_RATES.scanning() && !radioRobustOnly) {
+            // The node woke up: back to scanning every rate
+            resumeListening(deadlineMs);
         }
-        return false;
-    }
 
-    MedicalDevicePrefix* isPossibleHit(const std::string& macAddr) {
-        for (auto& prefix : medicalPrefixes) {
-            if (macAddr.length() >= prefix.prefix.length()) {
-                std::string devicePrefix = macAddr.substr(0, prefix.prefix.length());
-                if (strcasecmp(devicePrefix.c_str(), prefix.prefix.c_str()) == 0) {
-                    return &prefix;
+        TickType_t wait = portMAX_DELAY;
+        if (radioMode != RADIO_LISTEN) {
+            int32_t remainingMs = (int32_t)(deadlineMs - millis());
+            wait = remainingMs > 0 ? pdMS_TO_TICKS(remainingMs) : 0;
+        } else if (retryMs > 0) {
+            wait = pdMS_TO_TICKS(retryMs) + 1;
+        }
+        waitForEvent(TASK_LORA_RADIO, wait);
+
+        bool irq = radioIrqPending;
+        bool expired = radioMode != RADIO_LISTEN && (int32_t)(deadlineMs - millis()) <= 0;
+        if (!irq && !expired) continue;
+
+        switch (radioMode) {
+            case RADIO_LISTEN:
+                receiveFrame();
+                radio.startReceive();
+                break;
+            case RADIO_RECEIVE:
+                if (irq) receiveFrame();
+                resumeListening(deadlineMs);
+                break;
+            case RADIO_TRANSMIT:
+                finishTransmission(irq);
+                resumeListening(deadlineMs);
+                break;
+            case RADIO_SCAN: {
+                radioIrqPending = false;
+                bool busy = irq && radio.getChannelScanResult() == RADIOLIB_LORA_DETECTED;
+                if (transmitAfterCad(busy, deadlineMs)) break;
+                if (busy) {
+                    startReceiving(deadlineMs);
+                } else if (LORA_RATES.scanning() && !radioRobustOnly) {
+                    scanIndex = (scanIndex + 1) % LORA_RATES.size();
+                    startScanStep(deadlineMs);
+                } else {
+                    resumeListening(deadlineMs);
                 }
+                break;
             }
         }
-        return nullptr;
     }
+}
 
-    void onResult(NimBLEAdvertisedDevice* advertisedDevice) {
-        totalScans++;
+static WireRecord detectionRecord(uint64_t macKey, int rssi, uint8_t range, uint8_t deviceIndex,
+                                  uint32_t timestampMs) {
+    WireRecord record;
+    record.timestampMs = timestampMs;
+    record.mac = macKey;
+    record.rssi = (int8_t)(rssi < -128 ? -128 : rssi > 127 ? 127 : rssi);
+    record.deviceIndex = deviceIndex;
+    record.range = range;
+    return record;
+}
+
+// Path-loss distance and trend of a record (rssi_tracker.h)
+static void printRange(const char* indent, uint8_t range) {
+    if (!rssiRangeKnown(range)) return;
+    logger.printf("%sRange: ~%.1f m, %s\n", indent, rssiRangeMeters(range),
+                  rssiTrendName(rssiRangeTrend(range)));
+}
 
-        std::string macAddr = advertisedDevice->getAddress().toString();
-        int rssi = advertisedDevice->getRSSI();
+// Defined with the journal below
+static void journalDetections(const WireFrame& frame, bool sent);
+void postJournalAck(const WireAck& ack);
+
+// Position, and velocity while moving, for receivers to extrapolate from
+// (position_beacon.h); returns the track they will predict
+static PositionTrack attachPosition(WireFrame& frame, const GpsFix& position, uint32_t nowMs) {
+    PositionTrack track = {};
+    frame.hasPosition = position.valid();
+    if (!frame.hasPosition) return track;
+    frame.latE7 = position.latE7;
+    frame.lonE7 = position.lonE7;
+    frame.hasVelocity = beaconVelocity(position, GPS_STATIONARY_SPEED_CMS,
+                                       frame.velocityEast, frame.velocityNorth);
+    track.set(frame.latE7, frame.lonE7, frame.velocityEast, frame.velocityNorth, nowMs);
+    return track;
+}
 
-        // DEBUG: Show all detected devices
-        #if DEBUG_SHOW_ALL_DEVICES
-        Serial.printf("[BLE] Device: %s | RSSI: %d dBm", macAddr.c_str(), rssi);
-        if (advertisedDevice->haveName()) {
-            Serial.printf(" | Name: %s", advertisedDevice->getName().c_str());
-        }
-        Serial.println();
-        #endif
+// The position the last hit frame carried: published by the detection
+// task, taken by the GPS task as its beacon reference
+static GpsSnapshot<PositionTrack> positionSentWithHit;
+
+// Homebase only: the gateway's own hits, with where it made them, for
+// target fusion in meshRxTask(); filled by the detection task
+constexpr bool FUSION = MESH_GATEWAY && FUSION_ENABLED;
+struct FusionReport {
+    WireRecord record;
+    int32_t latE7;
+    int32_t lonE7;
+};
+static SpscRing<FusionReport, 2 * WIRE_MAX_RECORDS> localFusionQueue;
+
+// What the detection task hands the alert log task: an alert, with the
+// device's history as it stood, or what became of a hit frame. The
+// detection task never writes to the serial port: at 115200 baud an
+// alert's dozen lines would hold it for some 50 ms, long enough for
+// detectionQueue to overflow in a crowd.
+enum AlertLogKind : uint8_t {
+    ALERT_LOG_TRUE_HIT,
+    ALERT_LOG_POSSIBLE_HIT,
+    ALERT_LOG_FRAME,        // a hit frame queued for LoRa, or dropped
+};
 
-        // Get GPS coordinates if available
-        double lat = 0.0, lon = 0.0;
-        if (gpsAvailable && gps.location.isValid()) {
-            lat = gps.location.lat();
-            lon = gps.location.lng();
-        }
+struct AlertLogEntry {
+    AlertLogKind kind;
+    int8_t irk;             // TRUE HIT: index into TARGET_IRK_LIST, or -1
+    uint8_t deviceIndex;    // POSSIBLE HIT
+    uint8_t range;          // the device's path-loss range at the alert
+    DeviceReport reason;
+    int16_t rssi;           // of the advert
+    uint32_t timestampMs;
+    uint64_t macKey;
+    DeviceEntry device;
+    GpsFix position;
+    // ALERT_LOG_FRAME
+    uint8_t frameType;
+    uint8_t recordCount;
+    bool queued;
+    uint8_t frameBytes;
+    uint8_t txWaiting;
+};
+static SpscRing<AlertLogEntry, ALERT_LOG_DEPTH> alertLogQueue;
+TaskHandle_t alertLogTaskHandle = nullptr;
+
+// Homebase only: the gateway's own hits, encoded, for the alert log task
+// to write as serial frames
+struct LocalSerialFrame {
+    uint32_t uptimeMs;
+    uint8_t length;
+    uint8_t wire[WIRE_MAX_FRAME];
+};
+static SpscRing<LocalSerialFrame, SERIAL_FRAMES ? 8 : 2> localSerialQueue;
 
-        // Check for TRUE HIT (exact MAC match)
-        if (isTrueHit(macAddr)) {
-            trueHits++;
-            handleTrueHit(macAddr, rssi, lat, lon);
-            return;
-        }
+static void postAlertLog(const AlertLogEntry& entry) {
+    // A full ring is counted by alertLogQueue.overflows(); the hit goes
+    // out over LoRa all the same
+    alertLogQueue.push(entry);
+    if (alertLogTaskHandle != nullptr) xTaskNotifyGive(alertLogTaskHandle);
+}
 
-        // Check for POSSIBLE HIT (medical device prefix match)
-        MedicalDevicePrefix* medical = isPossibleHit(macAddr);
-        if (medical != nullptr) {
-            possibleHits++;
-            handlePossibleHit(macAddr, rssi, lat, lon, medical);
-            return;
-        }
+// Detection frame: the records plus the node's position when it has a fix,
+// which spares a beacon. The journal keeps them until the homebase
+// acknowledges the frame.
+static void sendDetections(MessageType type, const WireRecord* records, uint8_t count,
+                           const GpsFix& position) {
+    WireFrame frame = {};
+    frame.type = type;
+    PositionTrack track = attachPosition(frame, position, millis());
+    frame.recordCount = count;
+    for (uint8_t i = 0; i < count; i++) frame.records[i] = records[i];
+    size_t length, depth;
+    bool sent = queueLoRaMessage(frame, length, depth);
+    if (sent && track.known) positionSentWithHit.publish(track);
+    journalDetections(frame, sent);
+
+    AlertLogEntry entry = {};
+    entry.kind = ALERT_LOG_FRAME;
+    entry.frameType = type;
+    entry.recordCount = count;
+    entry.queued = sent;
+    entry.frameBytes = (uint8_t)length;
+    entry.txWaiting = (uint8_t)depth;
+    postAlertLog(entry);
+
+    // The homebase's own hits reach the host as if heard from itself
+    if (SERIAL_FRAMES) {
+        LocalSerialFrame local;
+        frame.node = LOCAL_NODE_INDEX;
+        frame.hopLimit = MESH_HOP_LIMIT;
+        local.uptimeMs = millis();
+        local.length = (uint8_t)wireEncode(frame, local.wire, sizeof(local.wire));
+        // A full ring is counted by localSerialQueue.overflows()
+        if (local.length > 0) localSerialQueue.push(local);
     }
 
-    void handleTrueHit(const std::string& mac, int rssi, double lat, double lon) {
-        Serial.println("\n🚨 ========== TRUE HIT ==========");
-        Serial.printf("Node: %s\n", NODE_ID);
-        Serial.printf("Target MAC: %s\n", mac.c_str());
-        Serial.printf("RSSI: %d dBm\n", rssi);
+    // ...and count towards target fusion like any node's
+    if (FUSION && frame.hasPosition && meshRxTaskHandle != nullptr) {
+        for (uint8_t i = 0; i < count; i++) localFusionQueue.push({records[i], frame.latE7, frame.lonE7});
+        xTaskNotifyGive(meshRxTaskHandle);
+    }
+}
 
-        if (gpsAvailable && lat != 0.0 && lon != 0.0) {
-            Serial.printf("GPS: %.6f, %.6f\n", lat, lon);
-        } else {
-            Serial.println("GPS: N/A");
-        }
+void sendTrueHitAlert(uint64_t macKey, int rssi, uint8_t range, const GpsFix& position, uint32_t timestampMs) {
+    // TRUE HITs bypass the batching window
+    WireRecord record = detectionRecord(macKey, rssi, range, WIRE_NO_DEVICE, timestampMs);
+    sendDetections(MSG_TRUE_HIT, &record, 1, position);
+}
 
-        Serial.printf("Time: %lu ms\n", millis());
-        Serial.println("================================\n");
+// POSSIBLE HITs wait up to LORA_BATCH_WINDOW_MS so several share one frame.
+// Owned by the detection task, which flushes it when the window closes.
+static_assert(LORA_BATCH_WINDOW_MS <= 60000, "records in a batch must lie within 65 s");
+static DetectionBatch<LORA_BATCH_MAX_RECORDS> possibleHitBatch(LORA_BATCH_WINDOW_MS);
+static GpsFix possibleHitBatchPosition = {};
 
-        // Display alert on OLED screen
-        displayTrueHit(mac.c_str(), rssi);
+void flushPossibleHitBatch() {
+    if (possibleHitBatch.empty()) return;
 
-        // Send priority LoRa mesh message
-        sendTrueHitAlert(mac.c_str(), rssi, lat, lon);
-    }
+    WireFrame frame = {};
+    uint8_t count = possibleHitBatch.size();
+    possibleHitBatch.take(frame);
+    sendDetections(MSG_POSSIBLE_HIT, frame.records, count, possibleHitBatchPosition);
+}
 
-    void handlePossibleHit(const std::string& mac, int rssi, double lat, double lon,
-                          MedicalDevicePrefix* medical) {
-        Serial.println("\n⚠️  ======== POSSIBLE HIT ========");
-        Serial.printf("Node: %s\n", NODE_ID);
-        Serial.printf("MAC: %s\n", mac.c_str());
-        Serial.printf("Device: %s (%s)\n", medical->deviceType.c_str(), medical->manufacturer.c_str());
-        Serial.printf("RSSI: %d dBm\n", rssi);
+void sendPossibleHitAlert(uint64_t macKey, int rssi, uint8_t range, const GpsFix& position,
+                          uint8_t deviceIndex, uint32_t timestampMs) {
+    // The frame carries the node's latest position
+    possibleHitBatchPosition = position;
+    WireRecord record = detectionRecord(macKey, rssi, range, deviceIndex, timestampMs);
+    if (possibleHitBatch.add(record, millis())) flushPossibleHitBatch();
+}
 
-        if (gpsAvailable && lat != 0.0 && lon != 0.0) {
-            Serial.printf("GPS: %.6f, %.6f\n", lat, lon);
-        } else {
-            Serial.println("GPS: N/A");
-        }
+PositionTrack sendPositionBeaconLoRa(const GpsFix& position) {
+    WireFrame frame = {};
+    frame.type = MSG_POSITION;
+    frame.timestampMs = millis();
+    PositionTrack track = attachPosition(frame, position, frame.timestampMs);
 
-        Serial.printf("Time: %lu ms\n", millis());
-        Serial.println("================================\n");
+    logger.println("📡 Sending position beacon via LoRa...");
+    sendLoRaMessage(frame);
+    return track;
+}
 
-        // Display alert on OLED screen
-        displayPossibleHit(mac.c_str(), rssi, medical->deviceType.c_str());
+// Rebroadcast delay: longer the stronger the frame was heard, since a relay
+// near the edge of the sender's range extends coverage the most, plus
+// jitter so relays that heard it equally well do not collide
+static uint32_t relayDelayMs(int16_t rssi) {
+    int32_t strength = rssi + 120;      // 0 at -120 dBm .. 80 at -40 dBm
+    if (strength < 0) strength = 0;
+    if (strength > 80) strength = 80;
+    return MESH_RELAY_MIN_DELAY_MS + (uint32_t)strength * MESH_RELAY_DELAY_SPREAD_MS / 80 +
+           (uint32_t)random(0, MESH_RELAY_JITTER_MS + 1);
+}
 
-        // Send LoRa mesh message
-        sendPossibleHitAlert(mac.c_str(), rssi, lat, lon, medical->deviceType.c_str());
+// Hold a newly heard frame for rebroadcast if this node relays
+static void scheduleRelay(const LoRaRxFrame& rx, const WireFrame& frame) {
+    if (!MESH_RELAY_ENABLED) return;
+    if (frame.type == MSG_POSITION && !MESH_RELAY_BEACONS) return;
+    if (frame.hopLimit == 0) {
+        meshRelay.noteHopLimited();
+        return;
     }
+    uint8_t data[WIRE_MAX_FRAME];
+    memcpy(data, rx.data, rx.length);
+    wireSetHopLimit(data, rx.length, frame.hopLimit - 1);
+    meshRelay.schedule(frame.type, frame.node, frame.sequence, data, rx.length,
+                       millis() + relayDelayMs(rx.rssi));
+}
 
-    // Note: Buzzer functions removed - Heltec V3 uses OLED display for alerts
-    // If external buzzer is added, buzzer alert functions can be re-enabled
-};
-
-// ============================================================================
-// GPS FUNCTIONS
-// ============================================================================
-
-void initGPS() {
-    Serial.println("Initializing GPS...");
-    GPSSerial.begin(9600, SERIAL_8N1, GPS_RX_PIN, GPS_TX_PIN);
-    delay(1000);
-
-    // Wait briefly for GPS data
-    unsigned long startTime = millis();
-    while (millis() - startTime < 2000) {
-        while (GPSSerial.available() > 0) {
-            gps.encode(GPSSerial.read());
+// Hand rebroadcasts whose delay has passed to the transmitter
+static void forwardDueRelays() {
+    static MeshRelayTable::Frame frame;
+    while (meshRelay.popDue(frame, millis())) {
+        uint64_t key = (1ULL << 62) | (uint64_t)frame.origin << 8 | frame.sequence;
+        xSemaphoreTake(loraTxQueueMutex, portMAX_DELAY);
+        bool queued = loraTxQueue.push(frame.type, key, frame.data, frame.length, millis());
+        xSemaphoreGive(loraTxQueueMutex);
+        meshRelay.noteForwarded(queued);
+
+        if (queued) {
+            logger.printf("LoRa: Relaying NODE-%03u #%u (type %d)\n",
+                          frame.origin, frame.sequence, frame.type);
+            xTaskNotifyGive(loraRadioTaskHandle);
         }
     }
+}
 
-    if (gps.charsProcessed() > 10) {
-        gpsAvailable = true;
-        Serial.println("GPS: Connected");
-        if (gps.location.isValid()) {
-            Serial.printf("GPS: Initial fix - %.6f, %.6f\n",
-                         gps.location.lat(), gps.location.lng());
-        } else {
-            Serial.println("GPS: Waiting for fix...");
-        }
-    } else {
-        gpsAvailable = false;
-        Serial.println("GPS: No module detected (continuing without GPS)");
+// Homebase: acknowledge what field nodes sent once the delay has passed
+static void sendDueAcks() {
+    static WireFrame frame;
+    WireAck ack;
+    while (meshAcks.popDue(ack, millis())) {
+        frame = {};
+        frame.type = MSG_ACK;
+        frame.timestampMs = millis();
+        frame.ack = ack;
+        sendLoRaMessage(frame);
     }
 }
 
-void updateGPS() {
-    if (!gpsAvailable) return;
+// Defined with the detection tables below
+static bool possibleHitDevice(uint8_t deviceIndex, const char*& deviceType, const char*& manufacturer);
+static void handleTargets(const WireTargets& targets);
+static uint32_t serviceTargets(uint32_t nowMs);
+
+// Defined with target fusion below
+static void fuseDetection(uint8_t node, const WireRecord& record, int32_t latE7, int32_t lonE7, uint32_t nowMs);
+static void fuseLocalDetections();
+
+// Each node's last live position and velocity, extrapolated when a hit
+// arrives without one. Owned by the mesh RX task.
+static NodeTracks<MESH_TRACKED_NODES> nodeTracks;
+
+// Homebase only: targets located from several nodes' hits
+// (target_fusion.h), with the time spent fitting them. Owned by the mesh
+// RX task.
+static_assert(FUSION_MIN_OBSERVERS >= 2 && FUSION_MIN_OBSERVERS <= FUSION_OBSERVERS,
+              "FUSION_MIN_OBSERVERS must be 2 to FUSION_OBSERVERS");
+static TargetFusion<FUSION_TARGETS, FUSION_OBSERVERS> targetFusion({
+    FUSION_WINDOW_MS,
+    FUSION_MIN_OBSERVERS,
+    FUSION_INTERVAL_MS,
+    (float)FUSION_RANGE_SIGMA,
+});
+static uint64_t fusionTotalUs = 0;
+static uint32_t fusionMaxUs = 0;
+static uint32_t fusionUnplaced = 0;     // live hits from a node whose position is unknown
+
+// ", moving 1.4 m/s heading 90°" from a frame's velocity
+static void printVelocity(const WireFrame& frame) {
+    if (!frame.hasVelocity) {
+        logger.print(", stationary");
+        return;
+    }
+    float east = frame.velocityEast * WIRE_VELOCITY_UNIT_CMS / 100.0f;
+    float north = frame.velocityNorth * WIRE_VELOCITY_UNIT_CMS / 100.0f;
+    float heading = atan2f(east, north) * (float)RAD_TO_DEG;
+    logger.printf(", moving %.1f m/s heading %.0f°", sqrtf(east * east + north * north),
+                  heading < 0 ? heading + 360.0f : heading);
+}
 
-    while (GPSSerial.available() > 0) {
-        gps.encode(GPSSerial.read());
+// A fused location, as the homebase reports it
+static void printFusedLocation(const WireFrame& frame) {
+    const WireFused& fused = frame.fused;
+    char mac[18];
+    formatMacKey(fused.mac, mac);
+    logger.printf("  🎯 Fused location: %s\n", mac);
+    logger.printf("  GPS: %.6f, %.6f ±%.1f m (95%%), from %u nodes\n", wireE7ToDegrees(frame.latE7),
+                  wireE7ToDegrees(frame.lonE7), fused.radiusDm / 10.0, fused.observers);
+    const char* deviceType;
+    const char* manufacturer;
+    if (fused.deviceIndex == WIRE_NO_DEVICE) {
+        logger.println("  Target: TRUE HIT");
+    } else if (possibleHitDevice(fused.deviceIndex, deviceType, manufacturer)) {
+        logger.printf("  Device: %s\n", deviceType);
+    } else {
+        logger.printf("  Device: unknown (#%u)\n", fused.deviceIndex);
     }
 }
 
-double calculateDistance(double lat1, double lon1, double lat2, double lon2) {
-    // Haversine formula for distance in meters
-    double R = 6371000; // Earth radius in meters
-    double phi1 = lat1 * DEG_TO_RAD;
-    double phi2 = lat2 * DEG_TO_RAD;
-    double deltaPhi = (lat2 - lat1) * DEG_TO_RAD;
-    double deltaLambda = (lon2 - lon1) * DEG_TO_RAD;
+void handleLoRaFrame(const LoRaRxFrame& rx) {
+    static WireFrame frame;
+    WireDecodeResult result = wireDecode(rx.data, rx.length, frame);
+    if (result != WIRE_OK) {
+        loraRxMalformed++;
+        logger.printf("LoRa: Ignoring %u-byte frame (%s, RSSI %d dBm)\n",
+                      (unsigned)rx.length, wireDecodeResultName(result), rx.rssi);
+        return;
+    }
+    loraRxFrames++;
+
+    // Frames heard straight from their origin measure that link (as if
+    // sent at full power); our own frames coming back show relays are
+    // repeating what we send at the faster rates
+    uint32_t nowMs = millis();
+    xSemaphoreTake(loraRateMutex, portMAX_DELAY);
+    if (frame.node == LOCAL_NODE_INDEX) {
+        loraRatePolicy.repeatHeard(frame.sequence, nowMs);
+    } else if (frame.hopLimit == MESH_HOP_LIMIT) {
+        int backoffDb = WIRE_POWER_STEP_DB * frame.powerSteps;
+        loraLinks.update(frame.node, rx.snrQ2 / 4.0f + backoffDb, (float)(rx.rssi + backoffDb), nowMs);
+    }
+    xSemaphoreGive(loraRateMutex);
 
-    double a = sin(deltaPhi / 2) * sin(deltaPhi / 2) +
-               cos(phi1) * cos(phi2) *
-               sin(deltaLambda / 2) * sin(deltaLambda / 2);
-    double c = 2 * atan2(sqrt(a), sqrt(1 - a));
+    // Copies arriving via other relays (or our own frames echoed back)
+    if (!meshRelay.accept(frame.node, frame.sequence, millis())) return;
+    scheduleRelay(rx, frame);
 
-    return R * c;
-}
+    if (SERIAL_FRAMES) {
+        uint8_t hops = frame.hopLimit < MESH_HOP_LIMIT ? MESH_HOP_LIMIT - frame.hopLimit : 0;
+        writeSerialFrame({SERIAL_SOURCE_MESH, nowMs, rx.rssi, rx.snrQ2, rx.sf, hops}, rx.data, rx.length);
+    }
 
-bool shouldSendPositionBeacon() {
-    if (!gpsAvailable || !gps.location.isValid()) return false;
-    if (lastBeaconLat == 0.0 && lastBeaconLon == 0.0) return true; // First beacon
+    double lat = wireE7ToDegrees(frame.latE7);
+    double lon = wireE7ToDegrees(frame.lonE7);
+    // Replayed frames carry where the node was, not where it is, and a
+    // fused location where its target is
+    if (frame.hasPosition && !frame.replayed && frame.type != MSG_FUSED) {
+        nodeTracks.update(frame.node, frame, nowMs);
+    }
 
-    double distance = calculateDistance(
-        lastBeaconLat, lastBeaconLon,
-        gps.location.lat(), gps.location.lng()
-    );
+    logger.println("\n📩 LoRa message received:");
+    logger.printf("  From: NODE-%03u\n", frame.node);
+    logger.printf("  Type: %d\n", frame.type);
+    logger.printf("  Seq: %u, hops left %u\n", frame.sequence, frame.hopLimit);
+    logger.printf("  Link: RSSI %d dBm, SNR %.2f dB, SF%u\n", rx.rssi, rx.snrQ2 / 4.0, rx.sf);
 
-    return distance >= MOVEMENT_THRESHOLD_METERS;
-}
+    // The homebase tells field nodes which of their hits and reports arrived
+    if (MESH_GATEWAY && (frame.type == MSG_TRUE_HIT || frame.type == MSG_POSSIBLE_HIT ||
+                         frame.type == MSG_STATUS)) {
+        meshAcks.add(frame.node, frame.sequence, millis());
+    }
 
-void sendPositionBeacon() {
-    if (!gpsAvailable || !gps.location.isValid()) return;
+    if (frame.type == MSG_ACK) {
+        const WireAck& ack = frame.ack;
+        if (ack.target != LOCAL_NODE_INDEX) return;
+        logger.printf("  ✅ Ack: #%u", ack.sequence);
+        for (uint8_t n = 0; n < 16; n++) {
+            if (ack.following & (1u << n)) logger.printf(" #%u", (uint8_t)(ack.sequence + 1 + n));
+        }
+        logger.println();
+        postJournalAck(ack);
+        return;
+    }
 
-    lastBeaconLat = gps.location.lat();
-    lastBeaconLon = gps.location.lng();
+    if (frame.type == MSG_POSITION) {
+        logger.printf("  📍 Position beacon: %.6f, %.6f", lat, lon);
+        printVelocity(frame);
+        logger.println();
+        return;
+    }
 
-    Serial.printf("📍 Position Beacon: %.6f, %.6f\n", lastBeaconLat, lastBeaconLon);
+    if (frame.type == MSG_STATUS) {
+        const WireStatus& status = frame.status;
+        logger.printf("  🔋 Status: battery %.2f V, profile %s (%s), scan %u%%, "
+                      "est. active %.1f mA, conservation %.1f mA, burst %.1f mA\n",
+                      status.batteryMv / 1000.0, scanProfileName(status.profile),
+                      scanReasonName(status.reason), status.dutyPercent,
+                      status.estimatedDeciMa[SCAN_PROFILE_ACTIVE] / 10.0,
+                      status.estimatedDeciMa[SCAN_PROFILE_CONSERVATION] / 10.0,
+                      status.estimatedDeciMa[SCAN_PROFILE_BURST] / 10.0);
+        return;
+    }
 
-    // Send position beacon via LoRa mesh
-    sendPositionBeaconLoRa(lastBeaconLat, lastBeaconLon);
-}
+    if (frame.type == MSG_COMMAND) {
+        const WireCommand& command = frame.command;
+        if (command.command != WIRE_CMD_SCAN_PROFILE) {
+            logger.printf("  Command %u: not supported\n", command.command);
+            return;
+        }
+        uint8_t profile = command.argument < SCAN_PROFILE_COUNT ? command.argument : SCAN_PROFILE_AUTO;
+        char target[16] = "all nodes";
+        if (command.target != 0) snprintf(target, sizeof(target), "NODE-%03u", command.target);
+        logger.printf("  🛰️  Command: %s scan %s", target, scanProfileName(profile));
+        if (command.durationMin > 0) {
+            logger.printf(" for %u min\n", command.durationMin);
+        } else {
+            logger.println(" until changed");
+        }
+        if (command.target == 0 || command.target == LOCAL_NODE_INDEX) {
+            scanCommandQueue.push({profile, (uint32_t)(command.durationMin * 60000UL)});
+            xTaskNotifyGive(mainLoopTaskHandle);
+        }
+        return;
+    }
 
-// ============================================================================
-// BLE SCANNING
-// ============================================================================
+    if (frame.type == MSG_FUSED) {
+        printFusedLocation(frame);
+        return;
+    }
 
-void initBLE() {
-    Serial.println("Initializing BLE...");
+    if (frame.type == MSG_TARGETS) {
+        const WireTargets& targets = frame.targets;
+        char target[16] = "all nodes";
+        if (targets.target != 0) snprintf(target, sizeof(target), "NODE-%03u", targets.target);
+        logger.printf("  🎯 Targets: operation %u for %s\n", targets.op, target);
+        if (targets.target == 0 || targets.target == LOCAL_NODE_INDEX) handleTargets(targets);
+        return;
+    }
 
-    NimBLEDevice::init(NODE_ID);
-    NimBLEScan* pBLEScan = NimBLEDevice::getScan();
+    if (frame.replayed) {
+        if (frame.replayAgeS == WIRE_AGE_UNKNOWN) {
+            logger.println("  Replayed from journal, age unknown");
+        } else {
+            logger.printf("  Replayed from journal, recorded %lu s ago\n", (unsigned long)frame.replayAgeS);
+        }
+    }
 
-    pBLEScan->setAdvertisedDeviceCallbacks(new BLEScanCallbacks(), false);
-    pBLEScan->setActiveScan(true); // Active scanning for better range
-    pBLEScan->setInterval(SCAN_INTERVAL);
-    pBLEScan->setWindow(SCAN_WINDOW);
+    // Where the hits were made: the frame's position, or for a live frame
+    // without one, the prediction from the node's last
+    const PositionTrack* track = nodeTracks.find(frame.node);
+    int32_t observerLat = frame.latE7, observerLon = frame.lonE7;
+    bool observerKnown = frame.hasPosition && !frame.replayed;
+    if (frame.hasPosition) {
+        logger.printf("  GPS: %.6f, %.6f", lat, lon);
+        if (!frame.replayed) printVelocity(frame);
+        logger.println();
+    } else if (!frame.replayed && track && frame.recordCount > 0) {
+        track->predict(nowMs, GPS_BEACON_MAX_INTERVAL_MS, observerLat, observerLon);
+        observerKnown = true;
+        logger.printf("  GPS: %.6f, %.6f (predicted, last position %lu s ago)\n",
+                      wireE7ToDegrees(observerLat), wireE7ToDegrees(observerLon),
+                      (unsigned long)((nowMs - track->atMs) / 1000));
+    }
 
-    Serial.println("BLE: Scanner initialized");
+    for (uint8_t i = 0; i < frame.recordCount; i++) {
+        const WireRecord& record = frame.records[i];
+        char mac[18];
+        formatMacKey(record.mac, mac);
+
+        if (frame.type == MSG_TRUE_HIT) {
+            logger.println("  🚨 TRUE HIT ALERT from mesh!");
+            logger.printf("  MAC: %s\n", mac);
+            logger.printf("  RSSI: %d dBm\n", record.rssi);
+
+            // Display alert on local OLED
+            displayTrueHit(mac, record.rssi);
+        } else if (frame.type == MSG_POSSIBLE_HIT) {
+            logger.println("  ⚠️  POSSIBLE HIT from mesh");
+            logger.printf("  MAC: %s\n", mac);
+            const char* deviceType;
+            const char* manufacturer;
+            if (possibleHitDevice(record.deviceIndex, deviceType, manufacturer)) {
+                logger.printf("  Device: %s\n", deviceType);
+            } else {
+                logger.printf("  Device: unknown (#%u)\n", record.deviceIndex);
+            }
+        }
+        printRange("  ", record.range);
+
+        // Replayed hits are too old to fit with live ones
+        if (FUSION && !frame.replayed) {
+            if (observerKnown) {
+                fuseDetection(frame.node, record, observerLat, observerLon, nowMs);
+            } else {
+                fusionUnplaced++;
+            }
+        }
+    }
 }
 
-void startBLEScan() {
-    Serial.println("BLE: Starting continuous scan...");
-    NimBLEScan* pBLEScan = NimBLEDevice::getScan();
-    pBLEScan->start(SCAN_DURATION, nullptr, false); // Continuous scan
+// Consumer end of loraRxQueue: decoding, logging and display for frames
+// from other nodes, off the radio task
+void meshRxTask(void* param) {
+    static LoRaRxFrame frame;
+    for (;;) {
+        // Sleep until a frame, console line or homebase hit arrives, or the
+        // next rebroadcast, ack or filter broadcast frame is due
+        uint32_t nowMs = millis();
+        uint32_t waitMs = meshRelay.msUntilDue(nowMs);
+        uint32_t ackMs = meshAcks.msUntilDue(nowMs);
+        uint32_t targetsMs = serviceTargets(nowMs);
+        if (ackMs < waitMs) waitMs = ackMs;
+        if (targetsMs < waitMs) waitMs = targetsMs;
+        waitForEvent(TASK_MESH_RX, ticksFor(waitMs));
+        while (loraRxQueue.pop(frame)) {
+            handleLoRaFrame(frame);
+        }
+        if (FUSION) fuseLocalDetections();
+        forwardDueRelays();
+        sendDueAcks();
+    }
+}
+
+void initLoRaTasks() {
+    // Without a radio there is nothing to send, scan or receive
+    if (!loraInitialized) return;
+
+    startTask(TASK_LORA_RADIO, loraRadioTask, &loraRadioTaskHandle);
+    startTask(TASK_MESH_RX, meshRxTask, &meshRxTaskHandle);
 }
 
 // ============================================================================
-// MAIN SETUP AND LOOP
+// CONFIGURATION
 // ============================================================================
 
-void setup() {
-    Serial.begin(115200);
-    delay(1000);
+#define NODE_ID NODE_ID_CONFIG
+#define SCAN_INTERVAL BLE_SCAN_INTERVAL
+#define SCAN_WINDOW BLE_SCAN_WINDOW
+#define SCAN_DURATION BLE_SCAN_DURATION
 
-    // Initialize OLED display
-    initDisplay();
+// GPS Serial (adjust for your Heltec version)
+HardwareSerial GPSSerial(1);
+
+// ============================================================================
+// GLOBAL VARIABLES
+// ============================================================================
+
+// Target MAC addresses (TRUE HIT) - packed and sorted at compile time from config.h
+static constexpr auto TARGET_MAC_TABLE = makeMacTable(TARGET_MACS);
+static_assert(TARGET_MAC_TABLE.valid(), "TARGET_MACS contains a malformed MAC address");
+
+// Medical device MAC prefixes (POSSIBLE HIT) - longest-prefix-match index
+// built at compile time from config.h
+static constexpr auto MEDICAL_PREFIX_INDEX = makePrefixIndex(MEDICAL_DEVICE_PREFIXES);
+static_assert(MEDICAL_PREFIX_INDEX.valid(), "MEDICAL_DEVICE_PREFIXES contains a malformed prefix");
+
+// Advertisement payload rules (POSSIBLE HIT) - parsed and sorted at
+// compile time. On the wire their device index follows the prefixes.
+static constexpr AdvertisementRule ADVERTISEMENT_RULE_LIST[] = { ADVERTISEMENT_RULES {nullptr, nullptr, nullptr} };
+static constexpr auto ADVERTISEMENT_RULE_SET = makeAdRuleSet(ADVERTISEMENT_RULE_LIST);
+static_assert(ADVERTISEMENT_RULE_SET.valid(), "ADVERTISEMENT_RULES contains a malformed rule");
+static_assert(NUM_MEDICAL_PREFIXES + ADVERTISEMENT_RULE_SET.size() < WIRE_DEVICE_REGISTRY,
+              "too many MAC prefixes and payload rules for the one-byte device index");
+
+// Target IRKs (TRUE HIT from rotating private addresses) - parsed at
+// compile time; the sentinel lets TARGET_IRKS in config.h be empty
+static constexpr TargetIrk TARGET_IRK_LIST[] = { TARGET_IRKS {nullptr, nullptr} };
+static constexpr auto TARGET_IRK_TABLE = makeIrkTable(TARGET_IRK_LIST);
+static_assert(TARGET_IRK_TABLE.valid(), "TARGET_IRKS contains a malformed IRK");
+
+// Detection statistics
+uint32_t totalScans = 0;
+uint32_t trueHits = 0;
+uint32_t possibleHits = 0;
+uint32_t payloadRuleMatches = 0;    // adverts matching an ADVERTISEMENT_RULES entry
+
+// ============================================================================
+// DETECTION QUEUE
+// ============================================================================
+
+// One advertisement as seen by the BLE callback. Kept small and fixed-size
+// so the NimBLE host task only copies 16 bytes per advert; everything slow
+// happens in detectionTask().
+struct DetectionRecord {
+    uint8_t addr[6];        // NimBLE native order (least significant byte first)
+    uint8_t addrType;       // BLE_ADDR_PUBLIC / BLE_ADDR_RANDOM
+    uint8_t advType;        // HCI advertising report event type
+    int8_t rssi;
+    uint8_t adFlags;        // AD type 0x01 (Flags) value, 0 if absent
+    int16_t adRule;         // first ADVERTISEMENT_RULES match, -1 if none
+    uint32_t timestampMs;   // millis() when the advert reached the host
+};
+static_assert(sizeof(DetectionRecord) == 16, "DetectionRecord layout changed");
+
+static_assert((DETECTION_QUEUE_DEPTH & (DETECTION_QUEUE_DEPTH - 1)) == 0,
+              "DETECTION_QUEUE_DEPTH must be a power of two");
+SpscRing<DetectionRecord, DETECTION_QUEUE_DEPTH> detectionQueue;
+TaskHandle_t detectionTaskHandle = nullptr;
+
+// Latest reported hit, written by the detection task for the scan
+// scheduler in the main loop, which it wakes
+volatile uint32_t detectionHitCount = 0;
+volatile uint32_t detectionHitAtMs = 0;
+
+// The latest fix: published by the GPS task, read by any task without a
+// lock (gps_receiver.h)
+GpsSnapshot<> gpsSnapshot;
+
+// Unix time at uptime 0 from the GPS clock (0 = none yet), for journal
+// timestamps; written by the GPS task
+volatile uint32_t gpsUtcAtBoot = 0;
+
+// Matched devices, owned by the detection task; decides when to report
+static_assert((DEVICE_CACHE_SIZE & (DEVICE_CACHE_SIZE - 1)) == 0,
+              "DEVICE_CACHE_SIZE must be a power of two");
+DeviceCache<DEVICE_CACHE_SIZE> deviceCache(DEVICE_CACHE_MAX_AGE_MS, DEVICE_REPORT_REFRESH_MS,
+                                           DEVICE_REPORT_RSSI_DELTA,
+                                           makeRssiFilterConfig(RSSI_WANDER_DB, RSSI_NOISE_DB,
+                                                                RSSI_TREND_WINDOW_MS, RSSI_TREND_DB));
+
+// Path-loss environment for range estimates: set by the console, read by
+// the detection task and, for hits that come without a range, target fusion
+static volatile uint8_t rssiEnvironment = RSSI_ENVIRONMENT;
+
+static uint8_t deviceRange(const DeviceEntry& device) {
+    return rssiRange(device.rssi.levelQ4, RSSI_AT_1M, rssiEnvironment, device.trend(deviceCache.filter()));
+}
+
+// ============================================================================
+// TARGET FUSION
+// ============================================================================
+
+// Homebase: report a fused location to the log, the host and, with
+// FUSION_BROADCAST, the field teams
+static void sendFusedLocation(const FusedLocation& location, uint32_t nowMs) {
+    static WireFrame frame;
+    frame = {};
+    frame.type = MSG_FUSED;
+    frame.timestampMs = nowMs;
+    frame.hasPosition = true;
+    frame.latE7 = location.latE7;
+    frame.lonE7 = location.lonE7;
+    frame.fused.mac = location.mac;
+    frame.fused.deviceIndex = location.deviceIndex;
+    frame.fused.observers = location.observers;
+    frame.fused.radiusDm = (uint16_t)lroundf(location.radiusM * 10.0f);
+
+    logger.println("\n📍 Target fusion:");
+    printFusedLocation(frame);
+    if (FUSION_BROADCAST) sendLoRaMessage(frame);
+
+    if (SERIAL_FRAMES) {
+        uint8_t buffer[WIRE_MAX_FRAME];
+        frame.node = LOCAL_NODE_INDEX;
+        frame.hopLimit = MESH_HOP_LIMIT;
+        size_t length = wireEncode(frame, buffer, sizeof(buffer));
+        if (length > 0) writeSerialFrame({SERIAL_SOURCE_FUSION, nowMs, 0, 0, 0, 0}, buffer, length);
+    }
+}
+
+// One live hit, made by node from (latE7, lonE7), into targetFusion
+static void fuseDetection(uint8_t node, const WireRecord& record, int32_t latE7, int32_t lonE7, uint32_t nowMs) {
+    uint8_t range = rssiRangeKnown(record.range) ? record.range :
+                    rssiRange((int16_t)(record.rssi * 16), RSSI_AT_1M, rssiEnvironment, RSSI_TREND_UNKNOWN);
+    FusedLocation location;
+    uint32_t startUs = micros();
+    bool due = targetFusion.observe(record.mac, record.deviceIndex, node, latE7, lonE7,
+                                    rssiRangeMeters(range), nowMs, location);
+    uint32_t elapsedUs = micros() - startUs;
+    fusionTotalUs += elapsedUs;
+    if (elapsedUs > fusionMaxUs) fusionMaxUs = elapsedUs;
+    if (due) sendFusedLocation(location, nowMs);
+}
+
+// The homebase's own hits, posted by the detection task
+static void fuseLocalDetections() {
+    FusionReport report;
+    while (localFusionQueue.pop(report)) {
+        fuseDetection(LOCAL_NODE_INDEX, report.record, report.latE7, report.lonE7, millis());
+    }
+}
+
+// RPA verdicts, owned by the detection task. A device resolved by an IRK
+// is tracked in the device cache under its key index rather than its
+// current address, so a rotation does not make it a new device.
+RpaResolver<TARGET_IRK_TABLE.size(), RPA_CACHE_SIZE> rpaResolver(TARGET_IRK_TABLE);
+constexpr uint64_t IRK_IDENTITY_KEY = 1ULL << 48;
+
+// Per-key ah() cost measured at boot, for the capacity figure in the report
+static uint32_t rpaAhNs = 0;
+
+// ============================================================================
+// RUNTIME TARGETS
+// ============================================================================
+
+// Exact MACs and the registry filter adverts are checked against, owned
+// by the detection task. meshRxTask loads them and sends each change
+// through targetUpdateQueue.
+static RuntimeTargets<RUNTIME_TARGET_CAPACITY> runtimeTargets;
+static XorFilter registryFilter;
+static uint32_t registryLookups = 0;
+static uint32_t registryMatches = 0;
+
+enum TargetUpdateOp : uint8_t {
+    TARGET_UPDATE_ADD,
+    TARGET_UPDATE_REMOVE,
+    TARGET_UPDATE_CLEAR,
+    TARGET_UPDATE_FILTER,   // use this filter (empty: none)
+};
+
+struct TargetUpdate {
+    uint8_t op;
+    uint64_t mac;
+    XorFilter filter;
+};
+static SpscRing<TargetUpdate, 8> targetUpdateQueue;
+
+// Owned by meshRxTask: both filter buffers, a copy of the runtime MACs
+// for NVS and the console, and the gateway's filter broadcast
+static TargetFilterLoader<TARGET_FILTER_MAX_BYTES> filterLoader;
+static RuntimeTargets<RUNTIME_TARGET_CAPACITY> installedTargets;
+
+struct FilterBroadcast {
+    bool active;
+    uint8_t target;         // node index, 0 = all
+    uint8_t round;
+    uint16_t next;          // 0 = the header, n = chunk n - 1
+    uint16_t crc;           // names the filter being sent
+    uint32_t nextMs;
+};
+static FilterBroadcast filterBroadcast = {};
+
+// Console requests for meshRxTask, filled by the main loop: targets
+// operations, plus two that only concern the console
+static constexpr uint8_t CONSOLE_TARGETS_LIST = 0x80;
+static constexpr uint8_t CONSOLE_FILTER_SEND = 0x81;
+static SpscRing<WireTargets, 4> consoleTargetsQueue;
+
+static bool targetsNvsReady = false;
+static uint32_t targetsNvsWrites = 0;
+static uint32_t targetsNvsFailures = 0;
+
+// Hand a change to the detection task
+static void postTargetUpdate(uint8_t op, uint64_t mac, const XorFilter& filter = XorFilter()) {
+    while (!targetUpdateQueue.push({op, mac, filter})) {
+        if (detectionTaskHandle != nullptr) xTaskNotifyGive(detectionTaskHandle);
+        vTaskDelay(1);
+    }
+    if (detectionTaskHandle != nullptr) xTaskNotifyGive(detectionTaskHandle);
+}
+
+// The detection task applies updates before its next lookup, so once the
+// queue is empty it no longer reads a filter that has been replaced
+static void waitForTargetUpdates() {
+    while (targetUpdateQueue.size() != 0) {
+        if (detectionTaskHandle != nullptr) xTaskNotifyGive(detectionTaskHandle);
+        vTaskDelay(1);
+    }
+}
+
+// Detection task only
+static void applyTargetUpdates() {
+    TargetUpdate update;
+    while (targetUpdateQueue.pop(update)) {
+        switch (update.op) {
+            case TARGET_UPDATE_ADD: runtimeTargets.add(update.mac); break;
+            case TARGET_UPDATE_REMOVE: runtimeTargets.remove(update.mac); break;
+            case TARGET_UPDATE_CLEAR: runtimeTargets.clear(); break;
+            case TARGET_UPDATE_FILTER: registryFilter = update.filter; break;
+        }
+    }
+}
+
+// Store a blob in the "targets" NVS partition; length 0 erases it
+static bool writeTargetsNvs(const char* key, const void* data, size_t length) {
+    if (!targetsNvsReady) return false;
+    nvs_handle_t nvs;
+    esp_err_t err = nvs_open_from_partition("targets", "targets", NVS_READWRITE, &nvs);
+    if (err == ESP_OK) {
+        err = length > 0 ? nvs_set_blob(nvs, key, data, length) : nvs_erase_key(nvs, key);
+        if (err == ESP_ERR_NVS_NOT_FOUND) err = ESP_OK;
+        if (err == ESP_OK) err = nvs_commit(nvs);
+        nvs_close(nvs);
+    }
+    if (err != ESP_OK) {
+        targetsNvsFailures++;
+        logger.printf("Targets: NVS write of %s failed (0x%x)\n", key, err);
+        return false;
+    }
+    targetsNvsWrites++;
+    return true;
+}
+
+static void saveRuntimeTargets() {
+    writeTargetsNvs("macs", installedTargets.keys(), installedTargets.size() * sizeof(uint64_t));
+}
+
+// Fingerprints first: a header without matching fingerprints fails its
+// CRC at boot, so a write cut short leaves no filter rather than a wrong one
+static void saveRegistryFilter(const XorFilter& filter) {
+    if (filter.empty()) {
+        writeTargetsNvs("filter_hdr", nullptr, 0);
+        writeTargetsNvs("filter", nullptr, 0);
+        return;
+    }
+    uint8_t header[TARGET_FILTER_HEADER_BYTES];
+    filter.header().encode(header);
+    if (writeTargetsNvs("filter", filter.fingerprints(), filter.header().bytes())) {
+        writeTargetsNvs("filter_hdr", header, sizeof(header));
+    }
+}
+
+static uint32_t registryFalseMatchOdds(const XorFilterHeader& header) {
+    return 1UL << header.fingerprintBits;
+}
 
-    Serial.println("\n\n");
-    Serial.println("================================");
-    Serial.println("btrpa-scan-lora");
-    Serial.println("BLE Detection Mesh Node");
-    Serial.println("================================");
-    Serial.printf("Node ID: %s\n", NODE_ID);
-    Serial.printf("Firmware Build: %s %s\n", __DATE__, __TIME__);
-    Serial.println("================================\n");
+// A targets operation for this node, from the mesh or the console;
+// meshRxTask only
+static void handleTargets(const WireTargets& targets) {
+    switch (targets.op) {
+        case WIRE_TARGETS_ADD:
+        case WIRE_TARGETS_REMOVE: {
+            if (targets.length < 6) return;
+            uint64_t mac = 0;
+            for (int i = 0; i < 6; i++) mac = mac << 8 | targets.data[i];
+            char text[18];
+            formatMacKey(mac, text);
+            bool add = targets.op == WIRE_TARGETS_ADD;
+            if (!(add ? installedTargets.add(mac) : installedTargets.remove(mac))) {
+                logger.printf("Targets: %s %s\n", text, !add ? "is not a runtime target" :
+                              installedTargets.contains(mac) ? "is already a target" : "not added, table full");
+                return;
+            }
+            postTargetUpdate(add ? TARGET_UPDATE_ADD : TARGET_UPDATE_REMOVE, mac);
+            saveRuntimeTargets();
+            logger.printf("Targets: %s %s (%u runtime)\n", add ? "added" : "removed", text,
+                          (unsigned)installedTargets.size());
+            return;
+        }
+        case WIRE_TARGETS_CLEAR:
+            installedTargets.clear();
+            postTargetUpdate(TARGET_UPDATE_CLEAR, 0);
+            saveRuntimeTargets();
+            logger.println("Targets: runtime targets cleared");
+            return;
+        case WIRE_TARGETS_FILTER: {
+            if (targets.length < TARGET_FILTER_HEADER_BYTES) return;
+            XorFilterHeader header = XorFilterHeader::decode(targets.data);
+            // begin() may overwrite the buffer of a filter just dropped
+            waitForTargetUpdates();
+            if (!filterLoader.begin(header)) {
+                bool installed = filterLoader.installed().header().crc == header.crc &&
+                                 !filterLoader.installed().empty();
+                logger.printf("Filter: %04X %s\n", header.crc, installed ? "already installed" : "rejected");
+                return;
+            }
+            logger.printf("Filter: loading %04X, %lu addresses in %u chunks (%u received)\n", header.crc,
+                          (unsigned long)header.entries, header.chunks(), filterLoader.received());
+            return;
+        }
+        case WIRE_TARGETS_CHUNK: {
+            XorFilterHeader header = filterLoader.loadingHeader();
+            TargetFilterChunkResult result = filterLoader.store(targets.filterCrc, targets.chunk, targets.data,
+                                                                targets.length);
+            if (result == FILTER_CHUNK_IGNORED) {
+                logger.printf("Filter: chunk %u of %04X not wanted\n", targets.chunk, targets.filterCrc);
+            } else if (result == FILTER_CHUNK_BAD_CRC) {
+                logger.printf("Filter: %04X failed its CRC, collecting it again\n", header.crc);
+            } else if (result == FILTER_CHUNK_COMPLETE) {
+                XorFilter filter = filterLoader.commit();
+                postTargetUpdate(TARGET_UPDATE_FILTER, 0, filter);
+                saveRegistryFilter(filter);
+                logger.printf("Filter: %04X installed, %lu addresses, %u bytes, 1 in %lu false matches\n",
+                              header.crc, (unsigned long)header.entries, (unsigned)header.bytes(),
+                              (unsigned long)registryFalseMatchOdds(header));
+            } else {
+                logger.printf("Filter: chunk %u, %u/%u received\n", targets.chunk, filterLoader.received(),
+                              header.chunks());
+            }
+            return;
+        }
+        case WIRE_TARGETS_DROP_FILTER:
+            filterLoader.drop();
+            filterBroadcast.active = false;
+            postTargetUpdate(TARGET_UPDATE_FILTER, 0);
+            saveRegistryFilter(XorFilter());
+            logger.println("Filter: dropped");
+            return;
+        default:
+            logger.printf("Targets: operation %u not supported\n", targets.op);
+            return;
+    }
+}
+
+static void sendTargets(const WireTargets& targets) {
+    WireFrame frame = {};
+    frame.type = MSG_TARGETS;
+    frame.timestampMs = millis();
+    frame.targets = targets;
+    sendLoRaMessage(frame);
+}
+
+static void listTargets() {
+    char mac[18];
+    logger.printf("Targets: %u runtime MACs (of %u)\n", (unsigned)installedTargets.size(),
+                  (unsigned)installedTargets.capacity());
+    for (size_t i = 0; i < installedTargets.size(); i++) {
+        logger.printf("  Target MAC: %s\n", formatMacKey(installedTargets.keys()[i], mac));
+    }
+    XorFilter filter = filterLoader.installed();
+    if (filter.empty()) {
+        logger.println("Filter: none");
+    } else {
+        const XorFilterHeader& header = filter.header();
+        logger.printf("Filter: %04X, %lu addresses, %u-bit, %u bytes, 1 in %lu false matches\n", header.crc,
+                      (unsigned long)header.entries, header.fingerprintBits, (unsigned)header.bytes(),
+                      (unsigned long)registryFalseMatchOdds(header));
+    }
+    if (filterLoader.loading()) {
+        const XorFilterHeader& header = filterLoader.loadingHeader();
+        logger.printf("Filter: loading %04X, %u/%u chunks\n", header.crc, filterLoader.received(),
+                      header.chunks());
+    }
+}
+
+static void startFilterBroadcast(uint8_t target) {
+    XorFilter filter = filterLoader.installed();
+    if (filter.empty()) {
+        logger.println("Filter: none installed to send");
+        return;
+    }
+    uint32_t frames = (filter.header().chunks() + 1UL) * TARGET_FILTER_ROUNDS;
+    filterBroadcast = {true, target, 0, 0, filter.header().crc, (uint32_t)millis()};
+    logger.printf("Filter: sending %04X, %lu frames over at least %lu s\n", filter.header().crc,
+                  (unsigned long)frames, (unsigned long)(frames * TARGET_FILTER_FRAME_INTERVAL_MS / 1000));
+}
+
+// Queue the next frame of the filter broadcast once it is due and the
+// transmitter has little else waiting; time until it wants to run again
+static uint32_t advanceFilterBroadcast(uint32_t nowMs) {
+    FilterBroadcast& broadcast = filterBroadcast;
+    if (!broadcast.active) return UINT32_MAX;
+    XorFilter filter = filterLoader.installed();
+    if (filter.empty() || filter.header().crc != broadcast.crc) {
+        broadcast.active = false;
+        logger.printf("Filter: stopped sending %04X, no longer installed\n", broadcast.crc);
+        return UINT32_MAX;
+    }
+    int32_t waitMs = (int32_t)(broadcast.nextMs - nowMs);
+    if (waitMs > 0) return (uint32_t)waitMs;
+    xSemaphoreTake(loraTxQueueMutex, portMAX_DELAY);
+    size_t waiting = loraTxQueue.size();
+    xSemaphoreGive(loraTxQueueMutex);
+    broadcast.nextMs = nowMs + TARGET_FILTER_FRAME_INTERVAL_MS;
+    if (waiting >= 2) return TARGET_FILTER_FRAME_INTERVAL_MS;
+
+    const XorFilterHeader& header = filter.header();
+    WireTargets targets = {};
+    targets.target = broadcast.target;
+    targets.filterCrc = header.crc;
+    if (broadcast.next == 0) {
+        targets.op = WIRE_TARGETS_FILTER;
+        header.encode(targets.data);
+        targets.length = TARGET_FILTER_HEADER_BYTES;
+    } else {
+        targets.op = WIRE_TARGETS_CHUNK;
+        targets.chunk = broadcast.next - 1;
+        size_t offset = (size_t)targets.chunk * TARGET_FILTER_CHUNK_BYTES;
+        size_t length = header.bytes() - offset;
+        if (length > TARGET_FILTER_CHUNK_BYTES) length = TARGET_FILTER_CHUNK_BYTES;
+        memcpy(targets.data, filter.fingerprints() + offset, length);
+        targets.length = (uint8_t)length;
+    }
+    sendTargets(targets);
+
+    if (++broadcast.next > header.chunks()) {
+        broadcast.next = 0;
+        if (++broadcast.round == TARGET_FILTER_ROUNDS) {
+            broadcast.active = false;
+            logger.printf("Filter: finished sending %04X\n", header.crc);
+            return UINT32_MAX;
+        }
+    }
+    return TARGET_FILTER_FRAME_INTERVAL_MS;
+}
+
+// Console requests, then the filter broadcast; meshRxTask only
+static uint32_t serviceTargets(uint32_t nowMs) {
+    WireTargets targets;
+    while (consoleTargetsQueue.pop(targets)) {
+        if (targets.op == CONSOLE_TARGETS_LIST) {
+            listTargets();
+        } else if (targets.op == CONSOLE_FILTER_SEND) {
+            startFilterBroadcast(targets.target);
+        } else {
+            if (targets.target == 0 || targets.target == LOCAL_NODE_INDEX) handleTargets(targets);
+            if (targets.target != LOCAL_NODE_INDEX) sendTargets(targets);
+        }
+    }
+    return advanceFilterBroadcast(nowMs);
+}
+
+// Runtime targets and the registry filter kept in NVS, installed before
+// the tasks that own them start
+void initTargets() {
+    esp_err_t err = nvs_flash_init_partition("targets");
+    if (err == ESP_ERR_NVS_NO_FREE_PAGES || err == ESP_ERR_NVS_NEW_VERSION_FOUND) {
+        nvs_flash_erase_partition("targets");
+        err = nvs_flash_init_partition("targets");
+    }
+    if (err != ESP_OK) {
+        logger.printf("Targets: no NVS partition (0x%x), runtime targets are lost at reboot\n", err);
+        return;
+    }
+    targetsNvsReady = true;
+
+    nvs_handle_t nvs;
+    if (nvs_open_from_partition("targets", "targets", NVS_READWRITE, &nvs) != ESP_OK) return;
+    uint64_t macs[RUNTIME_TARGET_CAPACITY];
+    size_t length = sizeof(macs);
+    if (nvs_get_blob(nvs, "macs", macs, &length) == ESP_OK) {
+        for (size_t i = 0; i < length / sizeof(uint64_t); i++) {
+            installedTargets.add(macs[i]);
+            runtimeTargets.add(macs[i]);
+        }
+    }
+    uint8_t header[TARGET_FILTER_HEADER_BYTES];
+    length = sizeof(header);
+    if (nvs_get_blob(nvs, "filter_hdr", header, &length) == ESP_OK && length == sizeof(header)) {
+        XorFilterHeader filter = XorFilterHeader::decode(header);
+        length = filterLoader.maxBytes();
+        if (nvs_get_blob(nvs, "filter", filterLoader.spareBuffer(), &length) != ESP_OK ||
+            length != filter.bytes() || !filterLoader.restore(filter)) {
+            logger.printf("Filter: %04X in NVS is damaged, ignored\n", filter.crc);
+        }
+        registryFilter = filterLoader.installed();
+    }
+    nvs_close(nvs);
+
+    logger.printf("Targets: %u runtime MACs from NVS", (unsigned)installedTargets.size());
+    if (!registryFilter.empty()) {
+        const XorFilterHeader& filter = registryFilter.header();
+        logger.printf(", registry filter %04X of %lu addresses (%u bytes, 1 in %lu false matches)", filter.crc,
+                      (unsigned long)filter.entries, (unsigned)filter.bytes(),
+                      (unsigned long)registryFalseMatchOdds(filter));
+    }
+    logger.println();
+}
+
+// ============================================================================
+// DETECTION PROCESSING
+// ============================================================================
+
+bool isTrueHit(uint64_t macKey) {
+    return TARGET_MAC_TABLE.contains(macKey) || runtimeTargets.contains(macKey);
+}
+
+// Registry filter lookup, for identity addresses only (public or random
+// static): private addresses change too often to be registered
+static bool isRegistryMatch(uint64_t macKey, uint8_t addrType) {
+    if (registryFilter.empty()) return false;
+    if (addrType == BLE_ADDR_RANDOM && (macKey >> 46) != 3) return false;
+    registryLookups++;
+    if (!registryFilter.contains(macKey)) return false;
+    registryMatches++;
+    return true;
+}
+
+// Device index for a POSSIBLE HIT (MAC prefix first, then payload rule),
+// or -1
+int possibleHitIndex(uint64_t macKey, int adRule) {
+    if (!ENABLE_MEDICAL_DEVICE_SCANNING) return -1;
+    int match = MEDICAL_PREFIX_INDEX.lookup(macKey);
+    if (match >= 0) return match;
+    return adRule >= 0 ? NUM_MEDICAL_PREFIXES + adRule : -1;
+}
+
+// Device type and manufacturer behind a device index; false if unknown
+static bool possibleHitDevice(uint8_t deviceIndex, const char*& deviceType, const char*& manufacturer) {
+    if (deviceIndex == WIRE_DEVICE_REGISTRY) {
+        deviceType = "Registry match";
+        manufacturer = "target filter";
+        return true;
+    }
+    if (deviceIndex < NUM_MEDICAL_PREFIXES) {
+        deviceType = MEDICAL_DEVICE_PREFIXES[deviceIndex].deviceType;
+        manufacturer = MEDICAL_DEVICE_PREFIXES[deviceIndex].manufacturer;
+        return true;
+    }
+    size_t rule = deviceIndex - NUM_MEDICAL_PREFIXES;
+    if (rule >= ADVERTISEMENT_RULE_SET.size()) return false;
+    deviceType = ADVERTISEMENT_RULE_LIST[rule].deviceType;
+    manufacturer = ADVERTISEMENT_RULE_LIST[rule].manufacturer;
+    return true;
+}
+
+// The snapshot if it holds a fix no older than GPS_MAX_FIX_AGE_MS, else
+// an empty one (valid() false): a stale position is worse than none
+static GpsFix currentPosition(uint32_t nowMs) {
+    GpsFix fix = gpsSnapshot.read();
+    if (!fix.valid() || fix.ageMs(nowMs) > GPS_MAX_FIX_AGE_MS) return GpsFix{};
+    return fix;
+}
+
+static void printPosition(const GpsFix& position) {
+    if (position.valid()) {
+        logger.printf("GPS: %.6f, %.6f (HDOP %.1f)\n", wireE7ToDegrees(position.latE7),
+                      wireE7ToDegrees(position.lonE7), position.hdopCenti / 100.0);
+    } else {
+        logger.println("GPS: N/A");
+    }
+}
+
+// Sighting history shown under each alert
+static void printSightings(const DeviceEntry& device, DeviceReport reason, uint8_t range) {
+    logger.printf("Report: %s (#%u)\n", deviceReportName(reason), device.reports);
+    logger.printf("Seen: %lu times over %lu s, RSSI max %d smoothed %d dBm\n",
+                  (unsigned long)device.sightings,
+                  (unsigned long)((device.lastSeenMs - device.firstSeenMs) / 1000),
+                  device.rssiMax, device.rssiMean());
+    printRange("", range);
+}
+
+// The detection task's part of an alert: a record for the alert log task,
+// the display and LoRa, none of which waits for the serial port
+static AlertLogEntry alertLogEntry(AlertLogKind kind, uint64_t macKey, int rssi, const GpsFix& position,
+                                   uint32_t timestampMs, const DeviceEntry& device, DeviceReport reason) {
+    AlertLogEntry entry = {};
+    entry.kind = kind;
+    entry.irk = -1;
+    entry.range = deviceRange(device);
+    entry.reason = reason;
+    entry.rssi = (int16_t)rssi;
+    entry.timestampMs = timestampMs;
+    entry.macKey = macKey;
+    entry.device = device;
+    entry.position = position;
+    return entry;
+}
+
+// irk: index into TARGET_IRK_LIST when macKey was resolved, else -1
+void handleTrueHit(uint64_t macKey, int irk, int rssi, const GpsFix& position, uint32_t timestampMs,
+                   const DeviceEntry& device, DeviceReport reason) {
+    AlertLogEntry entry = alertLogEntry(ALERT_LOG_TRUE_HIT, macKey, rssi, position, timestampMs, device, reason);
+    entry.irk = (int8_t)irk;
+    postAlertLog(entry);
+
+    // Display alert on OLED screen
+    char mac[18];
+    formatMacKey(macKey, mac);
+    displayTrueHit(mac, device.rssiMean());
+
+    // Send priority LoRa mesh message
+    sendTrueHitAlert(macKey, device.rssiMean(), entry.range, position, timestampMs);
+}
+
+void handlePossibleHit(uint64_t macKey, int rssi, const GpsFix& position,
+                       uint8_t deviceIndex, uint32_t timestampMs,
+                       const DeviceEntry& device, DeviceReport reason) {
+    AlertLogEntry entry = alertLogEntry(ALERT_LOG_POSSIBLE_HIT, macKey, rssi, position, timestampMs, device,
+                                        reason);
+    entry.deviceIndex = deviceIndex;
+    postAlertLog(entry);
+
+    // Display alert on OLED screen
+    char mac[18];
+    formatMacKey(macKey, mac);
+    const char* deviceType = "unknown";
+    const char* manufacturer = "unknown";
+    possibleHitDevice(deviceIndex, deviceType, manufacturer);
+    displayPossibleHit(mac, device.rssiMean(), deviceType);
+
+    // Send LoRa mesh message
+    sendPossibleHitAlert(macKey, device.rssiMean(), entry.range, position, deviceIndex, timestampMs);
+}
+
+void processDetection(const DetectionRecord& record) {
+    uint64_t macKey = macKeyFromNative(record.addr);
+
+    // Check for TRUE HIT (exact MAC match, or an RPA one of the IRKs resolves)
+    bool trueHit = isTrueHit(macKey);
+    int irk = trueHit ? -1 : rpaResolver.resolve(macKey, record.addrType == BLE_ADDR_RANDOM);
+    trueHit = trueHit || irk >= 0;
+    int deviceIndex = trueHit ? -1 : possibleHitIndex(macKey, record.adRule);
+    if (!trueHit && deviceIndex < 0 && isRegistryMatch(macKey, record.addrType)) {
+        deviceIndex = WIRE_DEVICE_REGISTRY;
+    }
+    if (!trueHit && deviceIndex < 0) return;
+
+    // The scanner delivers every advertisement; the cache decides which
+    // sightings are worth a report
+    const DeviceEntry* device;
+    uint64_t deviceKey = irk >= 0 ? IRK_IDENTITY_KEY | (uint64_t)irk : macKey;
+    DeviceReport reason = deviceCache.observe(deviceKey, record.rssi, record.timestampMs, device);
+    if (reason == DEVICE_SUPPRESS) return;
+    detectionHitAtMs = record.timestampMs;
+    detectionHitCount = detectionHitCount + 1;
+    xTaskNotifyGive(mainLoopTaskHandle);
+
+    // The node's position, if it has a recent fix
+    GpsFix position = currentPosition(millis());
+
+    if (trueHit) {
+        trueHits++;
+        handleTrueHit(macKey, irk, record.rssi, position, record.timestampMs, *device, reason);
+    } else {
+        // POSSIBLE HIT (medical device prefix, payload rule or registry match)
+        possibleHits++;
+        handlePossibleHit(macKey, record.rssi, position, (uint8_t)deviceIndex, record.timestampMs,
+                          *device, reason);
+    }
+}
+
+// Consumer end of detectionQueue, pinned away from the NimBLE host core
+void detectionTask(void* param) {
+    DetectionRecord record;
+    for (;;) {
+        // Sleep until the next advert, or until a pending batch is due
+        waitForEvent(TASK_DETECTION, possibleHitBatch.empty() ? portMAX_DELAY :
+                                     ticksFor(possibleHitBatch.msUntilDue(millis())));
+        applyTargetUpdates();
+        while (detectionQueue.pop(record)) {
+            processDetection(record);
+        }
+        if (possibleHitBatch.due(millis())) flushPossibleHitBatch();
+    }
+}
+
+// Check ah() against the known answers on this AES engine, load the keys
+// and time one block, so the report can state how many new addresses per
+// second the key set can absorb
+void initRpaResolver() {
+    if (!rpaSelfTest()) {
+        logger.println("IRK: ah() self-test FAILED, RPA resolution disabled");
+        return;
+    }
+    rpaResolver.begin();
+
+    mbedtls_aes_context aes;
+    mbedtls_aes_init(&aes);
+    mbedtls_aes_setkey_enc(&aes, RPA_TEST_VECTORS[0].irk, 128);
+    const uint32_t rounds = 256;
+    uint32_t matches = 0;
+    uint32_t start = micros();
+    for (uint32_t i = 0; i < rounds; i++) {
+        matches += rpaHashMatches(&aes, RPA_TEST_VECTORS[0].address ^ ((uint64_t)i << 24)) ? 1 : 0;
+    }
+    rpaAhNs = (uint32_t)((micros() - start) * 1000ULL / rounds);
+    mbedtls_aes_free(&aes);
+
+    logger.printf("IRK: ah() self-test passed, %lu ns per key", (unsigned long)rpaAhNs);
+    if (TARGET_IRK_TABLE.size() > 0 && rpaAhNs > 0) {
+        logger.printf(", %u keys resolve %lu new addresses/s",
+                      (unsigned)TARGET_IRK_TABLE.size(),
+                      (unsigned long)(1000000000ULL / ((uint64_t)rpaAhNs * TARGET_IRK_TABLE.size())));
+    }
+    logger.println(matches == 1 ? "" : " (benchmark mismatch)");
+}
+
+void initDetectionTask() {
+    startTask(TASK_DETECTION, detectionTask, &detectionTaskHandle);
+}
+
+// ============================================================================
+// ALERT LOG
+// ============================================================================
+
+static void printTrueHit(const AlertLogEntry& entry) {
+    char mac[18];
+    formatMacKey(entry.macKey, mac);
+
+    logger.println("\n🚨 ========== TRUE HIT ==========");
+    logger.printf("Node: %s\n", NODE_ID);
+    logger.printf("Target MAC: %s\n", mac);
+    if (entry.irk >= 0) {
+        logger.printf("IRK resolved: %s\n", TARGET_IRK_LIST[entry.irk].label);
+    }
+    logger.printf("RSSI: %d dBm\n", entry.rssi);
+
+    printPosition(entry.position);
+
+    logger.printf("Time: %lu ms\n", (unsigned long)entry.timestampMs);
+    printSightings(entry.device, entry.reason, entry.range);
+    logger.println("================================\n");
+}
+
+static void printPossibleHit(const AlertLogEntry& entry) {
+    char mac[18];
+    formatMacKey(entry.macKey, mac);
+    const char* deviceType = "unknown";
+    const char* manufacturer = "unknown";
+    possibleHitDevice(entry.deviceIndex, deviceType, manufacturer);
+
+    logger.println("\n⚠️  ======== POSSIBLE HIT ========");
+    logger.printf("Node: %s\n", NODE_ID);
+    logger.printf("MAC: %s\n", mac);
+    logger.printf("Device: %s (%s)\n", deviceType, manufacturer);
+    if (entry.deviceIndex == WIRE_DEVICE_REGISTRY) {
+        logger.println("Matched: registry filter, to be confirmed by the homebase");
+    } else if (entry.deviceIndex >= NUM_MEDICAL_PREFIXES) {
+        logger.printf("Matched: advertisement %s\n",
+                      ADVERTISEMENT_RULE_LIST[entry.deviceIndex - NUM_MEDICAL_PREFIXES].rule);
+    }
+    logger.printf("RSSI: %d dBm\n", entry.rssi);
+
+    printPosition(entry.position);
+
+    logger.printf("Time: %lu ms\n", (unsigned long)entry.timestampMs);
+    printSightings(entry.device, entry.reason, entry.range);
+    logger.println("================================\n");
+}
+
+static void printHitFrame(const AlertLogEntry& entry) {
+    if (entry.frameType == MSG_TRUE_HIT) {
+        logger.println("📡 Sending TRUE HIT via LoRa mesh...");
+    } else {
+        logger.printf("📡 Sending %u POSSIBLE HIT%s via LoRa mesh...\n", entry.recordCount,
+                      entry.recordCount == 1 ? "" : "s");
+    }
+    if (loraInitialized) printQueued(entry.frameType, entry.queued, entry.frameBytes, entry.txWaiting);
+}
+
+// Prints what the detection task posts and, on the homebase, writes its
+// own hits to the host; below detection and the radio, on the background
+// core. A slow port backs up alertLogQueue, never detectionQueue.
+void alertLogTask(void* param) {
+    AlertLogEntry entry;
+    LocalSerialFrame local;
+    for (;;) {
+        waitForEvent(TASK_ALERT_LOG, portMAX_DELAY);
+        while (localSerialQueue.pop(local)) {
+            writeSerialFrame({SERIAL_SOURCE_LOCAL, local.uptimeMs, 0, 0, 0, 0}, local.wire, local.length);
+        }
+        while (alertLogQueue.pop(entry)) {
+            switch (entry.kind) {
+                case ALERT_LOG_TRUE_HIT: printTrueHit(entry); break;
+                case ALERT_LOG_POSSIBLE_HIT: printPossibleHit(entry); break;
+                case ALERT_LOG_FRAME: printHitFrame(entry); break;
+            }
+        }
+    }
+}
+
+// ============================================================================
+// BLE SCANNING CALLBACKS
+// ============================================================================
+
+// Runs on the NimBLE host task: copy the advert into the detection queue
+// and return. Matching, display and LoRa happen in detectionTask().
+class BLEScanCallbacks : public NimBLEAdvertisedDeviceCallbacks {
+
+    void onResult(NimBLEAdvertisedDevice* advertisedDevice) {
+        totalScans++;
+
+        // Everything up to the enqueue must not touch the heap: counted in
+        // DEBUG_COUNT_ALLOCATIONS builds
+        {
+            AllocScope noHeap;
+            NimBLEAddress address = advertisedDevice->getAddress();
+            DetectionRecord record;
+            memcpy(record.addr, address.getNative(), sizeof(record.addr));
+            record.addrType = address.getType();
+            record.advType = advertisedDevice->getAdvType();
+            record.rssi = (int8_t)advertisedDevice->getRSSI();
+            // One pass over the raw AD structures for Flags and payload rules;
+            // the payload is not kept once this returns
+            AdScanResult ad = scanAdvertisement(ADVERTISEMENT_RULE_SET,
+                                                advertisedDevice->getPayload(),
+                                                advertisedDevice->getPayloadLength());
+            record.adFlags = ad.flags;
+            record.adRule = ad.rule;
+            if (ad.rule >= 0) payloadRuleMatches++;
+            record.timestampMs = millis();
+
+            if (detectionQueue.push(record)) {
+                xTaskNotifyGive(detectionTaskHandle);
+            }
+        }
+
+        // DEBUG: Show all detected devices (slow; the name is only available here)
+        #if DEBUG_SHOW_ALL_DEVICES
+        char debugMac[18];
+        logger.printf("[BLE] Device: %s | RSSI: %d dBm",
+                      formatMacKey(macKeyFromNative(advertisedDevice->getAddress().getNative()),
+                                   debugMac),
+                      advertisedDevice->getRSSI());
+        if (advertisedDevice->haveName()) {
+            logger.printf(" | Name: %s", advertisedDevice->getName().c_str());
+        }
+        logger.println();
+        #endif
+    }
+
+    // Note: Buzzer functions removed - Heltec V3 uses OLED display for alerts
+    // If external buzzer is added, buzzer alert functions can be re-enabled
+};
+
+// ============================================================================
+// GPS FUNCTIONS
+// ============================================================================
+
+TaskHandle_t gpsTaskHandle = nullptr;
+
+// Sentences are parsed once the module pauses after a burst, not per byte;
+// the timeout covers a UART that stops raising events
+static constexpr uint32_t GPS_EVENT_TIMEOUT_MS = 5000;
+
+static_assert((uint64_t)GPS_BAUD / 10 * GPS_RATE_MS / 1000 >= 2 * 82,
+              "GPS_BAUD is too slow for a GGA and an RMC sentence every GPS_RATE_MS");
+
+// Parser and fix, owned by the GPS task; other tasks read gpsSnapshot
+static GpsParser gpsParser;
+static GpsFix gpsFix = {};
+
+enum GpsDialect : uint8_t { GPS_DIALECT_NMEA, GPS_DIALECT_UBX, GPS_DIALECT_PMTK };
+static const char* const GPS_DIALECT_NAMES[] = {"NMEA-only", "u-blox", "MediaTek"};
+
+// What the GPS task has learned about the module
+struct GpsLink {
+    GpsDialect dialect = GPS_DIALECT_NMEA;     // until the module acknowledges a command
+    uint32_t baud = GPS_MODULE_BAUD;
+    uint32_t sinceMs = 0;           // commands sent or baud rate changed
+    uint32_t heard = 0;             // sentences and UBX frames parsed
+    uint32_t heardMs = 0;           // when the count last moved
+    bool announced = false;         // "Connected" or "No module" printed
+    GpsDialect reported = GPS_DIALECT_NMEA;
+    bool resent = false;            // configuration repeated for a late module
+    bool baudDone = false;          // switched to GPS_BAUD, or gave up
+};
+static GpsLink gpsLink;
+
+// UART overflows and framing errors, counted on the UART event task
+volatile uint32_t gpsUartErrors = 0;
+
+void gpsTask(void* param);
+
+// Runs on the UART driver's event task when the line goes idle
+static void onGpsReceive() {
+    xTaskNotifyGive(gpsTaskHandle);
+}
+
+static void onGpsReceiveError(hardwareSerial_error_t error) {
+    gpsUartErrors = gpsUartErrors + 1;
+}
+
+// Returns at once: the GPS task configures the module and reports what it
+// finds
+void initGPS() {
+    logger.println("Initializing GPS...");
+    // Room for a whole burst of sentences between events (~500 bytes at
+    // 1 Hz before the module is configured, ~150 after)
+    GPSSerial.setRxBufferSize(1024);
+    GPSSerial.begin(GPS_MODULE_BAUD, SERIAL_8N1, GPS_RX_PIN, GPS_TX_PIN);
+    startTask(TASK_GPS, gpsTask, &gpsTaskHandle);
+    GPSSerial.onReceive(onGpsReceive, true);
+    GPSSerial.onReceiveError(onGpsReceiveError);
+}
+
+// GGA and RMC every GPS_RATE_MS, in both dialects: the module answers the
+// one it speaks and ignores the other
+static void sendGpsConfiguration() {
+    uint8_t ubx[GPS_COMMAND_BYTES];
+    char pmtk[GPS_COMMAND_BYTES];
+    GPSSerial.write(ubx, GpsCommands::ubxConfigure(ubx, GPS_RATE_MS));
+    GPSSerial.write((const uint8_t*)pmtk, GpsCommands::pmtkConfigure(pmtk, GPS_RATE_MS));
+}
+
+static void switchGpsBaud(uint32_t baud) {
+    uint8_t command[GPS_COMMAND_BYTES];
+    size_t length = gpsLink.dialect == GPS_DIALECT_UBX ? GpsCommands::ubxBaud(command, baud) :
+                                                         GpsCommands::pmtkBaud((char*)command, baud);
+    GPSSerial.write(command, length);
+    GPSSerial.flush();      // out at the old rate before the UART changes
+    GPSSerial.updateBaudRate(baud);
+    gpsLink.baud = baud;
+    gpsLink.sinceMs = millis();
+}
+
+// Drain the UART through the parser and publish the fix once per burst.
+// True if a position sentence arrived.
+bool updateGPS() {
+    uint32_t nowMs = millis();
+    bool positionUpdated = false;
+    uint8_t buffer[128];
+    int available;
+    while ((available = GPSSerial.available()) > 0) {
+        size_t n = GPSSerial.read(buffer, available < (int)sizeof(buffer) ? (size_t)available : sizeof(buffer));
+        for (size_t i = 0; i < n; i++) {
+            switch (gpsParser.feed(buffer[i], gpsFix)) {
+            case GPS_RMC:
+                // Unix time for journal timestamps
+                if (gpsFix.utc != 0) gpsUtcAtBoot = gpsFix.utc - nowMs / 1000;
+                // fall through
+            case GPS_GGA:
+                if (gpsFix.quality != 0) gpsFix.fixMs = nowMs;
+                positionUpdated = true;
+                break;
+            case GPS_UBX_ACK:
+                if (gpsParser.ackedCommand() == UBX_CFG_RATE) gpsLink.dialect = GPS_DIALECT_UBX;
+                break;
+            case GPS_PMTK_ACK:
+                if (gpsParser.ackedCommand() == PMTK_SET_FIX_INTERVAL) gpsLink.dialect = GPS_DIALECT_PMTK;
+                break;
+            case GPS_UBX_NAK:
+            case GPS_PMTK_NAK:
+                logger.printf("GPS: module rejected command %04x\n", gpsParser.ackedCommand());
+                break;
+            default:
+                break;
+            }
+        }
+    }
+    uint32_t heard = gpsParser.stats().sentences + gpsParser.stats().ubxFrames;
+    if (heard != gpsLink.heard) {
+        gpsLink.heard = heard;
+        gpsLink.heardMs = nowMs;
+    }
+    if (positionUpdated) gpsSnapshot.publish(gpsFix);
+    return positionUpdated;
+}
+
+// Reports the module once it is heard, repeats the configuration for one
+// that started after it was sent, and raises the baud rate once the
+// module's dialect is known (falling back if nothing arrives at the new
+// rate). Returns how long the task may sleep.
+static uint32_t serviceGpsLink(uint32_t nowMs) {
+    // Anything parsed since the commands or the baud change
+    bool heard = gpsLink.heard != 0 && (int32_t)(gpsLink.heardMs - gpsLink.sinceMs) >= 0;
+    if (heard && !gpsLink.announced) {
+        logger.printf("GPS: Connected at %lu baud\n", (unsigned long)gpsLink.baud);
+        gpsLink.announced = true;
+    }
+    if (gpsLink.dialect != gpsLink.reported) {
+        gpsLink.reported = gpsLink.dialect;
+        logger.printf("GPS: %s module, GGA and RMC every %u ms\n", GPS_DIALECT_NAMES[gpsLink.dialect],
+                      (unsigned)GPS_RATE_MS);
+    }
+    if (heard && gpsLink.dialect == GPS_DIALECT_NMEA && GPS_CONFIGURE_MODULE && !gpsLink.resent &&
+        nowMs - gpsLink.sinceMs >= GPS_INIT_TIMEOUT) {
+        sendGpsConfiguration();
+        gpsLink.resent = true;
+    }
+    if (gpsLink.dialect != GPS_DIALECT_NMEA && !gpsLink.baudDone && GPS_BAUD != gpsLink.baud) {
+        logger.printf("GPS: switching to %lu baud\n", (unsigned long)GPS_BAUD);
+        switchGpsBaud(GPS_BAUD);
+        gpsLink.baudDone = true;
+        return GPS_INIT_TIMEOUT;
+    }
+    if (heard) return GPS_EVENT_TIMEOUT_MS;
+
+    uint32_t elapsedMs = nowMs - gpsLink.sinceMs;
+    if (elapsedMs < GPS_INIT_TIMEOUT) return GPS_INIT_TIMEOUT - elapsedMs;
+    if (gpsLink.baud != GPS_MODULE_BAUD) {
+        logger.printf("GPS: nothing at %lu baud, back to %lu\n", (unsigned long)gpsLink.baud,
+                      (unsigned long)GPS_MODULE_BAUD);
+        GPSSerial.updateBaudRate(GPS_MODULE_BAUD);
+        gpsLink.baud = GPS_MODULE_BAUD;
+        gpsLink.sinceMs = nowMs;
+        return GPS_INIT_TIMEOUT;
+    }
+    if (!gpsLink.announced) {
+        logger.println("GPS: No module detected (continuing without GPS)");
+        gpsLink.announced = true;
+    }
+    return GPS_EVENT_TIMEOUT_MS;
+}
+
+// When to beacon, owned by the GPS task
+static BeaconPolicy beaconPolicy((uint32_t)(GPS_MOVEMENT_THRESHOLD * 100), GPS_BEACON_MIN_INTERVAL_MS,
+                                 GPS_BEACON_MAX_INTERVAL_MS);
+
+// A beacon when the fix strays from what the homebase extrapolates, or
+// the longest interval passes. A hit frame that carried the position since
+// counts as a beacon.
+static void sendPositionBeaconIfDue(uint32_t nowMs) {
+    beaconPolicy.sentWithHit(positionSentWithHit.read());
+    BeaconReason reason = beaconPolicy.due(gpsFix, nowMs);
+    if (reason == BEACON_NONE) return;
+
+    logger.printf("📍 Position Beacon: %.6f, %.6f (%s)\n", wireE7ToDegrees(gpsFix.latE7),
+                  wireE7ToDegrees(gpsFix.lonE7), beaconReasonName(reason));
+    beaconPolicy.sent(sendPositionBeaconLoRa(gpsFix), reason);
+}
+
+// Owns the UART, the parser and the module: woken when a burst of
+// sentences has arrived, parses it, publishes the fix and sends a beacon
+// if the node is off its extrapolated track
+void gpsTask(void* param) {
+    if (GPS_CONFIGURE_MODULE) sendGpsConfiguration();
+    gpsLink.sinceMs = millis();
+    uint32_t waitMs = GPS_INIT_TIMEOUT;
+    for (;;) {
+        waitForEvent(TASK_GPS, ticksFor(waitMs));
+        if (updateGPS()) sendPositionBeaconIfDue(millis());
+        waitMs = serviceGpsLink(millis());
+    }
+}
+
+// ============================================================================
+// DETECTION JOURNAL
+// ============================================================================
+
+// The "journal" data partition (partitions.csv) under FlashJournal. Every
+// write or erase stalls both cores' caches until the flash is done.
+struct PartitionFlash {
+    const esp_partition_t* partition = nullptr;
+
+    uint32_t size() const { return partition ? partition->size : 0; }
+
+    bool read(uint32_t offset, void* data, size_t length) {
+        return esp_partition_read(partition, offset, data, length) == ESP_OK;
+    }
+
+    bool write(uint32_t offset, const void* data, size_t length) {
+        return esp_partition_write(partition, offset, data, length) == ESP_OK;
+    }
+
+    bool erase(uint32_t offset, size_t length) {
+        return esp_partition_erase_range(partition, offset, length) == ESP_OK;
+    }
+};
+
+// One 256-byte flash page of records per write
+static constexpr size_t JOURNAL_BATCH_RECORDS = 8;
+// Replay frames waiting for an ack at once
+static constexpr size_t JOURNAL_REPLAY_FRAMES = 2;
+
+// Owned by the journal task after setup
+static PartitionFlash journalFlash;
+static FlashJournal<PartitionFlash, JOURNAL_BATCH_RECORDS> journal(journalFlash);
+static JournalInFlight<16> journalInFlight;
+static constexpr uint32_t JOURNAL_REPLAY_SCAN = decltype(journal)::RECORDS_PER_SECTOR;
+bool journalReady = false;
+TaskHandle_t journalTaskHandle = nullptr;
+
+// A record from a detection frame the detection task sent (or failed to
+// queue), in frame order
+struct JournalEntry {
+    WireRecord record;
+    uint8_t type;
+    uint8_t sequence;       // frame it went out in
+    bool sent;              // queued for LoRa
+    bool last;              // last record of its frame
+    bool hasPosition;
+    int32_t latE7;
+    int32_t lonE7;
+};
+
+// Detections from the detection task, acks from meshRxTask
+static SpscRing<JournalEntry, 32> journalQueue;
+static SpscRing<WireAck, 8> journalAckQueue;
+
+enum JournalDump : uint8_t {
+    JOURNAL_DUMP_NONE,
+    JOURNAL_DUMP_ALL,
+    JOURNAL_DUMP_PENDING,
+};
+static volatile uint8_t journalDumpRequest = JOURNAL_DUMP_NONE;    // set by the console
+
+// Written by the journal task for the report
+static uint32_t journalFlushUs = 0;
+static uint32_t journalFlushMaxUs = 0;
+static uint32_t journalRecoveryUs = 0;
+static uint32_t journalReplayFrames = 0;
+static uint32_t journalReplayRecords = 0;
+static volatile uint32_t homebaseAckMs = 0;
+static volatile bool homebaseHeard = false;
+static uint32_t journalNextReplayMs = 0;
+
+static void journalDetections(const WireFrame& frame, bool sent) {
+    if (!journalReady) return;
+    for (uint8_t i = 0; i < frame.recordCount; i++) {
+        // A full ring is counted by journalQueue.overflows()
+        journalQueue.push({frame.records[i], frame.type, frame.sequence, sent,
+                           (uint8_t)(i + 1) == frame.recordCount, frame.hasPosition, frame.latE7, frame.lonE7});
+    }
+    xTaskNotifyGive(journalTaskHandle);
+}
+
+void postJournalAck(const WireAck& ack) {
+    if (!journalReady) return;
+    journalAckQueue.push(ack);
+    xTaskNotifyGive(journalTaskHandle);
+}
+
+static bool homebaseReachable(uint32_t nowMs) {
+    return homebaseHeard && nowMs - homebaseAckMs < JOURNAL_REACHABLE_MS;
+}
+
+static void flushJournal() {
+    if (journal.buffered() == 0) return;
+    uint32_t start = micros();
+    journal.flush();
+    uint32_t us = micros() - start;
+    journalFlushUs += us;
+    if (us > journalFlushMaxUs) journalFlushMaxUs = us;
+}
+
+// Records from this boot are aged by uptime, older ones by the GPS clock
+static uint32_t journalAgeS(uint16_t boot, uint32_t uptimeMs, uint32_t utc, uint32_t nowMs) {
+    uint32_t age = WIRE_AGE_UNKNOWN;
+    if (boot == journal.boot()) {
+        age = (nowMs - uptimeMs) / 1000;
+    } else if (utc != 0 && gpsUtcAtBoot != 0) {
+        age = gpsUtcAtBoot + nowMs / 1000 - utc;
+    }
+    return age < WIRE_AGE_UNKNOWN ? age : WIRE_AGE_UNKNOWN;
+}
+
+static void journalAcknowledge(const WireAck& ack, uint32_t nowMs) {
+    if (!homebaseHeard) journalNextReplayMs = nowMs;
+    homebaseAckMs = nowMs;
+    homebaseHeard = true;
+
+    JournalInFlight<16>::Frame frame;
+    for (uint8_t n = 0; n <= 16; n++) {
+        if (n > 0 && !(ack.following & (1u << (n - 1)))) continue;
+        if (!journalInFlight.acked((uint8_t)(ack.sequence + n), frame)) continue;
+        for (uint8_t i = 0; i < frame.count; i++) journal.ack(frame.ids[i]);
+    }
+}
+
+// While the homebase answers, send unacknowledged records again, oldest
+// first: records of one type, boot and position within 60 s share a frame
+static void replayJournal(uint32_t nowMs) {
+    if (!homebaseReachable(nowMs) || journal.pending() == 0) return;
+    if (journalInFlight.replaysWaiting() >= JOURNAL_REPLAY_FRAMES) return;
+    if ((int32_t)(nowMs - journalNextReplayMs) < 0) return;
+    journalNextReplayMs = nowMs + JOURNAL_REPLAY_INTERVAL_MS;
+
+    static WireFrame frame;
+    frame = {};
+    uint32_t ids[WIRE_MAX_RECORDS];
+    uint16_t boot = 0;
+    uint32_t oldestMs = 0, newestMs = 0, oldestUtc = 0;
+    JournalRecord record;
+    journal.skipAcked(JOURNAL_REPLAY_SCAN);
+    uint32_t end = journal.endId();
+    for (uint32_t id = journal.oldestPendingId(), scanned = 0;
+         id < end && scanned < JOURNAL_REPLAY_SCAN && frame.recordCount < WIRE_MAX_RECORDS; id++, scanned++) {
+        if (!journal.read(id, record) || record.acked || journalInFlight.contains(id)) continue;
+        if (frame.recordCount == 0) {
+            frame.type = record.type;
+            frame.hasPosition = record.hasPosition;
+            frame.latE7 = record.latE7;
+            frame.lonE7 = record.lonE7;
+            boot = record.boot;
+            oldestMs = newestMs = record.uptimeMs;
+            oldestUtc = record.utc;
+        } else if (record.type != frame.type || record.boot != boot || record.hasPosition != frame.hasPosition ||
+                   record.latE7 != frame.latE7 || record.lonE7 != frame.lonE7) {
+            continue;
+        }
+        uint32_t from = record.uptimeMs < oldestMs ? record.uptimeMs : oldestMs;
+        uint32_t to = record.uptimeMs > newestMs ? record.uptimeMs : newestMs;
+        if (to - from > 60000) continue;
+        if (record.uptimeMs < oldestMs) oldestUtc = record.utc;
+        oldestMs = from;
+        newestMs = to;
+        frame.records[frame.recordCount] = {record.uptimeMs, record.mac, record.rssi, record.deviceIndex,
+                                            record.range};
+        ids[frame.recordCount++] = id;
+    }
+    if (frame.recordCount == 0) return;
+
+    frame.replayed = true;
+    frame.replayAgeS = journalAgeS(boot, oldestMs, oldestUtc, nowMs);
+    logger.printf("📡 Replaying %u journaled %s%s via LoRa mesh...\n", frame.recordCount,
+                  frame.type == MSG_TRUE_HIT ? "TRUE HIT" : "POSSIBLE HIT", frame.recordCount == 1 ? "" : "s");
+    if (!sendLoRaMessage(frame)) return;
+    journalInFlight.add(frame.sequence, ids, frame.recordCount, true, nowMs);
+    journalReplayFrames++;
+    journalReplayRecords += frame.recordCount;
+}
+
+// USB dump, a chunk per pass so new detections keep being journaled:
+//   journal,<id>,<boot>,<uptime ms>,<utc>,<type>,<mac>,<rssi>,<device>,<lat>,<lon>,<state>,<range m>
+static void dumpJournal() {
+    static uint32_t nextId = 0, dumped = 0;
+    static bool active = false;
+    uint8_t mode = journalDumpRequest;
+    if (!active) {
+        flushJournal();
+        logger.printf("Journal dump: %lu records on flash, %lu pending\n",
+                      (unsigned long)(journal.endId() - journal.oldestId()), (unsigned long)journal.pending());
+        logger.println("journal,id,boot,uptime_ms,utc,type,mac,rssi,device,lat,lon,state,range_m");
+        nextId = mode == JOURNAL_DUMP_PENDING ? journal.oldestPendingId() : journal.oldestId();
+        dumped = 0;
+        active = true;
+    }
+
+    JournalRecord record;
+    for (uint8_t n = 0; n < 32 && nextId < journal.endId(); n++, nextId++) {
+        if (!journal.read(nextId, record)) continue;
+        if (mode == JOURNAL_DUMP_PENDING && record.acked) continue;
+        char mac[18];
+        formatMacKey(record.mac, mac);
+        const char* deviceType = "";
+        const char* manufacturer;
+        if (record.type == MSG_POSSIBLE_HIT) possibleHitDevice(record.deviceIndex, deviceType, manufacturer);
+        logger.printf("journal,%lu,%u,%lu,%lu,%s,%s,%d,%s,", (unsigned long)nextId, record.boot,
+                      (unsigned long)record.uptimeMs, (unsigned long)record.utc,
+                      record.type == MSG_TRUE_HIT ? "TRUE_HIT" : "POSSIBLE_HIT", mac, record.rssi, deviceType);
+        if (record.hasPosition) {
+            logger.printf("%.6f,%.6f,", wireE7ToDegrees(record.latE7), wireE7ToDegrees(record.lonE7));
+        } else {
+            logger.print(",,");
+        }
+        logger.print(record.acked ? "acked," : "pending,");
+        if (rssiRangeKnown(record.range)) logger.printf("%.1f", rssiRangeMeters(record.range));
+        logger.println();
+        dumped++;
+    }
+    if (nextId >= journal.endId()) {
+        logger.printf("Journal dump end: %lu records\n", (unsigned long)dumped);
+        active = false;
+        journalDumpRequest = JOURNAL_DUMP_NONE;
+    }
+}
+
+// Time until the next buffered write, ack timeout or replay is due
+static uint32_t journalWaitMs(uint32_t nowMs) {
+    if (journalDumpRequest != JOURNAL_DUMP_NONE) return 0;
+    uint32_t waitMs = journalInFlight.msUntilExpiry(nowMs, JOURNAL_ACK_TIMEOUT_MS);
+    if (journal.buffered() > 0) {
+        uint32_t bufferedMs = journal.bufferedMs(nowMs);
+        uint32_t flushMs = bufferedMs < JOURNAL_FLUSH_MS ? JOURNAL_FLUSH_MS - bufferedMs : 0;
+        if (flushMs < waitMs) waitMs = flushMs;
+    }
+    if (homebaseReachable(nowMs) && journal.pending() > 0 &&
+        journalInFlight.replaysWaiting() < JOURNAL_REPLAY_FRAMES) {
+        int32_t replayMs = (int32_t)(journalNextReplayMs - nowMs);
+        uint32_t ms = replayMs > 0 ? (uint32_t)replayMs : 0;
+        if (ms < waitMs) waitMs = ms;
+    }
+    return waitMs;
+}
+
+// Owns the journal: stores what the detection task sent, matches acks
+// from the homebase, replays what was never acknowledged and serves USB
+// dumps. Woken by both producers and the console; sleeps otherwise.
+void journalTask(void* param) {
+    JournalEntry entry;
+    WireAck ack;
+    uint32_t frameIds[WIRE_MAX_RECORDS];
+    uint8_t frameCount = 0, frameSequence = 0;
+    for (;;) {
+        waitForEvent(TASK_JOURNAL, ticksFor(journalWaitMs(millis())));
+        uint32_t nowMs = millis();
+
+        bool urgent = false;
+        while (journalQueue.pop(entry)) {
+            JournalRecord record = {};
+            record.boot = journal.boot();
+            record.type = entry.type;
+            record.deviceIndex = entry.record.deviceIndex;
+            record.uptimeMs = entry.record.timestampMs;
+            record.utc = gpsUtcAtBoot != 0 ? gpsUtcAtBoot + entry.record.timestampMs / 1000 : 0;
+            record.mac = entry.record.mac;
+            record.rssi = entry.record.rssi;
+            record.range = entry.record.range;
+            record.hasPosition = entry.hasPosition;
+            record.latE7 = entry.latE7;
+            record.lonE7 = entry.lonE7;
+            if (journal.buffered() == JOURNAL_BATCH_RECORDS) flushJournal();
+            uint32_t id = journal.add(record, nowMs);
+            urgent |= entry.type == MSG_TRUE_HIT;
+
+            // Until the homebase acknowledges the frame it went out in
+            if (!entry.sent) continue;
+            if (frameCount > 0 && entry.sequence != frameSequence) frameCount = 0;
+            frameSequence = entry.sequence;
+            frameIds[frameCount++] = id;
+            if (entry.last || frameCount == WIRE_MAX_RECORDS) {
+                journalInFlight.add(entry.sequence, frameIds, frameCount, false, nowMs);
+                frameCount = 0;
+            }
+        }
+        while (journalAckQueue.pop(ack)) {
+            journalAcknowledge(ack, nowMs);
+        }
+        journalInFlight.expire(nowMs, JOURNAL_ACK_TIMEOUT_MS);
+
+        // TRUE HITs are written at once, others a page at a time or
+        // after JOURNAL_FLUSH_MS
+        if (urgent || journal.bufferedMs(nowMs) >= JOURNAL_FLUSH_MS) flushJournal();
+
+        replayJournal(nowMs);
+        if (journalDumpRequest != JOURNAL_DUMP_NONE) dumpJournal();
+    }
+}
+
+// Find the partition and recover the ring before the first detection
+void initJournal() {
+    journalFlash.partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, "journal");
+    if (journalFlash.partition == nullptr) {
+        logger.println("Journal: no \"journal\" partition, detections are not stored");
+        return;
+    }
+    uint32_t start = micros();
+    if (!journal.begin()) {
+        logger.println("Journal: partition too small");
+        return;
+    }
+    journalRecoveryUs = micros() - start;
+    const JournalStats& stats = journal.stats();
+    logger.printf("Journal: boot %u, recovered %lu records (%lu pending, %lu torn) from %lu KB in %.1f ms\n",
+                  journal.boot(), (unsigned long)stats.recovered, (unsigned long)journal.pending(),
+                  (unsigned long)stats.torn, (unsigned long)(journalFlash.size() / 1024), journalRecoveryUs / 1000.0);
+    journalReady = true;
+    startTask(TASK_JOURNAL, journalTask, &journalTaskHandle);
+}
+
+// ============================================================================
+// POWER MANAGEMENT
+// ============================================================================
+
+static_assert(SCAN_CONSERVATION_WINDOW_MS > 0 && SCAN_CONSERVATION_WINDOW_MS <= SCAN_CONSERVATION_INTERVAL_MS &&
+              SCAN_CONSERVATION_INTERVAL_MS <= 60000,
+              "SCAN_CONSERVATION_WINDOW_MS must be 1..SCAN_CONSERVATION_INTERVAL_MS (at most 60 s)");
+static_assert(BATTERY_LOW_MV <= BATTERY_RECOVER_MV, "BATTERY_RECOVER_MV must not be below BATTERY_LOW_MV");
+static_assert(WIRE_STATUS_PROFILES == SCAN_PROFILE_COUNT, "status frame carries one estimate per profile");
+
+// Gaps between scan windows shorter than this are left to the BLE
+// controller; longer ones the node sleeps through
+static constexpr uint16_t SCAN_SLEEP_MIN_GAP_MS = 1000;
+static_assert(SCAN_CONSERVATION_INTERVAL_MS - SCAN_CONSERVATION_WINDOW_MS >= SCAN_SLEEP_MIN_GAP_MS ||
+              SCAN_CONSERVATION_INTERVAL_MS <= 10240, "BLE scan intervals are limited to 10.24 s");
+
+static constexpr uint32_t BATTERY_SAMPLE_MS = 10000;
+
+// Owned by the main loop
+ScanScheduler scanScheduler({
+    {{SCAN_INTERVAL, SCAN_WINDOW},
+     {SCAN_CONSERVATION_INTERVAL_MS, SCAN_CONSERVATION_WINDOW_MS},
+     {SCAN_INTERVAL, SCAN_INTERVAL}},
+    SCAN_BURST_MS, SCAN_IDLE_CONSERVE_MS, BATTERY_LOW_MV, BATTERY_RECOVER_MV, SCAN_SLEEP_MIN_GAP_MS,
+}, HELTEC_V3_POWER_MODEL);
+
+static uint32_t lightSleeps = 0;
+static uint32_t lightSleepRejects = 0;      // esp_light_sleep_start() refused
+static uint32_t lightSleepRadioWakes = 0;   // woken by a LoRa frame
+
+// Battery voltage in mV, 0 without a battery (or with the divider off)
+static uint16_t readBatteryMv() {
+    #if BATTERY_ADC_PIN >= 0
+    #if BATTERY_ADC_CTRL_PIN >= 0
+    pinMode(BATTERY_ADC_CTRL_PIN, OUTPUT);
+    digitalWrite(BATTERY_ADC_CTRL_PIN, HIGH);
+    delay(2);
+    #endif
+    uint32_t pinMv = 0;
+    for (int i = 0; i < 4; i++) pinMv += analogReadMilliVolts(BATTERY_ADC_PIN);
+    #if BATTERY_ADC_CTRL_PIN >= 0
+    digitalWrite(BATTERY_ADC_CTRL_PIN, LOW);
+    #endif
+    uint32_t mv = (uint32_t)(pinMv / 4 * BATTERY_DIVIDER);
+    // Below any usable cell: running from USB without one
+    return mv < 2500 ? 0 : mv > UINT16_MAX ? UINT16_MAX : (uint16_t)mv;
+    #else
+    return 0;
+    #endif
+}
+
+// Battery, scan profile and the estimated current of each profile
+static uint32_t lastStatusMs = 0;
+
+void sendStatusFrame() {
+    WireFrame frame = {};
+    frame.type = MSG_STATUS;
+    frame.timestampMs = millis();
+    frame.status.batteryMv = scanScheduler.batteryMv();
+    frame.status.profile = scanScheduler.profile();
+    frame.status.reason = scanScheduler.reason();
+    frame.status.dutyPercent = (uint8_t)(scanScheduler.timing().dutyPermille() / 10);
+    for (int p = 0; p < SCAN_PROFILE_COUNT; p++) {
+        frame.status.estimatedDeciMa[p] = (uint16_t)(scanScheduler.estimatedMa((ScanProfile)p) * 10 + 0.5f);
+    }
+    lastStatusMs = frame.timestampMs;
+    sendLoRaMessage(frame);
+}
+
+// Scanner settings and display for the scheduler's current profile. A
+// windowed profile scans flat out while its window is open.
+static void applyScanProfile() {
+    NimBLEScan* scan = NimBLEDevice::getScan();
+    const ScanTiming& timing = scanScheduler.timing();
+    bool windowed = scanScheduler.windowed();
+    scan->stop();
+    scan->setInterval(windowed ? SCAN_INTERVAL : timing.intervalMs);
+    scan->setWindow(windowed ? SCAN_INTERVAL : timing.windowMs);
+    if (scanScheduler.windowOpen(millis())) scan->start(SCAN_DURATION, nullptr, false);
+
+    // The display task switches the panel
+    displayPowered = ScanScheduler::displayOn(scanScheduler.profile());
+    if (displayTaskHandle) xTaskNotifyGive(displayTaskHandle);
+
+    logger.printf("Power: scan profile %s (%s), %u/%u ms%s\n",
+                  scanProfileName(scanScheduler.profile()), scanReasonName(scanScheduler.reason()),
+                  timing.windowMs, timing.intervalMs, windowed ? ", light sleep between windows" : "");
+}
+
+static bool batterySampled = false;
+static uint32_t lastBatteryMs = 0;
+
+// Battery, hits and commands into the scheduler; switch profile, open and
+// close scan windows, and report status to the mesh
+void updatePower() {
+    uint32_t now = millis();
+
+    static uint16_t batteryMv = 0;
+    if (!batterySampled || now - lastBatteryMs >= BATTERY_SAMPLE_MS) {
+        batterySampled = true;
+        lastBatteryMs = now;
+        uint16_t sample = readBatteryMv();
+        batteryMv = sample == 0 || batteryMv == 0 ? sample : (uint16_t)((batteryMv * 3 + sample) / 4);
+        scanScheduler.battery(batteryMv);
+    }
+
+    static uint32_t hitsSeen = 0;
+    if (detectionHitCount != hitsSeen) {
+        hitsSeen = detectionHitCount;
+        scanScheduler.hit(detectionHitAtMs);
+    }
+
+    ScanCommand command;
+    while (scanCommandQueue.pop(command)) scanScheduler.command(command, now);
+
+    NimBLEScan* scan = NimBLEDevice::getScan();
+    bool open = scanScheduler.windowOpen(now);
+    if (scanScheduler.update(now, scan->isScanning())) {
+        applyScanProfile();
+        open = scanScheduler.windowOpen(now);
+        sendStatusFrame();
+    } else if (open != scan->isScanning()) {
+        if (open) {
+            scan->start(SCAN_DURATION, nullptr, false);
+        } else {
+            scan->stop();
+        }
+    }
+
+    // Between windows the radio listens at the robust rate only, so that
+    // DIO1 fires for frames rather than for every CAD
+    if (radioRobustOnly == open) {
+        radioRobustOnly = !open;
+        if (loraInitialized) xTaskNotifyGive(loraRadioTaskHandle);
+    }
+
+    if (STATUS_INTERVAL_MS > 0 && millis() - lastStatusMs >= STATUS_INTERVAL_MS) sendStatusFrame();
+}
+
+// Light sleep for up to sleepMs if nothing else needs the CPU: the radio
+// is in plain RX and no advert, frame, batch, alert or relay is waiting. A LoRa
+// frame (DIO1) wakes the node early. False if the node stayed awake.
+static bool lightSleep(uint32_t sleepMs) {
+    if (loraInitialized && (radioMode != RADIO_LISTEN || radioIrqPending || digitalRead(LORA_DIO1) == HIGH)) {
+        return false;
+    }
+    if (detectionQueue.size() > 0 || !possibleHitBatch.empty() || loraRxQueue.size() > 0 ||
+        alertLogQueue.size() > 0 || meshRelay.pending() > 0) {
+        return false;
+    }
+    xSemaphoreTake(loraTxQueueMutex, portMAX_DELAY);
+    bool txIdle = loraTxQueue.size() == 0;
+    xSemaphoreGive(loraTxQueueMutex);
+    if (!txIdle) return false;
+
+    Serial.flush();
+    esp_sleep_enable_timer_wakeup((uint64_t)sleepMs * 1000);
+    if (loraInitialized) {
+        // The wakeup level replaces the pin's edge interrupt while asleep
+        gpio_intr_disable((gpio_num_t)LORA_DIO1);
+        gpio_wakeup_enable((gpio_num_t)LORA_DIO1, GPIO_INTR_HIGH_LEVEL);
+        esp_sleep_enable_gpio_wakeup();
+    }
+    uint32_t startMs = millis();
+    taskLoads[TASK_LOOP].blocking(micros());
+    esp_err_t result = esp_light_sleep_start();
+    taskLoads[TASK_LOOP].woke(micros());
+    uint32_t sleptMs = millis() - startMs;
+    if (loraInitialized) {
+        gpio_wakeup_disable((gpio_num_t)LORA_DIO1);
+        gpio_set_intr_type((gpio_num_t)LORA_DIO1, GPIO_INTR_POSEDGE);
+        gpio_intr_enable((gpio_num_t)LORA_DIO1);
+        // A frame that arrived meanwhile raised DIO1 with the interrupt off
+        if (digitalRead(LORA_DIO1) == HIGH && !radioIrqPending) {
+            radioIrqAtUs = micros();
+            radioIrqPending = true;
+            xTaskNotifyGive(loraRadioTaskHandle);
+            lightSleepRadioWakes++;
+        }
+    }
+    if (result != ESP_OK) {
+        lightSleepRejects++;
+        return false;
+    }
+    lightSleeps++;
+    scanScheduler.slept(sleptMs);
+    return true;
+}
+
+static uint32_t msUntilPeriod(uint32_t lastMs, uint32_t periodMs, uint32_t nowMs) {
+    uint32_t elapsed = nowMs - lastMs;
+    return elapsed < periodMs ? periodMs - elapsed : 0;
+}
+
+// Block until the scheduler next has work: a window edge, a command or
+// burst ending, a battery sample or a status report, or earlier for a hit,
+// a scan command or console input. Through a gap between scan windows in
+// light sleep when nothing else needs the CPU.
+void waitForNextLoop() {
+    uint32_t now = millis();
+    uint32_t waitMs = scanScheduler.msUntilNextEvent(now);
+    uint32_t batteryMs = msUntilPeriod(lastBatteryMs, BATTERY_SAMPLE_MS, now);
+    if (batteryMs < waitMs) waitMs = batteryMs;
+    if (STATUS_INTERVAL_MS > 0) {
+        uint32_t statusMs = msUntilPeriod(lastStatusMs, STATUS_INTERVAL_MS, now);
+        if (statusMs < waitMs) waitMs = statusMs;
+    }
+    if (!scanScheduler.windowOpen(now) && waitMs > 100) {
+        if (lightSleep(waitMs)) return;
+        // Work in flight kept the node awake: look again shortly
+        waitMs = 100;
+    }
+    waitForEvent(TASK_LOOP, ticksFor(waitMs));
+}
+
+// Node from a console argument: 0 for "all", else its index (0 if invalid)
+static bool consoleNode(const char* text, uint8_t& node) {
+    node = strcasecmp(text, "all") == 0 ? 0 : nodeIndexFromId(text);
+    return node != 0 || strcasecmp(text, "all") == 0;
+}
+
+// Hand a targets request to meshRxTask
+static void postConsoleTargets(const WireTargets& targets) {
+    if (meshRxTaskHandle == nullptr) {
+        logger.println("Console: LoRa is not running, targets are installed by its receive task");
+        return;
+    }
+    if (!consoleTargetsQueue.push(targets)) {
+        logger.println("Console: busy, try again");
+        return;
+    }
+    xTaskNotifyGive(meshRxTaskHandle);
+}
+
+// "targets" lists the runtime targets; "target <add|remove> <node|all>
+// <mac>" and "target clear <node|all>" change them. "filter load <bits>
+// <seed> <block length> <entries> <crc>" and "filter chunk <crc> <index>
+// <hex>" load a registry filter here (homebase/target_filter.py);
+// "filter <send|drop> <node|all>" broadcasts this node's filter or drops one.
+static void handleTargetsConsoleLine(const char* line) {
+    WireTargets targets = {};
+    char verb[8], node[12], text[18];
+    unsigned long bits, seed, blockLength, entries, crc;
+    unsigned index;
+    int offset = 0;
+    if (strcasecmp(line, "targets") == 0) {
+        targets.op = CONSOLE_TARGETS_LIST;
+    } else if (sscanf(line, "target %7s %11s %17s", verb, node, text) == 3 &&
+               (strcasecmp(verb, "add") == 0 || strcasecmp(verb, "remove") == 0) &&
+               consoleNode(node, targets.target) && parseMacKey(text) != MAC_KEY_INVALID) {
+        uint64_t mac = parseMacKey(text);
+        targets.op = strcasecmp(verb, "add") == 0 ? WIRE_TARGETS_ADD : WIRE_TARGETS_REMOVE;
+        for (int i = 0; i < 6; i++) targets.data[i] = (uint8_t)(mac >> (40 - 8 * i));
+        targets.length = 6;
+    } else if (sscanf(line, "target clear %11s", node) == 1 && consoleNode(node, targets.target)) {
+        targets.op = WIRE_TARGETS_CLEAR;
+    } else if (sscanf(line, "filter load %lu %lu %lu %lu %lx", &bits, &seed, &blockLength, &entries, &crc) == 5 &&
+               bits <= 16 && crc <= 0xFFFF) {
+        XorFilterHeader header = {(uint8_t)bits, (uint16_t)crc, (uint32_t)seed, (uint32_t)blockLength,
+                                  (uint32_t)entries};
+        targets.target = LOCAL_NODE_INDEX;
+        targets.op = WIRE_TARGETS_FILTER;
+        targets.filterCrc = header.crc;
+        header.encode(targets.data);
+        targets.length = TARGET_FILTER_HEADER_BYTES;
+    } else if (sscanf(line, "filter chunk %lx %u %n", &crc, &index, &offset) == 2 && offset > 0 &&
+               crc <= 0xFFFF && index <= UINT16_MAX) {
+        const char* hex = line + offset;
+        size_t length = 0;
+        while (length < TARGET_FILTER_CHUNK_BYTES && macHexNibble(hex[0]) >= 0 && macHexNibble(hex[1]) >= 0) {
+            targets.data[length++] = (uint8_t)(macHexNibble(hex[0]) << 4 | macHexNibble(hex[1]));
+            hex += 2;
+        }
+        if (*hex != '\0') {
+            logger.println("Console: filter chunk <crc> <index> <up to 112 bytes of hex>");
+            return;
+        }
+        targets.target = LOCAL_NODE_INDEX;
+        targets.op = WIRE_TARGETS_CHUNK;
+        targets.filterCrc = (uint16_t)crc;
+        targets.chunk = (uint16_t)index;
+        targets.length = (uint8_t)length;
+    } else if (sscanf(line, "filter %7s %11s", verb, node) == 2 && consoleNode(node, targets.target) &&
+               (strcasecmp(verb, "send") == 0 || strcasecmp(verb, "drop") == 0)) {
+        targets.op = strcasecmp(verb, "send") == 0 ? CONSOLE_FILTER_SEND : WIRE_TARGETS_DROP_FILTER;
+    } else {
+        logger.println("Console: targets | target <add|remove> <node|all> <mac> | target clear <node|all> | "
+                       "filter load <bits> <seed> <block length> <entries> <crc> | filter chunk <crc> <index> <hex> | "
+                       "filter <send|drop> <node|all>");
+        return;
+    }
+    postConsoleTargets(targets);
+}
+
+// Gateway console: "scan <node|all> <active|conservation|burst|auto> [minutes]"
+// sets the scan profile here, on another node or on all of them;
+// "journal <dump|pending>" prints the detection journal as CSV; "target"
+// and "filter" install runtime targets (see handleTargetsConsoleLine())
+static void handleConsoleLine(const char* line) {
+    if (strncasecmp(line, "target", 6) == 0 || strncasecmp(line, "filter", 6) == 0) {
+        handleTargetsConsoleLine(line);
+        return;
+    }
+
+    if (strncasecmp(line, "journal", 7) == 0) {
+        bool all = strcasecmp(line, "journal dump") == 0;
+        if (!journalReady || (!all && strcasecmp(line, "journal pending") != 0)) {
+            logger.println(journalReady ? "Console: journal <dump|pending>" : "Console: no journal");
+            return;
+        }
+        journalDumpRequest = all ? JOURNAL_DUMP_ALL : JOURNAL_DUMP_PENDING;
+        xTaskNotifyGive(journalTaskHandle);
+        return;
+    }
+
+    if (strncasecmp(line, "environment", 11) == 0) {
+        uint8_t environment = 0;
+        while (environment < RSSI_ENV_COUNT &&
+               strcasecmp(line + 11 + strspn(line + 11, " "), rssiEnvironmentName(environment)) != 0) {
+            environment++;
+        }
+        if (environment == RSSI_ENV_COUNT) {
+            logger.println("Console: environment <free_space|outdoor|indoor>");
+            return;
+        }
+        rssiEnvironment = environment;
+        logger.printf("Console: range estimates for %s, path-loss exponent %.1f\n",
+                      rssiEnvironmentName(environment), RSSI_PATH_LOSS_X10[environment] / 10.0);
+        return;
+    }
+
+    char target[12], name[16];
+    unsigned minutes = 0;
+    bool all = false;
+    uint8_t node = 0, profile = 0;
+    if (sscanf(line, "scan %11s %15s %u", target, name, &minutes) >= 2) {
+        all = strcasecmp(target, "all") == 0;
+        node = all ? 0 : nodeIndexFromId(target);
+        while (profile <= SCAN_PROFILE_COUNT && strcasecmp(name, scanProfileName(profile)) != 0) profile++;
+    }
+    if ((!all && node == 0) || profile > SCAN_PROFILE_COUNT || minutes > UINT16_MAX) {
+        logger.println("Console: scan <node|all> <active|conservation|burst|auto> [minutes]");
+        return;
+    }
+
+    if (all || node == LOCAL_NODE_INDEX) scanScheduler.command({profile, (uint32_t)(minutes * 60000UL)}, millis());
+    if (node == LOCAL_NODE_INDEX) return;
+
+    WireFrame frame = {};
+    frame.type = MSG_COMMAND;
+    frame.timestampMs = millis();
+    frame.command.target = node;
+    frame.command.command = WIRE_CMD_SCAN_PROFILE;
+    frame.command.argument = profile < SCAN_PROFILE_COUNT ? profile : WIRE_CMD_ARG_AUTO;
+    frame.command.durationMin = (uint16_t)minutes;
+    logger.printf("📡 Sending scan %s command to %s via LoRa...\n", scanProfileName(profile), target);
+    sendLoRaMessage(frame);
+}
+
+// Runs on the UART driver's event task
+static void onConsoleReceive() {
+    xTaskNotifyGive(mainLoopTaskHandle);
+}
+
+void pollConsole() {
+    static char line[256];
+    static size_t length = 0;
+    while (Serial.available() > 0) {
+        char c = (char)Serial.read();
+        if (c == '\r' || c == '\n') {
+            line[length] = '\0';
+            if (length > 0) {
+                consoleLineMs = millis();
+                handleConsoleLine(line);
+            }
+            length = 0;
+        } else if (length < sizeof(line) - 1) {
+            line[length++] = c;
+        }
+    }
+}
+
+// ============================================================================
+// BLE SCANNING
+// ============================================================================
+
+void initBLE() {
+    logger.println("Initializing BLE...");
+
+    NimBLEDevice::init(NODE_ID);
+    NimBLEScan* pBLEScan = NimBLEDevice::getScan();
+
+    // Deliver every advert without keeping a result list: the NimBLE list
+    // grows without bound and is searched linearly per advert, and a device
+    // whose first advert overflowed the detection queue would never be
+    // reported again. Repeat alerts are suppressed by the device cache.
+    pBLEScan->setAdvertisedDeviceCallbacks(new BLEScanCallbacks(), true);
+    pBLEScan->setMaxResults(0);
+    pBLEScan->setActiveScan(true); // Active scanning for better range
+    pBLEScan->setInterval(SCAN_INTERVAL);
+    pBLEScan->setWindow(SCAN_WINDOW);
+
+    logger.println("BLE: Scanner initialized");
+}
+
+void startBLEScan() {
+    logger.println("BLE: Starting scan...");
+    // The scan scheduler picks the first profile and starts the scanner
+    scanScheduler.begin(millis());
+    updatePower();
+}
+
+// ============================================================================
+// STATISTICS
+// ============================================================================
+
+// CPU time and wakeups per task since the last report, and the least
+// stack each has had free (unknown on the host sim)
+static void printTaskLoads() {
+    static TaskLoadReport<TASK_COUNT> report;
+    static uint32_t lastUs = 0;
+    uint32_t nowUs = micros();
+    uint32_t elapsedUs = nowUs - lastUs;
+    lastUs = nowUs;
+    uint32_t busyUs = 0, wakeups = 0;
+    for (size_t t = 0; t < TASK_COUNT; t++) {
+        const TaskLoad& load = taskLoads[t];
+        if (load.handle == nullptr) continue;
+        TaskLoadSample sample = report.sample(t, load);
+        busyUs += sample.busyUs;
+        wakeups += sample.wakeups;
+        logger.printf("Task %-9s core %d prio %u: %5.2f%% CPU, %6.1f wakeups/s, stack ",
+                      load.name, load.core, load.priority,
+                      elapsedUs ? 100.0 * sample.busyUs / elapsedUs : 0.0,
+                      elapsedUs ? sample.wakeups * 1e6 / elapsedUs : 0.0);
+        UBaseType_t freeBytes = uxTaskGetStackHighWaterMark(load.handle);
+        if (freeBytes > 0) {
+            logger.printf("%u/%lu bytes free\n", (unsigned)freeBytes, (unsigned long)load.stackBytes);
+        } else {
+            logger.printf("n/a of %lu bytes\n", (unsigned long)load.stackBytes);
+        }
+    }
+    logger.printf("Tasks: %.2f%% CPU, %.1f wakeups/s in all\n",
+                  elapsedUs ? 100.0 * busyUs / elapsedUs : 0.0,
+                  elapsedUs ? wakeups * 1e6 / elapsedUs : 0.0);
+}
+
+void printStatistics() {
+    logger.println("\n--- Statistics ---");
+    logger.printf("Uptime: %lu seconds\n", millis() / 1000);
+    logger.printf("Total scans: %u\n", totalScans);
+    logger.printf("TRUE HITs: %u\n", trueHits);
+    logger.printf("POSSIBLE HITs: %u\n", possibleHits);
+    if (ENABLE_MEDICAL_DEVICE_SCANNING && ADVERTISEMENT_RULE_SET.size() > 0) {
+        logger.printf("Payload rules: %u rules, %u adverts matched\n",
+                      (unsigned)ADVERTISEMENT_RULE_SET.size(), payloadRuleMatches);
+    }
+    XorFilter filter = filterLoader.installed();
+    const TargetFilterStats& loads = filterLoader.stats();
+    logger.printf("Targets: %u runtime MACs, registry ", (unsigned)installedTargets.size());
+    if (filter.empty()) {
+        logger.print("none");
+    } else {
+        logger.printf("%lu addresses (%u bytes, 1 in %lu false)", (unsigned long)filter.header().entries,
+                      (unsigned)filter.header().bytes(), (unsigned long)registryFalseMatchOdds(filter.header()));
+    }
+    logger.printf(", %lu lookups, %lu matches; filter loads %lu, chunks %lu, installed %lu, CRC failures %lu, "
+                  "rejected %lu; NVS %lu writes, %lu failed\n",
+                  (unsigned long)registryLookups, (unsigned long)registryMatches, (unsigned long)loads.loads,
+                  (unsigned long)loads.chunks, (unsigned long)loads.installed, (unsigned long)loads.crcFailures,
+                  (unsigned long)loads.rejected, (unsigned long)targetsNvsWrites,
+                  (unsigned long)targetsNvsFailures);
+    logger.printf("Detection queue: %u/%u (peak %u, overflows %u)\n",
+                  (unsigned)detectionQueue.size(), (unsigned)detectionQueue.capacity(),
+                  detectionQueue.highWater(), detectionQueue.overflows());
+    logger.printf("Alert log queue: %u/%u (peak %u, overflows %u)\n",
+                  (unsigned)alertLogQueue.size(), (unsigned)alertLogQueue.capacity(),
+                  alertLogQueue.highWater(), alertLogQueue.overflows());
+
+    // A largest block shrinking while free space holds steady is
+    // fragmentation; a falling minimum is a leak or a burst
+    logger.printf("Heap: %u free, largest block %u, minimum ever %u bytes\n",
+                  (unsigned)heap_caps_get_free_size(MALLOC_CAP_8BIT),
+                  (unsigned)heap_caps_get_largest_free_block(MALLOC_CAP_8BIT),
+                  (unsigned)heap_caps_get_minimum_free_size(MALLOC_CAP_8BIT));
+
+    // Per advert since the last report; outstanding counts since boot
+    if (AllocCounter::enabled()) {
+        static AllocSnapshot lastScoped = {}, lastHost = {}, lastAll = {};
+        static uint32_t lastScans = 0;
+        AllocSnapshot scoped = allocSnapshot(allocCounter.scoped);
+        AllocSnapshot host = allocSnapshot(allocCounter.hostTask);
+        AllocSnapshot all = allocSnapshot(allocCounter.all);
+        uint32_t adverts = totalScans - lastScans;
+        double perAdvert = adverts > 0 ? 1.0 / adverts : 0.0;
+        logger.printf("Allocations: onResult %.2f/advert (%.0f B), BLE host %.2f/advert (%.0f B), "
+                      "all tasks %lu (%lu B), %ld outstanding\n",
+                      (scoped.allocs - lastScoped.allocs) * perAdvert,
+                      (scoped.bytes - lastScoped.bytes) * perAdvert,
+                      (host.allocs - lastHost.allocs) * perAdvert,
+                      (host.bytes - lastHost.bytes) * perAdvert,
+                      (unsigned long)(all.allocs - lastAll.allocs),
+                      (unsigned long)(all.bytes - lastAll.bytes),
+                      (long)(all.allocs - all.frees));
+        lastScoped = scoped;
+        lastHost = host;
+        lastAll = all;
+        lastScans += adverts;
+    }
+
+    // Read without a lock: the detection task owns the cache, and a
+    // slightly stale count is fine for a report
+    const DeviceCacheStats& cache = deviceCache.stats();
+    logger.printf("Device cache: %u/%u devices (peak %lu), reports %lu, suppressed %lu, "
+                  "aged out %lu, evicted %lu, ranging %s\n",
+                  (unsigned)deviceCache.size(), (unsigned)deviceCache.maxDevices(),
+                  (unsigned long)cache.peak, (unsigned long)cache.reported,
+                  (unsigned long)cache.suppressed, (unsigned long)cache.expired,
+                  (unsigned long)cache.evicted, rssiEnvironmentName(rssiEnvironment));
+
+    // Same ownership as the device cache
+    if (rpaResolver.keys() > 0) {
+        const RpaResolverStats& rpa = rpaResolver.stats();
+        logger.printf("RPA resolver: %lu random adverts, %lu not resolvable, %lu cached, "
+                      "%lu computed (%lu ah), %lu resolved, %lu evicted\n",
+                      (unsigned long)rpa.lookups, (unsigned long)rpa.notRpa,
+                      (unsigned long)rpa.cacheHits, (unsigned long)rpa.computed,
+                      (unsigned long)rpa.ahCalls, (unsigned long)rpa.resolved,
+                      (unsigned long)rpa.evictions);
+    }
+
+    // Per-class LoRa TX queue counters and enqueue-to-air latency
+    xSemaphoreTake(loraTxQueueMutex, portMAX_DELAY);
+    for (int c = 0; c < TX_CLASS_COUNT; c++) {
+        const TxClassStats& tx = loraTxQueue.stats((TxClass)c);
+        if (tx.queued == 0 && tx.dropped == 0) continue;
+        logger.printf("LoRa TX %-12s sent %u, coalesced %u, dropped %u, expired %u, failed %u, "
+                      "queue avg %u ms max %u ms\n",
+                      txClassName((TxClass)c), tx.dequeued, tx.coalesced, tx.dropped,
+                      tx.expired, tx.failed, tx.latencyAvgMs(), tx.latencyMaxMs);
+    }
+    xSemaphoreGive(loraTxQueueMutex);
+
+    // Owned by the detection task, like the device cache
+    const DetectionBatchStats& batch = possibleHitBatch.stats();
+    if (batch.frames > 0) {
+        logger.printf("LoRa batching: %lu records in %lu frames (%.1f per frame), "
+                      "%lu merged, %.1f s airtime saved\n",
+                      (unsigned long)batch.recordsSent, (unsigned long)batch.frames,
+                      (double)batch.recordsSent / batch.frames, (unsigned long)batch.coalesced,
+                      batchAirtimeSavedUs / 1e6);
+    }
+
+    // Airtime by spreading factor, against sending everything robust
+    xSemaphoreTake(loraRateMutex, portMAX_DELAY);
+    const LoRaRateStats& rates = loraRatePolicy.stats();
+    LinkEntry weakest = {};
+    bool linkKnown = loraLinks.weakest(millis(), weakest);
+    size_t neighbours = loraLinks.neighbours(millis());
+    uint64_t rateAirtimeUs = 0;
+    for (size_t i = 0; i < LORA_RATES.size(); i++) rateAirtimeUs += rates.airtimeUs[LORA_RATES.sf[i]];
+    if (rateAirtimeUs > 0) {
+        logger.print("LoRa rates:");
+        for (size_t i = 0; i < LORA_RATES.size(); i++) {
+            uint8_t sf = LORA_RATES.sf[i];
+            if (rates.frames[sf] == 0) continue;
+            logger.printf(" SF%u %lu (%.1f s)", sf, (unsigned long)rates.frames[sf], rates.airtimeUs[sf] / 1e6);
+        }
+        logger.printf("; %.1f s on air vs %.1f s at SF%u, %lu adapted, %lu repeated, "
+                      "%lu failures, %lu fallbacks%s\n",
+                      rateAirtimeUs / 1e6, rates.robustAirtimeUs / 1e6, LORA_RATES.robust(),
+                      (unsigned long)rates.adapted, (unsigned long)rates.acked,
+                      (unsigned long)rates.failures, (unsigned long)rates.fallbacks,
+                      loraRatePolicy.holdingOff(millis()) ? " (holding robust)" : "");
+    }
+    if (linkKnown) {
+        logger.printf("LoRa links: %u neighbours, weakest NODE-%03u SNR %.1f dB RSSI %d dBm\n",
+                      (unsigned)neighbours, weakest.node, weakest.snrDb(), weakest.rssiDbm());
+    }
+    xSemaphoreGive(loraRateMutex);
+
+    // Owned by the radio task: CAD before each frame, and airtime against
+    // the regional limit over the last hour
+    const LbtStats& lbt = loraLbt.stats();
+    if (lbt.checks > 0) {
+        logger.printf("LoRa channel: %lu checks, %lu busy (%.0f%%), %lu backoffs (%.1f s), "
+                      "%lu sent busy, %lu dropped\n",
+                      (unsigned long)lbt.checks, (unsigned long)lbt.busy, 100.0 * lbt.busy / lbt.checks,
+                      (unsigned long)lbt.backoffs, lbt.backoffMs / 1000.0,
+                      (unsigned long)lbt.forced, (unsigned long)lbt.dropped);
+    }
+    uint64_t dutyUsedUs = loraDutyCycle.usedUs(millis());
+    if (loraDutyCycle.limited()) {
+        logger.printf("Duty cycle (%s, %.1f%%): %.1f of %.1f s used this hour (%.0f%%, peak %.0f%%)",
+                      LORA_DUTY_CYCLE_BAND >= 0 ? DUTY_CYCLE_BANDS[LORA_DUTY_CYCLE_BAND].name : "custom",
+                      LORA_DUTY_CYCLE_LIMIT / 10.0, dutyUsedUs / 1e6, loraDutyCycle.budgetUs() / 1e6,
+                      100.0 * dutyUsedUs / loraDutyCycle.budgetUs(),
+                      100.0 * loraDutyCycle.stats().peakUsedUs / loraDutyCycle.budgetUs());
+        for (int c = 0; c < TX_CLASS_COUNT; c++) {
+            if (loraDutyDeferred[c] > 0) {
+                logger.printf(", %s deferred %lu", txClassName((TxClass)c), (unsigned long)loraDutyDeferred[c]);
+            }
+        }
+        logger.println();
+    } else if (dutyUsedUs > 0) {
+        logger.printf("Duty cycle: no limit at %d MHz, %.1f s on air this hour (%.2f%%)\n",
+                      LORA_FREQUENCY, dutyUsedUs / 1e6, dutyUsedUs / 36000000.0);
+    }
+
+    uint32_t uptimeMs = millis();
+    logger.printf("LoRa RX: %u frames (%.1f/min), CRC errors %u, bad length %u, malformed %u, "
+                  "queue peak %u/%u, overflows %u\n",
+                  loraRxFrames, uptimeMs ? loraRxFrames * 60000.0 / uptimeMs : 0.0,
+                  loraRxCrcErrors, loraRxBadLength, loraRxMalformed,
+                  loraRxQueue.highWater(), (unsigned)loraRxQueue.capacity(), loraRxQueue.overflows());
+    if (SERIAL_FRAMES) {
+        uint32_t bytes = 0;
+        for (uint8_t source = 0; source < SERIAL_SOURCE_COUNT; source++) bytes += serialFrameBytes[source];
+        logger.printf("Serial frames: %lu mesh, %lu local (%u lost), %lu fused, %lu bytes (%.2f%% of %d baud)\n",
+                      (unsigned long)serialFrames[SERIAL_SOURCE_MESH],
+                      (unsigned long)serialFrames[SERIAL_SOURCE_LOCAL], localSerialQueue.overflows(),
+                      (unsigned long)serialFrames[SERIAL_SOURCE_FUSION], (unsigned long)bytes,
+                      uptimeMs ? bytes * 10 * 100.0 / GATEWAY_SERIAL_BAUD / (uptimeMs / 1000.0) : 0.0,
+                      GATEWAY_SERIAL_BAUD);
+    }
+    if (FUSION) {
+        const FusionStats& fusion = targetFusion.stats();
+        logger.printf("Target fusion: %u targets in window, %lu observations (%lu unplaced; %lu us avg, "
+                      "%lu us max), %lu fits (%.1f iterations), %lu locations, %lu targets evicted\n",
+                      (unsigned)targetFusion.tracked(millis()), (unsigned long)fusion.observations,
+                      (unsigned long)fusionUnplaced,
+                      (unsigned long)(fusion.observations ? fusionTotalUs / fusion.observations : 0),
+                      (unsigned long)fusionMaxUs, (unsigned long)fusion.solves,
+                      fusion.solves ? (double)fusion.iterations / fusion.solves : 0.0,
+                      (unsigned long)fusion.located, (unsigned long)fusion.evicted);
+    }
+
+    // Owned by the journal task and read unlocked
+    if (journalReady) {
+        const JournalStats& stored = journal.stats();
+        uint32_t nowMs = millis();
+        logger.printf("Journal: %lu records (%lu of %lu on flash, %lu pending), %lu lost, %lu writes "
+                      "(flush avg %.1f ms max %.1f ms), %lu erases, %.2f records/s\n",
+                      (unsigned long)stored.appended, (unsigned long)(journal.endId() - journal.oldestId()),
+                      (unsigned long)journal.capacity(), (unsigned long)journal.pending(),
+                      (unsigned long)stored.lost, (unsigned long)stored.writes,
+                      stored.writes ? journalFlushUs / 1000.0 / stored.writes : 0.0, journalFlushMaxUs / 1000.0,
+                      (unsigned long)stored.erases, nowMs ? stored.appended * 1000.0 / nowMs : 0.0);
+        logger.printf("Journal replay: %lu records in %lu frames, %lu acked; homebase ",
+                      (unsigned long)journalReplayRecords, (unsigned long)journalReplayFrames,
+                      (unsigned long)stored.acked);
+        if (homebaseHeard) {
+            logger.printf("last heard %lu s ago", (unsigned long)((nowMs - homebaseAckMs) / 1000));
+        } else {
+            logger.print("not heard");
+        }
+        logger.printf("; recovered %lu (%lu torn) in %.1f ms, queue peak %u/%u, overflows %u\n",
+                      (unsigned long)stored.recovered, (unsigned long)stored.torn, journalRecoveryUs / 1000.0,
+                      journalQueue.highWater(), (unsigned)journalQueue.capacity(), journalQueue.overflows());
+    } else {
+        logger.println("Journal: no journal partition");
+    }
+    if (MESH_GATEWAY) {
+        const MeshAckStats& acks = meshAcks.stats();
+        logger.printf("Acks: %lu frames acknowledged in %lu acks, %lu dropped\n",
+                      (unsigned long)acks.acknowledged, (unsigned long)acks.frames, (unsigned long)acks.dropped);
+    }
+
+    // Owned by meshRxTask; duplicates show how much of the flood we hear
+    const MeshRelayStats& relay = meshRelay.stats();
+    logger.printf("Mesh: %lu new, %lu duplicates, %lu own echoes",
+                  (unsigned long)relay.accepted, (unsigned long)relay.duplicates,
+                  (unsigned long)relay.ownEchoes);
+    if (MESH_RELAY_ENABLED) {
+        logger.printf("; relay forwarded %lu, suppressed %lu, dropped %lu, hop limit %lu, pending %u",
+                      (unsigned long)relay.forwarded, (unsigned long)relay.cancelled,
+                      (unsigned long)relay.dropped, (unsigned long)relay.hopLimited,
+                      (unsigned)meshRelay.pending());
+    }
+    logger.println();
+
+    // Owned by the main loop and read unlocked; currents are model
+    // estimates, not measurements
+    logger.printf("Power: %s (%s), battery ", scanProfileName(scanScheduler.profile()),
+                  scanReasonName(scanScheduler.reason()));
+    if (scanScheduler.batteryMv() > 0) {
+        logger.printf("%.2f V", scanScheduler.batteryMv() / 1000.0);
+    } else {
+        logger.print("not measured");
+    }
+    logger.printf(", est. active %.1f mA, conservation %.1f mA, burst %.1f mA, average %.1f mA\n",
+                  scanScheduler.estimatedMa(SCAN_PROFILE_ACTIVE),
+                  scanScheduler.estimatedMa(SCAN_PROFILE_CONSERVATION),
+                  scanScheduler.estimatedMa(SCAN_PROFILE_BURST), scanScheduler.estimatedMa());
+    const ScanProfileUsage& conserving = scanScheduler.usage(SCAN_PROFILE_CONSERVATION);
+    logger.printf("Scan profiles: active %lu s, conservation %lu s (%.0f%% light sleep, %lu sleeps, "
+                  "%lu refused, %lu LoRa wakes), burst %lu s, %lu switches\n",
+                  (unsigned long)(scanScheduler.usage(SCAN_PROFILE_ACTIVE).totalMs / 1000),
+                  (unsigned long)(conserving.totalMs / 1000),
+                  conserving.totalMs ? 100.0 * conserving.sleepMs / conserving.totalMs : 0.0,
+                  (unsigned long)lightSleeps, (unsigned long)lightSleepRejects,
+                  (unsigned long)lightSleepRadioWakes,
+                  (unsigned long)(scanScheduler.usage(SCAN_PROFILE_BURST).totalMs / 1000),
+                  (unsigned long)scanScheduler.switches());
+
+    #if defined(HELTEC_V3)
+    // Owned by the display task
+    const TileRendererStats& frames = displayRenderer.stats();
+    const AlertViewStats& alerts = alertView.stats();
+    if (frames.frames > 0) {
+        logger.printf("Display: %lu frames (%lu full, %lu unchanged skipped), %.1f of 8 tile rows per frame, "
+                      "I2C avg %.1f ms max %.1f ms; %lu alerts on %lu screens\n",
+                      (unsigned long)frames.frames, (unsigned long)frames.fullFrames,
+                      (unsigned long)frames.unchanged, (double)frames.tileRows / frames.frames,
+                      displayI2cUs / 1000.0 / frames.frames, displayI2cMaxUs / 1000.0,
+                      (unsigned long)alerts.alerts, (unsigned long)alerts.screens);
+    }
+    #endif
+
+    printTaskLoads();
+
+    GpsFix position = gpsSnapshot.read();
+    const GpsParserStats& nmea = gpsParser.stats();
+    if (position.valid()) {
+        logger.printf("GPS: %.6f, %.6f, HDOP %.1f, %u satellites, fix %.1f s old\n",
+                      wireE7ToDegrees(position.latE7), wireE7ToDegrees(position.lonE7),
+                      position.hdopCenti / 100.0, position.satellites, position.ageMs(millis()) / 1000.0);
+    } else {
+        logger.println("GPS: No fix");
+    }
+    if (gpsLink.heard || nmea.sentences > 0) {
+        logger.printf("GPS link: %s at %lu baud, %lu sentences (%lu skipped, %lu bad checksums), "
+                      "%lu UART errors\n",
+                      GPS_DIALECT_NAMES[gpsLink.dialect], (unsigned long)gpsLink.baud,
+                      (unsigned long)nmea.sentences, (unsigned long)nmea.skipped,
+                      (unsigned long)nmea.checksumErrors, (unsigned long)gpsUartErrors);
+    }
+    const BeaconStats& beacons = beaconPolicy.stats();
+    uint32_t beaconsSent = beacons.sent[BEACON_FIRST] + beacons.sent[BEACON_DEVIATION] + beacons.sent[BEACON_INTERVAL];
+    if (beaconsSent > 0 || beacons.viaHits > 0) {
+        logger.printf("Beacons: %lu sent (%lu off prediction, %lu interval), %lu positions on hit frames, "
+                      "%lu fixes on track\n",
+                      (unsigned long)beaconsSent, (unsigned long)beacons.sent[BEACON_DEVIATION],
+                      (unsigned long)beacons.sent[BEACON_INTERVAL], (unsigned long)beacons.viaHits,
+                      (unsigned long)(beacons.fixes - beacons.sent[BEACON_DEVIATION]));
+    }
+    logger.println("------------------\n");
+}
+
+TaskHandle_t telemetryTaskHandle = nullptr;
+
+// Statistics report every STATS_INTERVAL
+void telemetryTask(void* param) {
+    for (;;) {
+        waitForEvent(TASK_TELEMETRY, pdMS_TO_TICKS(STATS_INTERVAL));
+        printStatistics();
+    }
+}
+
+void initBackgroundTasks() {
+    #if defined(HELTEC_V3)
+    startTask(TASK_DISPLAY, displayTask, &displayTaskHandle);
+    #endif
+    startTask(TASK_TELEMETRY, telemetryTask, &telemetryTaskHandle);
+    startTask(TASK_ALERT_LOG, alertLogTask, &alertLogTaskHandle);
+}
+
+// ============================================================================
+// MAIN SETUP AND LOOP
+// ============================================================================
+
+void setup() {
+    // setup() and loop() run on the Arduino loop task
+    mainLoopTaskHandle = xTaskGetCurrentTaskHandle();
+    taskLoads[TASK_LOOP].handle = mainLoopTaskHandle;
+    taskLoads[TASK_LOOP].started(micros());
+
+    Serial.begin(SERIAL_FRAMES ? GATEWAY_SERIAL_BAUD : 115200);
+    delay(1000);
+
+    displayMutex = xSemaphoreCreateMutex();
+    loraTxQueueMutex = xSemaphoreCreateMutex();
+    loraRateMutex = xSemaphoreCreateMutex();
+
+    // Initialize OLED display
+    initDisplay();
+
+    logger.println("\n\n");
+    logger.println("================================");
+    logger.println("btrpa-scan-lora");
+    logger.println("BLE Detection Mesh Node");
+    logger.println("================================");
+    logger.printf("Node ID: %s\n", NODE_ID);
+    logger.printf("Firmware Build: %s %s\n", __DATE__, __TIME__);
+    logger.println("================================\n");
 
     // Load configuration from config.h
-    Serial.println("Loading configuration...");
+    logger.println("Loading configuration...");
 
-    // Load target MACs
+    // Target MACs are compiled into TARGET_MAC_TABLE
     for (int i = 0; i < NUM_TARGET_MACS; i++) {
-        targetMACs.push_back(TARGET_MACS[i]);
-        Serial.printf("  Target MAC: %s\n", TARGET_MACS[i]);
+        logger.printf("  Target MAC: %s\n", TARGET_MACS[i]);
+    }
+
+    // IRKs are masked as btrpa-scan.py does: first and last 4 digits
+    for (size_t i = 0; i < TARGET_IRK_TABLE.size(); i++) {
+        const uint8_t* k = TARGET_IRK_TABLE.keys[i];
+        logger.printf("  Target IRK: %02x%02x...%02x%02x (%s)\n", k[0], k[1], k[14], k[15],
+                      TARGET_IRK_LIST[i].label);
     }
 
-    // Load medical device prefixes
+    // Medical device prefixes are compiled into MEDICAL_PREFIX_INDEX
     if (ENABLE_MEDICAL_DEVICE_SCANNING) {
         for (int i = 0; i < NUM_MEDICAL_PREFIXES; i++) {
-            MedicalDevicePrefix prefix;
-            prefix.prefix = MEDICAL_DEVICE_PREFIXES[i].prefix;
-            prefix.deviceType = MEDICAL_DEVICE_PREFIXES[i].deviceType;
-            prefix.manufacturer = MEDICAL_DEVICE_PREFIXES[i].manufacturer;
-            medicalPrefixes.push_back(prefix);
-            Serial.printf("  Medical prefix: %s (%s - %s)\n",
-                         prefix.prefix.c_str(),
-                         prefix.deviceType.c_str(),
-                         prefix.manufacturer.c_str());
+            logger.printf("  Medical prefix: %s (%s - %s)\n",
+                         MEDICAL_DEVICE_PREFIXES[i].prefix,
+                         MEDICAL_DEVICE_PREFIXES[i].deviceType,
+                         MEDICAL_DEVICE_PREFIXES[i].manufacturer);
+        }
+        for (size_t i = 0; i < ADVERTISEMENT_RULE_SET.size(); i++) {
+            logger.printf("  Payload rule: %s (%s - %s)\n", ADVERTISEMENT_RULE_LIST[i].rule,
+                          ADVERTISEMENT_RULE_LIST[i].deviceType, ADVERTISEMENT_RULE_LIST[i].manufacturer);
         }
     }
-    Serial.println();
+    logger.println();
 
     // Note: Heltec V3 doesn't have a built-in buzzer
     // External buzzer can be added later if needed
@@ -677,65 +3609,59 @@ void setup() {
     // Initialize BLE scanning
     initBLE();
 
-    // Initialize LoRa mesh
+    // Runtime targets from NVS, before the tasks that use them start
+    initTargets();
+
+    // Initialize LoRa mesh and its radio/receive tasks
     initLoRa();
+    initLoRaTasks();
+
+    // Recover the journal and start the detection task before the first
+    // advert can be queued
+    initRpaResolver();
+    initJournal();
+    initDetectionTask();
 
     // Start BLE scanning
     startBLEScan();
 
-    Serial.println("\n🔍 Node operational - scanning for targets...\n");
+    logger.println("\n🔍 Node operational - scanning for targets...\n");
 
     // Show scanning screen on OLED
     displayStatus("READY", "Scanning for", "targets...", "");
 
+    // Scanning animation and statistics report; console input wakes the loop
+    initBackgroundTasks();
+    Serial.onReceive(onConsoleReceive);
+
     // Print configuration summary
-    Serial.printf("Target MACs: %d configured\n", targetMACs.size());
-    Serial.printf("Medical prefixes: %d configured\n", medicalPrefixes.size());
+    logger.printf("Target MACs: %d configured\n", (int)TARGET_MAC_TABLE.size());
+    logger.printf("Target IRKs: %d configured\n", (int)TARGET_IRK_TABLE.size());
+    logger.printf("Medical prefixes: %d configured\n",
+                  ENABLE_MEDICAL_DEVICE_SCANNING ? (int)MEDICAL_PREFIX_INDEX.size() : 0);
+    logger.printf("Payload rules: %d configured\n",
+                  ENABLE_MEDICAL_DEVICE_SCANNING ? (int)ADVERTISEMENT_RULE_SET.size() : 0);
 
     #if DEBUG_SHOW_ALL_DEVICES
-    Serial.println("");
-    Serial.println("⚠️  DEBUG MODE: Showing ALL detected BLE devices");
-    Serial.println("This will be very verbose! Looking for:");
-    for (const auto& mac : targetMACs) {
-        Serial.printf("   → Target: %s\n", mac.c_str());
+    logger.println("");
+    logger.println("⚠️  DEBUG MODE: Showing ALL detected BLE devices");
+    logger.println("This will be very verbose! Looking for:");
+    for (int i = 0; i < NUM_TARGET_MACS; i++) {
+        logger.printf("   → Target: %s\n", TARGET_MACS[i]);
     }
     #endif
 
-    Serial.println();
+    logger.println();
 }
 
+// The loop runs the scan scheduler and the console; GPS, display,
+// statistics, detection and the radio have tasks of their own
 void loop() {
-    // Check for incoming LoRa messages
-    checkLoRaMessages();
-
-    // Update GPS data
-    updateGPS();
-
-    // Check if we should send position beacon
-    if (shouldSendPositionBeacon()) {
-        sendPositionBeacon();
-    }
-
-    // Print statistics every 30 seconds
-    static unsigned long lastStatsTime = 0;
-    if (millis() - lastStatsTime > 30000) {
-        lastStatsTime = millis();
-        Serial.println("\n--- Statistics ---");
-        Serial.printf("Uptime: %lu seconds\n", millis() / 1000);
-        Serial.printf("Total scans: %u\n", totalScans);
-        Serial.printf("TRUE HITs: %u\n", trueHits);
-        Serial.printf("POSSIBLE HITs: %u\n", possibleHits);
-
-        if (gpsAvailable && gps.location.isValid()) {
-            Serial.printf("GPS: %.6f, %.6f\n", gps.location.lat(), gps.location.lng());
-        } else {
-            Serial.println("GPS: No fix");
-        }
-        Serial.println("------------------\n");
-    }
-
-    // Update OLED display with scanning animation
-    displayScanning();
+    // Scan profile, scan windows and status reports
+    pollConsole();
+    updatePower();
 
-    delay(100); // Small delay to prevent watchdog issues
+    // Light sleep between conservation scan windows, else until the next
+    // event or notification
+    waitForNextLoop();
 }
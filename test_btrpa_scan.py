@@ -152,6 +152,17 @@ class TestBtAh:
         rpa_dash = rpa_colon.replace(":", "-")
         assert btrpa._resolve_rpa(irk, rpa_dash) is True
 
+    def test_ah_core_spec_sample(self):
+        # Bluetooth Core Spec Vol 3, Part H, Appendix D.7 (also checked by
+        # the firmware's boot-time self-test in irk_resolver.h)
+        irk = bytes.fromhex("ec0234a357c8ad05341010a60a397d9b")
+        assert btrpa._bt_ah(irk, bytes.fromhex("708194")) == bytes.fromhex("0dfbaa")
+
+    def test_resolve_rpa_known_address(self):
+        irk = bytes.fromhex("0123456789abcdef0123456789abcdef")
+        assert btrpa._resolve_rpa(irk, "55:AA:33:B7:28:02") is True
+        assert btrpa._resolve_rpa(irk, "55:AA:33:B7:28:03") is False
+
     def test_ah_deterministic(self):
         irk = bytes.fromhex("abcdef0123456789abcdef0123456789")
         prand = bytes([0x60, 0x00, 0x01])